@@ -0,0 +1,111 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef B2_ALLOCATOR_H
+#define B2_ALLOCATOR_H
+
+#include "b2_api.h"
+#include "b2_settings.h"
+
+class b2MemoryListener;
+struct b2AllocatorCounters;
+
+/// Implement this interface to give a world its own heap memory, such as an arena or a
+/// tracked heap. See b2WorldDef::allocator. With a task system the functions are called
+/// from several threads at once, so they must be thread-safe.
+class B2_API b2Allocator
+{
+public:
+	virtual ~b2Allocator() {}
+
+	/// Allocate memory with the alignment of malloc.
+	virtual void* Allocate(int32 size) = 0;
+
+	/// Free memory returned by Allocate. The size matches the one given to Allocate.
+	virtual void Free(void* mem, int32 size) = 0;
+};
+
+/// Allocate memory from an allocator. This uses b2Alloc if the allocator is null.
+inline void* b2Alloc(b2Allocator* allocator, int32 size)
+{
+	if (allocator == nullptr)
+	{
+		return b2Alloc(size);
+	}
+
+	return allocator->Allocate(size);
+}
+
+/// Free memory from b2Alloc(allocator, size). Null memory is ignored.
+inline void b2Free(b2Allocator* allocator, void* mem, int32 size)
+{
+	if (mem == nullptr)
+	{
+		return;
+	}
+
+	if (allocator == nullptr)
+	{
+		b2Free(mem);
+		return;
+	}
+
+	allocator->Free(mem, size);
+}
+
+/// Counts the bytes that pass through to another allocator, or to b2Alloc if that is
+/// null, and reports when the count goes over a budget. This is thread-safe.
+class B2_API b2TrackingAllocator : public b2Allocator
+{
+public:
+	explicit b2TrackingAllocator(b2Allocator* allocator = nullptr);
+	~b2TrackingAllocator() override;
+
+	/// @see b2Allocator::Allocate
+	void* Allocate(int32 size) override;
+
+	/// @see b2Allocator::Free
+	void Free(void* mem, int32 size) override;
+
+	/// Set the budget in bytes. Zero means no budget.
+	void SetBudget(int32 budget);
+	int32 GetBudget() const;
+
+	/// Set the listener that is told when an allocation goes over the budget.
+	void SetListener(b2MemoryListener* listener);
+	b2MemoryListener* GetListener() const;
+
+	/// The bytes currently allocated.
+	int32 GetByteCount() const;
+
+	/// The high-water mark of the allocated bytes.
+	int32 GetPeakByteCount() const;
+
+private:
+
+	b2Allocator* m_allocator;
+	b2AllocatorCounters* m_counters;
+	b2MemoryListener* m_listener;
+	int32 m_budget;
+};
+
+#endif
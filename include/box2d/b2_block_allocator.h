@@ -23,6 +23,7 @@
 #ifndef B2_BLOCK_ALLOCATOR_H
 #define B2_BLOCK_ALLOCATOR_H
 
+#include "b2_allocator.h"
 #include "b2_api.h"
 #include "b2_settings.h"
 
@@ -31,13 +32,31 @@ const int32 b2_blockSizeCount = 14;
 struct b2Block;
 struct b2Chunk;
 
+/// Block allocator statistics. Allocations larger than the biggest block size go to
+/// b2Alloc and are not counted.
+struct B2_API b2BlockAllocatorStats
+{
+	/// The number of blocks in use for each size class. See b2BlockAllocator::GetBlockSize.
+	int32 liveBlocks[b2_blockSizeCount];
+
+	/// The number of 16KB chunks allocated.
+	int32 chunkCount;
+
+	/// The bytes in use, rounded up to the block sizes.
+	int32 liveBytes;
+
+	/// The high-water mark of liveBytes.
+	int32 peakBytes;
+};
+
 /// This is a small object allocator used for allocating small
 /// objects that persist for more than one time step.
 /// See: http://www.codeproject.com/useritems/Small_Block_Allocator.asp
 class B2_API b2BlockAllocator
 {
 public:
-	b2BlockAllocator();
+	/// Chunks come from the given allocator, or b2Alloc if it is null.
+	explicit b2BlockAllocator(b2Allocator* allocator = nullptr);
 	~b2BlockAllocator();
 
 	/// Allocate memory. This will use b2Alloc if the size is larger than b2_maxBlockSize.
@@ -48,13 +67,25 @@ public:
 
 	void Clear();
 
+	/// Get the allocation statistics.
+	b2BlockAllocatorStats GetStats() const;
+
+	/// Get the block size of a size class in the range [0, b2_blockSizeCount).
+	static int32 GetBlockSize(int32 sizeClass);
+
 private:
 
+	b2Allocator* m_allocator;
+
 	b2Chunk* m_chunks;
 	int32 m_chunkCount;
 	int32 m_chunkSpace;
 
 	b2Block* m_freeLists[b2_blockSizeCount];
+
+	int32 m_liveBlocks[b2_blockSizeCount];
+	int32 m_liveBytes;
+	int32 m_peakBytes;
 };
 
 #endif
@@ -26,6 +26,7 @@
 #include "b2_api.h"
 #include "b2_math.h"
 #include "b2_shape.h"
+#include "b2_time_step.h"
 
 class b2Fixture;
 class b2Joint;
@@ -35,6 +36,7 @@ class b2World;
 struct b2FixtureDef;
 struct b2JointEdge;
 struct b2ContactEdge;
+struct b2PersistentIsland;
 
 /// The body type.
 /// static: zero mass, zero velocity, may be manually moved
@@ -64,6 +66,7 @@ struct B2_API b2BodyDef
 		awake = true;
 		fixedRotation = false;
 		bullet = false;
+		speculative = false;
 		type = b2_staticBody;
 		enabled = true;
 		gravityScale = 1.0f;
@@ -114,6 +117,10 @@ struct B2_API b2BodyDef
 	/// @warning You should use this flag sparingly since it increases processing time.
 	bool bullet;
 
+	/// Use speculative contacts instead of time of impact sub-stepping to prevent this
+	/// body from tunneling. See b2World::SetSpeculativeContacts.
+	bool speculative;
+
 	/// Does this body start out enabled?
 	bool enabled;
 
@@ -175,7 +182,7 @@ public:
 	float GetAngle() const;
 
 	/// Get the world position of the center of mass.
-	const b2Vec2& GetWorldCenter() const;
+	b2Vec2 GetWorldCenter() const;
 
 	/// Get the local position of the center of mass.
 	const b2Vec2& GetLocalCenter() const;
@@ -186,7 +193,7 @@ public:
 
 	/// Get the linear velocity of the center of mass.
 	/// @return the linear velocity of the center of mass.
-	const b2Vec2& GetLinearVelocity() const;
+	b2Vec2 GetLinearVelocity() const;
 
 	/// Set the angular velocity.
 	/// @param omega the new angular velocity in radians/second.
@@ -317,6 +324,14 @@ public:
 	/// Is this body treated like a bullet for continuous collision detection?
 	bool IsBullet() const;
 
+	/// Should this body use speculative contacts for continuous collision detection?
+	/// Contacts of the body then keep points ahead of its motion and the time of impact
+	/// solver ignores it.
+	void SetSpeculative(bool flag);
+
+	/// Does this body use speculative contacts for continuous collision detection?
+	bool IsSpeculative() const;
+
 	/// You can disable sleeping on this body. If you disable sleeping, the
 	/// body will be woken.
 	void SetSleepingAllowed(bool flag);
@@ -383,6 +398,10 @@ public:
 	b2World* GetWorld();
 	const b2World* GetWorld() const;
 
+	/// Get the creation order id of this body. Ids are unique within the world and are
+	/// shared with fixtures and joints. See b2World::SetDeterministic.
+	uint32 GetId() const;
+
 	/// Dump this body to a file
 	void Dump();
 
@@ -393,6 +412,7 @@ private:
 	friend class b2ContactManager;
 	friend class b2ContactSolver;
 	friend class b2Contact;
+	friend struct b2SolverData;
 
 	friend class b2DistanceJoint;
 	friend class b2FrictionJoint;
@@ -414,7 +434,8 @@ private:
 		e_bulletFlag		= 0x0008,
 		e_fixedRotationFlag	= 0x0010,
 		e_enabledFlag		= 0x0020,
-		e_toiFlag			= 0x0040
+		e_toiFlag			= 0x0040,
+		e_speculativeFlag	= 0x0080
 	};
 
 	b2Body(const b2BodyDef* bd, b2World* world);
@@ -429,17 +450,42 @@ private:
 
 	void Advance(float t);
 
+	// The center of mass position and the velocity in the world state arrays.
+	b2Position& GetPositionState();
+	const b2Position& GetPositionState() const;
+	b2Velocity& GetVelocityState();
+	const b2Velocity& GetVelocityState() const;
+
+	// The swept motion for continuous collision.
+	b2Sweep GetSweep() const;
+	void SetSweep(const b2Sweep& sweep);
+
 	b2BodyType m_type;
 
 	uint16 m_flags;
 
 	int32 m_islandIndex;
 
+	// The persistent island of this body. Null for static and disabled bodies.
+	b2PersistentIsland* m_island;
+	b2Body* m_islandPrev;
+	b2Body* m_islandNext;
+
+	// Slot of this body in the world state arrays. The current center of mass position,
+	// angle and velocity are stored there.
+	b2BodyStates* m_states;
+	int32 m_stateIndex;
+
+	// Creation order id. Determinism mode orders bodies by this.
+	uint32 m_id;
+
 	b2Transform m_xf;		// the body origin transform
-	b2Sweep m_sweep;		// the swept motion for CCD
 
-	b2Vec2 m_linearVelocity;
-	float m_angularVelocity;
+	// The rest of the swept motion for CCD. See GetSweep.
+	b2Vec2 m_localCenter;	// local center of mass position
+	b2Vec2 m_c0;			// center world position at time alpha0
+	float m_a0;				// world angle at time alpha0
+	float m_alpha0;			// fraction of the current time step in the range [0,1]
 
 	b2Vec2 m_force;
 	float m_torque;
@@ -485,17 +531,17 @@ inline const b2Vec2& b2Body::GetPosition() const
 
 inline float b2Body::GetAngle() const
 {
-	return m_sweep.a;
+	return GetPositionState().a;
 }
 
-inline const b2Vec2& b2Body::GetWorldCenter() const
+inline b2Vec2 b2Body::GetWorldCenter() const
 {
-	return m_sweep.c;
+	return GetPositionState().c;
 }
 
 inline const b2Vec2& b2Body::GetLocalCenter() const
 {
-	return m_sweep.localCenter;
+	return m_localCenter;
 }
 
 inline void b2Body::SetLinearVelocity(const b2Vec2& v)
@@ -510,12 +556,12 @@ inline void b2Body::SetLinearVelocity(const b2Vec2& v)
 		SetAwake(true);
 	}
 
-	m_linearVelocity = v;
+	GetVelocityState().v = v;
 }
 
-inline const b2Vec2& b2Body::GetLinearVelocity() const
+inline b2Vec2 b2Body::GetLinearVelocity() const
 {
-	return m_linearVelocity;
+	return GetVelocityState().v;
 }
 
 inline void b2Body::SetAngularVelocity(float w)
@@ -530,12 +576,12 @@ inline void b2Body::SetAngularVelocity(float w)
 		SetAwake(true);
 	}
 
-	m_angularVelocity = w;
+	GetVelocityState().w = w;
 }
 
 inline float b2Body::GetAngularVelocity() const
 {
-	return m_angularVelocity;
+	return GetVelocityState().w;
 }
 
 inline float b2Body::GetMass() const
@@ -545,15 +591,15 @@ inline float b2Body::GetMass() const
 
 inline float b2Body::GetInertia() const
 {
-	return m_I + m_mass * b2Dot(m_sweep.localCenter, m_sweep.localCenter);
+	return m_I + m_mass * b2Dot(m_localCenter, m_localCenter);
 }
 
 inline b2MassData b2Body::GetMassData() const
 {
 	b2MassData data;
 	data.mass = m_mass;
-	data.I = m_I + m_mass * b2Dot(m_sweep.localCenter, m_sweep.localCenter);
-	data.center = m_sweep.localCenter;
+	data.I = m_I + m_mass * b2Dot(m_localCenter, m_localCenter);
+	data.center = m_localCenter;
 	return data;
 }
 
@@ -579,7 +625,8 @@ inline b2Vec2 b2Body::GetLocalVector(const b2Vec2& worldVector) const
 
 inline b2Vec2 b2Body::GetLinearVelocityFromWorldPoint(const b2Vec2& worldPoint) const
 {
-	return m_linearVelocity + b2Cross(m_angularVelocity, worldPoint - m_sweep.c);
+	const b2Velocity& state = GetVelocityState();
+	return state.v + b2Cross(state.w, worldPoint - GetPositionState().c);
 }
 
 inline b2Vec2 b2Body::GetLinearVelocityFromLocalPoint(const b2Vec2& localPoint) const
@@ -634,29 +681,23 @@ inline bool b2Body::IsBullet() const
 	return (m_flags & e_bulletFlag) == e_bulletFlag;
 }
 
-inline void b2Body::SetAwake(bool flag)
+inline void b2Body::SetSpeculative(bool flag)
 {
-	if (m_type == b2_staticBody)
-	{
-		return;
-	}
-
 	if (flag)
 	{
-		m_flags |= e_awakeFlag;
-		m_sleepTime = 0.0f;
+		m_flags |= e_speculativeFlag;
 	}
 	else
 	{
-		m_flags &= ~e_awakeFlag;
-		m_sleepTime = 0.0f;
-		m_linearVelocity.SetZero();
-		m_angularVelocity = 0.0f;
-		m_force.SetZero();
-		m_torque = 0.0f;
+		m_flags &= ~e_speculativeFlag;
 	}
 }
 
+inline bool b2Body::IsSpeculative() const
+{
+	return (m_flags & e_speculativeFlag) == e_speculativeFlag;
+}
+
 inline bool b2Body::IsAwake() const
 {
 	return (m_flags & e_awakeFlag) == e_awakeFlag;
@@ -756,7 +797,7 @@ inline void b2Body::ApplyForce(const b2Vec2& force, const b2Vec2& point, bool wa
 	if (m_flags & e_awakeFlag)
 	{
 		m_force += force;
-		m_torque += b2Cross(point - m_sweep.c, force);
+		m_torque += b2Cross(point - GetPositionState().c, force);
 	}
 }
 
@@ -813,8 +854,9 @@ inline void b2Body::ApplyLinearImpulse(const b2Vec2& impulse, const b2Vec2& poin
 	// Don't accumulate velocity if the body is sleeping
 	if (m_flags & e_awakeFlag)
 	{
-		m_linearVelocity += m_invMass * impulse;
-		m_angularVelocity += m_invI * b2Cross(point - m_sweep.c, impulse);
+		b2Velocity& state = GetVelocityState();
+		state.v += m_invMass * impulse;
+		state.w += m_invI * b2Cross(point - GetPositionState().c, impulse);
 	}
 }
 
@@ -833,7 +875,7 @@ inline void b2Body::ApplyLinearImpulseToCenter(const b2Vec2& impulse, bool wake)
 	// Don't accumulate velocity if the body is sleeping
 	if (m_flags & e_awakeFlag)
 	{
-		m_linearVelocity += m_invMass * impulse;
+		GetVelocityState().v += m_invMass * impulse;
 	}
 }
 
@@ -852,24 +894,70 @@ inline void b2Body::ApplyAngularImpulse(float impulse, bool wake)
 	// Don't accumulate velocity if the body is sleeping
 	if (m_flags & e_awakeFlag)
 	{
-		m_angularVelocity += m_invI * impulse;
+		GetVelocityState().w += m_invI * impulse;
 	}
 }
 
+inline b2Position& b2Body::GetPositionState()
+{
+	return m_states->positions[m_stateIndex];
+}
+
+inline const b2Position& b2Body::GetPositionState() const
+{
+	return m_states->positions[m_stateIndex];
+}
+
+inline b2Velocity& b2Body::GetVelocityState()
+{
+	return m_states->velocities[m_stateIndex];
+}
+
+inline const b2Velocity& b2Body::GetVelocityState() const
+{
+	return m_states->velocities[m_stateIndex];
+}
+
+inline b2Sweep b2Body::GetSweep() const
+{
+	const b2Position& state = GetPositionState();
+	b2Sweep sweep;
+	sweep.localCenter = m_localCenter;
+	sweep.c0 = m_c0;
+	sweep.c = state.c;
+	sweep.a0 = m_a0;
+	sweep.a = state.a;
+	sweep.alpha0 = m_alpha0;
+	return sweep;
+}
+
+inline void b2Body::SetSweep(const b2Sweep& sweep)
+{
+	b2Position& state = GetPositionState();
+	m_localCenter = sweep.localCenter;
+	m_c0 = sweep.c0;
+	state.c = sweep.c;
+	m_a0 = sweep.a0;
+	state.a = sweep.a;
+	m_alpha0 = sweep.alpha0;
+}
+
 inline void b2Body::SynchronizeTransform()
 {
-	m_xf.q.Set(m_sweep.a);
-	m_xf.p = m_sweep.c - b2Mul(m_xf.q, m_sweep.localCenter);
+	const b2Position& state = GetPositionState();
+	m_xf.q.Set(state.a);
+	m_xf.p = state.c - b2Mul(m_xf.q, m_localCenter);
 }
 
 inline void b2Body::Advance(float alpha)
 {
 	// Advance to the new safe time. This doesn't sync the broad-phase.
-	m_sweep.Advance(alpha);
-	m_sweep.c = m_sweep.c0;
-	m_sweep.a = m_sweep.a0;
-	m_xf.q.Set(m_sweep.a);
-	m_xf.p = m_sweep.c - b2Mul(m_xf.q, m_sweep.localCenter);
+	b2Sweep sweep = GetSweep();
+	sweep.Advance(alpha);
+	sweep.c = sweep.c0;
+	sweep.a = sweep.a0;
+	SetSweep(sweep);
+	SynchronizeTransform();
 }
 
 inline b2World* b2Body::GetWorld()
@@ -882,4 +970,9 @@ inline const b2World* b2Body::GetWorld() const
 	return m_world;
 }
 
+inline uint32 b2Body::GetId() const
+{
+	return m_id;
+}
+
 #endif
@@ -37,6 +37,8 @@ struct B2_API b2Pair
 /// The broad-phase is used for computing pairs and performing volume queries and ray casts.
 /// This broad-phase does not persist pairs. Instead, this reports potentially new pairs.
 /// It is up to the client to consume the new pairs and to track subsequent overlap.
+/// Static proxies are kept in a separate tree. This tree is rebuilt with the SAH builder
+/// when it changes and pairs between two static proxies are never considered.
 class B2_API b2BroadPhase
 {
 public:
@@ -46,16 +48,33 @@ public:
 		e_nullProxy = -1
 	};
 
-	b2BroadPhase();
+	enum
+	{
+		e_dynamicTree = 0,
+		e_staticTree = 1,
+		e_treeCount = 2
+	};
+
+	/// The trees and buffers come from the given allocator, or b2Alloc if it is null.
+	explicit b2BroadPhase(b2Allocator* allocator = nullptr);
 	~b2BroadPhase();
 
 	/// Create a proxy with an initial AABB. Pairs are not reported until
 	/// UpdatePairs is called.
-	int32 CreateProxy(const b2AABB& aabb, void* userData);
+	/// @param isStatic puts the proxy in the static tree.
+	int32 CreateProxy(const b2AABB& aabb, void* userData, bool isStatic = false);
 
 	/// Destroy a proxy. It is up to the client to remove any pairs.
 	void DestroyProxy(int32 proxyId);
 
+	/// Create many proxies at once. This is faster than calling CreateProxy for each.
+	/// @param isStatic puts all the proxies in the static tree.
+	/// @param proxyIds receives the ids of the new proxies.
+	void CreateProxies(const b2AABB* aabbs, void* const* userData, int32 count, bool isStatic, int32* proxyIds);
+
+	/// Destroy many proxies at once. This is faster than calling DestroyProxy for each.
+	void DestroyProxies(const int32* proxyIds, int32 count);
+
 	/// Call MoveProxy as many times as you like, then when you are done
 	/// call UpdatePairs to finalized the proxy pairs (for your time step).
 	void MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement);
@@ -69,6 +88,12 @@ public:
 	/// Get user data from a proxy. Returns nullptr if the id is invalid.
 	void* GetUserData(int32 proxyId) const;
 
+	/// Is this proxy in the static tree?
+	static bool IsStaticProxy(int32 proxyId);
+
+	/// Is this id a live proxy of either tree?
+	bool IsProxy(int32 proxyId) const;
+
 	/// Test overlap of fat AABBs.
 	bool TestOverlap(int32 proxyIdA, int32 proxyIdB) const;
 
@@ -76,9 +101,51 @@ public:
 	int32 GetProxyCount() const;
 
 	/// Update the pairs. This results in pair callbacks. This can only add pairs.
+	/// If FindPairs was used since the last update, the pairs found there are reported.
 	template <typename T>
 	void UpdatePairs(T* callback);
 
+	/// Get the number of buffered proxy moves. These are queried for new pairs.
+	int32 GetMoveCount() const;
+
+	/// Get the heap bytes held by the tree node pools.
+	int32 GetTreeByteCount() const;
+
+	/// Get the heap bytes held by the move buffer and the pair buffers.
+	int32 GetBufferByteCount() const;
+
+	/// Write the trees and the move buffer to a snapshot. The user data is not written.
+	void WriteSnapshot(b2SnapshotWriter* writer) const;
+
+	/// Replace the trees and the move buffer with ones from WriteSnapshot. The proxies
+	/// have null user data until it is set with SetUserData. If the reader turns invalid
+	/// the broad-phase is not usable until Reset.
+	void ReadSnapshot(b2SnapshotReader* reader);
+
+	/// Remove all proxies and buffered moves.
+	void Reset();
+
+	/// Set the user data of a proxy.
+	void SetUserData(int32 proxyId, void* userData);
+
+	/// Write the static tree in the layout used by ReferenceStaticTree.
+	void WriteStaticTree(b2SnapshotWriter* writer) const;
+
+	/// Use a static tree from WriteStaticTree in place. The static tree must be empty.
+	/// See b2DynamicTree::ReferenceLevel. The new proxies are not buffered, so pairs are
+	/// only found for dynamic proxies that are moved or touched.
+	void ReferenceStaticTree(b2SnapshotReader* reader);
+
+	/// Prepare to find pairs on multiple threads. Call this before FindPairs.
+	/// @param workerCount the number of threads that may call FindPairs.
+	void BeginFindPairs(int32 workerCount);
+
+	/// Find the pairs of the buffered moves [startIndex, endIndex). Disjoint ranges
+	/// may run concurrently on different workers. Each worker writes to its own pair
+	/// buffer and UpdatePairs then reports the pairs in move buffer order, so the
+	/// result does not depend on how the moves were split.
+	void FindPairs(int32 startIndex, int32 endIndex, int32 workerIndex);
+
 	/// Query an AABB for overlapping proxies. The callback class
 	/// is called for each proxy that overlaps the supplied AABB.
 	template <typename T>
@@ -94,15 +161,36 @@ public:
 	template <typename T>
 	void RayCast(T* callback, const b2RayCastInput& input) const;
 
-	/// Get the height of the embedded tree.
+	/// Cast a swept AABB against the proxies in both trees. See b2DynamicTree::ShapeCast.
+	template <typename T>
+	void ShapeCast(T* callback, const b2AABBCastInput& input) const;
+
+	/// Ray-cast a packet of rays against both trees. See b2DynamicTree::RayCastPacket.
+	template <typename T>
+	void RayCastPacket(T* callback, b2RayCastInput* inputs, int32 count) const;
+
+	/// Get the height of the taller embedded tree.
 	int32 GetTreeHeight() const;
 
-	/// Get the balance of the embedded tree.
+	/// Get the balance of the less balanced embedded tree.
 	int32 GetTreeBalance() const;
 
-	/// Get the quality metric of the embedded tree.
+	/// Get the quality metric of the worse embedded tree.
 	float GetTreeQuality() const;
 
+	/// Get one of the embedded trees. Proxy ids in these trees are not broad-phase proxy ids.
+	const b2DynamicTree& GetTree(int32 treeType) const;
+
+	/// Rebuild the embedded trees with the SAH builder. A partial rebuild only
+	/// rebuilds the parts of the trees that received proxies since the last rebuild.
+	void RebuildTree(bool fullBuild);
+
+	/// Build the wide trees used by Query and RayCast. See b2DynamicTree::BuildWideTree.
+	void BuildWideTrees();
+
+	/// Free the wide trees.
+	void ClearWideTrees();
+
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
 	/// @param newOrigin the new origin with respect to the old origin
@@ -112,41 +200,168 @@ private:
 
 	friend class b2DynamicTree;
 
+	template <typename T>
+	struct QueryWrapper
+	{
+		bool QueryCallback(int32 proxyId)
+		{
+			proceed = callback->QueryCallback(MakeProxyId(proxyId, treeType));
+			return proceed;
+		}
+
+		T* callback;
+		int32 treeType;
+		bool proceed;
+	};
+
+	template <typename T>
+	struct RayCastWrapper
+	{
+		float RayCastCallback(const b2RayCastInput& input, int32 proxyId)
+		{
+			float value = callback->RayCastCallback(input, MakeProxyId(proxyId, treeType));
+			if (value == 0.0f)
+			{
+				terminated = true;
+			}
+			else if (value > 0.0f)
+			{
+				maxFraction = value;
+			}
+			return value;
+		}
+
+		T* callback;
+		int32 treeType;
+		float maxFraction;
+		bool terminated;
+	};
+
+	template <typename T>
+	struct ShapeCastWrapper
+	{
+		float ShapeCastCallback(const b2AABBCastInput& input, int32 proxyId)
+		{
+			float value = callback->ShapeCastCallback(input, MakeProxyId(proxyId, treeType));
+			if (value == 0.0f)
+			{
+				terminated = true;
+			}
+			else if (value > 0.0f)
+			{
+				maxFraction = value;
+			}
+			return value;
+		}
+
+		T* callback;
+		int32 treeType;
+		float maxFraction;
+		bool terminated;
+	};
+
+	template <typename T>
+	struct RayCastPacketWrapper
+	{
+		float RayCastCallback(const b2RayCastInput& input, int32 proxyId, int32 rayIndex)
+		{
+			return callback->RayCastCallback(input, MakeProxyId(proxyId, treeType), rayIndex);
+		}
+
+		T* callback;
+		int32 treeType;
+	};
+
+	// Pairs found by one worker.
+	struct PairBuffer
+	{
+		bool QueryCallback(int32 treeProxyId);
+
+		const b2BroadPhase* broadPhase;
+		b2Pair* pairs;
+		int32 count;
+		int32 capacity;
+		int32 queryProxyId;
+		int32 queryTreeType;
+	};
+
+	// The pairs found for one entry of the move buffer.
+	struct MoveResult
+	{
+		int32 workerIndex;
+		int32 pairIndex;
+		int32 pairCount;
+	};
+
+	// Broad-phase proxy ids hold the tree type in the lowest bit.
+	static int32 MakeProxyId(int32 treeProxyId, int32 treeType);
+	static int32 GetTreeType(int32 proxyId);
+	static int32 GetTreeProxyId(int32 proxyId);
+
 	void BufferMove(int32 proxyId);
 	void UnBufferMove(int32 proxyId);
 
-	bool QueryCallback(int32 proxyId);
+	b2Allocator* m_allocator;
 
-	b2DynamicTree m_tree;
+	b2DynamicTree m_trees[e_treeCount];
 
 	int32 m_proxyCount;
 
 	int32* m_moveBuffer;
+	MoveResult* m_moveResults;
 	int32 m_moveCapacity;
 	int32 m_moveCount;
 
-	b2Pair* m_pairBuffer;
-	int32 m_pairCapacity;
-	int32 m_pairCount;
-
-	int32 m_queryProxyId;
+	PairBuffer* m_pairBuffers;
+	int32 m_pairBufferCount;
+	bool m_pairsFound;
 };
 
+inline int32 b2BroadPhase::MakeProxyId(int32 treeProxyId, int32 treeType)
+{
+	return (treeProxyId << 1) | treeType;
+}
+
+inline int32 b2BroadPhase::GetTreeType(int32 proxyId)
+{
+	return proxyId & 1;
+}
+
+inline int32 b2BroadPhase::GetTreeProxyId(int32 proxyId)
+{
+	return proxyId >> 1;
+}
+
+inline bool b2BroadPhase::IsStaticProxy(int32 proxyId)
+{
+	return GetTreeType(proxyId) == e_staticTree;
+}
+
+inline bool b2BroadPhase::IsProxy(int32 proxyId) const
+{
+	return m_trees[GetTreeType(proxyId)].IsProxy(GetTreeProxyId(proxyId));
+}
+
 inline void* b2BroadPhase::GetUserData(int32 proxyId) const
 {
-	return m_tree.GetUserData(proxyId);
+	return m_trees[GetTreeType(proxyId)].GetUserData(GetTreeProxyId(proxyId));
+}
+
+inline void b2BroadPhase::SetUserData(int32 proxyId, void* userData)
+{
+	m_trees[GetTreeType(proxyId)].SetUserData(GetTreeProxyId(proxyId), userData);
 }
 
 inline bool b2BroadPhase::TestOverlap(int32 proxyIdA, int32 proxyIdB) const
 {
-	const b2AABB& aabbA = m_tree.GetFatAABB(proxyIdA);
-	const b2AABB& aabbB = m_tree.GetFatAABB(proxyIdB);
+	const b2AABB& aabbA = GetFatAABB(proxyIdA);
+	const b2AABB& aabbB = GetFatAABB(proxyIdB);
 	return b2TestOverlap(aabbA, aabbB);
 }
 
 inline const b2AABB& b2BroadPhase::GetFatAABB(int32 proxyId) const
 {
-	return m_tree.GetFatAABB(proxyId);
+	return m_trees[GetTreeType(proxyId)].GetFatAABB(GetTreeProxyId(proxyId));
 }
 
 inline int32 b2BroadPhase::GetProxyCount() const
@@ -154,52 +369,59 @@ inline int32 b2BroadPhase::GetProxyCount() const
 	return m_proxyCount;
 }
 
+inline int32 b2BroadPhase::GetMoveCount() const
+{
+	return m_moveCount;
+}
+
 inline int32 b2BroadPhase::GetTreeHeight() const
 {
-	return m_tree.GetHeight();
+	return b2Max(m_trees[e_dynamicTree].GetHeight(), m_trees[e_staticTree].GetHeight());
 }
 
 inline int32 b2BroadPhase::GetTreeBalance() const
 {
-	return m_tree.GetMaxBalance();
+	return b2Max(m_trees[e_dynamicTree].GetMaxBalance(), m_trees[e_staticTree].GetMaxBalance());
 }
 
 inline float b2BroadPhase::GetTreeQuality() const
 {
-	return m_tree.GetAreaRatio();
+	return b2Max(m_trees[e_dynamicTree].GetAreaRatio(), m_trees[e_staticTree].GetAreaRatio());
+}
+
+inline const b2DynamicTree& b2BroadPhase::GetTree(int32 treeType) const
+{
+	b2Assert(0 <= treeType && treeType < e_treeCount);
+	return m_trees[treeType];
+}
+
+inline void b2BroadPhase::RebuildTree(bool fullBuild)
+{
+	m_trees[e_dynamicTree].Rebuild(fullBuild);
+	m_trees[e_staticTree].Rebuild(fullBuild);
 }
 
 template <typename T>
 void b2BroadPhase::UpdatePairs(T* callback)
 {
-	// Reset pair buffer
-	m_pairCount = 0;
-
-	// Perform tree queries for all moving proxies.
-	for (int32 i = 0; i < m_moveCount; ++i)
+	if (m_pairsFound == false)
 	{
-		m_queryProxyId = m_moveBuffer[i];
-		if (m_queryProxyId == e_nullProxy)
-		{
-			continue;
-		}
-
-		// We have to query the tree with the fat AABB so that
-		// we don't fail to create a pair that may touch later.
-		const b2AABB& fatAABB = m_tree.GetFatAABB(m_queryProxyId);
-
-		// Query tree, create pairs and add them pair buffer.
-		m_tree.Query(this, fatAABB);
+		BeginFindPairs(1);
+		FindPairs(0, m_moveCount, 0);
 	}
 
-	// Send pairs to caller
-	for (int32 i = 0; i < m_pairCount; ++i)
+	// Send pairs to caller in move buffer order.
+	for (int32 i = 0; i < m_moveCount; ++i)
 	{
-		b2Pair* primaryPair = m_pairBuffer + i;
-		void* userDataA = m_tree.GetUserData(primaryPair->proxyIdA);
-		void* userDataB = m_tree.GetUserData(primaryPair->proxyIdB);
+		const MoveResult& result = m_moveResults[i];
+		const b2Pair* pairs = m_pairBuffers[result.workerIndex].pairs + result.pairIndex;
+		for (int32 j = 0; j < result.pairCount; ++j)
+		{
+			void* userDataA = GetUserData(pairs[j].proxyIdA);
+			void* userDataB = GetUserData(pairs[j].proxyIdB);
 
-		callback->AddPair(userDataA, userDataB);
+			callback->AddPair(userDataA, userDataB);
+		}
 	}
 
 	// Clear move flags
@@ -211,28 +433,105 @@ void b2BroadPhase::UpdatePairs(T* callback)
 			continue;
 		}
 
-		m_tree.ClearMoved(proxyId);
+		m_trees[GetTreeType(proxyId)].ClearMoved(GetTreeProxyId(proxyId));
 	}
 
 	// Reset move buffer
 	m_moveCount = 0;
+	m_pairsFound = false;
 }
 
 template <typename T>
 inline void b2BroadPhase::Query(T* callback, const b2AABB& aabb) const
 {
-	m_tree.Query(callback, aabb);
+	QueryWrapper<T> wrapper;
+	wrapper.callback = callback;
+	wrapper.proceed = true;
+
+	wrapper.treeType = e_staticTree;
+	m_trees[e_staticTree].Query(&wrapper, aabb);
+
+	if (wrapper.proceed)
+	{
+		wrapper.treeType = e_dynamicTree;
+		m_trees[e_dynamicTree].Query(&wrapper, aabb);
+	}
 }
 
 template <typename T>
 inline void b2BroadPhase::RayCast(T* callback, const b2RayCastInput& input) const
 {
-	m_tree.RayCast(callback, input);
+	RayCastWrapper<T> wrapper;
+	wrapper.callback = callback;
+	wrapper.maxFraction = input.maxFraction;
+	wrapper.terminated = false;
+
+	wrapper.treeType = e_staticTree;
+	m_trees[e_staticTree].RayCast(&wrapper, input);
+
+	if (wrapper.terminated == false)
+	{
+		// Clip the ray against the closest static hit.
+		b2RayCastInput subInput = input;
+		subInput.maxFraction = wrapper.maxFraction;
+
+		wrapper.treeType = e_dynamicTree;
+		m_trees[e_dynamicTree].RayCast(&wrapper, subInput);
+	}
+}
+
+template <typename T>
+inline void b2BroadPhase::ShapeCast(T* callback, const b2AABBCastInput& input) const
+{
+	ShapeCastWrapper<T> wrapper;
+	wrapper.callback = callback;
+	wrapper.maxFraction = input.maxFraction;
+	wrapper.terminated = false;
+
+	wrapper.treeType = e_staticTree;
+	m_trees[e_staticTree].ShapeCast(&wrapper, input);
+
+	if (wrapper.terminated == false)
+	{
+		// Clip the sweep against the closest static hit.
+		b2AABBCastInput subInput = input;
+		subInput.maxFraction = wrapper.maxFraction;
+
+		wrapper.treeType = e_dynamicTree;
+		m_trees[e_dynamicTree].ShapeCast(&wrapper, subInput);
+	}
+}
+
+template <typename T>
+inline void b2BroadPhase::RayCastPacket(T* callback, b2RayCastInput* inputs, int32 count) const
+{
+	// The rays are clipped against the static tree before the dynamic tree is visited.
+	RayCastPacketWrapper<T> wrapper;
+	wrapper.callback = callback;
+
+	wrapper.treeType = e_staticTree;
+	m_trees[e_staticTree].RayCastPacket(&wrapper, inputs, count);
+
+	wrapper.treeType = e_dynamicTree;
+	m_trees[e_dynamicTree].RayCastPacket(&wrapper, inputs, count);
+}
+
+inline void b2BroadPhase::BuildWideTrees()
+{
+	m_trees[e_dynamicTree].BuildWideTree();
+	m_trees[e_staticTree].BuildWideTree();
+}
+
+inline void b2BroadPhase::ClearWideTrees()
+{
+	m_trees[e_dynamicTree].ClearWideTree();
+	m_trees[e_staticTree].ClearWideTree();
 }
 
 inline void b2BroadPhase::ShiftOrigin(const b2Vec2& newOrigin)
 {
-	m_tree.ShiftOrigin(newOrigin);
+	m_trees[e_dynamicTree].ShiftOrigin(newOrigin);
+	m_trees[e_staticTree].ShiftOrigin(newOrigin);
 }
 
 #endif
@@ -57,7 +57,13 @@ public:
 	void CreateChain(const b2Vec2* vertices, int32 count,
 		const b2Vec2& prevVertex, const b2Vec2& nextVertex);
 
-	/// Implement b2Shape. Vertices are cloned using b2Alloc.
+	/// Create a chain that uses the vertices in place instead of copying them. Clones
+	/// use the same vertices. This avoids the copy for large static geometry.
+	/// @warning the vertices must outlive this shape and its clones.
+	void CreateChainReference(const b2Vec2* vertices, int32 count,
+		const b2Vec2& prevVertex, const b2Vec2& nextVertex);
+
+	/// Implement b2Shape. Vertices are cloned using b2Alloc, unless they are referenced.
 	b2Shape* Clone(b2BlockAllocator* allocator) const override;
 
 	/// @see b2Shape::GetChildCount
@@ -81,13 +87,16 @@ public:
 	/// @see b2Shape::ComputeMass
 	void ComputeMass(b2MassData* massData, float density) const override;
 
-	/// The vertices. Owned by this class.
+	/// The vertices. Owned by this class, unless created by CreateChainReference.
 	b2Vec2* m_vertices;
 
 	/// The vertex count.
 	int32 m_count;
 
 	b2Vec2 m_prevVertex, m_nextVertex;
+
+	/// False if the vertices are referenced rather than owned.
+	bool m_ownsVertices;
 };
 
 inline b2ChainShape::b2ChainShape()
@@ -96,6 +105,7 @@ inline b2ChainShape::b2ChainShape()
 	m_radius = b2_polygonRadius;
 	m_vertices = nullptr;
 	m_count = 0;
+	m_ownsVertices = true;
 }
 
 #endif
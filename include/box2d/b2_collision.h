@@ -221,30 +221,47 @@ struct B2_API b2AABB
 	b2Vec2 upperBound;	///< the upper vertex
 };
 
+/// Swept AABB input data for b2DynamicTree::ShapeCast. The box moves from aabb
+/// to aabb translated by maxFraction * translation.
+struct B2_API b2AABBCastInput
+{
+	b2AABB aabb;
+	b2Vec2 translation;
+	float maxFraction;
+};
+
 /// Compute the collision manifold between two circles.
+/// @param speculativeDistance also keep points that are separated by up to this distance.
+/// The contact solver uses them to stop fast bodies before they touch. The other collide
+/// functions use this parameter the same way.
 B2_API void b2CollideCircles(b2Manifold* manifold,
 					  const b2CircleShape* circleA, const b2Transform& xfA,
-					  const b2CircleShape* circleB, const b2Transform& xfB);
+					  const b2CircleShape* circleB, const b2Transform& xfB,
+					  float speculativeDistance = 0.0f);
 
 /// Compute the collision manifold between a polygon and a circle.
 B2_API void b2CollidePolygonAndCircle(b2Manifold* manifold,
 							   const b2PolygonShape* polygonA, const b2Transform& xfA,
-							   const b2CircleShape* circleB, const b2Transform& xfB);
+							   const b2CircleShape* circleB, const b2Transform& xfB,
+							   float speculativeDistance = 0.0f);
 
 /// Compute the collision manifold between two polygons.
 B2_API void b2CollidePolygons(b2Manifold* manifold,
 					   const b2PolygonShape* polygonA, const b2Transform& xfA,
-					   const b2PolygonShape* polygonB, const b2Transform& xfB);
+					   const b2PolygonShape* polygonB, const b2Transform& xfB,
+					   float speculativeDistance = 0.0f);
 
 /// Compute the collision manifold between an edge and a circle.
 B2_API void b2CollideEdgeAndCircle(b2Manifold* manifold,
 							   const b2EdgeShape* polygonA, const b2Transform& xfA,
-							   const b2CircleShape* circleB, const b2Transform& xfB);
+							   const b2CircleShape* circleB, const b2Transform& xfB,
+							   float speculativeDistance = 0.0f);
 
 /// Compute the collision manifold between an edge and a polygon.
 B2_API void b2CollideEdgeAndPolygon(b2Manifold* manifold,
 							   const b2EdgeShape* edgeA, const b2Transform& xfA,
-							   const b2PolygonShape* circleB, const b2Transform& xfB);
+							   const b2PolygonShape* circleB, const b2Transform& xfB,
+							   float speculativeDistance = 0.0f);
 
 /// Clipping for contact manifolds.
 B2_API int32 b2ClipSegmentToLine(b2ClipVertex vOut[2], const b2ClipVertex vIn[2],
@@ -76,12 +76,20 @@
 /// Maximum number of sub-steps per contact in continuous physics simulation.
 #define b2_maxSubSteps			8
 
+/// Speculative contacts keep manifold points that are separated by up to this distance
+/// plus the distance the bodies may move in one step. In meters.
+#define b2_speculativeDistance	(4.0f * b2_linearSlop)
+
 
 // Dynamics
 
 /// Maximum number of contacts to be handled to solve a TOI impact.
 #define b2_maxTOIContacts			32
 
+/// The number of graph colors used by the wide contact solver. Constraints
+/// that don't fit in a color are solved one at a time. At most 32.
+#define b2_graphColorCount			16
+
 /// The maximum linear position correction used when solving constraints. This helps to
 /// prevent overshoot. Meters.
 #define b2_maxLinearCorrection		(0.2f * b2_lengthUnitsPerMeter)
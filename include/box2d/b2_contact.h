@@ -108,7 +108,8 @@ public:
 	/// Has this contact been disabled?
 	bool IsEnabled() const;
 
-	/// Get the next contact in the world's contact list.
+	/// Get the next contact in the world's contact list. The list is a view of the
+	/// world's contact array, so the order changes when contacts are destroyed.
 	b2Contact* GetNext();
 	const b2Contact* GetNext() const;
 
@@ -175,7 +176,7 @@ protected:
 	// Flags stored in m_flags
 	enum
 	{
-		// Used when crawling contact graph when forming islands.
+		// Used when crawling contact graph when forming TOI islands.
 		e_islandFlag		= 0x0001,
 
 		// Set when the shapes are touching.
@@ -191,7 +192,10 @@ protected:
 		e_bulletHitFlag		= 0x0010,
 
 		// This contact has a valid TOI in m_toi
-		e_toiFlag			= 0x0020
+		e_toiFlag			= 0x0020,
+
+		// This contact is in the contact list of a persistent island
+		e_islandLinkFlag	= 0x0040
 	};
 
 	/// Flag this contact for filtering. Filtering will occur the next time step.
@@ -210,19 +214,29 @@ protected:
 
 	void Update(b2ContactListener* listener);
 
+	// The narrow phase part of Update. This only writes to the contact so it may run
+	// in parallel with other contacts. The previous manifold is copied to oldManifold.
+	void UpdateManifold(b2Manifold* oldManifold);
+
+	// The rest of Update. Wakes the bodies if the touching state changed and calls the listener.
+	void ReportUpdate(b2ContactListener* listener, const b2Manifold* oldManifold, bool wasTouching);
+
 	static b2ContactRegister s_registers[b2Shape::e_typeCount][b2Shape::e_typeCount];
 	static bool s_initialized;
 
 	uint32 m_flags;
 
-	// World pool and list pointers.
-	b2Contact* m_prev;
-	b2Contact* m_next;
+	// Index in the contact manager's contact array. Changes when another contact is removed.
+	int32 m_managerIndex;
 
 	// Nodes for connecting bodies.
 	b2ContactEdge m_nodeA;
 	b2ContactEdge m_nodeB;
 
+	// Persistent island list pointers.
+	b2Contact* m_islandPrev;
+	b2Contact* m_islandNext;
+
 	b2Fixture* m_fixtureA;
 	b2Fixture* m_fixtureB;
 
@@ -239,6 +253,10 @@ protected:
 	float m_restitutionThreshold;
 
 	float m_tangentSpeed;
+
+	// Manifold points separated by up to this distance are kept so the solver can stop
+	// fast bodies before they touch. Zero unless speculative contacts are enabled.
+	float m_speculativeDistance;
 };
 
 inline b2Manifold* b2Contact::GetManifold()
@@ -283,16 +301,6 @@ inline bool b2Contact::IsTouching() const
 	return (m_flags & e_touchingFlag) == e_touchingFlag;
 }
 
-inline b2Contact* b2Contact::GetNext()
-{
-	return m_next;
-}
-
-inline const b2Contact* b2Contact::GetNext() const
-{
-	return m_next;
-}
-
 inline b2Fixture* b2Contact::GetFixtureA()
 {
 	return m_fixtureA;
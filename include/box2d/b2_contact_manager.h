@@ -25,33 +25,102 @@
 
 #include "b2_api.h"
 #include "b2_broad_phase.h"
+#include "b2_time_step.h"
 
 class b2Contact;
 class b2ContactFilter;
 class b2ContactListener;
 class b2BlockAllocator;
+class b2Profiler;
+class b2StackAllocator;
+class b2TaskSystem;
+
+// An entry of the contact pair table. The proxy ids are sorted. The entry is
+// empty if the contact is null.
+struct B2_API b2ContactPair
+{
+	int32 proxyIdA;
+	int32 proxyIdB;
+	b2Contact* contact;
+};
 
 // Delegate of b2World.
 class B2_API b2ContactManager
 {
 public:
-	b2ContactManager();
+	explicit b2ContactManager(b2Allocator* heapAllocator = nullptr);
+	~b2ContactManager();
 
 	// Broad-phase callback.
 	void AddPair(void* proxyUserDataA, void* proxyUserDataB);
 
+	// Find the contact of a broad-phase proxy pair in O(1).
+	b2Contact* FindContact(int32 proxyIdA, int32 proxyIdB) const;
+
+	// Find new contacts. With a task system the broad-phase queries run in parallel.
 	void FindNewContacts();
 
+	// The two halves of FindNewContacts. FindPairs runs the broad-phase tree queries
+	// and UpdatePairs looks up and creates the contacts of the new pairs.
+	void FindPairs();
+	void UpdatePairs();
+
+	// Task callback for FindNewContacts.
+	static void FindPairsTask(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext);
+
 	void Destroy(b2Contact* c);
 
 	void Collide();
 
+	// Collide using the task system. The narrow phase runs in parallel and the
+	// listener calls and contact destruction follow in the same order as Collide.
+	void CollideParallel();
+
+	// Task callback for CollideParallel.
+	static void UpdateContactsTask(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext);
+
+	// Contact pair table maintenance. The fixture proxies of the contact must exist.
+	void AddToPairTable(b2Contact* contact);
+	void RemoveFromPairTable(b2Contact* contact);
+
+	// Contact array maintenance. Removal moves the last contact into the hole.
+	void AddToContactArray(b2Contact* contact);
+	void RemoveFromContactArray(b2Contact* contact);
+
+	// The contact array, the pair table and the broad-phase come from this.
+	b2Allocator* m_heapAllocator;
+
 	b2BroadPhase m_broadPhase;
-	b2Contact* m_contactList;
+
+	// Dense array of all contacts. The contacts themselves do not move, so pointers
+	// remain valid handles while the contact exists.
+	b2Contact** m_contacts;
 	int32 m_contactCount;
+	int32 m_contactCapacity;
+
+	// Open addressing hash table of all contacts keyed by proxy pair.
+	b2ContactPair* m_pairTable;
+	int32 m_pairCapacity;
 	b2ContactFilter* m_contactFilter;
 	b2ContactListener* m_contactListener;
 	b2BlockAllocator* m_allocator;
+	b2StackAllocator* m_stackAllocator;
+	b2TaskSystem* m_taskSystem;
+
+	// Speculative contacts for all bodies. See b2World::SetSpeculativeContacts.
+	bool m_speculativeContacts;
+
+	// Canonical contact order. See b2World::SetDeterministic.
+	bool m_deterministic;
+
+	// Records the zones of the step. See b2World::SetProfiler.
+	b2Profiler* m_profiler;
+
+	// Counters of the step in progress. b2World::Step publishes them.
+	b2StepStats m_stats;
+
+	// The length of the current step. Speculative contacts look this far ahead.
+	float m_speculativeTime;
 };
 
 #endif
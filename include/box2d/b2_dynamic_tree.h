@@ -23,12 +23,19 @@
 #ifndef B2_DYNAMIC_TREE_H
 #define B2_DYNAMIC_TREE_H
 
+#include "b2_allocator.h"
 #include "b2_api.h"
 #include "b2_collision.h"
 #include "b2_growable_stack.h"
 
+class b2SnapshotReader;
+class b2SnapshotWriter;
+
 #define b2_nullNode (-1)
 
+/// The number of rays traversed together by b2DynamicTree::RayCastPacket.
+#define b2_rayPacketSize 4
+
 /// A node in the dynamic tree. The client does not interact with this directly.
 struct B2_API b2TreeNode
 {
@@ -55,6 +62,25 @@ struct B2_API b2TreeNode
 	int32 height;
 
 	bool moved;
+
+	// A leaf was inserted below this node since the last rebuild.
+	bool changed;
+};
+
+/// A node of the wide tree. The client does not interact with this directly.
+/// The bounds of the four children are stored by component so that all
+/// children are tested at once.
+struct B2_API b2WideTreeNode
+{
+	float lowerX[4];
+	float lowerY[4];
+	float upperX[4];
+	float upperY[4];
+
+	/// A proxy id if the bit of the child is set in leafMask, otherwise a wide node
+	/// index. Empty children are b2_nullNode and have inverted bounds.
+	int32 children[4];
+	int32 leafMask;
 };
 
 /// A dynamic AABB tree broad-phase, inspired by Nathanael Presson's btDbvt.
@@ -68,8 +94,9 @@ struct B2_API b2TreeNode
 class B2_API b2DynamicTree
 {
 public:
-	/// Constructing the tree initializes the node pool.
-	b2DynamicTree();
+	/// Constructing the tree initializes the node pool. Nodes come from the given
+	/// allocator, or b2Alloc if it is null.
+	explicit b2DynamicTree(b2Allocator* allocator = nullptr);
 
 	/// Destroy the tree, freeing the node pool.
 	~b2DynamicTree();
@@ -80,6 +107,21 @@ public:
 	/// Destroy a proxy. This asserts if the id is invalid.
 	void DestroyProxy(int32 proxyId);
 
+	/// Create many proxies at once. If the batch is large compared to the tree, the tree
+	/// is rebuilt in one pass instead of inserting the proxies one by one.
+	/// @param aabbs tight fitting AABBs, one per proxy.
+	/// @param userData user data pointers, one per proxy.
+	/// @param proxyIds receives the ids of the new proxies.
+	void CreateProxies(const b2AABB* aabbs, void* const* userData, int32 count, int32* proxyIds);
+
+	/// Destroy many proxies at once. If the batch is large compared to the tree, the
+	/// tree is rebuilt from the remaining proxies instead of removing them one by one.
+	void DestroyProxies(const int32* proxyIds, int32 count);
+
+	/// Is this id a live proxy? Ids of destroyed proxies may be reused by internal nodes.
+	/// Ids outside of the node pool are not proxies.
+	bool IsProxy(int32 proxyId) const;
+
 	/// Move a proxy with a swepted AABB. If the proxy has moved outside of its fattened AABB,
 	/// then the proxy is removed from the tree and re-inserted. Otherwise
 	/// the function returns immediately.
@@ -111,6 +153,25 @@ public:
 	template <typename T>
 	void RayCast(T* callback, const b2RayCastInput& input) const;
 
+	/// Cast a swept AABB against the proxies in the tree. A proxy is reported if its
+	/// fat AABB overlaps the box somewhere along the sweep. The callback performs the
+	/// exact shape cast and the filtering:
+	/// float ShapeCastCallback(const b2AABBCastInput& input, int32 proxyId).
+	/// Return values are handled as in RayCast.
+	/// @param input the box and its translation.
+	template <typename T>
+	void ShapeCast(T* callback, const b2AABBCastInput& input) const;
+
+	/// Ray-cast a packet of up to b2_rayPacketSize rays in one traversal of the tree.
+	/// A node is visited if any ray of the packet may hit it, so this works best for rays
+	/// with similar origins and directions. The callback receives the index of the ray:
+	/// float RayCastCallback(const b2RayCastInput& input, int32 proxyId, int32 rayIndex).
+	/// Return values are handled per ray as in RayCast.
+	/// @param inputs the rays. Each maxFraction is updated to the closest reported fraction.
+	/// Rays with a maxFraction of zero are skipped.
+	template <typename T>
+	void RayCastPacket(T* callback, b2RayCastInput* inputs, int32 count) const;
+
 	/// Validate this tree. For testing.
 	void Validate() const;
 
@@ -128,13 +189,88 @@ public:
 	/// Build an optimal tree. Very expensive. For testing.
 	void RebuildBottomUp();
 
+	/// Get the heap bytes held by the node pools.
+	int32 GetByteCount() const;
+
+	/// Rebuild the tree top-down using a binned surface area heuristic. This takes
+	/// O(n log n) time and gives better trees than incremental insertion, for example
+	/// after many proxies were created or moved.
+	/// @param fullBuild rebuild all internal nodes. Otherwise only the nodes above leaves
+	/// inserted since the last rebuild are rebuilt and the other subtrees are kept.
+	void Rebuild(bool fullBuild);
+
+	/// Collapse the binary tree into a tree with four children per node. Query and
+	/// RayCast use the wide tree and test four children at once with SIMD. Any change
+	/// to the binary tree invalidates the wide tree until this is called again.
+	/// This does nothing if the wide tree is up to date.
+	void BuildWideTree();
+
+	/// Free the wide tree. Queries go back to the binary tree.
+	void ClearWideTree();
+
+	/// Is the wide tree up to date?
+	bool IsWideTreeValid() const;
+
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
 	/// @param newOrigin the new origin with respect to the old origin
 	void ShiftOrigin(const b2Vec2& newOrigin);
 
+	/// Write the node pool to a snapshot. The user data is not written.
+	void WriteSnapshot(b2SnapshotWriter* writer) const;
+
+	/// Replace the node pool with one from WriteSnapshot. The proxies have null user
+	/// data until it is set with SetUserData. If the reader turns invalid the tree is
+	/// not usable until Reset.
+	void ReadSnapshot(b2SnapshotReader* reader);
+
+	/// Remove all proxies. This keeps an owned node pool.
+	void Reset();
+
+	/// Set the user data of a proxy.
+	void SetUserData(int32 proxyId, void* userData);
+
+	/// Write the node pool in the layout used by ReferenceLevel. The user data is not written.
+	void WriteLevel(b2SnapshotWriter* writer) const;
+
+	/// Use a node pool from WriteLevel in place instead of copying it. The tree must be
+	/// empty. The nodes are written to, so the data must be writable and must outlive
+	/// the tree. The pool is copied into owned memory if it has to grow.
+	void ReferenceLevel(b2SnapshotReader* reader);
+
+	/// Get the number of nodes in use, internal nodes included.
+	int32 GetNodeCount() const;
+
 private:
 
+	// The wide traversals are not templates so they can use SIMD. These forward
+	// the results to the callback class.
+	typedef bool QueryFcn(void* context, int32 proxyId);
+	typedef float RayCastFcn(void* context, const b2RayCastInput& input, int32 proxyId);
+	typedef float RayCastPacketFcn(void* context, const b2RayCastInput& input, int32 proxyId, int32 rayIndex);
+
+	template <typename T>
+	static bool QueryThunk(void* context, int32 proxyId)
+	{
+		return ((T*)context)->QueryCallback(proxyId);
+	}
+
+	template <typename T>
+	static float RayCastThunk(void* context, const b2RayCastInput& input, int32 proxyId)
+	{
+		return ((T*)context)->RayCastCallback(input, proxyId);
+	}
+
+	template <typename T>
+	static float RayCastPacketThunk(void* context, const b2RayCastInput& input, int32 proxyId, int32 rayIndex)
+	{
+		return ((T*)context)->RayCastCallback(input, proxyId, rayIndex);
+	}
+
+	void QueryWide(QueryFcn* fcn, void* context, const b2AABB& aabb) const;
+	void RayCastPacket(RayCastPacketFcn* fcn, void* context, b2RayCastInput* inputs, int32 count) const;
+	void RayCastWide(RayCastFcn* fcn, void* context, const b2RayCastInput& input) const;
+
 	int32 AllocateNode();
 	void FreeNode(int32 node);
 
@@ -143,12 +279,18 @@ private:
 
 	int32 Balance(int32 index);
 
+	// Build a tree over the given subtrees and return the root.
+	int32 BuildTree(int32* leaves, int32 count);
+	int32 PartitionSAH(int32* leaves, b2Vec2* centers, int32 count, b2AABB* aabb);
+
 	int32 ComputeHeight() const;
 	int32 ComputeHeight(int32 nodeId) const;
 
 	void ValidateStructure(int32 index) const;
 	void ValidateMetrics(int32 index) const;
 
+	b2Allocator* m_allocator;
+
 	int32 m_root;
 
 	b2TreeNode* m_nodes;
@@ -158,6 +300,14 @@ private:
 	int32 m_freeList;
 
 	int32 m_insertionCount;
+
+	// The node pool is referenced from level data and not owned.
+	bool m_externalNodes;
+
+	b2WideTreeNode* m_wideNodes;
+	int32 m_wideNodeCount;
+	int32 m_wideNodeCapacity;
+	bool m_wideValid;
 };
 
 inline void* b2DynamicTree::GetUserData(int32 proxyId) const
@@ -166,6 +316,22 @@ inline void* b2DynamicTree::GetUserData(int32 proxyId) const
 	return m_nodes[proxyId].userData;
 }
 
+inline void b2DynamicTree::SetUserData(int32 proxyId, void* userData)
+{
+	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+	m_nodes[proxyId].userData = userData;
+}
+
+inline int32 b2DynamicTree::GetNodeCount() const
+{
+	return m_nodeCount;
+}
+
+inline bool b2DynamicTree::IsProxy(int32 proxyId) const
+{
+	return 0 <= proxyId && proxyId < m_nodeCapacity && m_nodes[proxyId].height == 0;
+}
+
 inline bool b2DynamicTree::WasMoved(int32 proxyId) const
 {
 	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
@@ -184,9 +350,20 @@ inline const b2AABB& b2DynamicTree::GetFatAABB(int32 proxyId) const
 	return m_nodes[proxyId].aabb;
 }
 
+inline bool b2DynamicTree::IsWideTreeValid() const
+{
+	return m_wideValid;
+}
+
 template <typename T>
 inline void b2DynamicTree::Query(T* callback, const b2AABB& aabb) const
 {
+	if (m_wideValid)
+	{
+		QueryWide(QueryThunk<T>, callback, aabb);
+		return;
+	}
+
 	b2GrowableStack<int32, 256> stack;
 	stack.Push(m_root);
 
@@ -222,6 +399,12 @@ inline void b2DynamicTree::Query(T* callback, const b2AABB& aabb) const
 template <typename T>
 inline void b2DynamicTree::RayCast(T* callback, const b2RayCastInput& input) const
 {
+	if (m_wideValid)
+	{
+		RayCastWide(RayCastThunk<T>, callback, input);
+		return;
+	}
+
 	b2Vec2 p1 = input.p1;
 	b2Vec2 p2 = input.p2;
 	b2Vec2 r = p2 - p1;
@@ -305,4 +488,93 @@ inline void b2DynamicTree::RayCast(T* callback, const b2RayCastInput& input) con
 	}
 }
 
+template <typename T>
+inline void b2DynamicTree::ShapeCast(T* callback, const b2AABBCastInput& input) const
+{
+	// The box is swept as a ray from its center against the node AABBs
+	// extended by the box extents.
+	b2Vec2 p1 = input.aabb.GetCenter();
+	b2Vec2 extents = input.aabb.GetExtents();
+	b2Vec2 d = input.translation;
+
+	// v is perpendicular to the sweep. A zero translation makes this an overlap query.
+	b2Vec2 v = b2Cross(1.0f, d);
+	v.Normalize();
+	b2Vec2 abs_v = b2Abs(v);
+
+	float maxFraction = input.maxFraction;
+
+	// Build a bounding box for the sweep.
+	b2AABB sweptAABB;
+	{
+		b2Vec2 t = maxFraction * d;
+		sweptAABB.lowerBound = input.aabb.lowerBound + b2Min(b2Vec2_zero, t);
+		sweptAABB.upperBound = input.aabb.upperBound + b2Max(b2Vec2_zero, t);
+	}
+
+	b2GrowableStack<int32, 256> stack;
+	stack.Push(m_root);
+
+	while (stack.GetCount() > 0)
+	{
+		int32 nodeId = stack.Pop();
+		if (nodeId == b2_nullNode)
+		{
+			continue;
+		}
+
+		const b2TreeNode* node = m_nodes + nodeId;
+
+		if (b2TestOverlap(node->aabb, sweptAABB) == false)
+		{
+			continue;
+		}
+
+		// Separating axis for the sweep against the extended node.
+		b2Vec2 c = node->aabb.GetCenter();
+		b2Vec2 h = node->aabb.GetExtents() + extents;
+		float separation = b2Abs(b2Dot(v, p1 - c)) - b2Dot(abs_v, h);
+		if (separation > 0.0f)
+		{
+			continue;
+		}
+
+		if (node->IsLeaf())
+		{
+			b2AABBCastInput subInput;
+			subInput.aabb = input.aabb;
+			subInput.translation = input.translation;
+			subInput.maxFraction = maxFraction;
+
+			float value = callback->ShapeCastCallback(subInput, nodeId);
+
+			if (value == 0.0f)
+			{
+				// The client has terminated the cast.
+				return;
+			}
+
+			if (value > 0.0f)
+			{
+				// Update the swept bounding box.
+				maxFraction = value;
+				b2Vec2 t = maxFraction * d;
+				sweptAABB.lowerBound = input.aabb.lowerBound + b2Min(b2Vec2_zero, t);
+				sweptAABB.upperBound = input.aabb.upperBound + b2Max(b2Vec2_zero, t);
+			}
+		}
+		else
+		{
+			stack.Push(node->child1);
+			stack.Push(node->child2);
+		}
+	}
+}
+
+template <typename T>
+inline void b2DynamicTree::RayCastPacket(T* callback, b2RayCastInput* inputs, int32 count) const
+{
+	RayCastPacket(RayCastPacketThunk<T>, callback, inputs, count);
+}
+
 #endif
@@ -149,6 +149,9 @@ public:
 	b2Body* GetBody();
 	const b2Body* GetBody() const;
 
+	/// Get the creation order id of this fixture. See b2Body::GetId.
+	uint32 GetId() const;
+
 	/// Get the next fixture in the parent body's fixture list.
 	/// @return the next shape.
 	b2Fixture* GetNext();
@@ -228,7 +231,8 @@ protected:
 	void CreateProxies(b2BroadPhase* broadPhase, const b2Transform& xf);
 	void DestroyProxies(b2BroadPhase* broadPhase);
 
-	void Synchronize(b2BroadPhase* broadPhase, const b2Transform& xf1, const b2Transform& xf2);
+	// The AABB covers the sweep from xf1 to xf2 and the shape at xf2 moved by lookAhead.
+	void Synchronize(b2BroadPhase* broadPhase, const b2Transform& xf1, const b2Transform& xf2, const b2Vec2& lookAhead);
 
 	float m_density;
 
@@ -244,6 +248,9 @@ protected:
 	b2FixtureProxy* m_proxies;
 	int32 m_proxyCount;
 
+	// Creation order id. Determinism mode orders contacts by this.
+	uint32 m_id;
+
 	b2Filter m_filter;
 
 	bool m_isSensor;
@@ -296,6 +303,11 @@ inline const b2Body* b2Fixture::GetBody() const
 	return m_body;
 }
 
+inline uint32 b2Fixture::GetId() const
+{
+	return m_id;
+}
+
 inline b2Fixture* b2Fixture::GetNext()
 {
 	return m_next;
@@ -88,6 +88,8 @@ protected:
 	void InitVelocityConstraints(const b2SolverData& data) override;
 	void SolveVelocityConstraints(const b2SolverData& data) override;
 	bool SolvePositionConstraints(const b2SolverData& data) override;
+	void WriteState(b2SnapshotWriter* writer) const override;
+	void ReadState(b2SnapshotReader* reader) override;
 
 	b2Joint* m_joint1;
 	b2Joint* m_joint2;
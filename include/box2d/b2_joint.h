@@ -31,6 +31,8 @@ class b2Draw;
 class b2Joint;
 struct b2SolverData;
 class b2BlockAllocator;
+class b2SnapshotReader;
+class b2SnapshotWriter;
 
 enum b2JointType
 {
@@ -119,6 +121,9 @@ public:
 	/// Get the second body attached to this joint.
 	b2Body* GetBodyB();
 
+	/// Get the creation order id of this joint. See b2Body::GetId.
+	uint32 GetId() const;
+
 	/// Get the anchor point on bodyA in world coordinates.
 	virtual b2Vec2 GetAnchorA() const = 0;
 
@@ -165,6 +170,10 @@ protected:
 	static b2Joint* Create(const b2JointDef* def, b2BlockAllocator* allocator);
 	static void Destroy(b2Joint* joint, b2BlockAllocator* allocator);
 
+	// Create a joint with the given base settings and the defaults of its type. Gear
+	// joints also need the two joints. This is used to restore snapshots.
+	static b2Joint* CreateDefault(const b2JointDef* base, b2Joint* joint1, b2Joint* joint2, b2BlockAllocator* allocator);
+
 	b2Joint(const b2JointDef* def);
 	virtual ~b2Joint() {}
 
@@ -174,6 +183,11 @@ protected:
 	// This returns true if the position errors are within tolerance.
 	virtual bool SolvePositionConstraints(const b2SolverData& data) = 0;
 
+	// Write and read the state of the joint type that persists between time steps.
+	// See b2World::SaveSnapshot.
+	virtual void WriteState(b2SnapshotWriter* writer) const = 0;
+	virtual void ReadState(b2SnapshotReader* reader) = 0;
+
 	b2JointType m_type;
 	b2Joint* m_prev;
 	b2Joint* m_next;
@@ -184,7 +198,15 @@ protected:
 
 	int32 m_index;
 
-	bool m_islandFlag;
+	// Creation order id. Determinism mode orders joints by this.
+	uint32 m_id;
+
+	// Persistent island list pointers.
+	b2Joint* m_islandPrev;
+	b2Joint* m_islandNext;
+
+	// True if this joint is in the joint list of a persistent island.
+	bool m_islandLinked;
 	bool m_collideConnected;
 
 	b2JointUserData m_userData;
@@ -205,6 +227,11 @@ inline b2Body* b2Joint::GetBodyB()
 	return m_bodyB;
 }
 
+inline uint32 b2Joint::GetId() const
+{
+	return m_id;
+}
+
 inline b2Joint* b2Joint::GetNext()
 {
 	return m_next;
@@ -0,0 +1,215 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef B2_PROFILER_H
+#define B2_PROFILER_H
+
+#include "b2_api.h"
+#include "b2_settings.h"
+
+struct b2ProfilerData;
+
+/// A hierarchical profiler for the time step. Attach it with b2World::SetProfiler.
+/// Zones are recorded per thread and nest by time, so the worker threads of a task
+/// system get their own rows in a trace. A frame is one call to b2World::Step.
+/// The zones are only compiled in when B2_PROFILER is defined (BOX2D_PROFILER in CMake).
+/// A profiler may be used by one world at a time.
+class B2_API b2Profiler
+{
+public:
+
+	/// Construct a profiler that keeps at most eventCapacity zones over all frames.
+	explicit b2Profiler(int32 eventCapacity = 1 << 16);
+	~b2Profiler();
+
+	/// Enable or disable recording. This takes effect at the next frame.
+	void SetEnabled(bool flag);
+	bool IsEnabled() const;
+
+	/// Keep only the slowest frames. Zero keeps all frames until the capacity is used up.
+	void SetWorstFrameCount(int32 count);
+	int32 GetWorstFrameCount() const;
+
+	/// Remove all recorded frames.
+	void Clear();
+
+	/// The number of recorded frames and zones.
+	int32 GetFrameCount() const;
+	int32 GetEventCount() const;
+
+	/// The number of frames that did not fit in the capacity.
+	int32 GetDroppedFrameCount() const;
+
+	/// The duration of a recorded frame in milliseconds. Frames are in recording order.
+	float GetFrameTime(int32 index) const;
+
+	/// Write the recorded frames as Chrome trace JSON. This can be opened in
+	/// chrome://tracing or in Perfetto.
+	/// @param buffer the buffer that receives the text, may be null
+	/// @param capacity the size of the buffer in bytes
+	/// @return the size of the text in bytes, not counting the terminating null. The
+	/// text is incomplete if this is not less than the capacity.
+	int32 ExportChromeTrace(char* buffer, int32 capacity) const;
+
+	/// Is the current frame being recorded? This is cheap to call.
+	bool IsRecording() const
+	{
+		return m_recording;
+	}
+
+	/// Start and end a frame. Called by b2World::Step.
+	void BeginFrame();
+	void EndFrame();
+
+	/// Open and close a zone on the calling thread. The name must be a string literal.
+	void Begin(const char* name);
+	void End();
+
+	/// Add time to a zone that is summed over many short calls, such as the narrow-phase
+	/// of one shape pair type. It is reported as a child of the innermost open zone.
+	void Accumulate(const char* name, unsigned long long ticks);
+
+	/// The current time in profiler ticks (nanoseconds).
+	static unsigned long long GetTicks();
+
+private:
+
+	b2Profiler(const b2Profiler&) = delete;
+	b2Profiler& operator=(const b2Profiler&) = delete;
+
+	b2ProfilerData* m_data;
+	bool m_enabled;
+	bool m_recording;
+};
+
+/// Records a zone for the lifetime of the object. Use b2ProfileScope.
+class b2ProfileZone
+{
+public:
+	b2ProfileZone(b2Profiler* profiler, const char* name)
+	{
+		m_profiler = profiler != nullptr && profiler->IsRecording() ? profiler : nullptr;
+		if (m_profiler != nullptr)
+		{
+			m_profiler->Begin(name);
+		}
+	}
+
+	~b2ProfileZone()
+	{
+		if (m_profiler != nullptr)
+		{
+			m_profiler->End();
+		}
+	}
+
+private:
+	b2Profiler* m_profiler;
+};
+
+/// Adds the lifetime of the object to an accumulated zone. Use b2ProfileAccumulate.
+class b2ProfileSample
+{
+public:
+	b2ProfileSample(b2Profiler* profiler, const char* name)
+	{
+		m_profiler = profiler != nullptr && profiler->IsRecording() ? profiler : nullptr;
+		m_name = name;
+		m_start = m_profiler != nullptr ? b2Profiler::GetTicks() : 0;
+	}
+
+	~b2ProfileSample()
+	{
+		if (m_profiler != nullptr)
+		{
+			m_profiler->Accumulate(m_name, b2Profiler::GetTicks() - m_start);
+		}
+	}
+
+private:
+	b2Profiler* m_profiler;
+	const char* m_name;
+	unsigned long long m_start;
+};
+
+/// Records a frame for the lifetime of the object. Use b2ProfileFrame.
+class b2ProfileFrameScope
+{
+public:
+	explicit b2ProfileFrameScope(b2Profiler* profiler)
+	{
+		m_profiler = profiler;
+		if (m_profiler != nullptr)
+		{
+			m_profiler->BeginFrame();
+		}
+	}
+
+	~b2ProfileFrameScope()
+	{
+		if (m_profiler != nullptr)
+		{
+			m_profiler->EndFrame();
+		}
+	}
+
+private:
+	b2Profiler* m_profiler;
+};
+
+/// Open a zone that is closed by b2ProfileZoneEnd. Use b2ProfileBegin.
+inline void b2ProfileZoneBegin(b2Profiler* profiler, const char* name)
+{
+	if (profiler != nullptr && profiler->IsRecording())
+	{
+		profiler->Begin(name);
+	}
+}
+
+/// Close a zone opened by b2ProfileZoneBegin. Use b2ProfileEnd.
+inline void b2ProfileZoneEnd(b2Profiler* profiler)
+{
+	if (profiler != nullptr && profiler->IsRecording())
+	{
+		profiler->End();
+	}
+}
+
+#define B2_PROFILE_CONCAT2(a, b) a##b
+#define B2_PROFILE_CONCAT(a, b) B2_PROFILE_CONCAT2(a, b)
+
+// Profiler zones. These compile to nothing unless B2_PROFILER is defined.
+#ifdef B2_PROFILER
+#define b2ProfileFrame(profiler) b2ProfileFrameScope B2_PROFILE_CONCAT(b2_profileFrame, __LINE__)(profiler)
+#define b2ProfileScope(profiler, name) b2ProfileZone B2_PROFILE_CONCAT(b2_profileZone, __LINE__)(profiler, name)
+#define b2ProfileAccumulate(profiler, name) b2ProfileSample B2_PROFILE_CONCAT(b2_profileSample, __LINE__)(profiler, name)
+#define b2ProfileBegin(profiler, name) b2ProfileZoneBegin(profiler, name)
+#define b2ProfileEnd(profiler) b2ProfileZoneEnd(profiler)
+#else
+#define b2ProfileFrame(profiler)
+#define b2ProfileScope(profiler, name)
+#define b2ProfileAccumulate(profiler, name)
+#define b2ProfileBegin(profiler, name)
+#define b2ProfileEnd(profiler)
+#endif
+
+#endif
@@ -23,11 +23,12 @@
 #ifndef B2_STACK_ALLOCATOR_H
 #define B2_STACK_ALLOCATOR_H
 
+#include "b2_allocator.h"
 #include "b2_api.h"
 #include "b2_settings.h"
 
-const int32 b2_stackSize = 100 * 1024;	// 100k
-const int32 b2_maxStackEntries = 32;
+const int32 b2_stackSize = 100 * 1024;	// 100k, the default capacity
+const int32 b2_maxStackEntries = 32;	// the initial entry capacity
 
 struct B2_API b2StackEntry
 {
@@ -39,27 +40,45 @@ struct B2_API b2StackEntry
 // This is a stack allocator used for fast per step allocations.
 // You must nest allocate/free pairs. The code will assert
 // if you try to interleave multiple allocate/free pairs.
+// Allocations that don't fit in the stack fall back to the heap. Memory comes from the
+// given allocator, or b2Alloc if it is null.
 class B2_API b2StackAllocator
 {
 public:
-	b2StackAllocator();
+	explicit b2StackAllocator(int32 capacity = b2_stackSize, b2Allocator* allocator = nullptr);
 	~b2StackAllocator();
 
 	void* Allocate(int32 size);
 	void Free(void* p);
 
+	// The largest total of live allocations so far.
 	int32 GetMaxAllocation() const;
 
+	// Resize the stack. The stack must be empty.
+	void SetCapacity(int32 capacity);
+	int32 GetCapacity() const;
+
+	// Grow the stack to fit the largest total allocation so far. The stack must be empty.
+	void Grow();
+
+	// The number of allocations that did not fit and used b2Alloc.
+	int32 GetHeapFallbackCount() const;
+
 private:
 
-	char m_data[b2_stackSize];
+	b2Allocator* m_allocator;
+
+	char* m_data;
+	int32 m_capacity;
 	int32 m_index;
 
 	int32 m_allocation;
 	int32 m_maxAllocation;
+	int32 m_heapFallbackCount;
 
-	b2StackEntry m_entries[b2_maxStackEntries];
+	b2StackEntry* m_entries;
 	int32 m_entryCount;
+	int32 m_entryCapacity;
 };
 
 #endif
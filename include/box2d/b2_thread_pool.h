@@ -0,0 +1,64 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef B2_THREAD_POOL_H
+#define B2_THREAD_POOL_H
+
+#include "b2_api.h"
+#include "b2_settings.h"
+#include "b2_world_callbacks.h"
+
+struct b2ThreadPoolData;
+
+/// A simple task system built on std::thread. The calling thread participates
+/// in each task as worker zero, so a pool with a single worker runs all tasks inline.
+/// This executes one task at a time.
+class B2_API b2ThreadPool : public b2TaskSystem
+{
+public:
+
+	/// Construct a pool with the given number of workers, including the calling thread.
+	/// Use zero or less to match the hardware concurrency.
+	explicit b2ThreadPool(int32 workerCount = 0);
+
+	/// Joins all worker threads.
+	~b2ThreadPool() override;
+
+	/// @see b2TaskSystem::GetWorkerCount
+	int32 GetWorkerCount() const override;
+
+	/// @see b2TaskSystem::EnqueueTask
+	void* EnqueueTask(b2TaskCallback* task, int32 itemCount, int32 minRange, void* taskContext) override;
+
+	/// @see b2TaskSystem::FinishTask
+	void FinishTask(void* userTask) override;
+
+private:
+
+	b2ThreadPool(const b2ThreadPool&) = delete;
+	b2ThreadPool& operator=(const b2ThreadPool&) = delete;
+
+	b2ThreadPoolData* m_data;
+	int32 m_workerCount;
+};
+
+#endif
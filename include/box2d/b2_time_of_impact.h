@@ -51,6 +51,8 @@ struct B2_API b2TOIOutput
 
 	State state;
 	float t;
+	int32 iterations;			///< number of separating axis iterations
+	int32 distanceIterations;	///< total GJK iterations of the distance queries
 };
 
 /// Compute the upper bound on time before two shapes penetrate. Time is represented as
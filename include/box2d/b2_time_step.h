@@ -25,6 +25,8 @@
 #include "b2_api.h"
 #include "b2_math.h"
 
+class b2Body;
+
 /// Profiling data. Times are in milliseconds.
 struct B2_API b2Profile
 {
@@ -35,7 +37,35 @@ struct B2_API b2Profile
 	float solveVelocity;
 	float solvePosition;
 	float broadphase;
+	float findPairs;	// broad-phase tree queries of the moved proxies, part of broadphase
+	float updatePairs;	// contact lookup and creation for the new pairs, part of broadphase
 	float solveTOI;
+	int32 stackHeapFallbacks;	// stack allocations that did not fit and used b2Alloc
+};
+
+/// The number of island size classes in b2StepStats. Class i counts the islands with
+/// 2^i to 2^(i+1) - 1 bodies. The last class also counts all larger islands.
+#define b2_islandSizeClassCount 8
+
+/// Counters of one time step. Contacts created and destroyed between steps are
+/// counted by the next step.
+struct B2_API b2StepStats
+{
+	int32 contactsCreated;		///< pairs accepted by the contact filter
+	int32 contactsDestroyed;
+	int32 touchingContacts;		///< touching contacts after the step
+	int32 pairsTested;			///< broad-phase pairs looked up, including pairs of one body and pairs with a contact
+	int32 proxiesMoved;			///< proxies that left their fat AABB or were added
+	int32 islands;				///< awake islands solved
+	int32 largestIsland;		///< bodies in the largest island
+	int32 islandSizes[b2_islandSizeClassCount];	///< island count by size class
+	int32 toiCalls;				///< time of impact computations
+	int32 toiIterations;		///< separating axis iterations of the computations
+	int32 toiEvents;			///< time of impact events, each is a sub-step of two bodies
+	int32 toiMaxSubSteps;		///< most sub-steps of a contact, at most b2_maxSubSteps
+	int32 gjkIterations;		///< distance iterations of the time of impact computations
+	int32 awakeBodies;			///< non-static bodies that are awake after the step
+	int32 sleepingBodies;		///< enabled non-static bodies that are asleep after the step
 };
 
 /// This is an internal structure.
@@ -47,6 +77,7 @@ struct B2_API b2TimeStep
 	int32 velocityIterations;
 	int32 positionIterations;
 	bool warmStarting;
+	bool wideSolver;
 };
 
 /// This is an internal structure.
@@ -63,12 +94,35 @@ struct B2_API b2Velocity
 	float w;
 };
 
+/// The solver state of all bodies of a world. The arrays are indexed by the state
+/// index of a body and the island solver works on them in place. Slots past the
+/// body count are scratch space of the solver.
+/// This is an internal structure.
+struct B2_API b2BodyStates
+{
+	b2Position* positions;
+	b2Velocity* velocities;
+	b2Body** bodies;
+	int32 count;
+	int32 capacity;
+};
+
 /// Solver Data
 struct B2_API b2SolverData
 {
+	/// Get the index of a body in the state arrays. Islands that share a static body
+	/// may be solved concurrently, so in that case each call returns a private copy
+	/// of the static body state.
+	int32 GetIndex(b2Body* body) const;
+
 	b2TimeStep step;
 	b2Position* positions;
 	b2Velocity* velocities;
+
+	// Next free and end of the slots for static body copies. Null if static bodies
+	// use their own slots.
+	int32* staticSlot;
+	int32 staticSlotEnd;
 };
 
 #endif
@@ -23,6 +23,7 @@
 #ifndef B2_WORLD_H
 #define B2_WORLD_H
 
+#include "b2_allocator.h"
 #include "b2_api.h"
 #include "b2_block_allocator.h"
 #include "b2_contact_manager.h"
@@ -35,10 +36,87 @@ struct b2AABB;
 struct b2BodyDef;
 struct b2Color;
 struct b2JointDef;
+struct b2PersistentIsland;
+struct b2QueryBatchBuffer;
+struct b2QueryBatchRange;
+struct b2TOIQueue;
 class b2Body;
 class b2Draw;
 class b2Fixture;
 class b2Joint;
+class b2Profiler;
+class b2Shape;
+class b2SnapshotReader;
+class b2SnapshotWriter;
+
+/// A world definition holds the settings needed to construct a world.
+struct B2_API b2WorldDef
+{
+	b2WorldDef()
+	{
+		gravity.Set(0.0f, -10.0f);
+		stackCapacity = b2_stackSize;
+		growStack = true;
+		allocator = nullptr;
+		memoryBudget = 0;
+		memoryListener = nullptr;
+	}
+
+	/// The world gravity vector.
+	b2Vec2 gravity;
+
+	/// The initial size in bytes of the stack allocators that hold per step memory. There
+	/// is one for the world and one per task worker.
+	int32 stackCapacity;
+
+	/// Grow the stack allocators between steps to fit the largest step so far.
+	/// Allocations that don't fit fall back to b2Alloc. See b2Profile::stackHeapFallbacks.
+	bool growStack;
+
+	/// The heap of this world. All memory owned by the world comes from here, except
+	/// chain shape vertices which use b2Alloc. Null means b2Alloc. The allocator must
+	/// outlive the world.
+	b2Allocator* allocator;
+
+	/// The memory budget in bytes. Zero means no budget. See b2World::SetMemoryBudget.
+	int32 memoryBudget;
+
+	/// Told when the world goes over the memory budget.
+	b2MemoryListener* memoryListener;
+};
+
+/// The memory used by a world in bytes. The categories hold the objects and the arrays
+/// that track them. The total is the exact heap footprint of the world, which also
+/// includes free blocks of the small object allocator and other bookkeeping.
+struct B2_API b2MemoryStats
+{
+	/// Bodies and the body state arrays.
+	int32 bodies;
+
+	/// Fixtures and their shapes.
+	int32 fixtures;
+
+	/// Contacts, the contact array and the contact pair table.
+	int32 contacts;
+
+	/// Fixture proxies and the broad-phase pair finding buffers.
+	int32 proxies;
+
+	/// The node pools of the broad-phase trees.
+	int32 treeNodes;
+
+	/// The stack allocators of the world and the task workers.
+	int32 stack;
+
+	/// The bytes allocated from the world heap.
+	int32 totalBytes;
+
+	/// The high-water mark of totalBytes.
+	int32 peakBytes;
+
+	/// The memory budget. Zero means no budget.
+	int32 budget;
+};
 
 /// The world class manages all physics entities, dynamic simulation,
 /// and asynchronous queries. The world also contains efficient memory
@@ -50,6 +128,9 @@ public:
 	/// @param gravity the world gravity vector.
 	b2World(const b2Vec2& gravity);
 
+	/// Construct a world object from a definition.
+	explicit b2World(const b2WorldDef* def);
+
 	/// Destruct the world. All physics entities are destroyed and all heap memory is released.
 	~b2World();
 
@@ -71,6 +152,15 @@ public:
 	/// by you and must remain in scope.
 	void SetDebugDraw(b2Draw* debugDraw);
 
+	/// Register a task system to run the time step on multiple threads. Pass nullptr
+	/// to run everything on the calling thread. The results are identical either way.
+	/// The task system is owned by you and must remain in scope.
+	/// @warning This function is locked during callbacks.
+	void SetTaskSystem(b2TaskSystem* taskSystem);
+
+	/// Get the registered task system, if any.
+	b2TaskSystem* GetTaskSystem() const { return m_taskSystem; }
+
 	/// Create a rigid body given a definition. No reference to the definition
 	/// is retained.
 	/// @warning This function is locked during callbacks.
@@ -82,6 +172,22 @@ public:
 	/// @warning This function is locked during callbacks.
 	void DestroyBody(b2Body* body);
 
+	/// Create many rigid bodies at once. This is much faster than calling CreateBody and
+	/// b2Body::CreateFixture for each body because storage is reserved up front and the
+	/// broad-phase proxies of all fixtures are built in one pass.
+	/// @param bodyDefs the body definitions, one per body.
+	/// @param fixtureDefs the fixture definitions, one per body. May be null.
+	/// @param count the number of bodies.
+	/// @param bodies receives the new bodies.
+	/// @warning This function is locked during callbacks.
+	void CreateBodies(const b2BodyDef* bodyDefs, const b2FixtureDef* fixtureDefs, int32 count, b2Body** bodies);
+
+	/// Destroy many rigid bodies at once. The broad-phase proxies of all fixtures are
+	/// destroyed in one pass.
+	/// @warning This automatically deletes all associated shapes and joints.
+	/// @warning This function is locked during callbacks.
+	void DestroyBodies(b2Body* const* bodies, int32 count);
+
 	/// Create a joint to constrain bodies together. No reference to the definition
 	/// is retained. This may cause the connected bodies to cease colliding.
 	/// @warning This function is locked during callbacks.
@@ -126,6 +232,49 @@ public:
 	/// @param point2 the ray ending point
 	void RayCast(b2RayCastCallback* callback, const b2Vec2& point1, const b2Vec2& point2) const;
 
+	/// Find the closest hit of many rays. Consecutive rays are traversed together in
+	/// packets, so neighboring rays should have similar origins and directions. Sensors
+	/// are ignored. With a task system the packets are cast in parallel.
+	/// @param inputs the rays.
+	/// @param count the number of rays.
+	/// @param results receives the closest hit of each ray.
+	void RayCastBatch(const b2RayInput* inputs, int32 count, b2RayResult* results) const;
+
+	/// Query the world for all fixtures that potentially overlap any of the provided
+	/// AABBs. The overlaps are written in query order and, within a query, in the order
+	/// b2World::QueryAABB would report them. With a task system the queries run in parallel.
+	/// @param aabbs the query boxes.
+	/// @param count the number of query boxes.
+	/// @param results receives at most capacity overlaps.
+	/// @param capacity the size of the result array.
+	/// @param testOverlap only report fixtures whose shape overlaps the box, as computed
+	/// by b2TestOverlap, instead of fixtures whose fat AABB overlaps the box.
+	/// @return the number of overlaps found. This is larger than capacity if the results
+	/// were truncated.
+	int32 QueryAABBBatch(const b2AABB* aabbs, int32 count, b2QueryResult* results, int32 capacity, bool testOverlap = false) const;
+
+	/// Cast a shape through the world and find the closest fixture it hits. Sensors and
+	/// fixtures that already overlap the shape at its start are ignored.
+	/// @param shape the cast shape. Chain shapes are not supported.
+	/// @param transform the start transform of the shape.
+	/// @param translation the translation of the shape.
+	/// @param result receives the closest hit.
+	/// @param maskBits only fixtures with a category bit in this mask are hit.
+	/// @return true if the shape hit a fixture.
+	bool ShapeCast(const b2Shape* shape, const b2Transform& transform, const b2Vec2& translation,
+					b2ShapeCastResult* result, uint16 maskBits = 0xFFFF) const;
+
+	/// Find the fixtures that overlap a shape, including sensors.
+	/// @param shape the query shape. Chain shapes are not supported.
+	/// @param transform the transform of the shape.
+	/// @param results receives at most capacity overlaps. The query index is zero.
+	/// @param capacity the size of the result array.
+	/// @param maskBits only fixtures with a category bit in this mask are reported.
+	/// @return the number of overlaps found. This is larger than capacity if the results
+	/// were truncated.
+	int32 OverlapShape(const b2Shape* shape, const b2Transform& transform, b2QueryResult* results,
+						int32 capacity, uint16 maskBits = 0xFFFF) const;
+
 	/// Get the world body list. With the returned body, use b2Body::GetNext to get
 	/// the next body in the world list. A nullptr body indicates the end of the list.
 	/// @return the head of the world body list.
@@ -154,14 +303,55 @@ public:
 	void SetWarmStarting(bool flag) { m_warmStarting = flag; }
 	bool GetWarmStarting() const { return m_warmStarting; }
 
+	/// Enable/disable the wide contact solver. The contact constraints of each island are
+	/// graph colored and solved in SIMD batches. This changes the order in which constraints
+	/// are solved, so results differ slightly from the default solver.
+	void SetWideSolver(bool flag) { m_wideSolver = flag; }
+	bool GetWideSolver() const { return m_wideSolver; }
+
+	/// Enable/disable wide broad-phase trees. At the end of each step the broad-phase
+	/// trees are collapsed into trees with four children per node. Queries and ray casts
+	/// then test four children at once. Trees that did not change are not rebuilt.
+	void SetWideQueries(bool flag);
+	bool GetWideQueries() const { return m_wideQueries; }
+
 	/// Enable/disable continuous physics. For testing.
 	void SetContinuousPhysics(bool flag) { m_continuousPhysics = flag; }
 	bool GetContinuousPhysics() const { return m_continuousPhysics; }
 
+	/// Enable/disable speculative contacts for all bodies. Contacts then keep points that
+	/// are separated by up to the distance the bodies can move in one step, and the
+	/// contact solver stops the bodies before they tunnel. This replaces the time of
+	/// impact event loop, so the cost of continuous collision is bounded by the number of
+	/// contacts. Fast bodies may catch on corners they pass closely.
+	/// Use b2Body::SetSpeculative to enable this per body.
+	void SetSpeculativeContacts(bool flag) { m_contactManager.m_speculativeContacts = flag; }
+	bool GetSpeculativeContacts() const { return m_contactManager.m_speculativeContacts; }
+
 	/// Enable/disable single stepped continuous physics. For testing.
 	void SetSubStepping(bool flag) { m_subStepping = flag; }
 	bool GetSubStepping() const { return m_subStepping; }
 
+	/// Enable/disable determinism mode. Contacts, islands and the constraints of each
+	/// island are put in a canonical order before they are used. The order follows the
+	/// creation order of bodies, fixtures and joints, so results are bit identical
+	/// regardless of the task system and of the history of contacts and islands, such as
+	/// broad-phase proxy ids or the order in which contacts began. Results still depend on
+	/// the relative creation order of objects and on the compiler and platform.
+	/// This sorts the contacts on steps where contacts were added or removed.
+	void SetDeterministic(bool flag) { m_contactManager.m_deterministic = flag; }
+	bool GetDeterministic() const { return m_contactManager.m_deterministic; }
+
+	/// Set the size in bytes of the stack allocators that hold per step memory.
+	/// @warning This function is locked during callbacks.
+	void SetStackCapacity(int32 capacity);
+	int32 GetStackCapacity() const { return m_stackCapacity; }
+
+	/// Enable/disable growing the stack allocators between steps to fit the largest
+	/// step so far.
+	void SetStackGrowth(bool flag) { m_growStack = flag; }
+	bool GetStackGrowth() const { return m_growStack; }
+
 	/// Get the number of broad-phase proxies.
 	int32 GetProxyCount() const;
 
@@ -210,30 +400,171 @@ public:
 	/// Get the current profile.
 	const b2Profile& GetProfile() const;
 
+	/// Get the counters of the last time step, such as contacts created, islands solved
+	/// and time of impact events.
+	const b2StepStats& GetStepStats() const;
+
+	/// Attach a profiler that records the zones of each step, or null to detach it.
+	/// Zones are only recorded if Box2D is compiled with B2_PROFILER.
+	void SetProfiler(b2Profiler* profiler) { m_contactManager.m_profiler = profiler; }
+	b2Profiler* GetProfiler() const { return m_contactManager.m_profiler; }
+
+	/// Get the statistics of the small object allocator that holds bodies, fixtures,
+	/// contacts, joints, and islands.
+	b2BlockAllocatorStats GetBlockAllocatorStats() const;
+
+	/// Set the memory budget in bytes. The memory listener is told each time an
+	/// allocation takes the world heap over the budget. The allocation still succeeds.
+	/// Zero means no budget.
+	void SetMemoryBudget(int32 budget) { m_allocator.SetBudget(budget); }
+	int32 GetMemoryBudget() const { return m_allocator.GetBudget(); }
+
+	/// Register a memory listener. The listener is owned by you and must remain in
+	/// scope. With a task system it may be called from worker threads.
+	void SetMemoryListener(b2MemoryListener* listener) { m_allocator.SetListener(listener); }
+
+	/// Get the memory used by this world by category.
+	b2MemoryStats GetMemoryStats() const;
+
 	/// Dump the world into the log file.
 	/// @warning this should be called outside of a time step.
 	void Dump();
 
+	/// Save the complete simulation state into a binary snapshot. Restoring the snapshot
+	/// and stepping gives the same results, bit for bit, as stepping this world.
+	/// Pass a null buffer to query the size.
+	/// @param data the buffer that receives the snapshot, may be null
+	/// @param capacity the size of the buffer in bytes
+	/// @return the size of the snapshot in bytes. The snapshot is incomplete if this
+	/// is larger than the capacity.
+	/// @warning this should be called outside of a time step.
+	int32 SaveSnapshot(void* data, int32 capacity);
+
+	/// Replace the simulation state with a snapshot from SaveSnapshot. All bodies, fixtures,
+	/// joints and contacts are recreated, so pointers to the old objects become invalid.
+	/// User data is restored. Listeners are not called. Execution settings, such as the
+	/// task system and the listeners, are kept. The snapshot must come from the same build.
+	/// @return false if the snapshot is not valid for this build, in which case the
+	/// world is not changed, or if the snapshot is cut short or holds an out of range
+	/// count, index or type, in which case the world is left empty with its settings kept.
+	/// @warning this should be called outside of a time step.
+	bool RestoreSnapshot(const void* data, int32 size);
+
+	/// Save the static bodies and the static broad-phase tree as a level. A level is laid
+	/// out so that LoadLevel can use it in place, for example from a memory mapped file.
+	/// Pass a null buffer to query the size.
+	/// @param data the buffer that receives the level, may be null
+	/// @param capacity the size of the buffer in bytes
+	/// @return the size of the level in bytes. The level is incomplete if this is larger
+	/// than the capacity.
+	int32 SaveLevel(void* data, int32 capacity) const;
+
+	/// Create the static bodies of a level from SaveLevel. Chain vertices and the static
+	/// tree nodes are used in place rather than copied, so loading does not depend on the
+	/// number of chain vertices. The world must not have static proxies yet.
+	/// The data must be 16 byte aligned, such as a memory mapping. The tree nodes are
+	/// written to, so map the file privately (copy-on-write). The data must remain valid
+	/// until the world is destroyed. The level must come from the same build.
+	/// @return false if the level is not valid for this build or the world already has
+	/// static proxies, in which case the world is not changed.
+	/// @warning this should be called outside of a time step.
+	bool LoadLevel(void* data, int32 size);
+
 private:
 
 	friend class b2Body;
 	friend class b2Fixture;
+	friend class b2Contact;
 	friend class b2ContactManager;
 	friend class b2Controller;
 
+	// Persistent island graph. Constraints are linked when they are created or start
+	// touching and unlinked when they are destroyed or stop touching.
+	void LinkBody(b2Body* body);
+	void UnlinkBody(b2Body* body);
+	void LinkContact(b2Contact* contact);
+	void UnlinkContact(b2Contact* contact);
+	void LinkJoint(b2Joint* joint);
+	void UnlinkJoint(b2Joint* joint);
+
+	b2PersistentIsland* CreateIsland();
+	void DestroyIsland(b2PersistentIsland* island);
+	b2PersistentIsland* MergeIslands(b2PersistentIsland* island1, b2PersistentIsland* island2);
+	void SplitIsland(b2PersistentIsland* island);
+	void WakeIsland(b2PersistentIsland* island);
+	void RemoveAwakeIsland(b2PersistentIsland* island);
+
+	// Canonical orders for determinism mode.
+	void SortContacts(int32 startIndex);
+	void SortAwakeIslands();
+	void SortContactList(b2Body* body);
+
+	// Finish the counters of the step and start counting the next step.
+	void PublishStepStats();
+
 	void Solve(const b2TimeStep& step);
 	void SolveTOI(const b2TimeStep& step);
+	void ComputeTOIs(b2Contact** contacts, int32 count, b2TOIQueue* queue);
+
+	// Body state storage. See b2BodyStates.
+	void CreateBodyState(b2Body* body);
+	void DestroyBodyState(b2Body* body);
+	void ReserveBodyStates(int32 capacity);
 
 	void DrawShape(b2Fixture* shape, const b2Transform& xf, const b2Color& color);
 
+	// Fixture records shared by snapshots and levels. A level references the chain vertices
+	// and gets new ids. ReadFixture returns null and invalidates the reader on bad data.
+	void WriteFixture(b2SnapshotWriter* writer, const b2Fixture* fixture) const;
+	b2Fixture* ReadFixture(b2SnapshotReader* reader, b2Body* body, bool level);
+
+	// Rebuild the objects of a snapshot. This stops at the first bad value and leaves the
+	// reader invalid. DestroySnapshotObjects then removes whatever was rebuilt.
+	void ReadSnapshotObjects(b2SnapshotReader* reader, b2Body** bodies, int32 bodyCount,
+		b2Joint** joints, int32 jointCount, int32 contactCount);
+	void DestroySnapshotObjects();
+
+	// Scratch memory for task workers, indexed by worker.
+	b2StackAllocator* GetWorkerAllocators();
+
+	// The heap fallbacks of the world and worker stack allocators.
+	int32 GetStackHeapFallbackCount() const;
+
+	// The world heap. This is declared first so that it is destroyed last. Mutable
+	// so that const queries can grow their scratch memory.
+	mutable b2TrackingAllocator m_allocator;
+
 	b2BlockAllocator m_blockAllocator;
 	b2StackAllocator m_stackAllocator;
 
+	b2TaskSystem* m_taskSystem;
+
+	// One stack allocator per task worker.
+	b2StackAllocator* m_workerAllocators;
+	int32 m_workerCount;
+
+	int32 m_stackCapacity;
+	bool m_growStack;
+
 	b2ContactManager m_contactManager;
 
 	b2Body* m_bodyList;
 	b2Joint* m_jointList;
 
+	b2BodyStates m_bodyStates;
+
+	// Scratch of QueryAABBBatch, kept between calls so that repeated batches do not
+	// allocate. There is one result buffer per worker and one range per query.
+	mutable b2QueryBatchBuffer* m_queryBuffers;
+	mutable int32 m_queryBufferCount;
+	mutable b2QueryBatchRange* m_queryRanges;
+	mutable int32 m_queryRangeCapacity;
+
+	// Islands that are solved by the next time step.
+	b2PersistentIsland** m_awakeIslands;
+	int32 m_awakeIslandCount;
+	int32 m_awakeIslandCapacity;
+
 	int32 m_bodyCount;
 	int32 m_jointCount;
 
@@ -247,10 +578,16 @@ private:
 	// support a variable time step.
 	float m_inv_dt0;
 
+	// The next creation order id of a body, fixture or joint.
+	uint32 m_nextId;
+
 	bool m_newContacts;
 	bool m_locked;
 	bool m_clearForces;
 
+	bool m_wideSolver;
+	bool m_wideQueries;
+
 	// These are for debugging the solver.
 	bool m_warmStarting;
 	bool m_continuousPhysics;
@@ -259,6 +596,7 @@ private:
 	bool m_stepComplete;
 
 	b2Profile m_profile;
+	b2StepStats m_stepStats;
 };
 
 inline b2Body* b2World::GetBodyList()
@@ -283,12 +621,12 @@ inline const b2Joint* b2World::GetJointList() const
 
 inline b2Contact* b2World::GetContactList()
 {
-	return m_contactManager.m_contactList;
+	return m_contactManager.m_contactCount > 0 ? m_contactManager.m_contacts[0] : nullptr;
 }
 
 inline const b2Contact* b2World::GetContactList() const
 {
-	return m_contactManager.m_contactList;
+	return m_contactManager.m_contactCount > 0 ? m_contactManager.m_contacts[0] : nullptr;
 }
 
 inline int32 b2World::GetBodyCount() const
@@ -337,9 +675,19 @@ inline const b2ContactManager& b2World::GetContactManager() const
 	return m_contactManager;
 }
 
+inline b2BlockAllocatorStats b2World::GetBlockAllocatorStats() const
+{
+	return m_blockAllocator.GetStats();
+}
+
 inline const b2Profile& b2World::GetProfile() const
 {
 	return m_profile;
 }
 
+inline const b2StepStats& b2World::GetStepStats() const
+{
+	return m_stepStats;
+}
+
 #endif
@@ -24,6 +24,7 @@
 #define B2_WORLD_CALLBACKS_H
 
 #include "b2_api.h"
+#include "b2_math.h"
 #include "b2_settings.h"
 
 struct b2Vec2;
@@ -101,6 +102,8 @@ public:
 	/// Note: this is called only for awake bodies.
 	/// Note: this is called even when the number of contact points is zero.
 	/// Note: this is not called for sensors.
+	/// Note: this is also called for speculative contacts. They have contact points with a
+	/// positive separation before the shapes touch.
 	/// Note: if you set the number of contact points to zero, you will not
 	/// get an EndContact callback. However, you may get a BeginContact callback
 	/// the next step.
@@ -158,4 +161,97 @@ public:
 									const b2Vec2& normal, float fraction) = 0;
 };
 
+/// A ray for b2World::RayCastBatch. The ray goes from p1 to p2.
+struct B2_API b2RayInput
+{
+	b2RayInput()
+	{
+		maskBits = 0xFFFF;
+	}
+
+	b2Vec2 p1, p2;
+
+	/// Only fixtures with a category bit in this mask are hit.
+	uint16 maskBits;
+};
+
+/// The closest hit of a ray from b2World::RayCastBatch.
+struct B2_API b2RayResult
+{
+	/// The fixture hit or nullptr if the ray missed.
+	b2Fixture* fixture;
+	b2Vec2 point;
+	b2Vec2 normal;
+	float fraction;
+};
+
+/// The closest hit of b2World::ShapeCast.
+struct B2_API b2ShapeCastResult
+{
+	/// The fixture hit or nullptr if the shape did not hit anything.
+	b2Fixture* fixture;
+
+	/// The hit point on the fixture and the normal pointing from the fixture
+	/// towards the cast shape.
+	b2Vec2 point;
+	b2Vec2 normal;
+
+	/// The fraction of the translation where the hit occurs.
+	float fraction;
+};
+
+/// An overlap found by b2World::QueryAABBBatch or b2World::OverlapShape.
+struct B2_API b2QueryResult
+{
+	/// The index of the AABB in the batch.
+	int32 queryIndex;
+
+	/// The fixture and the child of the fixture that overlaps the AABB.
+	b2Fixture* fixture;
+	int32 childIndex;
+};
+
+/// A range of work items executed by a task system. The items [startIndex, endIndex)
+/// must be processed by the worker identified by workerIndex.
+typedef void b2TaskCallback(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext);
+
+/// Implement this class to run the parallel parts of the world step on your own job
+/// system. See b2ThreadPool for a ready to use implementation.
+/// A task covers a number of items. The items may be split into ranges that run in
+/// any order on any worker, but each worker must only run one range at a time.
+/// @warning the world only enqueues one task at a time and waits for it to finish
+/// before continuing.
+class B2_API b2TaskSystem
+{
+public:
+	virtual ~b2TaskSystem() {}
+
+	/// The number of workers that may execute ranges concurrently. Worker indices
+	/// passed to the task callbacks must be in [0, GetWorkerCount()).
+	virtual int32 GetWorkerCount() const = 0;
+
+	/// Start a task that covers the items [0, itemCount). Ranges should contain at least
+	/// minRange items to amortize scheduling cost.
+	/// @return a handle passed to FinishTask or nullptr if the task was already executed.
+	virtual void* EnqueueTask(b2TaskCallback* task, int32 itemCount, int32 minRange, void* taskContext) = 0;
+
+	/// Wait until all ranges of the task have been executed.
+	virtual void FinishTask(void* userTask) = 0;
+};
+
+/// Implement this class to get notified when a world uses more heap memory than its
+/// budget. See b2World::SetMemoryBudget.
+class B2_API b2MemoryListener
+{
+public:
+	virtual ~b2MemoryListener() {}
+
+	/// Called when an allocation takes the memory use over the budget. The allocation
+	/// still succeeds. This is called again only after the use drops to the budget and
+	/// goes over it again. It may be called from a task worker.
+	/// @param byteCount the bytes in use including the new allocation.
+	/// @param budget the budget in bytes.
+	virtual void OverBudget(int32 byteCount, int32 budget) = 0;
+};
+
 #endif
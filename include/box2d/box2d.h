@@ -26,7 +26,10 @@
 // These include files constitute the main Box2D API
 
 #include "b2_settings.h"
+#include "b2_allocator.h"
 #include "b2_draw.h"
+#include "b2_profiler.h"
+#include "b2_thread_pool.h"
 #include "b2_timer.h"
 
 #include "b2_chain_shape.h"
@@ -21,30 +21,40 @@
 // SOFTWARE.
 
 #include "box2d/b2_broad_phase.h"
+#include "common/b2_snapshot.h"
 #include <string.h>
 
-b2BroadPhase::b2BroadPhase()
+b2BroadPhase::b2BroadPhase(b2Allocator* allocator)
+	: m_allocator(allocator)
+	, m_trees{ b2DynamicTree(allocator), b2DynamicTree(allocator) }
 {
 	m_proxyCount = 0;
 
-	m_pairCapacity = 16;
-	m_pairCount = 0;
-	m_pairBuffer = (b2Pair*)b2Alloc(m_pairCapacity * sizeof(b2Pair));
-
 	m_moveCapacity = 16;
 	m_moveCount = 0;
-	m_moveBuffer = (int32*)b2Alloc(m_moveCapacity * sizeof(int32));
+	m_moveBuffer = (int32*)b2Alloc(m_allocator, m_moveCapacity * sizeof(int32));
+	m_moveResults = (MoveResult*)b2Alloc(m_allocator, m_moveCapacity * sizeof(MoveResult));
+
+	m_pairBuffers = nullptr;
+	m_pairBufferCount = 0;
+	m_pairsFound = false;
 }
 
 b2BroadPhase::~b2BroadPhase()
 {
-	b2Free(m_moveBuffer);
-	b2Free(m_pairBuffer);
+	for (int32 i = 0; i < m_pairBufferCount; ++i)
+	{
+		b2Free(m_allocator, m_pairBuffers[i].pairs, m_pairBuffers[i].capacity * sizeof(b2Pair));
+	}
+	b2Free(m_allocator, m_pairBuffers, m_pairBufferCount * sizeof(PairBuffer));
+	b2Free(m_allocator, m_moveResults, m_moveCapacity * sizeof(MoveResult));
+	b2Free(m_allocator, m_moveBuffer, m_moveCapacity * sizeof(int32));
 }
 
-int32 b2BroadPhase::CreateProxy(const b2AABB& aabb, void* userData)
+int32 b2BroadPhase::CreateProxy(const b2AABB& aabb, void* userData, bool isStatic)
 {
-	int32 proxyId = m_tree.CreateProxy(aabb, userData);
+	int32 treeType = isStatic ? e_staticTree : e_dynamicTree;
+	int32 proxyId = MakeProxyId(m_trees[treeType].CreateProxy(aabb, userData), treeType);
 	++m_proxyCount;
 	BufferMove(proxyId);
 	return proxyId;
@@ -54,12 +64,58 @@ void b2BroadPhase::DestroyProxy(int32 proxyId)
 {
 	UnBufferMove(proxyId);
 	--m_proxyCount;
-	m_tree.DestroyProxy(proxyId);
+	m_trees[GetTreeType(proxyId)].DestroyProxy(GetTreeProxyId(proxyId));
+}
+
+void b2BroadPhase::CreateProxies(const b2AABB* aabbs, void* const* userData, int32 count, bool isStatic, int32* proxyIds)
+{
+	int32 treeType = isStatic ? e_staticTree : e_dynamicTree;
+	m_trees[treeType].CreateProxies(aabbs, userData, count, proxyIds);
+	m_proxyCount += count;
+	for (int32 i = 0; i < count; ++i)
+	{
+		proxyIds[i] = MakeProxyId(proxyIds[i], treeType);
+		BufferMove(proxyIds[i]);
+	}
+}
+
+void b2BroadPhase::DestroyProxies(const int32* proxyIds, int32 count)
+{
+	// Split the proxies by tree. Static proxies go to the front, dynamic proxies to the back.
+	int32* treeProxyIds = (int32*)b2Alloc(m_allocator, count * sizeof(int32));
+	int32 staticCount = 0;
+	int32 dynamicIndex = count;
+	for (int32 i = 0; i < count; ++i)
+	{
+		if (IsStaticProxy(proxyIds[i]))
+		{
+			treeProxyIds[staticCount++] = GetTreeProxyId(proxyIds[i]);
+		}
+		else
+		{
+			treeProxyIds[--dynamicIndex] = GetTreeProxyId(proxyIds[i]);
+		}
+	}
+
+	m_trees[e_staticTree].DestroyProxies(treeProxyIds, staticCount);
+	m_trees[e_dynamicTree].DestroyProxies(treeProxyIds + staticCount, count - staticCount);
+	m_proxyCount -= count;
+	b2Free(m_allocator, treeProxyIds, count * sizeof(int32));
+
+	// Remove the destroyed proxies from the move buffer in one pass.
+	for (int32 i = 0; i < m_moveCount; ++i)
+	{
+		int32 proxyId = m_moveBuffer[i];
+		if (proxyId != e_nullProxy && m_trees[GetTreeType(proxyId)].IsProxy(GetTreeProxyId(proxyId)) == false)
+		{
+			m_moveBuffer[i] = e_nullProxy;
+		}
+	}
 }
 
 void b2BroadPhase::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement)
 {
-	bool buffer = m_tree.MoveProxy(proxyId, aabb, displacement);
+	bool buffer = m_trees[GetTreeType(proxyId)].MoveProxy(GetTreeProxyId(proxyId), aabb, displacement);
 	if (buffer)
 	{
 		BufferMove(proxyId);
@@ -77,9 +133,14 @@ void b2BroadPhase::BufferMove(int32 proxyId)
 	{
 		int32* oldBuffer = m_moveBuffer;
 		m_moveCapacity *= 2;
-		m_moveBuffer = (int32*)b2Alloc(m_moveCapacity * sizeof(int32));
+		m_moveBuffer = (int32*)b2Alloc(m_allocator, m_moveCapacity * sizeof(int32));
 		memcpy(m_moveBuffer, oldBuffer, m_moveCount * sizeof(int32));
-		b2Free(oldBuffer);
+		b2Free(m_allocator, oldBuffer, m_moveCount * sizeof(int32));
+
+		// The results are only valid while finding pairs.
+		b2Assert(m_pairsFound == false);
+		b2Free(m_allocator, m_moveResults, m_moveCount * sizeof(MoveResult));
+		m_moveResults = (MoveResult*)b2Alloc(m_allocator, m_moveCapacity * sizeof(MoveResult));
 	}
 
 	m_moveBuffer[m_moveCount] = proxyId;
@@ -97,35 +158,208 @@ void b2BroadPhase::UnBufferMove(int32 proxyId)
 	}
 }
 
+void b2BroadPhase::BeginFindPairs(int32 workerCount)
+{
+	b2Assert(workerCount > 0);
+
+	// Static proxies are inserted one by one. Rebuild the parts of the
+	// static tree that changed since the last update.
+	m_trees[e_staticTree].Rebuild(false);
+
+	if (workerCount > m_pairBufferCount)
+	{
+		PairBuffer* oldBuffers = m_pairBuffers;
+		m_pairBuffers = (PairBuffer*)b2Alloc(m_allocator, workerCount * sizeof(PairBuffer));
+		if (oldBuffers != nullptr)
+		{
+			memcpy(m_pairBuffers, oldBuffers, m_pairBufferCount * sizeof(PairBuffer));
+			b2Free(m_allocator, oldBuffers, m_pairBufferCount * sizeof(PairBuffer));
+		}
+
+		for (int32 i = m_pairBufferCount; i < workerCount; ++i)
+		{
+			m_pairBuffers[i].capacity = 16;
+			m_pairBuffers[i].pairs = (b2Pair*)b2Alloc(m_allocator, m_pairBuffers[i].capacity * sizeof(b2Pair));
+		}
+
+		m_pairBufferCount = workerCount;
+	}
+
+	for (int32 i = 0; i < workerCount; ++i)
+	{
+		m_pairBuffers[i].broadPhase = this;
+		m_pairBuffers[i].count = 0;
+	}
+
+	m_pairsFound = true;
+}
+
+void b2BroadPhase::FindPairs(int32 startIndex, int32 endIndex, int32 workerIndex)
+{
+	b2Assert(m_pairsFound);
+	b2Assert(0 <= workerIndex && workerIndex < m_pairBufferCount);
+
+	PairBuffer* buffer = m_pairBuffers + workerIndex;
+
+	// Perform tree queries for all moving proxies.
+	for (int32 i = startIndex; i < endIndex; ++i)
+	{
+		MoveResult* result = m_moveResults + i;
+		result->workerIndex = workerIndex;
+		result->pairIndex = buffer->count;
+
+		int32 proxyId = m_moveBuffer[i];
+		if (proxyId != e_nullProxy)
+		{
+			// We have to query the tree with the fat AABB so that
+			// we don't fail to create a pair that may touch later.
+			const b2AABB& fatAABB = GetFatAABB(proxyId);
+
+			// Query tree, create pairs and add them pair buffer.
+			buffer->queryProxyId = proxyId;
+			buffer->queryTreeType = e_dynamicTree;
+			m_trees[e_dynamicTree].Query(buffer, fatAABB);
+
+			// Static proxies don't pair with each other.
+			if (GetTreeType(proxyId) == e_dynamicTree)
+			{
+				buffer->queryTreeType = e_staticTree;
+				m_trees[e_staticTree].Query(buffer, fatAABB);
+			}
+		}
+
+		result->pairCount = buffer->count - result->pairIndex;
+	}
+}
+
 // This is called from b2DynamicTree::Query when we are gathering pairs.
-bool b2BroadPhase::QueryCallback(int32 proxyId)
+bool b2BroadPhase::PairBuffer::QueryCallback(int32 treeProxyId)
 {
+	int32 proxyId = MakeProxyId(treeProxyId, queryTreeType);
+
 	// A proxy cannot form a pair with itself.
-	if (proxyId == m_queryProxyId)
+	if (proxyId == queryProxyId)
 	{
 		return true;
 	}
 
-	const bool moved = m_tree.WasMoved(proxyId);
-	if (moved && proxyId > m_queryProxyId)
+	const bool moved = broadPhase->m_trees[queryTreeType].WasMoved(treeProxyId);
+	if (moved)
 	{
-		// Both proxies are moving. Avoid duplicate pairs.
-		return true;
+		if (queryTreeType == e_staticTree)
+		{
+			// The static proxy queries the dynamic tree itself. Avoid duplicate pairs.
+			return true;
+		}
+
+		if (GetTreeType(queryProxyId) == e_dynamicTree && proxyId > queryProxyId)
+		{
+			// Both proxies are moving. Avoid duplicate pairs.
+			return true;
+		}
 	}
 
 	// Grow the pair buffer as needed.
-	if (m_pairCount == m_pairCapacity)
+	if (count == capacity)
 	{
-		b2Pair* oldBuffer = m_pairBuffer;
-		m_pairCapacity = m_pairCapacity + (m_pairCapacity >> 1);
-		m_pairBuffer = (b2Pair*)b2Alloc(m_pairCapacity * sizeof(b2Pair));
-		memcpy(m_pairBuffer, oldBuffer, m_pairCount * sizeof(b2Pair));
-		b2Free(oldBuffer);
+		b2Pair* oldBuffer = pairs;
+		capacity = capacity + (capacity >> 1);
+		pairs = (b2Pair*)b2Alloc(broadPhase->m_allocator, capacity * sizeof(b2Pair));
+		memcpy(pairs, oldBuffer, count * sizeof(b2Pair));
+		b2Free(broadPhase->m_allocator, oldBuffer, count * sizeof(b2Pair));
 	}
 
-	m_pairBuffer[m_pairCount].proxyIdA = b2Min(proxyId, m_queryProxyId);
-	m_pairBuffer[m_pairCount].proxyIdB = b2Max(proxyId, m_queryProxyId);
-	++m_pairCount;
+	pairs[count].proxyIdA = b2Min(proxyId, queryProxyId);
+	pairs[count].proxyIdB = b2Max(proxyId, queryProxyId);
+	++count;
 
 	return true;
 }
+
+int32 b2BroadPhase::GetTreeByteCount() const
+{
+	return m_trees[e_dynamicTree].GetByteCount() + m_trees[e_staticTree].GetByteCount();
+}
+
+int32 b2BroadPhase::GetBufferByteCount() const
+{
+	int32 byteCount = m_moveCapacity * (sizeof(int32) + sizeof(MoveResult));
+	byteCount += m_pairBufferCount * sizeof(PairBuffer);
+	for (int32 i = 0; i < m_pairBufferCount; ++i)
+	{
+		byteCount += m_pairBuffers[i].capacity * sizeof(b2Pair);
+	}
+	return byteCount;
+}
+
+void b2BroadPhase::WriteSnapshot(b2SnapshotWriter* writer) const
+{
+	b2Assert(m_pairsFound == false);
+
+	m_trees[e_dynamicTree].WriteSnapshot(writer);
+	m_trees[e_staticTree].WriteSnapshot(writer);
+
+	writer->Write(m_proxyCount);
+	writer->Write(m_moveCount);
+	writer->Write(m_moveBuffer, m_moveCount * sizeof(int32));
+}
+
+void b2BroadPhase::ReadSnapshot(b2SnapshotReader* reader)
+{
+	b2Assert(m_pairsFound == false);
+
+	m_trees[e_dynamicTree].ReadSnapshot(reader);
+	m_trees[e_staticTree].ReadSnapshot(reader);
+
+	m_proxyCount = reader->Read<int32>();
+
+	int32 moveCount = reader->ReadCount(sizeof(int32));
+	if (moveCount > m_moveCapacity)
+	{
+		b2Free(m_allocator, m_moveBuffer, m_moveCapacity * sizeof(int32));
+		b2Free(m_allocator, m_moveResults, m_moveCapacity * sizeof(MoveResult));
+		m_moveCapacity = moveCount;
+		m_moveBuffer = (int32*)b2Alloc(m_allocator, m_moveCapacity * sizeof(int32));
+		m_moveResults = (MoveResult*)b2Alloc(m_allocator, m_moveCapacity * sizeof(MoveResult));
+	}
+
+	m_moveCount = moveCount;
+	reader->Read(m_moveBuffer, m_moveCount * sizeof(int32));
+
+	for (int32 i = 0; i < m_moveCount; ++i)
+	{
+		int32 proxyId = m_moveBuffer[i];
+		if (proxyId != e_nullProxy && IsProxy(proxyId) == false)
+		{
+			reader->Invalidate();
+			m_moveCount = 0;
+			break;
+		}
+	}
+}
+
+void b2BroadPhase::Reset()
+{
+	b2Assert(m_pairsFound == false);
+
+	m_trees[e_dynamicTree].Reset();
+	m_trees[e_staticTree].Reset();
+	m_proxyCount = 0;
+	m_moveCount = 0;
+}
+
+void b2BroadPhase::WriteStaticTree(b2SnapshotWriter* writer) const
+{
+	m_trees[e_staticTree].WriteLevel(writer);
+}
+
+void b2BroadPhase::ReferenceStaticTree(b2SnapshotReader* reader)
+{
+	b2DynamicTree* tree = m_trees + e_staticTree;
+	b2Assert(tree->GetNodeCount() == 0);
+	tree->ReferenceLevel(reader);
+
+	// Every internal node has two children.
+	int32 nodeCount = tree->GetNodeCount();
+	m_proxyCount += nodeCount > 0 ? (nodeCount + 1) / 2 : 0;
+}
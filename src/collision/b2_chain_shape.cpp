@@ -35,9 +35,13 @@ b2ChainShape::~b2ChainShape()
 
 void b2ChainShape::Clear()
 {
-	b2Free(m_vertices);
+	if (m_ownsVertices)
+	{
+		b2Free(m_vertices);
+	}
 	m_vertices = nullptr;
 	m_count = 0;
+	m_ownsVertices = true;
 }
 
 void b2ChainShape::CreateLoop(const b2Vec2* vertices, int32 count)
@@ -83,11 +87,32 @@ void b2ChainShape::CreateChain(const b2Vec2* vertices, int32 count,	const b2Vec2
 	m_nextVertex = nextVertex;
 }
 
+void b2ChainShape::CreateChainReference(const b2Vec2* vertices, int32 count, const b2Vec2& prevVertex, const b2Vec2& nextVertex)
+{
+	b2Assert(m_vertices == nullptr && m_count == 0);
+	b2Assert(count >= 2);
+
+	// The vertices are never written through this pointer.
+	m_vertices = const_cast<b2Vec2*>(vertices);
+	m_count = count;
+	m_ownsVertices = false;
+
+	m_prevVertex = prevVertex;
+	m_nextVertex = nextVertex;
+}
+
 b2Shape* b2ChainShape::Clone(b2BlockAllocator* allocator) const
 {
 	void* mem = allocator->Allocate(sizeof(b2ChainShape));
 	b2ChainShape* clone = new (mem) b2ChainShape;
-	clone->CreateChain(m_vertices, m_count, m_prevVertex, m_nextVertex);
+	if (m_ownsVertices)
+	{
+		clone->CreateChain(m_vertices, m_count, m_prevVertex, m_nextVertex);
+	}
+	else
+	{
+		clone->CreateChainReference(m_vertices, m_count, m_prevVertex, m_nextVertex);
+	}
 	return clone;
 }
 
@@ -27,7 +27,8 @@
 void b2CollideCircles(
 	b2Manifold* manifold,
 	const b2CircleShape* circleA, const b2Transform& xfA,
-	const b2CircleShape* circleB, const b2Transform& xfB)
+	const b2CircleShape* circleB, const b2Transform& xfB,
+	float speculativeDistance)
 {
 	manifold->pointCount = 0;
 
@@ -37,7 +38,7 @@ void b2CollideCircles(
 	b2Vec2 d = pB - pA;
 	float distSqr = b2Dot(d, d);
 	float rA = circleA->m_radius, rB = circleB->m_radius;
-	float radius = rA + rB;
+	float radius = rA + rB + speculativeDistance;
 	if (distSqr > radius * radius)
 	{
 		return;
@@ -55,7 +56,8 @@ void b2CollideCircles(
 void b2CollidePolygonAndCircle(
 	b2Manifold* manifold,
 	const b2PolygonShape* polygonA, const b2Transform& xfA,
-	const b2CircleShape* circleB, const b2Transform& xfB)
+	const b2CircleShape* circleB, const b2Transform& xfB,
+	float speculativeDistance)
 {
 	manifold->pointCount = 0;
 
@@ -66,7 +68,7 @@ void b2CollidePolygonAndCircle(
 	// Find the min separating edge.
 	int32 normalIndex = 0;
 	float separation = -b2_maxFloat;
-	float radius = polygonA->m_radius + circleB->m_radius;
+	float radius = polygonA->m_radius + circleB->m_radius + speculativeDistance;
 	int32 vertexCount = polygonA->m_count;
 	const b2Vec2* vertices = polygonA->m_vertices;
 	const b2Vec2* normals = polygonA->m_normals;
@@ -30,7 +30,8 @@
 // This accounts for edge connectivity.
 void b2CollideEdgeAndCircle(b2Manifold* manifold,
 							const b2EdgeShape* edgeA, const b2Transform& xfA,
-							const b2CircleShape* circleB, const b2Transform& xfB)
+							const b2CircleShape* circleB, const b2Transform& xfB,
+							float speculativeDistance)
 {
 	manifold->pointCount = 0;
 	
@@ -54,7 +55,7 @@ void b2CollideEdgeAndCircle(b2Manifold* manifold,
 	float u = b2Dot(e, B - Q);
 	float v = b2Dot(e, Q - A);
 	
-	float radius = edgeA->m_radius + circleB->m_radius;
+	float radius = edgeA->m_radius + circleB->m_radius + speculativeDistance;
 	
 	b2ContactFeature cf;
 	cf.indexB = 0;
@@ -268,7 +269,8 @@ static b2EPAxis b2ComputePolygonSeparation(const b2TempPolygon& polygonB, const
 
 void b2CollideEdgeAndPolygon(b2Manifold* manifold,
 							const b2EdgeShape* edgeA, const b2Transform& xfA,
-							const b2PolygonShape* polygonB, const b2Transform& xfB)
+							const b2PolygonShape* polygonB, const b2Transform& xfB,
+							float speculativeDistance)
 {
 	manifold->pointCount = 0;
 
@@ -302,15 +304,16 @@ void b2CollideEdgeAndPolygon(b2Manifold* manifold,
 	}
 
 	float radius = polygonB->m_radius + edgeA->m_radius;
+	float maxSeparation = radius + speculativeDistance;
 
 	b2EPAxis edgeAxis = b2ComputeEdgeSeparation(tempPolygonB, v1, normal1);
-	if (edgeAxis.separation > radius)
+	if (edgeAxis.separation > maxSeparation)
 	{
 		return;
 	}
 
 	b2EPAxis polygonAxis = b2ComputePolygonSeparation(tempPolygonB, v1, v2);
-	if (polygonAxis.separation > radius)
+	if (polygonAxis.separation > maxSeparation)
 	{
 		return;
 	}
@@ -498,7 +501,7 @@ void b2CollideEdgeAndPolygon(b2Manifold* manifold,
 
 		separation = b2Dot(ref.normal, clipPoints2[i].v - ref.v1);
 
-		if (separation <= radius)
+		if (separation <= maxSeparation)
 		{
 			b2ManifoldPoint* cp = manifold->points + pointCount;
 
@@ -20,6 +20,8 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include "common/b2_counters.h"
+
 #include "box2d/b2_circle_shape.h"
 #include "box2d/b2_distance.h"
 #include "box2d/b2_edge_shape.h"
@@ -29,6 +31,8 @@
 // GJK using Voronoi regions (Christer Ericson) and Barycentric coordinates.
 B2_API int32 b2_gjkCalls, b2_gjkIters, b2_gjkMaxIters;
 
+thread_local bool b2_collisionCountersEnabled = true;
+
 void b2DistanceProxy::Set(const b2Shape* shape, int32 index)
 {
 	switch (shape->GetType())
@@ -455,8 +459,6 @@ void b2Distance(b2DistanceOutput* output,
 				b2SimplexCache* cache,
 				const b2DistanceInput* input)
 {
-	++b2_gjkCalls;
-
 	const b2DistanceProxy* proxyA = &input->proxyA;
 	const b2DistanceProxy* proxyB = &input->proxyB;
 
@@ -536,7 +538,6 @@ void b2Distance(b2DistanceOutput* output,
 
 		// Iteration count is equated to the number of support point calls.
 		++iter;
-		++b2_gjkIters;
 
 		// Check for duplicate support points. This is the main termination criteria.
 		bool duplicate = false;
@@ -559,7 +560,12 @@ void b2Distance(b2DistanceOutput* output,
 		++simplex.m_count;
 	}
 
-	b2_gjkMaxIters = b2Max(b2_gjkMaxIters, iter);
+	if (b2_collisionCountersEnabled)
+	{
+		++b2_gjkCalls;
+		b2_gjkIters += iter;
+		b2_gjkMaxIters = b2Max(b2_gjkMaxIters, iter);
+	}
 
 	// Prepare output.
 	simplex.GetWitnessPoints(&output->pointA, &output->pointB);
@@ -20,15 +20,18 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 #include "box2d/b2_dynamic_tree.h"
+#include "common/b2_simd.h"
+#include "common/b2_snapshot.h"
 #include <string.h>
 
-b2DynamicTree::b2DynamicTree()
+b2DynamicTree::b2DynamicTree(b2Allocator* allocator)
 {
+	m_allocator = allocator;
 	m_root = b2_nullNode;
 
 	m_nodeCapacity = 16;
 	m_nodeCount = 0;
-	m_nodes = (b2TreeNode*)b2Alloc(m_nodeCapacity * sizeof(b2TreeNode));
+	m_nodes = (b2TreeNode*)b2Alloc(m_allocator, m_nodeCapacity * sizeof(b2TreeNode));
 	memset(m_nodes, 0, m_nodeCapacity * sizeof(b2TreeNode));
 
 	// Build a linked list for the free list.
@@ -42,12 +45,22 @@ b2DynamicTree::b2DynamicTree()
 	m_freeList = 0;
 
 	m_insertionCount = 0;
+	m_externalNodes = false;
+
+	m_wideNodes = nullptr;
+	m_wideNodeCount = 0;
+	m_wideNodeCapacity = 0;
+	m_wideValid = false;
 }
 
 b2DynamicTree::~b2DynamicTree()
 {
 	// This frees the entire tree in one shot.
-	b2Free(m_nodes);
+	if (m_externalNodes == false)
+	{
+		b2Free(m_allocator, m_nodes, m_nodeCapacity * sizeof(b2TreeNode));
+	}
+	b2Free(m_allocator, m_wideNodes, m_wideNodeCapacity * sizeof(b2WideTreeNode));
 }
 
 // Allocate a node from the pool. Grow the pool if necessary.
@@ -61,9 +74,13 @@ int32 b2DynamicTree::AllocateNode()
 		// The free list is empty. Rebuild a bigger pool.
 		b2TreeNode* oldNodes = m_nodes;
 		m_nodeCapacity *= 2;
-		m_nodes = (b2TreeNode*)b2Alloc(m_nodeCapacity * sizeof(b2TreeNode));
+		m_nodes = (b2TreeNode*)b2Alloc(m_allocator, m_nodeCapacity * sizeof(b2TreeNode));
 		memcpy(m_nodes, oldNodes, m_nodeCount * sizeof(b2TreeNode));
-		b2Free(oldNodes);
+		if (m_externalNodes == false)
+		{
+			b2Free(m_allocator, oldNodes, m_nodeCount * sizeof(b2TreeNode));
+		}
+		m_externalNodes = false;
 
 		// Build a linked list for the free list. The parent
 		// pointer becomes the "next" pointer.
@@ -86,6 +103,7 @@ int32 b2DynamicTree::AllocateNode()
 	m_nodes[nodeId].height = 0;
 	m_nodes[nodeId].userData = nullptr;
 	m_nodes[nodeId].moved = false;
+	m_nodes[nodeId].changed = false;
 	++m_nodeCount;
 	return nodeId;
 }
@@ -130,6 +148,70 @@ void b2DynamicTree::DestroyProxy(int32 proxyId)
 	FreeNode(proxyId);
 }
 
+void b2DynamicTree::CreateProxies(const b2AABB* aabbs, void* const* userData, int32 count, int32* proxyIds)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	int32 leafCount = (m_nodeCount + 1) / 2;
+
+	b2Vec2 r(b2_aabbExtension, b2_aabbExtension);
+	for (int32 i = 0; i < count; ++i)
+	{
+		int32 proxyId = AllocateNode();
+		m_nodes[proxyId].aabb.lowerBound = aabbs[i].lowerBound - r;
+		m_nodes[proxyId].aabb.upperBound = aabbs[i].upperBound + r;
+		m_nodes[proxyId].userData = userData[i];
+		m_nodes[proxyId].height = 0;
+		m_nodes[proxyId].moved = true;
+		proxyIds[i] = proxyId;
+	}
+
+	// A few proxies are cheaper to insert incrementally.
+	if (4 * count < leafCount)
+	{
+		for (int32 i = 0; i < count; ++i)
+		{
+			InsertLeaf(proxyIds[i]);
+		}
+		return;
+	}
+
+	// The new leaves are not in the tree yet, so the rebuild picks them up.
+	Rebuild(true);
+}
+
+void b2DynamicTree::DestroyProxies(const int32* proxyIds, int32 count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	int32 leafCount = (m_nodeCount + 1) / 2;
+
+	if (4 * count < leafCount)
+	{
+		for (int32 i = 0; i < count; ++i)
+		{
+			DestroyProxy(proxyIds[i]);
+		}
+		return;
+	}
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		int32 proxyId = proxyIds[i];
+		b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+		b2Assert(m_nodes[proxyId].IsLeaf());
+		FreeNode(proxyId);
+	}
+
+	Rebuild(true);
+}
+
 bool b2DynamicTree::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement)
 {
 	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
@@ -197,6 +279,9 @@ bool b2DynamicTree::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& d
 void b2DynamicTree::InsertLeaf(int32 leaf)
 {
 	++m_insertionCount;
+	m_wideValid = false;
+
+	m_nodes[leaf].changed = true;
 
 	if (m_root == b2_nullNode)
 	{
@@ -327,6 +412,7 @@ void b2DynamicTree::InsertLeaf(int32 leaf)
 
 		m_nodes[index].height = 1 + b2Max(m_nodes[child1].height, m_nodes[child2].height);
 		m_nodes[index].aabb.Combine(m_nodes[child1].aabb, m_nodes[child2].aabb);
+		m_nodes[index].changed = true;
 
 		index = m_nodes[index].parent;
 	}
@@ -336,6 +422,8 @@ void b2DynamicTree::InsertLeaf(int32 leaf)
 
 void b2DynamicTree::RemoveLeaf(int32 leaf)
 {
+	m_wideValid = false;
+
 	if (leaf == m_root)
 	{
 		m_root = b2_nullNode;
@@ -714,9 +802,18 @@ int32 b2DynamicTree::GetMaxBalance() const
 	return maxBalance;
 }
 
+int32 b2DynamicTree::GetByteCount() const
+{
+	int32 nodeBytes = m_externalNodes ? 0 : m_nodeCapacity * sizeof(b2TreeNode);
+	return nodeBytes + m_wideNodeCapacity * sizeof(b2WideTreeNode);
+}
+
 void b2DynamicTree::RebuildBottomUp()
 {
-	int32* nodes = (int32*)b2Alloc(m_nodeCount * sizeof(int32));
+	m_wideValid = false;
+
+	int32 nodeBytes = m_nodeCount * sizeof(int32);
+	int32* nodes = (int32*)b2Alloc(m_allocator, nodeBytes);
 	int32 count = 0;
 
 	// Build array of leaves. Free the rest.
@@ -785,11 +882,313 @@ void b2DynamicTree::RebuildBottomUp()
 	}
 
 	m_root = nodes[0];
-	b2Free(nodes);
+	b2Free(m_allocator, nodes, nodeBytes);
 
 	Validate();
 }
 
+void b2DynamicTree::Rebuild(bool fullBuild)
+{
+	if (m_root == b2_nullNode && fullBuild == false)
+	{
+		return;
+	}
+
+	if (fullBuild == false && m_nodes[m_root].changed == false)
+	{
+		return;
+	}
+
+	m_wideValid = false;
+
+	int32 leafBytes = m_nodeCount * sizeof(int32);
+	int32* leaves = (int32*)b2Alloc(m_allocator, leafBytes);
+	int32 count = 0;
+
+	if (fullBuild)
+	{
+		// Build array of leaves. Free the rest. This also picks up leaves that
+		// are not in the tree yet.
+		for (int32 i = 0; i < m_nodeCapacity; ++i)
+		{
+			if (m_nodes[i].height < 0)
+			{
+				// free node in pool
+				continue;
+			}
+
+			if (m_nodes[i].IsLeaf())
+			{
+				m_nodes[i].changed = false;
+				leaves[count] = i;
+				++count;
+			}
+			else
+			{
+				FreeNode(i);
+			}
+		}
+	}
+	else
+	{
+		// Unchanged subtrees are kept and treated like leaves.
+		b2GrowableStack<int32, 256> stack;
+		stack.Push(m_root);
+		while (stack.GetCount() > 0)
+		{
+			int32 nodeId = stack.Pop();
+			b2TreeNode* node = m_nodes + nodeId;
+			if (node->IsLeaf() || node->changed == false)
+			{
+				node->changed = false;
+				leaves[count] = nodeId;
+				++count;
+				continue;
+			}
+
+			stack.Push(node->child1);
+			stack.Push(node->child2);
+			FreeNode(nodeId);
+		}
+	}
+
+	m_root = count > 0 ? BuildTree(leaves, count) : b2_nullNode;
+	b2Free(m_allocator, leaves, leafBytes);
+}
+
+enum
+{
+	b2_treeBinCount = 16
+};
+
+struct b2TreeBin
+{
+	b2AABB aabb;
+	int32 count;
+};
+
+struct b2TreeBuildItem
+{
+	int32 parent;
+	int32 start;
+	int32 end;
+	bool isChild1;
+};
+
+// The subtrees are split by a binned surface area heuristic along the longest axis of
+// their centers. The build uses an explicit stack because SAH splits may be uneven.
+int32 b2DynamicTree::BuildTree(int32* leaves, int32 count)
+{
+	b2Vec2* centers = (b2Vec2*)b2Alloc(m_allocator, count * sizeof(b2Vec2));
+	for (int32 i = 0; i < count; ++i)
+	{
+		centers[i] = m_nodes[leaves[i]].aabb.GetCenter();
+	}
+
+	// Internal nodes in creation order. Children are created after their parent.
+	int32 internalBytes = b2Max(count - 1, 1) * sizeof(int32);
+	int32* internalNodes = (int32*)b2Alloc(m_allocator, internalBytes);
+	int32 internalCount = 0;
+
+	int32 root = b2_nullNode;
+
+	b2GrowableStack<b2TreeBuildItem, 64> stack;
+	b2TreeBuildItem rootItem;
+	rootItem.parent = b2_nullNode;
+	rootItem.start = 0;
+	rootItem.end = count;
+	rootItem.isChild1 = true;
+	stack.Push(rootItem);
+
+	while (stack.GetCount() > 0)
+	{
+		b2TreeBuildItem item = stack.Pop();
+		int32 itemCount = item.end - item.start;
+
+		int32 nodeId;
+		if (itemCount == 1)
+		{
+			nodeId = leaves[item.start];
+		}
+		else
+		{
+			nodeId = AllocateNode();
+			internalNodes[internalCount++] = nodeId;
+
+			b2AABB aabb;
+			int32 split = PartitionSAH(leaves + item.start, centers + item.start, itemCount, &aabb);
+			m_nodes[nodeId].aabb = aabb;
+
+			b2TreeBuildItem child;
+			child.parent = nodeId;
+			child.start = item.start + split;
+			child.end = item.end;
+			child.isChild1 = false;
+			stack.Push(child);
+
+			child.start = item.start;
+			child.end = item.start + split;
+			child.isChild1 = true;
+			stack.Push(child);
+		}
+
+		m_nodes[nodeId].parent = item.parent;
+		if (item.parent == b2_nullNode)
+		{
+			root = nodeId;
+		}
+		else if (item.isChild1)
+		{
+			m_nodes[item.parent].child1 = nodeId;
+		}
+		else
+		{
+			m_nodes[item.parent].child2 = nodeId;
+		}
+	}
+
+	b2Assert(internalCount == count - 1);
+
+	// Compute the heights bottom up.
+	for (int32 i = internalCount - 1; i >= 0; --i)
+	{
+		b2TreeNode* node = m_nodes + internalNodes[i];
+		node->height = 1 + b2Max(m_nodes[node->child1].height, m_nodes[node->child2].height);
+	}
+
+	b2Free(m_allocator, internalNodes, internalBytes);
+	b2Free(m_allocator, centers, count * sizeof(b2Vec2));
+
+	return root;
+}
+
+// Partition the subtrees in place and return the number of subtrees on the left side.
+// Also computes the bounding box of all the subtrees.
+int32 b2DynamicTree::PartitionSAH(int32* leaves, b2Vec2* centers, int32 count, b2AABB* aabb)
+{
+	b2Assert(count > 1);
+
+	b2AABB bounds = m_nodes[leaves[0]].aabb;
+	b2Vec2 lower = centers[0];
+	b2Vec2 upper = centers[0];
+	for (int32 i = 1; i < count; ++i)
+	{
+		bounds.Combine(m_nodes[leaves[i]].aabb);
+		lower = b2Min(lower, centers[i]);
+		upper = b2Max(upper, centers[i]);
+	}
+
+	*aabb = bounds;
+
+	if (count == 2)
+	{
+		return 1;
+	}
+
+	b2Vec2 extent = upper - lower;
+	int32 axis = extent.x >= extent.y ? 0 : 1;
+	if (extent(axis) <= 0.0f)
+	{
+		// All centers are the same.
+		return count / 2;
+	}
+
+	b2TreeBin bins[b2_treeBinCount];
+	for (int32 i = 0; i < b2_treeBinCount; ++i)
+	{
+		bins[i].count = 0;
+	}
+
+	float binScale = b2_treeBinCount / extent(axis);
+	float binLower = lower(axis);
+	for (int32 i = 0; i < count; ++i)
+	{
+		int32 binIndex = b2Min(int32(binScale * (centers[i](axis) - binLower)), b2_treeBinCount - 1);
+		b2TreeBin* bin = bins + binIndex;
+		const b2AABB& leafAABB = m_nodes[leaves[i]].aabb;
+		if (bin->count == 0)
+		{
+			bin->aabb = leafAABB;
+		}
+		else
+		{
+			bin->aabb.Combine(leafAABB);
+		}
+		++bin->count;
+	}
+
+	// Sweep from the right to get the cost of the right side of each plane.
+	// Plane i separates bins [0, i] from bins [i + 1, b2_treeBinCount).
+	// The first and last bins hold the lowest and highest centers, so they are not
+	// empty and each sweep starts with the bounds of its end bin.
+	b2Assert(bins[0].count > 0 && bins[b2_treeBinCount - 1].count > 0);
+
+	float rightCosts[b2_treeBinCount];
+	b2AABB rightAABB = bins[b2_treeBinCount - 1].aabb;
+	int32 rightCount = 0;
+	for (int32 i = b2_treeBinCount - 1; i > 0; --i)
+	{
+		const b2TreeBin* bin = bins + i;
+		if (bin->count > 0)
+		{
+			rightAABB.Combine(bin->aabb);
+			rightCount += bin->count;
+		}
+
+		rightCosts[i - 1] = rightCount * rightAABB.GetPerimeter();
+	}
+
+	// Sweep from the left and pick the cheapest plane that has subtrees on both sides.
+	float bestCost = b2_maxFloat;
+	int32 bestPlane = -1;
+	b2AABB leftAABB = bins[0].aabb;
+	int32 leftCount = 0;
+	for (int32 i = 0; i < b2_treeBinCount - 1; ++i)
+	{
+		const b2TreeBin* bin = bins + i;
+		if (bin->count > 0)
+		{
+			leftAABB.Combine(bin->aabb);
+			leftCount += bin->count;
+		}
+
+		if (leftCount == count)
+		{
+			continue;
+		}
+
+		float cost = leftCount * leftAABB.GetPerimeter() + rightCosts[i];
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestPlane = i;
+		}
+	}
+
+	b2Assert(bestPlane != -1);
+
+	// Move the subtrees left of the plane to the front.
+	int32 i = 0;
+	int32 j = count - 1;
+	while (i <= j)
+	{
+		int32 binIndex = b2Min(int32(binScale * (centers[i](axis) - binLower)), b2_treeBinCount - 1);
+		if (binIndex <= bestPlane)
+		{
+			++i;
+		}
+		else
+		{
+			b2Swap(centers[i], centers[j]);
+			b2Swap(leaves[i], leaves[j]);
+			--j;
+		}
+	}
+
+	b2Assert(0 < i && i < count);
+	return i;
+}
+
 void b2DynamicTree::ShiftOrigin(const b2Vec2& newOrigin)
 {
 	// Build array of leaves. Free the rest.
@@ -798,4 +1197,666 @@ void b2DynamicTree::ShiftOrigin(const b2Vec2& newOrigin)
 		m_nodes[i].aabb.lowerBound -= newOrigin;
 		m_nodes[i].aabb.upperBound -= newOrigin;
 	}
+
+	// Shift the wide tree too so that it stays valid.
+	for (int32 i = 0; i < m_wideNodeCount; ++i)
+	{
+		b2WideTreeNode* node = m_wideNodes + i;
+		for (int32 j = 0; j < 4; ++j)
+		{
+			if (node->children[j] == b2_nullNode)
+			{
+				continue;
+			}
+
+			node->lowerX[j] -= newOrigin.x;
+			node->lowerY[j] -= newOrigin.y;
+			node->upperX[j] -= newOrigin.x;
+			node->upperY[j] -= newOrigin.y;
+		}
+	}
+}
+
+struct b2WideBuildItem
+{
+	int32 nodeId;
+	int32 wideIndex;
+};
+
+void b2DynamicTree::WriteSnapshot(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_nodeCapacity);
+	writer->Write(m_nodeCount);
+	writer->Write(m_root);
+	writer->Write(m_freeList);
+	writer->Write(m_insertionCount);
+	writer->Write(uint8(m_wideValid));
+
+	// Free nodes are written too so that the free list is kept.
+	for (int32 i = 0; i < m_nodeCapacity; ++i)
+	{
+		const b2TreeNode* node = m_nodes + i;
+		writer->Write(node->aabb);
+		writer->Write(node->parent);
+		writer->Write(node->child1);
+		writer->Write(node->child2);
+		writer->Write(node->height);
+		writer->Write(uint8(node->moved));
+		writer->Write(uint8(node->changed));
+	}
+}
+
+void b2DynamicTree::ReadSnapshot(b2SnapshotReader* reader)
+{
+	// The bytes written per node bound the capacity by the size of the data.
+	const int32 nodeSize = int32(sizeof(b2AABB) + 4 * sizeof(int32) + 2 * sizeof(uint8));
+	int32 nodeCapacity = reader->ReadCount(nodeSize);
+	if (nodeCapacity == 0)
+	{
+		reader->Invalidate();
+		return;
+	}
+
+	if (nodeCapacity != m_nodeCapacity || m_externalNodes)
+	{
+		if (m_externalNodes == false)
+		{
+			b2Free(m_allocator, m_nodes, m_nodeCapacity * sizeof(b2TreeNode));
+		}
+		m_nodeCapacity = nodeCapacity;
+		m_nodes = (b2TreeNode*)b2Alloc(m_allocator, m_nodeCapacity * sizeof(b2TreeNode));
+		m_externalNodes = false;
+	}
+
+	m_nodeCount = reader->Read<int32>();
+	m_root = reader->Read<int32>();
+	m_freeList = reader->Read<int32>();
+	m_insertionCount = reader->Read<int32>();
+	bool wideValid = reader->Read<uint8>() != 0;
+
+	for (int32 i = 0; i < m_nodeCapacity; ++i)
+	{
+		b2TreeNode* node = m_nodes + i;
+		reader->Read(&node->aabb);
+		reader->Read(&node->parent);
+		reader->Read(&node->child1);
+		reader->Read(&node->child2);
+		reader->Read(&node->height);
+		node->moved = reader->Read<uint8>() != 0;
+		node->changed = reader->Read<uint8>() != 0;
+		node->userData = nullptr;
+	}
+
+	// The wide tree is a function of the nodes, so it is rebuilt rather than stored.
+	ClearWideTree();
+	if (wideValid)
+	{
+		BuildWideTree();
+	}
+}
+
+void b2DynamicTree::Reset()
+{
+	if (m_externalNodes)
+	{
+		m_nodeCapacity = 16;
+		m_nodes = (b2TreeNode*)b2Alloc(m_allocator, m_nodeCapacity * sizeof(b2TreeNode));
+		m_externalNodes = false;
+	}
+
+	m_root = b2_nullNode;
+	m_nodeCount = 0;
+	memset(m_nodes, 0, m_nodeCapacity * sizeof(b2TreeNode));
+
+	// Build a linked list for the free list.
+	for (int32 i = 0; i < m_nodeCapacity - 1; ++i)
+	{
+		m_nodes[i].next = i + 1;
+		m_nodes[i].height = -1;
+	}
+	m_nodes[m_nodeCapacity-1].next = b2_nullNode;
+	m_nodes[m_nodeCapacity-1].height = -1;
+	m_freeList = 0;
+
+	m_insertionCount = 0;
+	ClearWideTree();
+}
+
+void b2DynamicTree::WriteLevel(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_nodeCapacity);
+	writer->Write(m_nodeCount);
+	writer->Write(m_root);
+	writer->Write(m_freeList);
+	writer->Write(m_insertionCount);
+
+	// The nodes are written as they are laid out in memory so that they can be used
+	// in place. The padding is zeroed so that the output is deterministic.
+	writer->Align(16);
+	for (int32 i = 0; i < m_nodeCapacity; ++i)
+	{
+		const b2TreeNode* source = m_nodes + i;
+		b2TreeNode node;
+		memset(&node, 0, sizeof(b2TreeNode));
+		node.aabb = source->aabb;
+		node.userData = nullptr;
+		node.parent = source->parent;
+		node.child1 = source->child1;
+		node.child2 = source->child2;
+		node.height = source->height;
+		node.moved = source->moved;
+		node.changed = source->changed;
+		writer->Write(&node, sizeof(b2TreeNode));
+	}
+}
+
+void b2DynamicTree::ReferenceLevel(b2SnapshotReader* reader)
+{
+	b2Assert(m_nodeCount == 0);
+
+	int32 nodeCapacity = reader->Read<int32>();
+	int32 nodeCount = reader->Read<int32>();
+	int32 root = reader->Read<int32>();
+	int32 freeList = reader->Read<int32>();
+	int32 insertionCount = reader->Read<int32>();
+
+	reader->Align(16);
+	const void* nodes = reader->Reference(nodeCapacity * sizeof(b2TreeNode));
+	if (nodes == nullptr || nodeCapacity <= 0)
+	{
+		return;
+	}
+
+	b2Assert(((uintptr_t)nodes & (alignof(b2TreeNode) - 1)) == 0);
+
+	if (m_externalNodes == false)
+	{
+		b2Free(m_allocator, m_nodes, m_nodeCapacity * sizeof(b2TreeNode));
+	}
+
+	// The level data is writable, see b2World::LoadLevel.
+	m_nodes = (b2TreeNode*)const_cast<void*>(nodes);
+	m_nodeCapacity = nodeCapacity;
+	m_nodeCount = nodeCount;
+	m_root = root;
+	m_freeList = freeList;
+	m_insertionCount = insertionCount;
+	m_externalNodes = true;
+
+	ClearWideTree();
+}
+
+void b2DynamicTree::BuildWideTree()
+{
+	if (m_wideValid || m_root == b2_nullNode)
+	{
+		return;
+	}
+
+	// Every wide node comes from a different internal node, or from a leaf root.
+	if (m_wideNodeCapacity < m_nodeCount)
+	{
+		b2Free(m_allocator, m_wideNodes, m_wideNodeCapacity * sizeof(b2WideTreeNode));
+		m_wideNodeCapacity = m_nodeCount;
+		m_wideNodes = (b2WideTreeNode*)b2Alloc(m_allocator, m_wideNodeCapacity * sizeof(b2WideTreeNode));
+	}
+
+	b2GrowableStack<b2WideBuildItem, 256> stack;
+	b2WideBuildItem rootItem;
+	rootItem.nodeId = m_root;
+	rootItem.wideIndex = 0;
+	stack.Push(rootItem);
+	m_wideNodeCount = 1;
+
+	while (stack.GetCount() > 0)
+	{
+		b2WideBuildItem item = stack.Pop();
+
+		// Collapse the binary subtree. Open the largest internal child until there are
+		// four children, so that big nodes are tested together with their siblings.
+		int32 slots[4];
+		int32 slotCount;
+		const b2TreeNode* node = m_nodes + item.nodeId;
+		if (node->IsLeaf())
+		{
+			slots[0] = item.nodeId;
+			slotCount = 1;
+		}
+		else
+		{
+			slots[0] = node->child1;
+			slots[1] = node->child2;
+			slotCount = 2;
+		}
+
+		while (slotCount < 4)
+		{
+			int32 best = -1;
+			float bestArea = -1.0f;
+			for (int32 i = 0; i < slotCount; ++i)
+			{
+				const b2TreeNode* child = m_nodes + slots[i];
+				if (child->IsLeaf() == false && child->aabb.GetPerimeter() > bestArea)
+				{
+					best = i;
+					bestArea = child->aabb.GetPerimeter();
+				}
+			}
+
+			if (best == -1)
+			{
+				break;
+			}
+
+			const b2TreeNode* child = m_nodes + slots[best];
+			slots[best] = child->child1;
+			slots[slotCount] = child->child2;
+			++slotCount;
+		}
+
+		b2WideTreeNode* wideNode = m_wideNodes + item.wideIndex;
+		wideNode->leafMask = 0;
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if (i == slotCount)
+			{
+				for (; i < 4; ++i)
+				{
+					wideNode->lowerX[i] = b2_maxFloat;
+					wideNode->lowerY[i] = b2_maxFloat;
+					wideNode->upperX[i] = -b2_maxFloat;
+					wideNode->upperY[i] = -b2_maxFloat;
+					wideNode->children[i] = b2_nullNode;
+				}
+				break;
+			}
+
+			const b2TreeNode* child = m_nodes + slots[i];
+			wideNode->lowerX[i] = child->aabb.lowerBound.x;
+			wideNode->lowerY[i] = child->aabb.lowerBound.y;
+			wideNode->upperX[i] = child->aabb.upperBound.x;
+			wideNode->upperY[i] = child->aabb.upperBound.y;
+
+			if (child->IsLeaf())
+			{
+				wideNode->children[i] = slots[i];
+				wideNode->leafMask |= 1 << i;
+			}
+			else
+			{
+				b2Assert(m_wideNodeCount < m_wideNodeCapacity);
+				b2WideBuildItem childItem;
+				childItem.nodeId = slots[i];
+				childItem.wideIndex = m_wideNodeCount++;
+				wideNode->children[i] = childItem.wideIndex;
+				stack.Push(childItem);
+			}
+		}
+	}
+
+	m_wideValid = true;
+}
+
+void b2DynamicTree::ClearWideTree()
+{
+	b2Free(m_allocator, m_wideNodes, m_wideNodeCapacity * sizeof(b2WideTreeNode));
+	m_wideNodes = nullptr;
+	m_wideNodeCount = 0;
+	m_wideNodeCapacity = 0;
+	m_wideValid = false;
+}
+
+void b2DynamicTree::QueryWide(QueryFcn* fcn, void* context, const b2AABB& aabb) const
+{
+	b2Float4 lowerX = b2Splat4(aabb.lowerBound.x);
+	b2Float4 lowerY = b2Splat4(aabb.lowerBound.y);
+	b2Float4 upperX = b2Splat4(aabb.upperBound.x);
+	b2Float4 upperY = b2Splat4(aabb.upperBound.y);
+
+	b2GrowableStack<int32, 256> stack;
+	stack.Push(0);
+
+	while (stack.GetCount() > 0)
+	{
+		const b2WideTreeNode* node = m_wideNodes + stack.Pop();
+
+		// Same test as b2TestOverlap for all four children.
+		b2Float4 overlapX = b2And4(b2GreaterEqual4(upperX, b2Load4(node->lowerX)), b2GreaterEqual4(b2Load4(node->upperX), lowerX));
+		b2Float4 overlapY = b2And4(b2GreaterEqual4(upperY, b2Load4(node->lowerY)), b2GreaterEqual4(b2Load4(node->upperY), lowerY));
+		int32 mask = b2MoveMask4(b2And4(overlapX, overlapY));
+
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if ((mask & (1 << i)) == 0)
+			{
+				continue;
+			}
+
+			if (node->leafMask & (1 << i))
+			{
+				bool proceed = fcn(context, node->children[i]);
+				if (proceed == false)
+				{
+					return;
+				}
+			}
+			else
+			{
+				stack.Push(node->children[i]);
+			}
+		}
+	}
+}
+
+void b2DynamicTree::RayCastWide(RayCastFcn* fcn, void* context, const b2RayCastInput& input) const
+{
+	b2Vec2 p1 = input.p1;
+	b2Vec2 p2 = input.p2;
+	b2Vec2 r = p2 - p1;
+	b2Assert(r.LengthSquared() > 0.0f);
+	r.Normalize();
+
+	// v is perpendicular to the segment.
+	b2Vec2 v = b2Cross(1.0f, r);
+	b2Vec2 abs_v = b2Abs(v);
+
+	b2Float4 p1X = b2Splat4(p1.x);
+	b2Float4 p1Y = b2Splat4(p1.y);
+	b2Float4 vX = b2Splat4(v.x);
+	b2Float4 vY = b2Splat4(v.y);
+	b2Float4 absVX = b2Splat4(abs_v.x);
+	b2Float4 absVY = b2Splat4(abs_v.y);
+	b2Float4 half = b2Splat4(0.5f);
+
+	float maxFraction = input.maxFraction;
+
+	// Build a bounding box for the segment.
+	b2Vec2 t = p1 + maxFraction * (p2 - p1);
+	b2Float4 segmentLowerX = b2Splat4(b2Min(p1.x, t.x));
+	b2Float4 segmentLowerY = b2Splat4(b2Min(p1.y, t.y));
+	b2Float4 segmentUpperX = b2Splat4(b2Max(p1.x, t.x));
+	b2Float4 segmentUpperY = b2Splat4(b2Max(p1.y, t.y));
+
+	b2GrowableStack<int32, 256> stack;
+	stack.Push(0);
+
+	while (stack.GetCount() > 0)
+	{
+		const b2WideTreeNode* node = m_wideNodes + stack.Pop();
+
+		b2Float4 lowerX = b2Load4(node->lowerX);
+		b2Float4 lowerY = b2Load4(node->lowerY);
+		b2Float4 upperX = b2Load4(node->upperX);
+		b2Float4 upperY = b2Load4(node->upperY);
+
+		b2Float4 overlapX = b2And4(b2GreaterEqual4(segmentUpperX, lowerX), b2GreaterEqual4(upperX, segmentLowerX));
+		b2Float4 overlapY = b2And4(b2GreaterEqual4(segmentUpperY, lowerY), b2GreaterEqual4(upperY, segmentLowerY));
+
+		// Separating axis for segment (Gino, p80).
+		// |dot(v, p1 - c)| > dot(|v|, h)
+		b2Float4 cX = b2Mul4(half, b2Add4(lowerX, upperX));
+		b2Float4 cY = b2Mul4(half, b2Add4(lowerY, upperY));
+		b2Float4 hX = b2Mul4(half, b2Sub4(upperX, lowerX));
+		b2Float4 hY = b2Mul4(half, b2Sub4(upperY, lowerY));
+		b2Float4 distance = b2Abs4(b2Add4(b2Mul4(vX, b2Sub4(p1X, cX)), b2Mul4(vY, b2Sub4(p1Y, cY))));
+		b2Float4 radius = b2Add4(b2Mul4(absVX, hX), b2Mul4(absVY, hY));
+		b2Float4 hit = b2And4(b2And4(overlapX, overlapY), b2GreaterEqual4(radius, distance));
+		int32 mask = b2MoveMask4(hit);
+		bool clipped = false;
+
+		// Visit the internal children near the ray origin first so the ray is clipped early.
+		int32 internalCount = 0;
+		int32 internal[4];
+		float distances[4];
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if ((mask & (1 << i)) == 0 || (node->leafMask & (1 << i)) != 0)
+			{
+				continue;
+			}
+
+			b2Vec2 c(0.5f * (node->lowerX[i] + node->upperX[i]), 0.5f * (node->lowerY[i] + node->upperY[i]));
+			float distance = b2Dot(r, c - p1);
+
+			// Insertion sort by decreasing distance because the stack pops the last child first.
+			int32 j = internalCount;
+			while (j > 0 && distances[j - 1] < distance)
+			{
+				internal[j] = internal[j - 1];
+				distances[j] = distances[j - 1];
+				--j;
+			}
+			internal[j] = node->children[i];
+			distances[j] = distance;
+			++internalCount;
+		}
+
+		for (int32 i = 0; i < internalCount; ++i)
+		{
+			stack.Push(internal[i]);
+		}
+
+		mask &= node->leafMask;
+		for (int32 i = 0; i < 4; ++i)
+		{
+			if ((mask & (1 << i)) == 0)
+			{
+				continue;
+			}
+
+			// A sibling may have shortened the ray after the mask was computed.
+			if (clipped)
+			{
+				b2Vec2 lower = b2Min(p1, t);
+				b2Vec2 upper = b2Max(p1, t);
+				if (node->lowerX[i] > upper.x || node->lowerY[i] > upper.y ||
+					lower.x > node->upperX[i] || lower.y > node->upperY[i])
+				{
+					continue;
+				}
+			}
+
+			b2RayCastInput subInput;
+			subInput.p1 = input.p1;
+			subInput.p2 = input.p2;
+			subInput.maxFraction = maxFraction;
+
+			float value = fcn(context, subInput, node->children[i]);
+
+			if (value == 0.0f)
+			{
+				// The client has terminated the ray cast.
+				return;
+			}
+
+			if (value > 0.0f)
+			{
+				// Update segment bounding box.
+				maxFraction = value;
+				t = p1 + maxFraction * (p2 - p1);
+				clipped = true;
+				segmentLowerX = b2Splat4(b2Min(p1.x, t.x));
+				segmentLowerY = b2Splat4(b2Min(p1.y, t.y));
+				segmentUpperX = b2Splat4(b2Max(p1.x, t.x));
+				segmentUpperY = b2Splat4(b2Max(p1.y, t.y));
+			}
+		}
+	}
+}
+
+void b2DynamicTree::RayCastPacket(RayCastPacketFcn* fcn, void* context, b2RayCastInput* inputs, int32 count) const
+{
+	b2Assert(0 < count && count <= b2_rayPacketSize);
+
+	if (m_root == b2_nullNode)
+	{
+		return;
+	}
+
+	// Per ray data by component. Unused lanes have inverted bounds and never hit.
+	float p1X[4], p1Y[4], vX[4], vY[4], absVX[4], absVY[4];
+	float lowerX[4], lowerY[4], upperX[4], upperY[4];
+	int32 activeMask = 0;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (i >= count || inputs[i].maxFraction == 0.0f)
+		{
+			p1X[i] = 0.0f;
+			p1Y[i] = 0.0f;
+			vX[i] = 0.0f;
+			vY[i] = 0.0f;
+			absVX[i] = 0.0f;
+			absVY[i] = 0.0f;
+			lowerX[i] = b2_maxFloat;
+			lowerY[i] = b2_maxFloat;
+			upperX[i] = -b2_maxFloat;
+			upperY[i] = -b2_maxFloat;
+			continue;
+		}
+
+		const b2RayCastInput& input = inputs[i];
+		b2Vec2 r = input.p2 - input.p1;
+		b2Assert(r.LengthSquared() > 0.0f);
+		r.Normalize();
+
+		// v is perpendicular to the segment.
+		b2Vec2 v = b2Cross(1.0f, r);
+		p1X[i] = input.p1.x;
+		p1Y[i] = input.p1.y;
+		vX[i] = v.x;
+		vY[i] = v.y;
+		absVX[i] = b2Abs(v.x);
+		absVY[i] = b2Abs(v.y);
+
+		b2Vec2 t = input.p1 + input.maxFraction * (input.p2 - input.p1);
+		lowerX[i] = b2Min(input.p1.x, t.x);
+		lowerY[i] = b2Min(input.p1.y, t.y);
+		upperX[i] = b2Max(input.p1.x, t.x);
+		upperY[i] = b2Max(input.p1.y, t.y);
+
+		activeMask |= 1 << i;
+	}
+
+	if (activeMask == 0)
+	{
+		return;
+	}
+
+	// Children are visited near to far along the first active ray. This
+	// clips the rays early when they point in similar directions.
+	int32 leadRay = 0;
+	while ((activeMask & (1 << leadRay)) == 0)
+	{
+		++leadRay;
+	}
+	b2Vec2 leadOrigin = inputs[leadRay].p1;
+	b2Vec2 leadDirection = inputs[leadRay].p2 - inputs[leadRay].p1;
+
+	b2Float4 rayP1X = b2Load4(p1X);
+	b2Float4 rayP1Y = b2Load4(p1Y);
+	b2Float4 rayVX = b2Load4(vX);
+	b2Float4 rayVY = b2Load4(vY);
+	b2Float4 rayAbsVX = b2Load4(absVX);
+	b2Float4 rayAbsVY = b2Load4(absVY);
+	b2Float4 segmentLowerX = b2Load4(lowerX);
+	b2Float4 segmentLowerY = b2Load4(lowerY);
+	b2Float4 segmentUpperX = b2Load4(upperX);
+	b2Float4 segmentUpperY = b2Load4(upperY);
+
+	b2GrowableStack<int32, 256> stack;
+	stack.Push(m_root);
+
+	while (stack.GetCount() > 0)
+	{
+		int32 nodeId = stack.Pop();
+		const b2TreeNode* node = m_nodes + nodeId;
+
+		// The same tests as RayCast, one ray per lane.
+		b2Float4 nodeLowerX = b2Splat4(node->aabb.lowerBound.x);
+		b2Float4 nodeLowerY = b2Splat4(node->aabb.lowerBound.y);
+		b2Float4 nodeUpperX = b2Splat4(node->aabb.upperBound.x);
+		b2Float4 nodeUpperY = b2Splat4(node->aabb.upperBound.y);
+		b2Float4 overlapX = b2And4(b2GreaterEqual4(segmentUpperX, nodeLowerX), b2GreaterEqual4(nodeUpperX, segmentLowerX));
+		b2Float4 overlapY = b2And4(b2GreaterEqual4(segmentUpperY, nodeLowerY), b2GreaterEqual4(nodeUpperY, segmentLowerY));
+
+		b2Vec2 c = node->aabb.GetCenter();
+		b2Vec2 h = node->aabb.GetExtents();
+		b2Float4 cX = b2Splat4(c.x);
+		b2Float4 cY = b2Splat4(c.y);
+		b2Float4 distance = b2Abs4(b2Add4(b2Mul4(rayVX, b2Sub4(rayP1X, cX)), b2Mul4(rayVY, b2Sub4(rayP1Y, cY))));
+		b2Float4 radius = b2Add4(b2Mul4(rayAbsVX, b2Splat4(h.x)), b2Mul4(rayAbsVY, b2Splat4(h.y)));
+		b2Float4 hit = b2And4(b2And4(overlapX, overlapY), b2GreaterEqual4(radius, distance));
+		int32 mask = b2MoveMask4(hit) & activeMask;
+
+		if (mask == 0)
+		{
+			continue;
+		}
+
+		if (node->IsLeaf() == false)
+		{
+			// The stack pops the last child first.
+			b2Vec2 c1 = m_nodes[node->child1].aabb.GetCenter();
+			b2Vec2 c2 = m_nodes[node->child2].aabb.GetCenter();
+			if (b2Dot(leadDirection, c1 - leadOrigin) < b2Dot(leadDirection, c2 - leadOrigin))
+			{
+				stack.Push(node->child2);
+				stack.Push(node->child1);
+			}
+			else
+			{
+				stack.Push(node->child1);
+				stack.Push(node->child2);
+			}
+			continue;
+		}
+
+		bool clipped = false;
+		for (int32 i = 0; i < count; ++i)
+		{
+			if ((mask & (1 << i)) == 0)
+			{
+				continue;
+			}
+
+			b2RayCastInput* input = inputs + i;
+			float value = fcn(context, *input, nodeId, i);
+
+			if (value == 0.0f)
+			{
+				// The client has terminated this ray.
+				input->maxFraction = 0.0f;
+				activeMask &= ~(1 << i);
+				lowerX[i] = b2_maxFloat;
+				lowerY[i] = b2_maxFloat;
+				upperX[i] = -b2_maxFloat;
+				upperY[i] = -b2_maxFloat;
+				clipped = true;
+			}
+			else if (value > 0.0f)
+			{
+				// Update segment bounding box.
+				input->maxFraction = value;
+				b2Vec2 t = input->p1 + value * (input->p2 - input->p1);
+				lowerX[i] = b2Min(input->p1.x, t.x);
+				lowerY[i] = b2Min(input->p1.y, t.y);
+				upperX[i] = b2Max(input->p1.x, t.x);
+				upperY[i] = b2Max(input->p1.y, t.y);
+				clipped = true;
+			}
+		}
+
+		if (activeMask == 0)
+		{
+			return;
+		}
+
+		if (clipped)
+		{
+			segmentLowerX = b2Load4(lowerX);
+			segmentLowerY = b2Load4(lowerY);
+			segmentUpperX = b2Load4(upperX);
+			segmentUpperY = b2Load4(upperY);
+		}
+	}
 }
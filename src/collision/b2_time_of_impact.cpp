@@ -20,6 +20,8 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include "common/b2_counters.h"
+
 #include "box2d/b2_collision.h"
 #include "box2d/b2_distance.h"
 #include "box2d/b2_circle_shape.h"
@@ -259,10 +261,10 @@ void b2TimeOfImpact(b2TOIOutput* output, const b2TOIInput* input)
 {
 	b2Timer timer;
 
-	++b2_toiCalls;
-
 	output->state = b2TOIOutput::e_unknown;
 	output->t = input->tMax;
+	output->iterations = 0;
+	output->distanceIterations = 0;
 
 	const b2DistanceProxy* proxyA = &input->proxyA;
 	const b2DistanceProxy* proxyB = &input->proxyB;
@@ -285,6 +287,8 @@ void b2TimeOfImpact(b2TOIOutput* output, const b2TOIInput* input)
 	float t1 = 0.0f;
 	const int32 k_maxIterations = 20;	// TODO_ERIN b2Settings
 	int32 iter = 0;
+	int32 rootIters = 0;
+	int32 maxRootIters = 0;
 
 	// Prepare input for distance query.
 	b2SimplexCache cache;
@@ -308,6 +312,7 @@ void b2TimeOfImpact(b2TOIOutput* output, const b2TOIInput* input)
 		distanceInput.transformB = xfB;
 		b2DistanceOutput distanceOutput;
 		b2Distance(&distanceOutput, &cache, &distanceInput);
+		output->distanceIterations += distanceOutput.iterations;
 
 		// If the shapes are overlapped, we give up on continuous collision.
 		if (distanceOutput.distance <= 0.0f)
@@ -426,7 +431,6 @@ void b2TimeOfImpact(b2TOIOutput* output, const b2TOIInput* input)
 				}
 
 				++rootIterCount;
-				++b2_toiRootIters;
 
 				float s = fcn.Evaluate(indexA, indexB, t);
 
@@ -455,7 +459,8 @@ void b2TimeOfImpact(b2TOIOutput* output, const b2TOIInput* input)
 				}
 			}
 
-			b2_toiMaxRootIters = b2Max(b2_toiMaxRootIters, rootIterCount);
+			rootIters += rootIterCount;
+			maxRootIters = b2Max(maxRootIters, rootIterCount);
 
 			++pushBackIter;
 
@@ -466,7 +471,6 @@ void b2TimeOfImpact(b2TOIOutput* output, const b2TOIInput* input)
 		}
 
 		++iter;
-		++b2_toiIters;
 
 		if (done)
 		{
@@ -482,9 +486,18 @@ void b2TimeOfImpact(b2TOIOutput* output, const b2TOIInput* input)
 		}
 	}
 
-	b2_toiMaxIters = b2Max(b2_toiMaxIters, iter);
+	output->iterations = iter;
 
-	float time = timer.GetMilliseconds();
-	b2_toiMaxTime = b2Max(b2_toiMaxTime, time);
-	b2_toiTime += time;
+	if (b2_collisionCountersEnabled)
+	{
+		++b2_toiCalls;
+		b2_toiIters += iter;
+		b2_toiMaxIters = b2Max(b2_toiMaxIters, iter);
+		b2_toiRootIters += rootIters;
+		b2_toiMaxRootIters = b2Max(b2_toiMaxRootIters, maxRootIters);
+
+		float time = timer.GetMilliseconds();
+		b2_toiMaxTime = b2Max(b2_toiMaxTime, time);
+		b2_toiTime += time;
+	}
 }
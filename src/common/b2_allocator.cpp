@@ -0,0 +1,110 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "box2d/b2_allocator.h"
+#include "box2d/b2_world_callbacks.h"
+
+#include <atomic>
+#include <new>
+
+struct b2AllocatorCounters
+{
+	std::atomic<int32> byteCount;
+	std::atomic<int32> peakByteCount;
+};
+
+b2TrackingAllocator::b2TrackingAllocator(b2Allocator* allocator)
+{
+	m_allocator = allocator;
+	m_counters = new (b2Alloc(m_allocator, sizeof(b2AllocatorCounters))) b2AllocatorCounters;
+	m_counters->byteCount = 0;
+	m_counters->peakByteCount = 0;
+	m_listener = nullptr;
+	m_budget = 0;
+}
+
+b2TrackingAllocator::~b2TrackingAllocator()
+{
+	m_counters->~b2AllocatorCounters();
+	b2Free(m_allocator, m_counters, sizeof(b2AllocatorCounters));
+}
+
+void* b2TrackingAllocator::Allocate(int32 size)
+{
+	int32 oldCount = m_counters->byteCount.fetch_add(size);
+	int32 newCount = oldCount + size;
+
+	int32 peak = m_counters->peakByteCount.load();
+	while (peak < newCount && m_counters->peakByteCount.compare_exchange_weak(peak, newCount) == false)
+	{
+	}
+
+	// Report when the budget is crossed rather than on every allocation over it.
+	if (m_budget > 0 && oldCount <= m_budget && m_budget < newCount && m_listener != nullptr)
+	{
+		m_listener->OverBudget(newCount, m_budget);
+	}
+
+	return b2Alloc(m_allocator, size);
+}
+
+void b2TrackingAllocator::Free(void* mem, int32 size)
+{
+	if (mem == nullptr)
+	{
+		return;
+	}
+
+	m_counters->byteCount.fetch_sub(size);
+	b2Free(m_allocator, mem, size);
+}
+
+void b2TrackingAllocator::SetBudget(int32 budget)
+{
+	b2Assert(budget >= 0);
+	m_budget = budget;
+}
+
+int32 b2TrackingAllocator::GetBudget() const
+{
+	return m_budget;
+}
+
+void b2TrackingAllocator::SetListener(b2MemoryListener* listener)
+{
+	m_listener = listener;
+}
+
+b2MemoryListener* b2TrackingAllocator::GetListener() const
+{
+	return m_listener;
+}
+
+int32 b2TrackingAllocator::GetByteCount() const
+{
+	return m_counters->byteCount.load();
+}
+
+int32 b2TrackingAllocator::GetPeakByteCount() const
+{
+	return m_counters->peakByteCount.load();
+}
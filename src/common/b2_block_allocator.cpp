@@ -86,26 +86,32 @@ struct b2Block
 	b2Block* next;
 };
 
-b2BlockAllocator::b2BlockAllocator()
+b2BlockAllocator::b2BlockAllocator(b2Allocator* allocator)
 {
 	b2Assert(b2_blockSizeCount < UCHAR_MAX);
 
+	m_allocator = allocator;
+
 	m_chunkSpace = b2_chunkArrayIncrement;
 	m_chunkCount = 0;
-	m_chunks = (b2Chunk*)b2Alloc(m_chunkSpace * sizeof(b2Chunk));
+	m_chunks = (b2Chunk*)b2Alloc(m_allocator, m_chunkSpace * sizeof(b2Chunk));
 	
 	memset(m_chunks, 0, m_chunkSpace * sizeof(b2Chunk));
 	memset(m_freeLists, 0, sizeof(m_freeLists));
+
+	memset(m_liveBlocks, 0, sizeof(m_liveBlocks));
+	m_liveBytes = 0;
+	m_peakBytes = 0;
 }
 
 b2BlockAllocator::~b2BlockAllocator()
 {
 	for (int32 i = 0; i < m_chunkCount; ++i)
 	{
-		b2Free(m_chunks[i].blocks);
+		b2Free(m_allocator, m_chunks[i].blocks, b2_chunkSize);
 	}
 
-	b2Free(m_chunks);
+	b2Free(m_allocator, m_chunks, m_chunkSpace * sizeof(b2Chunk));
 }
 
 void* b2BlockAllocator::Allocate(int32 size)
@@ -119,12 +125,20 @@ void* b2BlockAllocator::Allocate(int32 size)
 
 	if (size > b2_maxBlockSize)
 	{
-		return b2Alloc(size);
+		return b2Alloc(m_allocator, size);
 	}
 
 	int32 index = b2_sizeMap.values[size];
 	b2Assert(0 <= index && index < b2_blockSizeCount);
 
+	int32 blockSize = b2_blockSizes[index];
+	m_liveBlocks[index] += 1;
+	m_liveBytes += blockSize;
+	if (m_liveBytes > m_peakBytes)
+	{
+		m_peakBytes = m_liveBytes;
+	}
+
 	if (m_freeLists[index])
 	{
 		b2Block* block = m_freeLists[index];
@@ -136,19 +150,19 @@ void* b2BlockAllocator::Allocate(int32 size)
 		if (m_chunkCount == m_chunkSpace)
 		{
 			b2Chunk* oldChunks = m_chunks;
+			int32 oldSpace = m_chunkSpace;
 			m_chunkSpace += b2_chunkArrayIncrement;
-			m_chunks = (b2Chunk*)b2Alloc(m_chunkSpace * sizeof(b2Chunk));
+			m_chunks = (b2Chunk*)b2Alloc(m_allocator, m_chunkSpace * sizeof(b2Chunk));
 			memcpy(m_chunks, oldChunks, m_chunkCount * sizeof(b2Chunk));
 			memset(m_chunks + m_chunkCount, 0, b2_chunkArrayIncrement * sizeof(b2Chunk));
-			b2Free(oldChunks);
+			b2Free(m_allocator, oldChunks, oldSpace * sizeof(b2Chunk));
 		}
 
 		b2Chunk* chunk = m_chunks + m_chunkCount;
-		chunk->blocks = (b2Block*)b2Alloc(b2_chunkSize);
+		chunk->blocks = (b2Block*)b2Alloc(m_allocator, b2_chunkSize);
 #if defined(_DEBUG)
 		memset(chunk->blocks, 0xcd, b2_chunkSize);
 #endif
-		int32 blockSize = b2_blockSizes[index];
 		chunk->blockSize = blockSize;
 		int32 blockCount = b2_chunkSize / blockSize;
 		b2Assert(blockCount * blockSize <= b2_chunkSize);
@@ -179,16 +193,17 @@ void b2BlockAllocator::Free(void* p, int32 size)
 
 	if (size > b2_maxBlockSize)
 	{
-		b2Free(p);
+		b2Free(m_allocator, p, size);
 		return;
 	}
 
 	int32 index = b2_sizeMap.values[size];
 	b2Assert(0 <= index && index < b2_blockSizeCount);
 
+	int32 blockSize = b2_blockSizes[index];
+
 #if defined(_DEBUG)
 	// Verify the memory address and size is valid.
-	int32 blockSize = b2_blockSizes[index];
 	bool found = false;
 	for (int32 i = 0; i < m_chunkCount; ++i)
 	{
@@ -212,6 +227,9 @@ void b2BlockAllocator::Free(void* p, int32 size)
 	memset(p, 0xfd, blockSize);
 #endif
 
+	m_liveBlocks[index] -= 1;
+	m_liveBytes -= blockSize;
+
 	b2Block* block = (b2Block*)p;
 	block->next = m_freeLists[index];
 	m_freeLists[index] = block;
@@ -221,10 +239,28 @@ void b2BlockAllocator::Clear()
 {
 	for (int32 i = 0; i < m_chunkCount; ++i)
 	{
-		b2Free(m_chunks[i].blocks);
+		b2Free(m_allocator, m_chunks[i].blocks, b2_chunkSize);
 	}
 
 	m_chunkCount = 0;
 	memset(m_chunks, 0, m_chunkSpace * sizeof(b2Chunk));
 	memset(m_freeLists, 0, sizeof(m_freeLists));
+	memset(m_liveBlocks, 0, sizeof(m_liveBlocks));
+	m_liveBytes = 0;
+}
+
+b2BlockAllocatorStats b2BlockAllocator::GetStats() const
+{
+	b2BlockAllocatorStats stats;
+	memcpy(stats.liveBlocks, m_liveBlocks, sizeof(m_liveBlocks));
+	stats.chunkCount = m_chunkCount;
+	stats.liveBytes = m_liveBytes;
+	stats.peakBytes = m_peakBytes;
+	return stats;
+}
+
+int32 b2BlockAllocator::GetBlockSize(int32 sizeClass)
+{
+	b2Assert(0 <= sizeClass && sizeClass < b2_blockSizeCount);
+	return b2_blockSizes[sizeClass];
 }
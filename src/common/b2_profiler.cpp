@@ -0,0 +1,548 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "box2d/b2_math.h"
+#include "box2d/b2_profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#define b2_maxProfileDepth 32
+#define b2_maxProfileSamples 16
+
+// A zone. Accumulated zones have a count of calls, other zones have a count of zero.
+struct b2ProfileEvent
+{
+	const char* name;
+	unsigned long long start;
+	unsigned long long end;
+	int32 thread;
+	int32 count;
+};
+
+// An accumulated zone that is still open.
+struct b2ProfileAccumulator
+{
+	const char* name;
+	unsigned long long ticks;
+	int32 count;
+	int32 depth;
+};
+
+// The zones of one thread in the current frame. Only the owning thread writes
+// to this during a frame.
+struct b2ProfileThread
+{
+	std::thread::id id;
+	int32 index;
+
+	b2ProfileEvent* events;
+	int32 eventCount;
+	int32 eventCapacity;
+
+	int32 stack[b2_maxProfileDepth];
+	int32 depth;
+
+	b2ProfileAccumulator accumulators[b2_maxProfileSamples];
+	int32 accumulatorCount;
+};
+
+struct b2ProfileFrame
+{
+	unsigned long long start;
+	unsigned long long end;
+	int32 eventStart;
+	int32 eventCount;
+};
+
+struct b2ProfilerData
+{
+	// Identifies the profiler in the thread cache. Addresses may be reused.
+	uint32 serial;
+	unsigned long long origin;
+	unsigned long long frameStart;
+
+	std::mutex mutex;
+	b2ProfileThread** threads;
+	int32 threadCount;
+	int32 threadCapacity;
+
+	// The recorded frames and their events.
+	b2ProfileFrame* frames;
+	int32 frameCount;
+	int32 frameCapacity;
+	b2ProfileEvent* events;
+	int32 eventCount;
+	int32 eventCapacity;
+
+	int32 worstFrameCount;
+	int32 droppedFrameCount;
+};
+
+// The thread of the last profiler used by this thread.
+struct b2ProfileThreadCache
+{
+	uint32 serial;
+	b2ProfileThread* thread;
+};
+
+static std::atomic<uint32> s_profilerSerial(1);
+static thread_local b2ProfileThreadCache t_profileThread = { 0, nullptr };
+
+static b2ProfileThread* b2GetProfileThread(b2ProfilerData* data)
+{
+	b2ProfileThreadCache& cache = t_profileThread;
+	if (cache.serial == data->serial)
+	{
+		return cache.thread;
+	}
+
+	std::lock_guard<std::mutex> lock(data->mutex);
+
+	std::thread::id id = std::this_thread::get_id();
+	b2ProfileThread* thread = nullptr;
+	for (int32 i = 0; i < data->threadCount; ++i)
+	{
+		if (data->threads[i]->id == id)
+		{
+			thread = data->threads[i];
+			break;
+		}
+	}
+
+	if (thread == nullptr)
+	{
+		if (data->threadCount == data->threadCapacity)
+		{
+			b2ProfileThread** oldThreads = data->threads;
+			data->threadCapacity = b2Max(2 * data->threadCapacity, 8);
+			data->threads = (b2ProfileThread**)b2Alloc(data->threadCapacity * sizeof(b2ProfileThread*));
+			if (oldThreads != nullptr)
+			{
+				memcpy(data->threads, oldThreads, data->threadCount * sizeof(b2ProfileThread*));
+				b2Free(oldThreads);
+			}
+		}
+
+		void* mem = b2Alloc(sizeof(b2ProfileThread));
+		thread = new (mem) b2ProfileThread;
+		thread->id = id;
+		thread->index = data->threadCount;
+		thread->events = nullptr;
+		thread->eventCount = 0;
+		thread->eventCapacity = 0;
+		thread->depth = 0;
+		thread->accumulatorCount = 0;
+		data->threads[data->threadCount++] = thread;
+	}
+
+	cache.serial = data->serial;
+	cache.thread = thread;
+	return thread;
+}
+
+static b2ProfileEvent* b2AddProfileEvent(b2ProfileThread* thread)
+{
+	if (thread->eventCount == thread->eventCapacity)
+	{
+		b2ProfileEvent* oldEvents = thread->events;
+		thread->eventCapacity = b2Max(2 * thread->eventCapacity, 256);
+		thread->events = (b2ProfileEvent*)b2Alloc(thread->eventCapacity * sizeof(b2ProfileEvent));
+		if (oldEvents != nullptr)
+		{
+			memcpy(thread->events, oldEvents, thread->eventCount * sizeof(b2ProfileEvent));
+			b2Free(oldEvents);
+		}
+	}
+
+	b2ProfileEvent* event = thread->events + thread->eventCount++;
+	event->thread = thread->index;
+	event->count = 0;
+	return event;
+}
+
+b2Profiler::b2Profiler(int32 eventCapacity)
+{
+	b2Assert(eventCapacity > 0);
+
+	void* mem = b2Alloc(sizeof(b2ProfilerData));
+	m_data = new (mem) b2ProfilerData;
+	m_data->serial = s_profilerSerial.fetch_add(1);
+	m_data->origin = GetTicks();
+	m_data->frameStart = 0;
+	m_data->threads = nullptr;
+	m_data->threadCount = 0;
+	m_data->threadCapacity = 0;
+	m_data->frames = nullptr;
+	m_data->frameCount = 0;
+	m_data->frameCapacity = 0;
+	m_data->events = (b2ProfileEvent*)b2Alloc(eventCapacity * sizeof(b2ProfileEvent));
+	m_data->eventCount = 0;
+	m_data->eventCapacity = eventCapacity;
+	m_data->worstFrameCount = 0;
+	m_data->droppedFrameCount = 0;
+
+	m_enabled = false;
+	m_recording = false;
+}
+
+b2Profiler::~b2Profiler()
+{
+	for (int32 i = 0; i < m_data->threadCount; ++i)
+	{
+		b2ProfileThread* thread = m_data->threads[i];
+		b2Free(thread->events);
+		thread->~b2ProfileThread();
+		b2Free(thread);
+	}
+
+	b2Free(m_data->threads);
+	b2Free(m_data->frames);
+	b2Free(m_data->events);
+
+	m_data->~b2ProfilerData();
+	b2Free(m_data);
+}
+
+unsigned long long b2Profiler::GetTicks()
+{
+	std::chrono::nanoseconds ns = std::chrono::steady_clock::now().time_since_epoch();
+	return (unsigned long long)ns.count();
+}
+
+void b2Profiler::SetEnabled(bool flag)
+{
+	m_enabled = flag;
+}
+
+bool b2Profiler::IsEnabled() const
+{
+	return m_enabled;
+}
+
+void b2Profiler::SetWorstFrameCount(int32 count)
+{
+	b2Assert(count >= 0);
+	m_data->worstFrameCount = count;
+}
+
+int32 b2Profiler::GetWorstFrameCount() const
+{
+	return m_data->worstFrameCount;
+}
+
+void b2Profiler::Clear()
+{
+	m_data->frameCount = 0;
+	m_data->eventCount = 0;
+	m_data->droppedFrameCount = 0;
+}
+
+int32 b2Profiler::GetFrameCount() const
+{
+	return m_data->frameCount;
+}
+
+int32 b2Profiler::GetEventCount() const
+{
+	return m_data->eventCount;
+}
+
+int32 b2Profiler::GetDroppedFrameCount() const
+{
+	return m_data->droppedFrameCount;
+}
+
+float b2Profiler::GetFrameTime(int32 index) const
+{
+	b2Assert(0 <= index && index < m_data->frameCount);
+	const b2ProfileFrame* frame = m_data->frames + index;
+	return 0.000001f * float(frame->end - frame->start);
+}
+
+void b2Profiler::BeginFrame()
+{
+	b2Assert(m_recording == false);
+	m_recording = m_enabled;
+	m_data->frameStart = GetTicks();
+}
+
+// Remove a recorded frame and its events.
+static void b2RemoveProfileFrame(b2ProfilerData* data, int32 index)
+{
+	b2ProfileFrame* frame = data->frames + index;
+	int32 eventEnd = frame->eventStart + frame->eventCount;
+	memmove(data->events + frame->eventStart, data->events + eventEnd, (data->eventCount - eventEnd) * sizeof(b2ProfileEvent));
+	data->eventCount -= frame->eventCount;
+
+	for (int32 i = index + 1; i < data->frameCount; ++i)
+	{
+		data->frames[i].eventStart -= frame->eventCount;
+	}
+
+	memmove(data->frames + index, data->frames + index + 1, (data->frameCount - index - 1) * sizeof(b2ProfileFrame));
+	--data->frameCount;
+}
+
+void b2Profiler::EndFrame()
+{
+	if (m_recording == false)
+	{
+		return;
+	}
+
+	m_recording = false;
+
+	b2ProfilerData* data = m_data;
+	std::lock_guard<std::mutex> lock(data->mutex);
+
+	unsigned long long frameEnd = GetTicks();
+	unsigned long long duration = frameEnd - data->frameStart;
+
+	int32 eventCount = 0;
+	for (int32 i = 0; i < data->threadCount; ++i)
+	{
+		b2Assert(data->threads[i]->depth == 0);
+		eventCount += data->threads[i]->eventCount;
+	}
+
+	bool keep = true;
+	if (data->worstFrameCount > 0 && data->frameCount >= data->worstFrameCount)
+	{
+		// Replace the fastest frame if this one is slower.
+		int32 fastest = 0;
+		for (int32 i = 1; i < data->frameCount; ++i)
+		{
+			const b2ProfileFrame* frame = data->frames + i;
+			const b2ProfileFrame* best = data->frames + fastest;
+			if (frame->end - frame->start < best->end - best->start)
+			{
+				fastest = i;
+			}
+		}
+
+		const b2ProfileFrame* frame = data->frames + fastest;
+		if (frame->end - frame->start < duration)
+		{
+			b2RemoveProfileFrame(data, fastest);
+		}
+		else
+		{
+			keep = false;
+		}
+	}
+
+	if (keep && data->eventCount + eventCount > data->eventCapacity)
+	{
+		++data->droppedFrameCount;
+		keep = false;
+	}
+
+	if (keep)
+	{
+		if (data->frameCount == data->frameCapacity)
+		{
+			b2ProfileFrame* oldFrames = data->frames;
+			data->frameCapacity = b2Max(2 * data->frameCapacity, 16);
+			data->frames = (b2ProfileFrame*)b2Alloc(data->frameCapacity * sizeof(b2ProfileFrame));
+			if (oldFrames != nullptr)
+			{
+				memcpy(data->frames, oldFrames, data->frameCount * sizeof(b2ProfileFrame));
+				b2Free(oldFrames);
+			}
+		}
+
+		b2ProfileFrame* frame = data->frames + data->frameCount++;
+		frame->start = data->frameStart;
+		frame->end = frameEnd;
+		frame->eventStart = data->eventCount;
+		frame->eventCount = eventCount;
+
+		for (int32 i = 0; i < data->threadCount; ++i)
+		{
+			b2ProfileThread* thread = data->threads[i];
+			memcpy(data->events + data->eventCount, thread->events, thread->eventCount * sizeof(b2ProfileEvent));
+			data->eventCount += thread->eventCount;
+		}
+	}
+
+	for (int32 i = 0; i < data->threadCount; ++i)
+	{
+		data->threads[i]->eventCount = 0;
+	}
+}
+
+void b2Profiler::Begin(const char* name)
+{
+	b2ProfileThread* thread = b2GetProfileThread(m_data);
+	if (thread->depth < b2_maxProfileDepth)
+	{
+		thread->stack[thread->depth] = thread->eventCount;
+		b2ProfileEvent* event = b2AddProfileEvent(thread);
+		event->name = name;
+		event->start = GetTicks();
+		event->end = event->start;
+	}
+
+	++thread->depth;
+}
+
+void b2Profiler::End()
+{
+	unsigned long long ticks = GetTicks();
+
+	b2ProfileThread* thread = b2GetProfileThread(m_data);
+	b2Assert(thread->depth > 0);
+	--thread->depth;
+
+	if (thread->depth >= b2_maxProfileDepth)
+	{
+		return;
+	}
+
+	int32 index = thread->stack[thread->depth];
+	thread->events[index].end = ticks;
+	unsigned long long cursor = thread->events[index].start;
+
+	// Report the accumulated zones of this zone back to back from its start.
+	int32 childDepth = thread->depth + 1;
+	for (int32 i = 0; i < thread->accumulatorCount;)
+	{
+		b2ProfileAccumulator accumulator = thread->accumulators[i];
+		if (accumulator.depth != childDepth)
+		{
+			++i;
+			continue;
+		}
+
+		b2ProfileEvent* event = b2AddProfileEvent(thread);
+		event->name = accumulator.name;
+		event->start = cursor;
+		event->end = cursor + accumulator.ticks;
+		event->count = accumulator.count;
+		cursor = event->end;
+
+		thread->accumulators[i] = thread->accumulators[--thread->accumulatorCount];
+	}
+}
+
+void b2Profiler::Accumulate(const char* name, unsigned long long ticks)
+{
+	b2ProfileThread* thread = b2GetProfileThread(m_data);
+	if (thread->depth == 0 || thread->depth >= b2_maxProfileDepth)
+	{
+		return;
+	}
+
+	for (int32 i = 0; i < thread->accumulatorCount; ++i)
+	{
+		b2ProfileAccumulator* accumulator = thread->accumulators + i;
+		if (accumulator->name == name && accumulator->depth == thread->depth)
+		{
+			accumulator->ticks += ticks;
+			accumulator->count += 1;
+			return;
+		}
+	}
+
+	if (thread->accumulatorCount < b2_maxProfileSamples)
+	{
+		b2ProfileAccumulator* accumulator = thread->accumulators + thread->accumulatorCount++;
+		accumulator->name = name;
+		accumulator->ticks = ticks;
+		accumulator->count = 1;
+		accumulator->depth = thread->depth;
+	}
+}
+
+// Formats text into a buffer and counts the full length.
+struct b2TextWriter
+{
+	void Print(const char* format, ...)
+	{
+		va_list args;
+		va_start(args, format);
+		char* dest = size < capacity ? buffer + size : nullptr;
+		int32 room = size < capacity ? capacity - size : 0;
+		int32 length = vsnprintf(dest, size_t(room), format, args);
+		va_end(args);
+
+		if (length > 0)
+		{
+			size += length;
+		}
+	}
+
+	char* buffer;
+	int32 capacity;
+	int32 size;
+};
+
+int32 b2Profiler::ExportChromeTrace(char* buffer, int32 capacity) const
+{
+	const b2ProfilerData* data = m_data;
+
+	b2TextWriter writer;
+	writer.buffer = buffer;
+	writer.capacity = buffer != nullptr ? capacity : 0;
+	writer.size = 0;
+
+	writer.Print("{\"traceEvents\":[\n");
+
+	for (int32 i = 0; i < data->threadCount; ++i)
+	{
+		writer.Print("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"box2d thread %d\"}},\n", i, i);
+	}
+
+	for (int32 i = 0; i < data->frameCount; ++i)
+	{
+		const b2ProfileFrame* frame = data->frames + i;
+		for (int32 j = 0; j < frame->eventCount; ++j)
+		{
+			const b2ProfileEvent* event = data->events + frame->eventStart + j;
+			double ts = 0.001 * double(event->start - data->origin);
+			double dur = 0.001 * double(event->end - event->start);
+			if (event->count > 0)
+			{
+				writer.Print("{\"name\":\"%s\",\"cat\":\"box2d\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"count\":%d}},\n",
+							 event->name, event->thread, ts, dur, event->count);
+			}
+			else
+			{
+				writer.Print("{\"name\":\"%s\",\"cat\":\"box2d\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%d}},\n",
+							 event->name, event->thread, ts, dur, i);
+			}
+		}
+	}
+
+	// The process name also ends the list without a trailing comma.
+	writer.Print("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"box2d\"}}\n");
+	writer.Print("],\"displayTimeUnit\":\"ms\"}\n");
+
+	return writer.size;
+}
@@ -0,0 +1,415 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef B2_SIMD_H
+#define B2_SIMD_H
+
+#include "box2d/b2_math.h"
+#include "box2d/b2_settings.h"
+
+// Define B2_SIMD_NONE to force the scalar implementation.
+#if defined(B2_SIMD_NONE)
+	#define B2_SIMD_SCALAR
+#elif defined(__AVX2__)
+	#define B2_SIMD_AVX2
+	#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define B2_SIMD_SSE2
+	#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+	#define B2_SIMD_NEON
+	#include <arm_neon.h>
+#else
+	#define B2_SIMD_SCALAR
+#endif
+
+/// The number of lanes in b2FloatW.
+#if defined(B2_SIMD_AVX2)
+	#define b2_simdWidth 8
+#else
+	#define b2_simdWidth 4
+#endif
+
+// Wide float operations. Every operation matches the scalar operation
+// lane by lane, so the scalar implementation gives the same results.
+// Comparisons return a mask that is used by b2BlendW. Operations without a
+// wide argument take the wide type as a template argument.
+
+template <typename FloatW> FloatW b2ZeroW();
+template <typename FloatW> FloatW b2SplatW(float a);
+template <typename FloatW> FloatW b2LoadW(const float* a);
+
+/// The scalar implementation. It is always available, so the wide solver can
+/// check it against the SIMD implementation at run time. See g_wideSolverScalar.
+struct b2ScalarW
+{
+	float v[b2_simdWidth];
+};
+
+// Masks hold 1 for true and 0 for false.
+
+template <>
+inline b2ScalarW b2ZeroW<b2ScalarW>()
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = 0.0f;
+	}
+	return r;
+}
+
+template <>
+inline b2ScalarW b2SplatW<b2ScalarW>(float a)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = a;
+	}
+	return r;
+}
+
+template <>
+inline b2ScalarW b2LoadW<b2ScalarW>(const float* a)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = a[i];
+	}
+	return r;
+}
+
+inline void b2StoreW(float* a, b2ScalarW b)
+{
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		a[i] = b.v[i];
+	}
+}
+
+inline b2ScalarW b2AddW(b2ScalarW a, b2ScalarW b)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = a.v[i] + b.v[i];
+	}
+	return r;
+}
+
+inline b2ScalarW b2SubW(b2ScalarW a, b2ScalarW b)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = a.v[i] - b.v[i];
+	}
+	return r;
+}
+
+inline b2ScalarW b2MulW(b2ScalarW a, b2ScalarW b)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = a.v[i] * b.v[i];
+	}
+	return r;
+}
+
+inline b2ScalarW b2NegW(b2ScalarW a)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = -a.v[i];
+	}
+	return r;
+}
+
+inline b2ScalarW b2MinW(b2ScalarW a, b2ScalarW b)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+	}
+	return r;
+}
+
+inline b2ScalarW b2MaxW(b2ScalarW a, b2ScalarW b)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+	}
+	return r;
+}
+
+inline b2ScalarW b2GreaterEqualW(b2ScalarW a, b2ScalarW b)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = a.v[i] >= b.v[i] ? 1.0f : 0.0f;
+	}
+	return r;
+}
+
+inline b2ScalarW b2AndW(b2ScalarW a, b2ScalarW b)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = a.v[i] != 0.0f && b.v[i] != 0.0f ? 1.0f : 0.0f;
+	}
+	return r;
+}
+
+inline b2ScalarW b2BlendW(b2ScalarW a, b2ScalarW b, b2ScalarW mask)
+{
+	b2ScalarW r;
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		r.v[i] = mask.v[i] != 0.0f ? b.v[i] : a.v[i];
+	}
+	return r;
+}
+
+#if defined(B2_SIMD_AVX2)
+
+typedef __m256 b2FloatW;
+
+template <> inline b2FloatW b2ZeroW<b2FloatW>() { return _mm256_setzero_ps(); }
+template <> inline b2FloatW b2SplatW<b2FloatW>(float a) { return _mm256_set1_ps(a); }
+template <> inline b2FloatW b2LoadW<b2FloatW>(const float* a) { return _mm256_loadu_ps(a); }
+inline void b2StoreW(float* a, b2FloatW b) { _mm256_storeu_ps(a, b); }
+inline b2FloatW b2AddW(b2FloatW a, b2FloatW b) { return _mm256_add_ps(a, b); }
+inline b2FloatW b2SubW(b2FloatW a, b2FloatW b) { return _mm256_sub_ps(a, b); }
+inline b2FloatW b2MulW(b2FloatW a, b2FloatW b) { return _mm256_mul_ps(a, b); }
+inline b2FloatW b2NegW(b2FloatW a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+inline b2FloatW b2MinW(b2FloatW a, b2FloatW b) { return _mm256_min_ps(a, b); }
+inline b2FloatW b2MaxW(b2FloatW a, b2FloatW b) { return _mm256_max_ps(a, b); }
+inline b2FloatW b2GreaterEqualW(b2FloatW a, b2FloatW b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline b2FloatW b2AndW(b2FloatW a, b2FloatW b) { return _mm256_and_ps(a, b); }
+inline b2FloatW b2BlendW(b2FloatW a, b2FloatW b, b2FloatW mask) { return _mm256_blendv_ps(a, b, mask); }
+
+#elif defined(B2_SIMD_SSE2)
+
+typedef __m128 b2FloatW;
+
+template <> inline b2FloatW b2ZeroW<b2FloatW>() { return _mm_setzero_ps(); }
+template <> inline b2FloatW b2SplatW<b2FloatW>(float a) { return _mm_set1_ps(a); }
+template <> inline b2FloatW b2LoadW<b2FloatW>(const float* a) { return _mm_loadu_ps(a); }
+inline void b2StoreW(float* a, b2FloatW b) { _mm_storeu_ps(a, b); }
+inline b2FloatW b2AddW(b2FloatW a, b2FloatW b) { return _mm_add_ps(a, b); }
+inline b2FloatW b2SubW(b2FloatW a, b2FloatW b) { return _mm_sub_ps(a, b); }
+inline b2FloatW b2MulW(b2FloatW a, b2FloatW b) { return _mm_mul_ps(a, b); }
+inline b2FloatW b2NegW(b2FloatW a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+inline b2FloatW b2MinW(b2FloatW a, b2FloatW b) { return _mm_min_ps(a, b); }
+inline b2FloatW b2MaxW(b2FloatW a, b2FloatW b) { return _mm_max_ps(a, b); }
+inline b2FloatW b2GreaterEqualW(b2FloatW a, b2FloatW b) { return _mm_cmpge_ps(a, b); }
+inline b2FloatW b2AndW(b2FloatW a, b2FloatW b) { return _mm_and_ps(a, b); }
+inline b2FloatW b2BlendW(b2FloatW a, b2FloatW b, b2FloatW mask)
+{
+	return _mm_or_ps(_mm_and_ps(mask, b), _mm_andnot_ps(mask, a));
+}
+
+#elif defined(B2_SIMD_NEON)
+
+typedef float32x4_t b2FloatW;
+
+template <> inline b2FloatW b2ZeroW<b2FloatW>() { return vdupq_n_f32(0.0f); }
+template <> inline b2FloatW b2SplatW<b2FloatW>(float a) { return vdupq_n_f32(a); }
+template <> inline b2FloatW b2LoadW<b2FloatW>(const float* a) { return vld1q_f32(a); }
+inline void b2StoreW(float* a, b2FloatW b) { vst1q_f32(a, b); }
+inline b2FloatW b2AddW(b2FloatW a, b2FloatW b) { return vaddq_f32(a, b); }
+inline b2FloatW b2SubW(b2FloatW a, b2FloatW b) { return vsubq_f32(a, b); }
+inline b2FloatW b2MulW(b2FloatW a, b2FloatW b) { return vmulq_f32(a, b); }
+inline b2FloatW b2NegW(b2FloatW a) { return vnegq_f32(a); }
+
+// vminq/vmaxq propagate NaN, so select explicitly to match b2Min/b2Max.
+inline b2FloatW b2MinW(b2FloatW a, b2FloatW b) { return vbslq_f32(vcltq_f32(a, b), a, b); }
+inline b2FloatW b2MaxW(b2FloatW a, b2FloatW b) { return vbslq_f32(vcgtq_f32(a, b), a, b); }
+inline b2FloatW b2GreaterEqualW(b2FloatW a, b2FloatW b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+inline b2FloatW b2AndW(b2FloatW a, b2FloatW b)
+{
+	return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+inline b2FloatW b2BlendW(b2FloatW a, b2FloatW b, b2FloatW mask) { return vbslq_f32(vreinterpretq_u32_f32(mask), b, a); }
+
+#else
+
+typedef b2ScalarW b2FloatW;
+
+#endif
+
+// Four lane operations used by the wide dynamic tree. The tree always has four
+// children per node, so AVX2 builds use SSE2 here. Masks follow b2FloatW.
+
+#if defined(B2_SIMD_AVX2) || defined(B2_SIMD_SSE2)
+
+typedef __m128 b2Float4;
+
+inline b2Float4 b2Splat4(float a) { return _mm_set1_ps(a); }
+inline b2Float4 b2Load4(const float* a) { return _mm_loadu_ps(a); }
+inline b2Float4 b2Add4(b2Float4 a, b2Float4 b) { return _mm_add_ps(a, b); }
+inline b2Float4 b2Sub4(b2Float4 a, b2Float4 b) { return _mm_sub_ps(a, b); }
+inline b2Float4 b2Mul4(b2Float4 a, b2Float4 b) { return _mm_mul_ps(a, b); }
+inline b2Float4 b2Abs4(b2Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline b2Float4 b2GreaterEqual4(b2Float4 a, b2Float4 b) { return _mm_cmpge_ps(a, b); }
+inline b2Float4 b2And4(b2Float4 a, b2Float4 b) { return _mm_and_ps(a, b); }
+
+/// Bit i of the result is set if lane i of the mask is true.
+inline int32 b2MoveMask4(b2Float4 mask) { return _mm_movemask_ps(mask); }
+
+#elif defined(B2_SIMD_NEON)
+
+typedef float32x4_t b2Float4;
+
+inline b2Float4 b2Splat4(float a) { return vdupq_n_f32(a); }
+inline b2Float4 b2Load4(const float* a) { return vld1q_f32(a); }
+inline b2Float4 b2Add4(b2Float4 a, b2Float4 b) { return vaddq_f32(a, b); }
+inline b2Float4 b2Sub4(b2Float4 a, b2Float4 b) { return vsubq_f32(a, b); }
+inline b2Float4 b2Mul4(b2Float4 a, b2Float4 b) { return vmulq_f32(a, b); }
+inline b2Float4 b2Abs4(b2Float4 a) { return vabsq_f32(a); }
+inline b2Float4 b2GreaterEqual4(b2Float4 a, b2Float4 b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+inline b2Float4 b2And4(b2Float4 a, b2Float4 b)
+{
+	return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+
+/// Bit i of the result is set if lane i of the mask is true.
+inline int32 b2MoveMask4(b2Float4 mask)
+{
+	uint32x4_t m = vreinterpretq_u32_f32(mask);
+	return int32((vgetq_lane_u32(m, 0) & 1) | (vgetq_lane_u32(m, 1) & 2) |
+		(vgetq_lane_u32(m, 2) & 4) | (vgetq_lane_u32(m, 3) & 8));
+}
+
+#else
+
+struct b2Float4
+{
+	float v[4];
+};
+
+inline b2Float4 b2Splat4(float a)
+{
+	b2Float4 r;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		r.v[i] = a;
+	}
+	return r;
+}
+
+inline b2Float4 b2Load4(const float* a)
+{
+	b2Float4 r;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		r.v[i] = a[i];
+	}
+	return r;
+}
+
+inline b2Float4 b2Add4(b2Float4 a, b2Float4 b)
+{
+	b2Float4 r;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		r.v[i] = a.v[i] + b.v[i];
+	}
+	return r;
+}
+
+inline b2Float4 b2Sub4(b2Float4 a, b2Float4 b)
+{
+	b2Float4 r;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		r.v[i] = a.v[i] - b.v[i];
+	}
+	return r;
+}
+
+inline b2Float4 b2Mul4(b2Float4 a, b2Float4 b)
+{
+	b2Float4 r;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		r.v[i] = a.v[i] * b.v[i];
+	}
+	return r;
+}
+
+inline b2Float4 b2Abs4(b2Float4 a)
+{
+	b2Float4 r;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		r.v[i] = b2Abs(a.v[i]);
+	}
+	return r;
+}
+
+inline b2Float4 b2GreaterEqual4(b2Float4 a, b2Float4 b)
+{
+	b2Float4 r;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		r.v[i] = a.v[i] >= b.v[i] ? 1.0f : 0.0f;
+	}
+	return r;
+}
+
+inline b2Float4 b2And4(b2Float4 a, b2Float4 b)
+{
+	b2Float4 r;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		r.v[i] = a.v[i] != 0.0f && b.v[i] != 0.0f ? 1.0f : 0.0f;
+	}
+	return r;
+}
+
+/// Bit i of the result is set if lane i of the mask is true.
+inline int32 b2MoveMask4(b2Float4 mask)
+{
+	int32 bits = 0;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		if (mask.v[i] != 0.0f)
+		{
+			bits |= 1 << i;
+		}
+	}
+	return bits;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef B2_SNAPSHOT_H
+#define B2_SNAPSHOT_H
+
+#include "box2d/b2_settings.h"
+
+#include <string.h>
+
+/// Writes a binary snapshot. The size keeps counting past the capacity so that the
+/// caller can learn the size it needs. Nothing past the capacity is written.
+class b2SnapshotWriter
+{
+public:
+	b2SnapshotWriter(void* data, int32 capacity)
+	{
+		m_data = (char*)data;
+		m_capacity = data != nullptr ? capacity : 0;
+		m_size = 0;
+	}
+
+	void Write(const void* data, int32 size)
+	{
+		if (m_size + size <= m_capacity)
+		{
+			memcpy(m_data + m_size, data, size);
+		}
+		m_size += size;
+	}
+
+	/// Write a value as raw bytes. Only use this for types without padding.
+	template <typename T>
+	void Write(const T& value)
+	{
+		Write(&value, sizeof(T));
+	}
+
+	/// Pad with zeros to a multiple of the alignment, relative to the start of the data.
+	void Align(int32 alignment)
+	{
+		static const char zeros[16] = {};
+		b2Assert(0 < alignment && alignment <= 16);
+		int32 padding = (alignment - m_size % alignment) % alignment;
+		Write(zeros, padding);
+	}
+
+	int32 GetSize() const
+	{
+		return m_size;
+	}
+
+private:
+	char* m_data;
+	int32 m_capacity;
+	int32 m_size;
+};
+
+/// Reads a binary snapshot. Reading past the end yields zeros and marks the reader invalid.
+class b2SnapshotReader
+{
+public:
+	b2SnapshotReader(const void* data, int32 size)
+	{
+		m_data = (const char*)data;
+		m_size = size;
+		m_offset = 0;
+		m_valid = true;
+	}
+
+	void Read(void* data, int32 size)
+	{
+		if (m_offset + size > m_size)
+		{
+			memset(data, 0, size);
+			m_offset = m_size;
+			m_valid = false;
+			return;
+		}
+
+		memcpy(data, m_data + m_offset, size);
+		m_offset += size;
+	}
+
+	template <typename T>
+	void Read(T* value)
+	{
+		Read(value, sizeof(T));
+	}
+
+	template <typename T>
+	T Read()
+	{
+		T value;
+		Read(&value, sizeof(T));
+		return value;
+	}
+
+	/// Read a count of items that take at least itemSize bytes each. A count that is
+	/// negative or larger than the rest of the data marks the reader invalid.
+	/// @return the count, or zero if the reader is invalid.
+	int32 ReadCount(int32 itemSize)
+	{
+		int32 count = Read<int32>();
+		if (count < 0 || count > (m_size - m_offset) / itemSize)
+		{
+			m_valid = false;
+		}
+		return m_valid ? count : 0;
+	}
+
+	/// Read an index into an array of count items. An index out of range marks the
+	/// reader invalid, so check IsValid before using the index.
+	int32 ReadIndex(int32 count)
+	{
+		int32 index = Read<int32>();
+		if (index < 0 || index >= count)
+		{
+			m_valid = false;
+		}
+		return m_valid ? index : 0;
+	}
+
+	/// Mark the data as not valid, for example when a value is out of range.
+	void Invalidate()
+	{
+		m_valid = false;
+	}
+
+	/// Skip padding written by b2SnapshotWriter::Align.
+	void Align(int32 alignment)
+	{
+		int32 padding = (alignment - m_offset % alignment) % alignment;
+		Reference(padding);
+	}
+
+	/// Get a pointer to the next bytes in place instead of copying them.
+	/// @return null if the bytes are past the end.
+	const void* Reference(int32 size)
+	{
+		if (m_offset + size > m_size)
+		{
+			m_offset = m_size;
+			m_valid = false;
+			return nullptr;
+		}
+
+		const void* data = m_data + m_offset;
+		m_offset += size;
+		return data;
+	}
+
+	bool IsValid() const
+	{
+		return m_valid;
+	}
+
+private:
+	const char* m_data;
+	int32 m_size;
+	int32 m_offset;
+	bool m_valid;
+};
+
+#endif
@@ -23,11 +23,21 @@
 #include "box2d/b2_stack_allocator.h"
 #include "box2d/b2_math.h"
 
-b2StackAllocator::b2StackAllocator()
+#include <string.h>
+
+b2StackAllocator::b2StackAllocator(int32 capacity, b2Allocator* allocator)
 {
+	b2Assert(capacity >= 0);
+	m_allocator = allocator;
+	m_capacity = (capacity + 7) & ~7;
+	m_data = (char*)b2Alloc(m_allocator, m_capacity);
 	m_index = 0;
 	m_allocation = 0;
 	m_maxAllocation = 0;
+	m_heapFallbackCount = 0;
+
+	m_entryCapacity = b2_maxStackEntries;
+	m_entries = (b2StackEntry*)b2Alloc(m_allocator, m_entryCapacity * sizeof(b2StackEntry));
 	m_entryCount = 0;
 }
 
@@ -35,18 +45,32 @@ b2StackAllocator::~b2StackAllocator()
 {
 	b2Assert(m_index == 0);
 	b2Assert(m_entryCount == 0);
+
+	b2Free(m_allocator, m_entries, m_entryCapacity * sizeof(b2StackEntry));
+	b2Free(m_allocator, m_data, m_capacity);
 }
 
 void* b2StackAllocator::Allocate(int32 size)
 {
-	b2Assert(m_entryCount < b2_maxStackEntries);
+	if (m_entryCount == m_entryCapacity)
+	{
+		b2StackEntry* oldEntries = m_entries;
+		m_entryCapacity *= 2;
+		m_entries = (b2StackEntry*)b2Alloc(m_allocator, m_entryCapacity * sizeof(b2StackEntry));
+		memcpy(m_entries, oldEntries, m_entryCount * sizeof(b2StackEntry));
+		b2Free(m_allocator, oldEntries, m_entryCount * sizeof(b2StackEntry));
+	}
+
+	// Keep the next entry aligned for pointers.
+	size = (size + 7) & ~7;
 
 	b2StackEntry* entry = m_entries + m_entryCount;
 	entry->size = size;
-	if (m_index + size > b2_stackSize)
+	if (m_index + size > m_capacity)
 	{
-		entry->data = (char*)b2Alloc(size);
+		entry->data = (char*)b2Alloc(m_allocator, size);
 		entry->usedMalloc = true;
+		++m_heapFallbackCount;
 	}
 	else
 	{
@@ -69,7 +93,7 @@ void b2StackAllocator::Free(void* p)
 	b2Assert(p == entry->data);
 	if (entry->usedMalloc)
 	{
-		b2Free(p);
+		b2Free(m_allocator, p, entry->size);
 	}
 	else
 	{
@@ -85,3 +109,37 @@ int32 b2StackAllocator::GetMaxAllocation() const
 {
 	return m_maxAllocation;
 }
+
+void b2StackAllocator::SetCapacity(int32 capacity)
+{
+	b2Assert(m_entryCount == 0);
+	b2Assert(capacity >= 0);
+
+	capacity = (capacity + 7) & ~7;
+	if (capacity == m_capacity)
+	{
+		return;
+	}
+
+	b2Free(m_allocator, m_data, m_capacity);
+	m_capacity = capacity;
+	m_data = (char*)b2Alloc(m_allocator, m_capacity);
+}
+
+int32 b2StackAllocator::GetCapacity() const
+{
+	return m_capacity;
+}
+
+void b2StackAllocator::Grow()
+{
+	if (m_maxAllocation > m_capacity)
+	{
+		SetCapacity(m_maxAllocation);
+	}
+}
+
+int32 b2StackAllocator::GetHeapFallbackCount() const
+{
+	return m_heapFallbackCount;
+}
@@ -0,0 +1,214 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "box2d/b2_math.h"
+#include "box2d/b2_thread_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+struct b2ThreadPoolData
+{
+	std::thread* threads;
+	int32 threadCount;
+
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+
+	// The current task. Written under the mutex while no worker is active.
+	b2TaskCallback* task;
+	void* taskContext;
+	int32 itemCount;
+	int32 rangeSize;
+	int32 rangeCount;
+	uint32 generation;
+
+	// Number of threads currently executing ranges. Guarded by the mutex.
+	int32 activeCount;
+	bool exit;
+
+	std::atomic<int32> nextRange;
+	std::atomic<int32> finishedRanges;
+};
+
+// Execute ranges of the current task until none are left.
+static void b2ExecuteRanges(b2ThreadPoolData* data, int32 workerIndex)
+{
+	for (;;)
+	{
+		int32 range = data->nextRange.fetch_add(1);
+		if (range >= data->rangeCount)
+		{
+			break;
+		}
+
+		int32 startIndex = range * data->rangeSize;
+		int32 endIndex = b2Min(startIndex + data->rangeSize, data->itemCount);
+		data->task(startIndex, endIndex, workerIndex, data->taskContext);
+
+		if (data->finishedRanges.fetch_add(1) + 1 == data->rangeCount)
+		{
+			std::lock_guard<std::mutex> lock(data->mutex);
+			data->doneCondition.notify_all();
+		}
+	}
+}
+
+static void b2WorkerMain(b2ThreadPoolData* data, int32 workerIndex)
+{
+	uint32 generation = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(data->mutex);
+			data->wakeCondition.wait(lock, [data, generation] { return data->exit || data->generation != generation; });
+			if (data->exit)
+			{
+				return;
+			}
+
+			generation = data->generation;
+			++data->activeCount;
+		}
+
+		b2ExecuteRanges(data, workerIndex);
+
+		{
+			std::lock_guard<std::mutex> lock(data->mutex);
+			--data->activeCount;
+			data->doneCondition.notify_all();
+		}
+	}
+}
+
+b2ThreadPool::b2ThreadPool(int32 workerCount)
+{
+	if (workerCount <= 0)
+	{
+		workerCount = int32(std::thread::hardware_concurrency());
+	}
+
+	m_workerCount = b2Max(workerCount, 1);
+
+	void* mem = b2Alloc(sizeof(b2ThreadPoolData));
+	m_data = new (mem) b2ThreadPoolData;
+	m_data->task = nullptr;
+	m_data->taskContext = nullptr;
+	m_data->itemCount = 0;
+	m_data->rangeSize = 0;
+	m_data->rangeCount = 0;
+	m_data->generation = 0;
+	m_data->activeCount = 0;
+	m_data->exit = false;
+	m_data->nextRange = 0;
+	m_data->finishedRanges = 0;
+
+	// Worker zero is the thread that calls FinishTask.
+	m_data->threadCount = m_workerCount - 1;
+	m_data->threads = (std::thread*)b2Alloc(b2Max(m_data->threadCount, 1) * sizeof(std::thread));
+	for (int32 i = 0; i < m_data->threadCount; ++i)
+	{
+		new (m_data->threads + i) std::thread(b2WorkerMain, m_data, i + 1);
+	}
+}
+
+b2ThreadPool::~b2ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_data->mutex);
+		m_data->exit = true;
+	}
+	m_data->wakeCondition.notify_all();
+
+	for (int32 i = 0; i < m_data->threadCount; ++i)
+	{
+		m_data->threads[i].join();
+		m_data->threads[i].~thread();
+	}
+
+	b2Free(m_data->threads);
+	m_data->~b2ThreadPoolData();
+	b2Free(m_data);
+}
+
+int32 b2ThreadPool::GetWorkerCount() const
+{
+	return m_workerCount;
+}
+
+void* b2ThreadPool::EnqueueTask(b2TaskCallback* task, int32 itemCount, int32 minRange, void* taskContext)
+{
+	if (itemCount <= 0)
+	{
+		return nullptr;
+	}
+
+	minRange = b2Max(minRange, 1);
+
+	if (m_workerCount == 1 || itemCount <= minRange)
+	{
+		task(0, itemCount, 0, taskContext);
+		return nullptr;
+	}
+
+	// Aim for a few ranges per worker so uneven items balance out.
+	int32 rangeSize = b2Max(minRange, itemCount / (4 * m_workerCount));
+
+	{
+		std::unique_lock<std::mutex> lock(m_data->mutex);
+
+		// A worker may have woken late for the previous task. Wait until it is out.
+		m_data->doneCondition.wait(lock, [this] { return m_data->activeCount == 0; });
+
+		m_data->task = task;
+		m_data->taskContext = taskContext;
+		m_data->itemCount = itemCount;
+		m_data->rangeSize = rangeSize;
+		m_data->rangeCount = (itemCount + rangeSize - 1) / rangeSize;
+		m_data->nextRange = 0;
+		m_data->finishedRanges = 0;
+		++m_data->generation;
+	}
+	m_data->wakeCondition.notify_all();
+
+	return m_data;
+}
+
+void b2ThreadPool::FinishTask(void* userTask)
+{
+	if (userTask == nullptr)
+	{
+		return;
+	}
+
+	b2Assert(userTask == m_data);
+
+	// The calling thread helps out as worker zero.
+	b2ExecuteRanges(m_data, 0);
+
+	std::unique_lock<std::mutex> lock(m_data->mutex);
+	m_data->doneCondition.wait(lock, [this] { return m_data->finishedRanges.load() == m_data->rangeCount; });
+}
@@ -26,6 +26,8 @@
 #include "box2d/b2_joint.h"
 #include "box2d/b2_world.h"
 
+#include "b2_island.h"
+
 #include <new>
 
 b2Body::b2Body(const b2BodyDef* bd, b2World* world)
@@ -43,6 +45,10 @@ b2Body::b2Body(const b2BodyDef* bd, b2World* world)
 	{
 		m_flags |= e_bulletFlag;
 	}
+	if (bd->speculative)
+	{
+		m_flags |= e_speculativeFlag;
+	}
 	if (bd->fixedRotation)
 	{
 		m_flags |= e_fixedRotationFlag;
@@ -61,24 +67,34 @@ b2Body::b2Body(const b2BodyDef* bd, b2World* world)
 	}
 
 	m_world = world;
+	m_id = world->m_nextId++;
 
 	m_xf.p = bd->position;
 	m_xf.q.Set(bd->angle);
 
-	m_sweep.localCenter.SetZero();
-	m_sweep.c0 = m_xf.p;
-	m_sweep.c = m_xf.p;
-	m_sweep.a0 = bd->angle;
-	m_sweep.a = bd->angle;
-	m_sweep.alpha0 = 0.0f;
+	world->CreateBodyState(this);
+
+	b2Position& position = GetPositionState();
+	position.c = m_xf.p;
+	position.a = bd->angle;
+
+	m_localCenter.SetZero();
+	m_c0 = m_xf.p;
+	m_a0 = bd->angle;
+	m_alpha0 = 0.0f;
 
 	m_jointList = nullptr;
 	m_contactList = nullptr;
 	m_prev = nullptr;
 	m_next = nullptr;
 
-	m_linearVelocity = bd->linearVelocity;
-	m_angularVelocity = bd->angularVelocity;
+	m_island = nullptr;
+	m_islandPrev = nullptr;
+	m_islandNext = nullptr;
+
+	b2Velocity& velocity = GetVelocityState();
+	velocity.v = bd->linearVelocity;
+	velocity.w = bd->angularVelocity;
 
 	m_linearDamping = bd->linearDamping;
 	m_angularDamping = bd->angularDamping;
@@ -108,6 +124,35 @@ b2Body::~b2Body()
 	// shapes and joints are destroyed in b2World::Destroy
 }
 
+void b2Body::SetAwake(bool flag)
+{
+	if (m_type == b2_staticBody)
+	{
+		return;
+	}
+
+	if (flag)
+	{
+		m_flags |= e_awakeFlag;
+		m_sleepTime = 0.0f;
+
+		// The rest of the island is woken by the next time step.
+		if (m_island != nullptr && m_island->awakeIndex == -1)
+		{
+			m_world->WakeIsland(m_island);
+		}
+	}
+	else
+	{
+		m_flags &= ~e_awakeFlag;
+		m_sleepTime = 0.0f;
+		GetVelocityState().v.SetZero();
+		GetVelocityState().w = 0.0f;
+		m_force.SetZero();
+		m_torque = 0.0f;
+	}
+}
+
 void b2Body::SetType(b2BodyType type)
 {
 	b2Assert(m_world->IsLocked() == false);
@@ -121,16 +166,20 @@ void b2Body::SetType(b2BodyType type)
 		return;
 	}
 
+	// The body joins a new island once its contacts are gone.
+	m_world->UnlinkBody(this);
+
+	b2BodyType oldType = m_type;
 	m_type = type;
 
 	ResetMassData();
 
 	if (m_type == b2_staticBody)
 	{
-		m_linearVelocity.SetZero();
-		m_angularVelocity = 0.0f;
-		m_sweep.a0 = m_sweep.a;
-		m_sweep.c0 = m_sweep.c;
+		GetVelocityState().v.SetZero();
+		GetVelocityState().w = 0.0f;
+		m_a0 = GetPositionState().a;
+		m_c0 = GetPositionState().c;
 		m_flags &= ~e_awakeFlag;
 		SynchronizeFixtures();
 	}
@@ -150,8 +199,22 @@ void b2Body::SetType(b2BodyType type)
 	}
 	m_contactList = nullptr;
 
-	// Touch the proxies so that new contacts will be created (when appropriate)
+	m_world->LinkBody(this);
+
 	b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
+	if ((oldType == b2_staticBody || m_type == b2_staticBody) && (m_flags & e_enabledFlag))
+	{
+		// Static proxies live in their own tree. Move the proxies across. This
+		// also buffers them so that new contacts will be created.
+		for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
+		{
+			f->DestroyProxies(broadPhase);
+			f->CreateProxies(broadPhase, m_xf);
+		}
+		return;
+	}
+
+	// Touch the proxies so that new contacts will be created (when appropriate)
 	for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
 	{
 		int32 proxyCount = f->m_proxyCount;
@@ -294,14 +357,14 @@ void b2Body::ResetMassData()
 	m_invMass = 0.0f;
 	m_I = 0.0f;
 	m_invI = 0.0f;
-	m_sweep.localCenter.SetZero();
+	m_localCenter.SetZero();
 
 	// Static and kinematic bodies have zero mass.
 	if (m_type == b2_staticBody || m_type == b2_kinematicBody)
 	{
-		m_sweep.c0 = m_xf.p;
-		m_sweep.c = m_xf.p;
-		m_sweep.a0 = m_sweep.a;
+		m_c0 = m_xf.p;
+		GetPositionState().c = m_xf.p;
+		m_a0 = GetPositionState().a;
 		return;
 	}
 
@@ -345,12 +408,14 @@ void b2Body::ResetMassData()
 	}
 
 	// Move center of mass.
-	b2Vec2 oldCenter = m_sweep.c;
-	m_sweep.localCenter = localCenter;
-	m_sweep.c0 = m_sweep.c = b2Mul(m_xf, m_sweep.localCenter);
+	b2Position& position = GetPositionState();
+	b2Vec2 oldCenter = position.c;
+	m_localCenter = localCenter;
+	m_c0 = position.c = b2Mul(m_xf, m_localCenter);
 
 	// Update center of mass velocity.
-	m_linearVelocity += b2Cross(m_angularVelocity, m_sweep.c - oldCenter);
+	b2Velocity& velocity = GetVelocityState();
+	velocity.v += b2Cross(velocity.w, position.c - oldCenter);
 }
 
 void b2Body::SetMassData(const b2MassData* massData)
@@ -386,12 +451,14 @@ void b2Body::SetMassData(const b2MassData* massData)
 	}
 
 	// Move center of mass.
-	b2Vec2 oldCenter = m_sweep.c;
-	m_sweep.localCenter =  massData->center;
-	m_sweep.c0 = m_sweep.c = b2Mul(m_xf, m_sweep.localCenter);
+	b2Position& position = GetPositionState();
+	b2Vec2 oldCenter = position.c;
+	m_localCenter =  massData->center;
+	m_c0 = position.c = b2Mul(m_xf, m_localCenter);
 
 	// Update center of mass velocity.
-	m_linearVelocity += b2Cross(m_angularVelocity, m_sweep.c - oldCenter);
+	b2Velocity& velocity = GetVelocityState();
+	velocity.v += b2Cross(velocity.w, position.c - oldCenter);
 }
 
 bool b2Body::ShouldCollide(const b2Body* other) const
@@ -428,16 +495,17 @@ void b2Body::SetTransform(const b2Vec2& position, float angle)
 	m_xf.q.Set(angle);
 	m_xf.p = position;
 
-	m_sweep.c = b2Mul(m_xf, m_sweep.localCenter);
-	m_sweep.a = angle;
+	b2Position& state = GetPositionState();
+	state.c = b2Mul(m_xf, m_localCenter);
+	state.a = angle;
 
-	m_sweep.c0 = m_sweep.c;
-	m_sweep.a0 = angle;
+	m_c0 = state.c;
+	m_a0 = angle;
 
 	b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
 	for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
 	{
-		f->Synchronize(broadPhase, m_xf, m_xf);
+		f->Synchronize(broadPhase, m_xf, m_xf, b2Vec2_zero);
 	}
 
 	// Check for new contacts the next step
@@ -446,24 +514,32 @@ void b2Body::SetTransform(const b2Vec2& position, float angle)
 
 void b2Body::SynchronizeFixtures()
 {
+	const b2ContactManager& contactManager = m_world->m_contactManager;
 	b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
 
 	if (m_flags & b2Body::e_awakeFlag)
 	{
 		b2Transform xf1;
-		xf1.q.Set(m_sweep.a0);
-		xf1.p = m_sweep.c0 - b2Mul(xf1.q, m_sweep.localCenter);
+		xf1.q.Set(m_a0);
+		xf1.p = m_c0 - b2Mul(xf1.q, m_localCenter);
+
+		// Assume the next step has the same length as the last one.
+		b2Vec2 lookAhead = b2Vec2_zero;
+		if (contactManager.m_speculativeContacts || (m_flags & e_speculativeFlag))
+		{
+			lookAhead = contactManager.m_speculativeTime * GetLinearVelocity();
+		}
 
 		for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
 		{
-			f->Synchronize(broadPhase, xf1, m_xf);
+			f->Synchronize(broadPhase, xf1, m_xf, lookAhead);
 		}
 	}
 	else
 	{
 		for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
 		{
-			f->Synchronize(broadPhase, m_xf, m_xf);
+			f->Synchronize(broadPhase, m_xf, m_xf, b2Vec2_zero);
 		}
 	}
 }
@@ -490,19 +566,14 @@ void b2Body::SetEnabled(bool flag)
 
 		// Contacts are created at the beginning of the next
 		m_world->m_newContacts = true;
+
+		m_world->LinkBody(this);
 	}
 	else
 	{
 		m_flags &= ~e_enabledFlag;
 
-		// Destroy all proxies.
-		b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
-		for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
-		{
-			f->DestroyProxies(broadPhase);
-		}
-
-		// Destroy the attached contacts.
+		// Destroy the attached contacts. This needs the proxies.
 		b2ContactEdge* ce = m_contactList;
 		while (ce)
 		{
@@ -511,6 +582,15 @@ void b2Body::SetEnabled(bool flag)
 			m_world->m_contactManager.Destroy(ce0->contact);
 		}
 		m_contactList = nullptr;
+
+		// Destroy all proxies.
+		b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
+		for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
+		{
+			f->DestroyProxies(broadPhase);
+		}
+
+		m_world->UnlinkBody(this);
 	}
 }
 
@@ -531,7 +611,7 @@ void b2Body::SetFixedRotation(bool flag)
 		m_flags &= ~e_fixedRotationFlag;
 	}
 
-	m_angularVelocity = 0.0f;
+	GetVelocityState().w = 0.0f;
 
 	ResetMassData();
 }
@@ -547,15 +627,16 @@ void b2Body::Dump()
 	b2Dump("  b2BodyDef bd;\n");
 	b2Dump("  bd.type = b2BodyType(%d);\n", m_type);
 	b2Dump("  bd.position.Set(%.9g, %.9g);\n", m_xf.p.x, m_xf.p.y);
-	b2Dump("  bd.angle = %.9g;\n", m_sweep.a);
-	b2Dump("  bd.linearVelocity.Set(%.9g, %.9g);\n", m_linearVelocity.x, m_linearVelocity.y);
-	b2Dump("  bd.angularVelocity = %.9g;\n", m_angularVelocity);
+	b2Dump("  bd.angle = %.9g;\n", GetAngle());
+	b2Dump("  bd.linearVelocity.Set(%.9g, %.9g);\n", GetLinearVelocity().x, GetLinearVelocity().y);
+	b2Dump("  bd.angularVelocity = %.9g;\n", GetAngularVelocity());
 	b2Dump("  bd.linearDamping = %.9g;\n", m_linearDamping);
 	b2Dump("  bd.angularDamping = %.9g;\n", m_angularDamping);
 	b2Dump("  bd.allowSleep = bool(%d);\n", m_flags & e_autoSleepFlag);
 	b2Dump("  bd.awake = bool(%d);\n", m_flags & e_awakeFlag);
 	b2Dump("  bd.fixedRotation = bool(%d);\n", m_flags & e_fixedRotationFlag);
 	b2Dump("  bd.bullet = bool(%d);\n", m_flags & e_bulletFlag);
+	b2Dump("  bd.speculative = bool(%d);\n", m_flags & e_speculativeFlag);
 	b2Dump("  bd.enabled = bool(%d);\n", m_flags & e_enabledFlag);
 	b2Dump("  bd.gravityScale = %.9g;\n", m_gravityScale);
 	b2Dump("  bodies[%d] = m_world->CreateBody(&bd);\n", m_islandIndex);
@@ -139,8 +139,10 @@ b2Contact::b2Contact(b2Fixture* fA, int32 indexA, b2Fixture* fB, int32 indexB)
 
 	m_manifold.pointCount = 0;
 
-	m_prev = nullptr;
-	m_next = nullptr;
+	m_managerIndex = -1;
+
+	m_islandPrev = nullptr;
+	m_islandNext = nullptr;
 
 	m_nodeA.contact = nullptr;
 	m_nodeA.prev = nullptr;
@@ -159,19 +161,58 @@ b2Contact::b2Contact(b2Fixture* fA, int32 indexA, b2Fixture* fB, int32 indexB)
 	m_restitutionThreshold = b2MixRestitutionThreshold(m_fixtureA->m_restitutionThreshold, m_fixtureB->m_restitutionThreshold);
 
 	m_tangentSpeed = 0.0f;
+	m_speculativeDistance = 0.0f;
+}
+
+b2Contact* b2Contact::GetNext()
+{
+	const b2ContactManager& manager = m_fixtureA->m_body->m_world->m_contactManager;
+	int32 index = m_managerIndex + 1;
+	return index < manager.m_contactCount ? manager.m_contacts[index] : nullptr;
+}
+
+const b2Contact* b2Contact::GetNext() const
+{
+	const b2ContactManager& manager = m_fixtureA->m_body->m_world->m_contactManager;
+	int32 index = m_managerIndex + 1;
+	return index < manager.m_contactCount ? manager.m_contacts[index] : nullptr;
+}
+
+// Bound the distance the points of a fixture child may move due to rotation in one
+// step of length dt.
+static float b2GetSpeculativeRotation(const b2Fixture* fixture, int32 childIndex, float dt)
+{
+	const b2Body* body = fixture->GetBody();
+	float angularSpeed = b2Abs(body->GetAngularVelocity());
+	if (angularSpeed == 0.0f)
+	{
+		return 0.0f;
+	}
+
+	const b2AABB& aabb = fixture->GetAABB(childIndex);
+	float radius = b2Distance(aabb.GetCenter(), body->GetWorldCenter()) + aabb.GetExtents().Length();
+	return dt * angularSpeed * radius;
 }
 
 // Update the contact manifold and touching status.
 // Note: do not assume the fixture AABBs are overlapping or are valid.
 void b2Contact::Update(b2ContactListener* listener)
 {
-	b2Manifold oldManifold = m_manifold;
+	b2Manifold oldManifold;
+	bool wasTouching = (m_flags & e_touchingFlag) == e_touchingFlag;
+
+	UpdateManifold(&oldManifold);
+	ReportUpdate(listener, &oldManifold, wasTouching);
+}
+
+void b2Contact::UpdateManifold(b2Manifold* oldManifold)
+{
+	*oldManifold = m_manifold;
 
 	// Re-enable this contact.
 	m_flags |= e_enabledFlag;
 
 	bool touching = false;
-	bool wasTouching = (m_flags & e_touchingFlag) == e_touchingFlag;
 
 	bool sensorA = m_fixtureA->IsSensor();
 	bool sensorB = m_fixtureB->IsSensor();
@@ -194,9 +235,40 @@ void b2Contact::Update(b2ContactListener* listener)
 	}
 	else
 	{
+		const b2ContactManager& contactManager = bodyA->m_world->m_contactManager;
+		if (contactManager.m_speculativeContacts || bodyA->IsSpeculative() || bodyB->IsSpeculative())
+		{
+			// Bound how far the shapes may approach each other in the next step.
+			float dt = contactManager.m_speculativeTime;
+			float linearSpeed = b2Distance(bodyA->GetLinearVelocity(), bodyB->GetLinearVelocity());
+			m_speculativeDistance = b2_speculativeDistance + dt * linearSpeed +
+				b2GetSpeculativeRotation(m_fixtureA, m_indexA, dt) + b2GetSpeculativeRotation(m_fixtureB, m_indexB, dt);
+		}
+		else
+		{
+			m_speculativeDistance = 0.0f;
+		}
+
 		Evaluate(&m_manifold, xfA, xfB);
 		touching = m_manifold.pointCount > 0;
 
+		if (touching && m_speculativeDistance > 0.0f)
+		{
+			// Speculative points are solved but the shapes only touch if a point is not separated.
+			b2WorldManifold worldManifold;
+			worldManifold.Initialize(&m_manifold, xfA, m_fixtureA->GetShape()->m_radius, xfB, m_fixtureB->GetShape()->m_radius);
+
+			touching = false;
+			for (int32 i = 0; i < m_manifold.pointCount; ++i)
+			{
+				if (worldManifold.separations[i] <= 0.0f)
+				{
+					touching = true;
+					break;
+				}
+			}
+		}
+
 		// Match old contact ids to new contact ids and copy the
 		// stored impulses to warm start the solver.
 		for (int32 i = 0; i < m_manifold.pointCount; ++i)
@@ -206,9 +278,9 @@ void b2Contact::Update(b2ContactListener* listener)
 			mp2->tangentImpulse = 0.0f;
 			b2ContactID id2 = mp2->id;
 
-			for (int32 j = 0; j < oldManifold.pointCount; ++j)
+			for (int32 j = 0; j < oldManifold->pointCount; ++j)
 			{
-				b2ManifoldPoint* mp1 = oldManifold.points + j;
+				b2ManifoldPoint* mp1 = oldManifold->points + j;
 
 				if (mp1->id.key == id2.key)
 				{
@@ -218,12 +290,6 @@ void b2Contact::Update(b2ContactListener* listener)
 				}
 			}
 		}
-
-		if (touching != wasTouching)
-		{
-			bodyA->SetAwake(true);
-			bodyB->SetAwake(true);
-		}
 	}
 
 	if (touching)
@@ -234,6 +300,39 @@ void b2Contact::Update(b2ContactListener* listener)
 	{
 		m_flags &= ~e_touchingFlag;
 	}
+}
+
+void b2Contact::ReportUpdate(b2ContactListener* listener, const b2Manifold* oldManifold, bool wasTouching)
+{
+	bool touching = (m_flags & e_touchingFlag) == e_touchingFlag;
+	bool sensor = m_fixtureA->IsSensor() || m_fixtureB->IsSensor();
+
+	// Solid contacts with manifold points are solved. Speculative contacts have points
+	// before the shapes touch.
+	bool solved = sensor == false && m_manifold.pointCount > 0;
+
+	// Solved contacts connect islands. Check the link on every update because
+	// a fixture may become a sensor while touching.
+	bool linked = (m_flags & e_islandLinkFlag) == e_islandLinkFlag;
+
+	if (sensor == false && (touching != wasTouching || linked != solved))
+	{
+		m_fixtureA->GetBody()->SetAwake(true);
+		m_fixtureB->GetBody()->SetAwake(true);
+	}
+
+	if (linked != solved)
+	{
+		b2World* world = m_fixtureA->GetBody()->m_world;
+		if (linked)
+		{
+			world->UnlinkContact(this);
+		}
+		else
+		{
+			world->LinkContact(this);
+		}
+	}
 
 	if (wasTouching == false && touching == true && listener)
 	{
@@ -245,8 +344,8 @@ void b2Contact::Update(b2ContactListener* listener)
 		listener->EndContact(this);
 	}
 
-	if (sensor == false && touching && listener)
+	if (solved && listener)
 	{
-		listener->PreSolve(this, &oldManifold);
+		listener->PreSolve(this, oldManifold);
 	}
 }
@@ -24,18 +24,224 @@
 #include "box2d/b2_contact.h"
 #include "box2d/b2_contact_manager.h"
 #include "box2d/b2_fixture.h"
+#include "box2d/b2_profiler.h"
+#include "box2d/b2_stack_allocator.h"
+#include "box2d/b2_world.h"
 #include "box2d/b2_world_callbacks.h"
 
+#include <string.h>
+
+#include "b2_task.h"
+
 b2ContactFilter b2_defaultFilter;
 b2ContactListener b2_defaultListener;
 
-b2ContactManager::b2ContactManager()
+// Look up existing contacts in the pair table. Otherwise walk the contact list of a
+// body as Box2D did before the pair table. This is for benchmarks.
+B2_API bool g_contactPairTable = true;
+
+#ifdef B2_PROFILER
+// Narrow-phase zones by the shape types of the contact.
+static const char* b2_narrowPhaseNames[b2Shape::e_typeCount][b2Shape::e_typeCount] =
 {
-	m_contactList = nullptr;
+	{ "narrow-phase circle-circle", "narrow-phase circle-edge", "narrow-phase circle-polygon", "narrow-phase circle-chain" },
+	{ "narrow-phase edge-circle", "narrow-phase edge-edge", "narrow-phase edge-polygon", "narrow-phase edge-chain" },
+	{ "narrow-phase polygon-circle", "narrow-phase polygon-edge", "narrow-phase polygon-polygon", "narrow-phase polygon-chain" },
+	{ "narrow-phase chain-circle", "narrow-phase chain-edge", "narrow-phase chain-polygon", "narrow-phase chain-chain" }
+};
+
+static const char* b2GetNarrowPhaseName(const b2Contact* contact)
+{
+	return b2_narrowPhaseNames[contact->GetFixtureA()->GetType()][contact->GetFixtureB()->GetType()];
+}
+#endif
+
+b2ContactManager::b2ContactManager(b2Allocator* heapAllocator)
+	: m_heapAllocator(heapAllocator)
+	, m_broadPhase(heapAllocator)
+{
+	m_contacts = nullptr;
 	m_contactCount = 0;
+	m_contactCapacity = 0;
 	m_contactFilter = &b2_defaultFilter;
 	m_contactListener = &b2_defaultListener;
 	m_allocator = nullptr;
+	m_stackAllocator = nullptr;
+	m_taskSystem = nullptr;
+	m_speculativeContacts = false;
+	m_deterministic = false;
+	m_profiler = nullptr;
+	memset(&m_stats, 0, sizeof(b2StepStats));
+	m_speculativeTime = 0.0f;
+	m_pairTable = nullptr;
+	m_pairCapacity = 0;
+}
+
+b2ContactManager::~b2ContactManager()
+{
+	b2Free(m_heapAllocator, m_pairTable, m_pairCapacity * sizeof(b2ContactPair));
+	b2Free(m_heapAllocator, m_contacts, m_contactCapacity * sizeof(b2Contact*));
+}
+
+static inline uint32 b2HashPair(int32 proxyIdA, int32 proxyIdB)
+{
+	uint32 h = uint32(proxyIdA) * 0x9E3779B1u;
+	h ^= uint32(proxyIdB) + 0x7F4A7C15u + (h << 6) + (h >> 2);
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	return h;
+}
+
+b2Contact* b2ContactManager::FindContact(int32 proxyIdA, int32 proxyIdB) const
+{
+	if (m_pairCapacity == 0)
+	{
+		return nullptr;
+	}
+
+	int32 idA = b2Min(proxyIdA, proxyIdB);
+	int32 idB = b2Max(proxyIdA, proxyIdB);
+
+	// Linear probing. The table is never full.
+	uint32 mask = uint32(m_pairCapacity - 1);
+	uint32 index = b2HashPair(idA, idB) & mask;
+	while (m_pairTable[index].contact != nullptr)
+	{
+		const b2ContactPair* pair = m_pairTable + index;
+		if (pair->proxyIdA == idA && pair->proxyIdB == idB)
+		{
+			return pair->contact;
+		}
+
+		index = (index + 1) & mask;
+	}
+
+	return nullptr;
+}
+
+void b2ContactManager::AddToPairTable(b2Contact* contact)
+{
+	// Keep the load factor at or below one half. m_contactCount includes the new contact.
+	if (2 * m_contactCount > m_pairCapacity)
+	{
+		b2ContactPair* oldTable = m_pairTable;
+		int32 oldCapacity = m_pairCapacity;
+
+		m_pairCapacity = b2Max(2 * m_pairCapacity, 64);
+		m_pairTable = (b2ContactPair*)b2Alloc(m_heapAllocator, m_pairCapacity * sizeof(b2ContactPair));
+		memset(m_pairTable, 0, m_pairCapacity * sizeof(b2ContactPair));
+
+		uint32 mask = uint32(m_pairCapacity - 1);
+		for (int32 i = 0; i < oldCapacity; ++i)
+		{
+			const b2ContactPair* pair = oldTable + i;
+			if (pair->contact == nullptr)
+			{
+				continue;
+			}
+
+			uint32 index = b2HashPair(pair->proxyIdA, pair->proxyIdB) & mask;
+			while (m_pairTable[index].contact != nullptr)
+			{
+				index = (index + 1) & mask;
+			}
+			m_pairTable[index] = *pair;
+		}
+
+		b2Free(m_heapAllocator, oldTable, oldCapacity * sizeof(b2ContactPair));
+	}
+
+	int32 proxyIdA = contact->m_fixtureA->m_proxies[contact->m_indexA].proxyId;
+	int32 proxyIdB = contact->m_fixtureB->m_proxies[contact->m_indexB].proxyId;
+	b2Assert(proxyIdA != b2BroadPhase::e_nullProxy && proxyIdB != b2BroadPhase::e_nullProxy);
+	int32 idA = b2Min(proxyIdA, proxyIdB);
+	int32 idB = b2Max(proxyIdA, proxyIdB);
+
+	uint32 mask = uint32(m_pairCapacity - 1);
+	uint32 index = b2HashPair(idA, idB) & mask;
+	while (m_pairTable[index].contact != nullptr)
+	{
+		b2Assert(m_pairTable[index].proxyIdA != idA || m_pairTable[index].proxyIdB != idB);
+		index = (index + 1) & mask;
+	}
+
+	b2ContactPair* pair = m_pairTable + index;
+	pair->proxyIdA = idA;
+	pair->proxyIdB = idB;
+	pair->contact = contact;
+}
+
+void b2ContactManager::RemoveFromPairTable(b2Contact* contact)
+{
+	int32 proxyIdA = contact->m_fixtureA->m_proxies[contact->m_indexA].proxyId;
+	int32 proxyIdB = contact->m_fixtureB->m_proxies[contact->m_indexB].proxyId;
+	b2Assert(proxyIdA != b2BroadPhase::e_nullProxy && proxyIdB != b2BroadPhase::e_nullProxy);
+	int32 idA = b2Min(proxyIdA, proxyIdB);
+	int32 idB = b2Max(proxyIdA, proxyIdB);
+
+	uint32 mask = uint32(m_pairCapacity - 1);
+	uint32 index = b2HashPair(idA, idB) & mask;
+	while (m_pairTable[index].contact != contact)
+	{
+		b2Assert(m_pairTable[index].contact != nullptr);
+		index = (index + 1) & mask;
+	}
+
+	// Shift following entries back so that probe sequences stay unbroken.
+	uint32 hole = index;
+	uint32 next = (hole + 1) & mask;
+	while (m_pairTable[next].contact != nullptr)
+	{
+		const b2ContactPair* pair = m_pairTable + next;
+		uint32 home = b2HashPair(pair->proxyIdA, pair->proxyIdB) & mask;
+
+		// Move the entry if its home slot is not in (hole, next].
+		if (((next - home) & mask) >= ((next - hole) & mask))
+		{
+			m_pairTable[hole] = *pair;
+			hole = next;
+		}
+
+		next = (next + 1) & mask;
+	}
+
+	m_pairTable[hole].contact = nullptr;
+}
+
+void b2ContactManager::AddToContactArray(b2Contact* contact)
+{
+	if (m_contactCount == m_contactCapacity)
+	{
+		b2Contact** oldContacts = m_contacts;
+		m_contactCapacity = b2Max(2 * m_contactCapacity, 64);
+		m_contacts = (b2Contact**)b2Alloc(m_heapAllocator, m_contactCapacity * sizeof(b2Contact*));
+		if (oldContacts != nullptr)
+		{
+			memcpy(m_contacts, oldContacts, m_contactCount * sizeof(b2Contact*));
+			b2Free(m_heapAllocator, oldContacts, m_contactCount * sizeof(b2Contact*));
+		}
+	}
+
+	contact->m_managerIndex = m_contactCount;
+	m_contacts[m_contactCount] = contact;
+	++m_contactCount;
+}
+
+void b2ContactManager::RemoveFromContactArray(b2Contact* contact)
+{
+	int32 index = contact->m_managerIndex;
+	b2Assert(0 <= index && index < m_contactCount && m_contacts[index] == contact);
+
+	--m_contactCount;
+	if (index < m_contactCount)
+	{
+		b2Contact* moved = m_contacts[m_contactCount];
+		moved->m_managerIndex = index;
+		m_contacts[index] = moved;
+	}
+
+	contact->m_managerIndex = -1;
 }
 
 void b2ContactManager::Destroy(b2Contact* c)
@@ -45,26 +251,22 @@ void b2ContactManager::Destroy(b2Contact* c)
 	b2Body* bodyA = fixtureA->GetBody();
 	b2Body* bodyB = fixtureB->GetBody();
 
+	++m_stats.contactsDestroyed;
+
 	if (m_contactListener && c->IsTouching())
 	{
 		m_contactListener->EndContact(c);
 	}
 
-	// Remove from the world.
-	if (c->m_prev)
+	if (c->m_flags & b2Contact::e_islandLinkFlag)
 	{
-		c->m_prev->m_next = c->m_next;
+		bodyA->m_world->UnlinkContact(c);
 	}
 
-	if (c->m_next)
-	{
-		c->m_next->m_prev = c->m_prev;
-	}
+	RemoveFromPairTable(c);
 
-	if (c == m_contactList)
-	{
-		m_contactList = c->m_next;
-	}
+	// Remove from the world.
+	RemoveFromContactArray(c);
 
 	// Remove from body 1
 	if (c->m_nodeA.prev)
@@ -100,7 +302,6 @@ void b2ContactManager::Destroy(b2Contact* c)
 
 	// Call the factory.
 	b2Contact::Destroy(c, m_allocator);
-	--m_contactCount;
 }
 
 // This is the top level collision call for the time step. Here
@@ -108,10 +309,17 @@ void b2ContactManager::Destroy(b2Contact* c)
 // contact list.
 void b2ContactManager::Collide()
 {
-	// Update awake contacts.
-	b2Contact* c = m_contactList;
-	while (c)
+	if (m_taskSystem != nullptr)
+	{
+		CollideParallel();
+		return;
+	}
+
+	// Update awake contacts. Walk the array backwards so that a destroyed contact
+	// is replaced by one that was already visited.
+	for (int32 i = m_contactCount - 1; i >= 0; --i)
 	{
+		b2Contact* c = m_contacts[i];
 		b2Fixture* fixtureA = c->GetFixtureA();
 		b2Fixture* fixtureB = c->GetFixtureB();
 		int32 indexA = c->GetChildIndexA();
@@ -125,18 +333,14 @@ void b2ContactManager::Collide()
 			// Should these bodies collide?
 			if (bodyB->ShouldCollide(bodyA) == false)
 			{
-				b2Contact* cNuke = c;
-				c = cNuke->GetNext();
-				Destroy(cNuke);
+				Destroy(c);
 				continue;
 			}
 
 			// Check user filtering.
 			if (m_contactFilter && m_contactFilter->ShouldCollide(fixtureA, fixtureB) == false)
 			{
-				b2Contact* cNuke = c;
-				c = cNuke->GetNext();
-				Destroy(cNuke);
+				Destroy(c);
 				continue;
 			}
 
@@ -150,7 +354,6 @@ void b2ContactManager::Collide()
 		// At least one body must be awake and it must be dynamic or kinematic.
 		if (activeA == false && activeB == false)
 		{
-			c = c->GetNext();
 			continue;
 		}
 
@@ -161,28 +364,252 @@ void b2ContactManager::Collide()
 		// Here we destroy contacts that cease to overlap in the broad-phase.
 		if (overlap == false)
 		{
-			b2Contact* cNuke = c;
-			c = cNuke->GetNext();
-			Destroy(cNuke);
+			Destroy(c);
 			continue;
 		}
 
 		// The contact persists.
+		b2ProfileAccumulate(m_profiler, b2GetNarrowPhaseName(c));
 		c->Update(m_contactListener);
-		c = c->GetNext();
 	}
 }
 
+// What CollideParallel does with a contact in the ordered pass.
+enum b2ContactUpdateState
+{
+	e_contactSleeping,
+	e_contactUpdated,
+	e_contactDestroyed
+};
+
+struct b2ContactUpdate
+{
+	b2Contact* contact;
+	b2Manifold oldManifold;
+	int32 state;
+	bool wasTouching;
+};
+
+struct b2UpdateContactsContext
+{
+	b2ContactUpdate* updates;
+	const b2BroadPhase* broadPhase;
+	b2Profiler* profiler;
+};
+
+void b2ContactManager::UpdateContactsTask(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext)
+{
+	B2_NOT_USED(workerIndex);
+
+	b2UpdateContactsContext* context = (b2UpdateContactsContext*)taskContext;
+	b2ProfileScope(context->profiler, "update contacts task");
+
+	for (int32 i = startIndex; i < endIndex; ++i)
+	{
+		b2ContactUpdate* update = context->updates + i;
+		if (update->state != e_contactUpdated)
+		{
+			continue;
+		}
+
+		b2Contact* c = update->contact;
+		int32 proxyIdA = c->m_fixtureA->m_proxies[c->m_indexA].proxyId;
+		int32 proxyIdB = c->m_fixtureB->m_proxies[c->m_indexB].proxyId;
+
+		// Here we destroy contacts that cease to overlap in the broad-phase.
+		if (context->broadPhase->TestOverlap(proxyIdA, proxyIdB) == false)
+		{
+			update->state = e_contactDestroyed;
+			continue;
+		}
+
+		update->wasTouching = c->IsTouching();
+		b2ProfileAccumulate(context->profiler, b2GetNarrowPhaseName(c));
+		c->UpdateManifold(&update->oldManifold);
+	}
+}
+
+void b2ContactManager::CollideParallel()
+{
+	b2ContactUpdate* updates = (b2ContactUpdate*)m_stackAllocator->Allocate(m_contactCount * sizeof(b2ContactUpdate));
+
+	// Filter and gather the contacts. Contacts are only destroyed in the ordered pass below.
+	int32 count = m_contactCount;
+	for (int32 i = 0; i < count; ++i)
+	{
+		b2Contact* c = m_contacts[i];
+		b2ContactUpdate* update = updates + i;
+		update->contact = c;
+		update->state = e_contactUpdated;
+		update->wasTouching = false;
+
+		b2Fixture* fixtureA = c->GetFixtureA();
+		b2Fixture* fixtureB = c->GetFixtureB();
+		b2Body* bodyA = fixtureA->GetBody();
+		b2Body* bodyB = fixtureB->GetBody();
+
+		// Is this contact flagged for filtering?
+		if (c->m_flags & b2Contact::e_filterFlag)
+		{
+			// Should these bodies collide?
+			if (bodyB->ShouldCollide(bodyA) == false)
+			{
+				update->state = e_contactDestroyed;
+				continue;
+			}
+
+			// Check user filtering.
+			if (m_contactFilter && m_contactFilter->ShouldCollide(fixtureA, fixtureB) == false)
+			{
+				update->state = e_contactDestroyed;
+				continue;
+			}
+
+			// Clear the filtering flag.
+			c->m_flags &= ~b2Contact::e_filterFlag;
+		}
+
+		bool activeA = bodyA->IsAwake() && bodyA->m_type != b2_staticBody;
+		bool activeB = bodyB->IsAwake() && bodyB->m_type != b2_staticBody;
+
+		// At least one body must be awake and it must be dynamic or kinematic.
+		if (activeA == false && activeB == false)
+		{
+			update->state = e_contactSleeping;
+		}
+	}
+
+	b2UpdateContactsContext context;
+	context.updates = updates;
+	context.broadPhase = &m_broadPhase;
+	context.profiler = m_profiler;
+
+	b2ProfileBegin(m_profiler, "update contacts");
+	b2RunTask(m_taskSystem, UpdateContactsTask, count, 64, &context);
+	b2ProfileEnd(m_profiler);
+
+	// Report in reverse array order, the same as Collide.
+	b2ProfileScope(m_profiler, "report contacts");
+	for (int32 i = count - 1; i >= 0; --i)
+	{
+		b2ContactUpdate* update = updates + i;
+		b2Contact* c = update->contact;
+
+		switch (update->state)
+		{
+		case e_contactSleeping:
+			{
+				// A contact earlier in the list may have woken a body.
+				b2Body* bodyA = c->GetFixtureA()->GetBody();
+				b2Body* bodyB = c->GetFixtureB()->GetBody();
+				bool activeA = bodyA->IsAwake() && bodyA->m_type != b2_staticBody;
+				bool activeB = bodyB->IsAwake() && bodyB->m_type != b2_staticBody;
+				if (activeA == false && activeB == false)
+				{
+					break;
+				}
+
+				int32 proxyIdA = c->m_fixtureA->m_proxies[c->m_indexA].proxyId;
+				int32 proxyIdB = c->m_fixtureB->m_proxies[c->m_indexB].proxyId;
+				if (m_broadPhase.TestOverlap(proxyIdA, proxyIdB) == false)
+				{
+					Destroy(c);
+					break;
+				}
+
+				b2ProfileAccumulate(m_profiler, b2GetNarrowPhaseName(c));
+				c->Update(m_contactListener);
+			}
+		break;
+
+		case e_contactUpdated:
+			c->ReportUpdate(m_contactListener, &update->oldManifold, update->wasTouching);
+			break;
+
+		case e_contactDestroyed:
+			Destroy(c);
+			break;
+		}
+	}
+
+	m_stackAllocator->Free(updates);
+}
+
+void b2ContactManager::FindPairsTask(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext)
+{
+	b2ContactManager* manager = (b2ContactManager*)taskContext;
+	b2ProfileScope(manager->m_profiler, "find pairs task");
+	manager->m_broadPhase.FindPairs(startIndex, endIndex, workerIndex);
+}
+
 void b2ContactManager::FindNewContacts()
 {
+	FindPairs();
+	UpdatePairs();
+}
+
+void b2ContactManager::FindPairs()
+{
+	// With a task system the pairs are still reported in move buffer order.
+	b2ProfileScope(m_profiler, "find pairs");
+	int32 workerCount = m_taskSystem != nullptr ? m_taskSystem->GetWorkerCount() : 1;
+	m_broadPhase.BeginFindPairs(workerCount);
+	b2RunTask(m_taskSystem, FindPairsTask, m_broadPhase.GetMoveCount(), 32, this);
+}
+
+void b2ContactManager::UpdatePairs()
+{
+	b2ProfileScope(m_profiler, "update pairs");
+	m_stats.proxiesMoved += m_broadPhase.GetMoveCount();
 	m_broadPhase.UpdatePairs(this);
 }
 
+// Does body B have a contact between these fixture children? This is O(degree).
+static bool b2FindContactInList(const b2Body* bodyB, const b2Fixture* fixtureA, int32 indexA,
+	const b2Fixture* fixtureB, int32 indexB)
+{
+	for (const b2ContactEdge* edge = bodyB->GetContactList(); edge; edge = edge->next)
+	{
+		if (edge->other != fixtureA->GetBody())
+		{
+			continue;
+		}
+
+		const b2Contact* c = edge->contact;
+		const b2Fixture* fA = c->GetFixtureA();
+		const b2Fixture* fB = c->GetFixtureB();
+		int32 iA = c->GetChildIndexA();
+		int32 iB = c->GetChildIndexB();
+
+		if (fA == fixtureA && fB == fixtureB && iA == indexA && iB == indexB)
+		{
+			return true;
+		}
+
+		if (fA == fixtureB && fB == fixtureA && iA == indexB && iB == indexA)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 void b2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 {
 	b2FixtureProxy* proxyA = (b2FixtureProxy*)proxyUserDataA;
 	b2FixtureProxy* proxyB = (b2FixtureProxy*)proxyUserDataB;
 
+	// Proxy ids depend on the history of the broad-phase, so determinism mode orders
+	// the fixtures by id instead.
+	if (m_deterministic && proxyB->fixture->m_id < proxyA->fixture->m_id)
+	{
+		b2Swap(proxyA, proxyB);
+	}
+
+	// Every reported pair is counted, so this includes the pairs rejected below.
+	++m_stats.pairsTested;
+
 	b2Fixture* fixtureA = proxyA->fixture;
 	b2Fixture* fixtureB = proxyB->fixture;
 
@@ -198,33 +625,17 @@ void b2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 		return;
 	}
 
-	// TODO_ERIN use a hash table to remove a potential bottleneck when both
-	// bodies have a lot of contacts.
 	// Does a contact already exist?
-	b2ContactEdge* edge = bodyB->GetContactList();
-	while (edge)
+	if (g_contactPairTable)
 	{
-		if (edge->other == bodyA)
+		if (FindContact(proxyA->proxyId, proxyB->proxyId) != nullptr)
 		{
-			b2Fixture* fA = edge->contact->GetFixtureA();
-			b2Fixture* fB = edge->contact->GetFixtureB();
-			int32 iA = edge->contact->GetChildIndexA();
-			int32 iB = edge->contact->GetChildIndexB();
-
-			if (fA == fixtureA && fB == fixtureB && iA == indexA && iB == indexB)
-			{
-				// A contact already exists.
-				return;
-			}
-
-			if (fA == fixtureB && fB == fixtureA && iA == indexB && iB == indexA)
-			{
-				// A contact already exists.
-				return;
-			}
+			return;
 		}
-
-		edge = edge->next;
+	}
+	else if (b2FindContactInList(bodyB, fixtureA, indexA, fixtureB, indexB))
+	{
+		return;
 	}
 
 	// Does a joint override collision? Is at least one body dynamic?
@@ -246,6 +657,8 @@ void b2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 		return;
 	}
 
+	++m_stats.contactsCreated;
+
 	// Contact creation may swap fixtures.
 	fixtureA = c->GetFixtureA();
 	fixtureB = c->GetFixtureB();
@@ -255,13 +668,7 @@ void b2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 	bodyB = fixtureB->GetBody();
 
 	// Insert into the world.
-	c->m_prev = nullptr;
-	c->m_next = m_contactList;
-	if (m_contactList != nullptr)
-	{
-		m_contactList->m_prev = c;
-	}
-	m_contactList = c;
+	AddToContactArray(c);
 
 	// Connect to island graph.
 
@@ -289,5 +696,5 @@ void b2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 	}
 	bodyB->m_contactList = &c->m_nodeB;
 
-	++m_contactCount;
+	AddToPairTable(c);
 }
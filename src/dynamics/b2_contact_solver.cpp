@@ -50,14 +50,18 @@ struct b2ContactPositionConstraint
 
 b2ContactSolver::b2ContactSolver(b2ContactSolverDef* def)
 {
-	m_step = def->step;
+	m_step = def->data->step;
 	m_allocator = def->allocator;
 	m_count = def->count;
 	m_positionConstraints = (b2ContactPositionConstraint*)m_allocator->Allocate(m_count * sizeof(b2ContactPositionConstraint));
 	m_velocityConstraints = (b2ContactVelocityConstraint*)m_allocator->Allocate(m_count * sizeof(b2ContactVelocityConstraint));
-	m_positions = def->positions;
-	m_velocities = def->velocities;
+	m_positions = def->data->positions;
+	m_velocities = def->data->velocities;
+	m_bodyColors = def->bodyColors;
 	m_contacts = def->contacts;
+	m_constraintColors = nullptr;
+	m_wideConstraints = nullptr;
+	m_wideCount = 0;
 
 	// Initialize position independent portions of the constraints.
 	for (int32 i = 0; i < m_count; ++i)
@@ -73,6 +77,8 @@ b2ContactSolver::b2ContactSolver(b2ContactSolverDef* def)
 		b2Body* bodyA = fixtureA->GetBody();
 		b2Body* bodyB = fixtureB->GetBody();
 		b2Manifold* manifold = contact->GetManifold();
+		int32 indexA = def->data->GetIndex(bodyA);
+		int32 indexB = def->data->GetIndex(bodyB);
 
 		int32 pointCount = manifold->pointCount;
 		b2Assert(pointCount > 0);
@@ -82,8 +88,8 @@ b2ContactSolver::b2ContactSolver(b2ContactSolverDef* def)
 		vc->restitution = contact->m_restitution;
 		vc->threshold = contact->m_restitutionThreshold;
 		vc->tangentSpeed = contact->m_tangentSpeed;
-		vc->indexA = bodyA->m_islandIndex;
-		vc->indexB = bodyB->m_islandIndex;
+		vc->indexA = indexA;
+		vc->indexB = indexB;
 		vc->invMassA = bodyA->m_invMass;
 		vc->invMassB = bodyB->m_invMass;
 		vc->invIA = bodyA->m_invI;
@@ -94,12 +100,12 @@ b2ContactSolver::b2ContactSolver(b2ContactSolverDef* def)
 		vc->normalMass.SetZero();
 
 		b2ContactPositionConstraint* pc = m_positionConstraints + i;
-		pc->indexA = bodyA->m_islandIndex;
-		pc->indexB = bodyB->m_islandIndex;
+		pc->indexA = indexA;
+		pc->indexB = indexB;
 		pc->invMassA = bodyA->m_invMass;
 		pc->invMassB = bodyB->m_invMass;
-		pc->localCenterA = bodyA->m_sweep.localCenter;
-		pc->localCenterB = bodyB->m_sweep.localCenter;
+		pc->localCenterA = bodyA->m_localCenter;
+		pc->localCenterB = bodyB->m_localCenter;
 		pc->invIA = bodyA->m_invI;
 		pc->invIB = bodyB->m_invI;
 		pc->localNormal = manifold->localNormal;
@@ -130,6 +136,7 @@ b2ContactSolver::b2ContactSolver(b2ContactSolverDef* def)
 			vcp->normalMass = 0.0f;
 			vcp->tangentMass = 0.0f;
 			vcp->velocityBias = 0.0f;
+			vcp->relativeVelocity = 0.0f;
 
 			pc->localPoints[j] = cp->localPoint;
 		}
@@ -138,6 +145,12 @@ b2ContactSolver::b2ContactSolver(b2ContactSolverDef* def)
 
 b2ContactSolver::~b2ContactSolver()
 {
+	if (m_wideConstraints != nullptr)
+	{
+		m_allocator->Free(m_wideConstraints);
+		m_allocator->Free(m_constraintColors);
+	}
+
 	m_allocator->Free(m_velocityConstraints);
 	m_allocator->Free(m_positionConstraints);
 }
@@ -187,6 +200,8 @@ void b2ContactSolver::InitializeVelocityConstraints()
 
 		vc->normal = worldManifold.normal;
 
+		bool speculative = m_contacts[vc->contactIndex]->m_speculativeDistance > 0.0f;
+
 		int32 pointCount = vc->pointCount;
 		for (int32 j = 0; j < pointCount; ++j)
 		{
@@ -213,8 +228,15 @@ void b2ContactSolver::InitializeVelocityConstraints()
 
 			// Setup a velocity bias for restitution.
 			vcp->velocityBias = 0.0f;
+			vcp->relativeVelocity = 0.0f;
 			float vRel = b2Dot(vc->normal, vB + b2Cross(wB, vcp->rB) - vA - b2Cross(wA, vcp->rA));
-			if (vRel < -vc->threshold)
+			if (speculative && worldManifold.separations[j] > 0.0f)
+			{
+				// The bodies may approach until the point touches at the end of the step.
+				vcp->velocityBias = -worldManifold.separations[j] * m_step.inv_dt;
+				vcp->relativeVelocity = b2Min(vRel, 0.0f);
+			}
+			else if (vRel < -vc->threshold)
 			{
 				vcp->velocityBias = -vc->restitution * vRel;
 			}
@@ -252,10 +274,21 @@ void b2ContactSolver::InitializeVelocityConstraints()
 			}
 		}
 	}
+
+	if (m_step.wideSolver)
+	{
+		PrepareWideConstraints();
+	}
 }
 
 void b2ContactSolver::WarmStart()
 {
+	if (m_wideConstraints != nullptr)
+	{
+		WarmStartWide();
+		return;
+	}
+
 	// Warm start.
 	for (int32 i = 0; i < m_count; ++i)
 	{
@@ -296,6 +329,12 @@ void b2ContactSolver::WarmStart()
 
 void b2ContactSolver::SolveVelocityConstraints()
 {
+	if (m_wideConstraints != nullptr)
+	{
+		SolveVelocityConstraintsWide();
+		return;
+	}
+
 	for (int32 i = 0; i < m_count; ++i)
 	{
 		b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
@@ -608,6 +647,11 @@ void b2ContactSolver::SolveVelocityConstraints()
 
 void b2ContactSolver::StoreImpulses()
 {
+	if (m_wideConstraints != nullptr)
+	{
+		StoreImpulsesWide();
+	}
+
 	for (int32 i = 0; i < m_count; ++i)
 	{
 		b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
@@ -621,6 +665,68 @@ void b2ContactSolver::StoreImpulses()
 	}
 }
 
+void b2ContactSolver::ApplySpeculativeRestitution()
+{
+	for (int32 i = 0; i < m_count; ++i)
+	{
+		b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
+
+		int32 indexA = vc->indexA;
+		int32 indexB = vc->indexB;
+		float mA = vc->invMassA;
+		float iA = vc->invIA;
+		float mB = vc->invMassB;
+		float iB = vc->invIB;
+		b2Vec2 normal = vc->normal;
+
+		b2Vec2 vA = m_velocities[indexA].v;
+		float wA = m_velocities[indexA].w;
+		b2Vec2 vB = m_velocities[indexB].v;
+		float wB = m_velocities[indexB].w;
+
+		bool applied = false;
+		for (int32 j = 0; j < vc->pointCount; ++j)
+		{
+			b2VelocityConstraintPoint* vcp = vc->points + j;
+
+			// Skip points that were not reached.
+			if (vcp->relativeVelocity == 0.0f || vcp->normalImpulse == 0.0f)
+			{
+				continue;
+			}
+
+			float targetVelocity = 0.0f;
+			if (vcp->relativeVelocity < -vc->threshold)
+			{
+				targetVelocity = -vc->restitution * vcp->relativeVelocity;
+			}
+
+			b2Vec2 dv = vB + b2Cross(wB, vcp->rB) - vA - b2Cross(wA, vcp->rA);
+			float vn = b2Dot(dv, normal);
+
+			float impulse = -vcp->normalMass * (vn - targetVelocity);
+			float newImpulse = b2Max(vcp->normalImpulse + impulse, 0.0f);
+			impulse = newImpulse - vcp->normalImpulse;
+			vcp->normalImpulse = newImpulse;
+
+			b2Vec2 P = impulse * normal;
+			vA -= mA * P;
+			wA -= iA * b2Cross(vcp->rA, P);
+			vB += mB * P;
+			wB += iB * b2Cross(vcp->rB, P);
+			applied = true;
+		}
+
+		if (applied)
+		{
+			m_velocities[indexA].v = vA;
+			m_velocities[indexA].w = wA;
+			m_velocities[indexB].v = vB;
+			m_velocities[indexB].w = wB;
+		}
+	}
+}
+
 struct b2PositionSolverManifold
 {
 	void Initialize(b2ContactPositionConstraint* pc, const b2Transform& xfA, const b2Transform& xfB, int32 index)
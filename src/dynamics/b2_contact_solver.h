@@ -31,6 +31,7 @@ class b2Contact;
 class b2Body;
 class b2StackAllocator;
 struct b2ContactPositionConstraint;
+struct b2ContactConstraintWide;
 
 struct b2VelocityConstraintPoint
 {
@@ -41,6 +42,9 @@ struct b2VelocityConstraintPoint
 	float normalMass;
 	float tangentMass;
 	float velocityBias;
+
+	// The approach velocity of a speculative point, otherwise zero.
+	float relativeVelocity;
 };
 
 struct b2ContactVelocityConstraint
@@ -63,11 +67,12 @@ struct b2ContactVelocityConstraint
 
 struct b2ContactSolverDef
 {
-	b2TimeStep step;
 	b2Contact** contacts;
 	int32 count;
-	b2Position* positions;
-	b2Velocity* velocities;
+	const b2SolverData* data;
+
+	// Zeroed scratch space for the wide solver, indexed like the state arrays.
+	uint32* bodyColors;
 	b2StackAllocator* allocator;
 };
 
@@ -83,17 +88,34 @@ public:
 	void SolveVelocityConstraints();
 	void StoreImpulses();
 
+	// Apply restitution to speculative points that were reached during the step. Call
+	// this after integrating positions so bodies bounce from the surface instead of before
+	// it. Without restitution the approach velocity is removed.
+	void ApplySpeculativeRestitution();
+
 	bool SolvePositionConstraints();
 	bool SolveTOIPositionConstraints(int32 toiIndexA, int32 toiIndexB);
 
+	// Wide solver. The velocity constraints are graph colored and packed into
+	// batches of b2_simdWidth constraints that share no dynamic body.
+	void PrepareWideConstraints();
+	void WarmStartWide();
+	void SolveVelocityConstraintsWide();
+	void StoreImpulsesWide();
+
 	b2TimeStep m_step;
 	b2Position* m_positions;
 	b2Velocity* m_velocities;
+	uint32* m_bodyColors;
 	b2StackAllocator* m_allocator;
 	b2ContactPositionConstraint* m_positionConstraints;
 	b2ContactVelocityConstraint* m_velocityConstraints;
 	b2Contact** m_contacts;
 	int m_count;
+
+	int32* m_constraintColors;
+	b2ContactConstraintWide* m_wideConstraints;
+	int32 m_wideCount;
 };
 
 #endif
@@ -0,0 +1,625 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "b2_contact_solver.h"
+#include "common/b2_simd.h"
+
+#include "box2d/b2_stack_allocator.h"
+
+#include <string.h>
+
+extern B2_API bool g_blockSolve;
+
+// Run the wide solver with the scalar implementation of the wide float operations.
+// This is for testing the scalar fallback against the SIMD implementation.
+B2_API bool g_wideSolverScalar = false;
+
+// The wide solver runs the same math as b2ContactSolver::SolveVelocityConstraints
+// on b2_simdWidth constraints at a time. Constraints in a batch share no dynamic
+// body. Bodies with infinite mass may be shared because their velocity never changes.
+
+struct b2ContactPointWide
+{
+	float rAx[b2_simdWidth];
+	float rAy[b2_simdWidth];
+	float rBx[b2_simdWidth];
+	float rBy[b2_simdWidth];
+	float normalImpulse[b2_simdWidth];
+	float tangentImpulse[b2_simdWidth];
+	float normalMass[b2_simdWidth];
+	float tangentMass[b2_simdWidth];
+	float velocityBias[b2_simdWidth];
+};
+
+struct b2ContactConstraintWide
+{
+	b2ContactPointWide points[b2_maxManifoldPoints];
+	float normalX[b2_simdWidth];
+	float normalY[b2_simdWidth];
+	float invMassA[b2_simdWidth];
+	float invMassB[b2_simdWidth];
+	float invIA[b2_simdWidth];
+	float invIB[b2_simdWidth];
+	float friction[b2_simdWidth];
+	float tangentSpeed[b2_simdWidth];
+
+	// Block solver
+	float k11[b2_simdWidth];
+	float k12[b2_simdWidth];
+	float k22[b2_simdWidth];
+	float normalMass11[b2_simdWidth];
+	float normalMass12[b2_simdWidth];
+	float normalMass21[b2_simdWidth];
+	float normalMass22[b2_simdWidth];
+
+	int32 indexA[b2_simdWidth];
+	int32 indexB[b2_simdWidth];
+
+	// The velocity constraint of each lane or -1 for an unused lane.
+	int32 constraintIndex[b2_simdWidth];
+
+	// All constraints in a batch have the same point count and solver.
+	int32 pointCount;
+	bool blockSolve;
+};
+
+template <typename FloatW>
+struct b2BodyWide
+{
+	FloatW vx;
+	FloatW vy;
+	FloatW w;
+};
+
+// Constraints are grouped by color and then by how they are solved.
+enum
+{
+	e_onePointBatch,
+	e_blockSolveBatch,
+	e_twoPointBatch,
+	e_batchKindCount
+};
+
+static int32 b2GetBatchKind(const b2ContactVelocityConstraint* vc)
+{
+	if (vc->pointCount == 1)
+	{
+		return e_onePointBatch;
+	}
+
+	return g_blockSolve ? e_blockSolveBatch : e_twoPointBatch;
+}
+
+template <typename FloatW>
+static b2BodyWide<FloatW> b2GatherBodies(const b2Velocity* velocities, const int32* indices)
+{
+	float vx[b2_simdWidth];
+	float vy[b2_simdWidth];
+	float w[b2_simdWidth];
+
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		const b2Velocity* v = velocities + indices[i];
+		vx[i] = v->v.x;
+		vy[i] = v->v.y;
+		w[i] = v->w;
+	}
+
+	b2BodyWide<FloatW> body;
+	body.vx = b2LoadW<FloatW>(vx);
+	body.vy = b2LoadW<FloatW>(vy);
+	body.w = b2LoadW<FloatW>(w);
+	return body;
+}
+
+template <typename FloatW>
+static void b2ScatterBodies(b2Velocity* velocities, const int32* indices, const int32* constraintIndices, const b2BodyWide<FloatW>& body)
+{
+	float vx[b2_simdWidth];
+	float vy[b2_simdWidth];
+	float w[b2_simdWidth];
+	b2StoreW(vx, body.vx);
+	b2StoreW(vy, body.vy);
+	b2StoreW(w, body.w);
+
+	for (int32 i = 0; i < b2_simdWidth; ++i)
+	{
+		// Unused lanes may alias a body of another lane.
+		if (constraintIndices[i] < 0)
+		{
+			continue;
+		}
+
+		b2Velocity* v = velocities + indices[i];
+		v->v.x = vx[i];
+		v->v.y = vy[i];
+		v->w = w[i];
+	}
+}
+
+// Cross product of r with the impulse P.
+template <typename FloatW>
+static inline FloatW b2CrossW(FloatW rx, FloatW ry, FloatW Px, FloatW Py)
+{
+	return b2SubW(b2MulW(rx, Py), b2MulW(ry, Px));
+}
+
+// Relative velocity at a contact point: vB + b2Cross(wB, rB) - vA - b2Cross(wA, rA)
+template <typename FloatW>
+static inline void b2RelativeVelocityW(FloatW* dvx, FloatW* dvy, const b2BodyWide<FloatW>& A, const b2BodyWide<FloatW>& B,
+	FloatW rAx, FloatW rAy, FloatW rBx, FloatW rBy)
+{
+	*dvx = b2SubW(b2SubW(b2AddW(B.vx, b2NegW(b2MulW(B.w, rBy))), A.vx), b2NegW(b2MulW(A.w, rAy)));
+	*dvy = b2SubW(b2SubW(b2AddW(B.vy, b2MulW(B.w, rBx)), A.vy), b2MulW(A.w, rAx));
+}
+
+void b2ContactSolver::PrepareWideConstraints()
+{
+	b2Assert(m_wideConstraints == nullptr);
+
+	m_constraintColors = (int32*)m_allocator->Allocate(m_count * sizeof(int32));
+
+	// Greedy graph coloring in constraint order. Only dynamic bodies are colored and
+	// these belong to a single island, so islands share the body colors.
+	b2Assert(m_bodyColors != nullptr);
+	uint32* bodyColors = m_bodyColors;
+
+	int32 bucketCounts[b2_graphColorCount * e_batchKindCount];
+	memset(bucketCounts, 0, sizeof(bucketCounts));
+	int32 overflowCount = 0;
+
+	for (int32 i = 0; i < m_count; ++i)
+	{
+		const b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
+		bool dynamicA = vc->invMassA > 0.0f || vc->invIA > 0.0f;
+		bool dynamicB = vc->invMassB > 0.0f || vc->invIB > 0.0f;
+
+		uint32 usedColors = 0;
+		if (dynamicA)
+		{
+			usedColors |= bodyColors[vc->indexA];
+		}
+		if (dynamicB)
+		{
+			usedColors |= bodyColors[vc->indexB];
+		}
+
+		int32 color = -1;
+		for (int32 j = 0; j < b2_graphColorCount; ++j)
+		{
+			if ((usedColors & (1u << j)) == 0)
+			{
+				color = j;
+				break;
+			}
+		}
+
+		m_constraintColors[i] = color;
+
+		if (color == -1)
+		{
+			++overflowCount;
+			continue;
+		}
+
+		if (dynamicA)
+		{
+			bodyColors[vc->indexA] |= 1u << color;
+		}
+		if (dynamicB)
+		{
+			bodyColors[vc->indexB] |= 1u << color;
+		}
+
+		++bucketCounts[color * e_batchKindCount + b2GetBatchKind(vc)];
+	}
+
+	// Each bucket is split into batches. Overflow constraints get a batch each.
+	int32 bucketBatches[b2_graphColorCount * e_batchKindCount];
+	m_wideCount = 0;
+	for (int32 i = 0; i < b2_graphColorCount * e_batchKindCount; ++i)
+	{
+		bucketBatches[i] = m_wideCount;
+		m_wideCount += (bucketCounts[i] + b2_simdWidth - 1) / b2_simdWidth;
+	}
+
+	int32 overflowBatch = m_wideCount;
+	m_wideCount += overflowCount;
+
+	// Allocate at least one batch so the wide path is used for empty islands too.
+	int32 capacity = b2Max(m_wideCount, 1);
+	m_wideConstraints = (b2ContactConstraintWide*)m_allocator->Allocate(capacity * sizeof(b2ContactConstraintWide));
+	memset(m_wideConstraints, 0, capacity * sizeof(b2ContactConstraintWide));
+	for (int32 i = 0; i < m_wideCount; ++i)
+	{
+		for (int32 j = 0; j < b2_simdWidth; ++j)
+		{
+			m_wideConstraints[i].constraintIndex[j] = -1;
+		}
+	}
+
+	memset(bucketCounts, 0, sizeof(bucketCounts));
+
+	for (int32 i = 0; i < m_count; ++i)
+	{
+		const b2ContactVelocityConstraint* vc = m_velocityConstraints + i;
+		int32 kind = b2GetBatchKind(vc);
+		int32 color = m_constraintColors[i];
+
+		b2ContactConstraintWide* wc;
+		int32 lane;
+		if (color == -1)
+		{
+			wc = m_wideConstraints + overflowBatch++;
+			lane = 0;
+		}
+		else
+		{
+			int32 bucket = color * e_batchKindCount + kind;
+			int32 slot = bucketCounts[bucket]++;
+			wc = m_wideConstraints + bucketBatches[bucket] + slot / b2_simdWidth;
+			lane = slot % b2_simdWidth;
+		}
+
+		wc->pointCount = vc->pointCount;
+		wc->blockSolve = kind == e_blockSolveBatch;
+		wc->constraintIndex[lane] = i;
+		wc->indexA[lane] = vc->indexA;
+		wc->indexB[lane] = vc->indexB;
+		wc->normalX[lane] = vc->normal.x;
+		wc->normalY[lane] = vc->normal.y;
+		wc->invMassA[lane] = vc->invMassA;
+		wc->invMassB[lane] = vc->invMassB;
+		wc->invIA[lane] = vc->invIA;
+		wc->invIB[lane] = vc->invIB;
+		wc->friction[lane] = vc->friction;
+		wc->tangentSpeed[lane] = vc->tangentSpeed;
+		wc->k11[lane] = vc->K.ex.x;
+		wc->k12[lane] = vc->K.ex.y;
+		wc->k22[lane] = vc->K.ey.y;
+		wc->normalMass11[lane] = vc->normalMass.ex.x;
+		wc->normalMass12[lane] = vc->normalMass.ey.x;
+		wc->normalMass21[lane] = vc->normalMass.ex.y;
+		wc->normalMass22[lane] = vc->normalMass.ey.y;
+
+		for (int32 j = 0; j < vc->pointCount; ++j)
+		{
+			const b2VelocityConstraintPoint* vcp = vc->points + j;
+			b2ContactPointWide* wcp = wc->points + j;
+			wcp->rAx[lane] = vcp->rA.x;
+			wcp->rAy[lane] = vcp->rA.y;
+			wcp->rBx[lane] = vcp->rB.x;
+			wcp->rBy[lane] = vcp->rB.y;
+			wcp->normalImpulse[lane] = vcp->normalImpulse;
+			wcp->tangentImpulse[lane] = vcp->tangentImpulse;
+			wcp->normalMass[lane] = vcp->normalMass;
+			wcp->tangentMass[lane] = vcp->tangentMass;
+			wcp->velocityBias[lane] = vcp->velocityBias;
+		}
+	}
+
+	// Unused lanes alias the bodies of lane 0 so gathers stay inside this island's slots.
+	for (int32 i = 0; i < m_wideCount; ++i)
+	{
+		b2ContactConstraintWide* wc = m_wideConstraints + i;
+		for (int32 j = 1; j < b2_simdWidth; ++j)
+		{
+			if (wc->constraintIndex[j] < 0)
+			{
+				wc->indexA[j] = wc->indexA[0];
+				wc->indexB[j] = wc->indexB[0];
+			}
+		}
+	}
+}
+
+template <typename FloatW>
+static void b2WarmStartWide(const b2ContactConstraintWide* constraints, int32 count, b2Velocity* velocities)
+{
+	for (int32 i = 0; i < count; ++i)
+	{
+		const b2ContactConstraintWide* wc = constraints + i;
+
+		b2BodyWide<FloatW> A = b2GatherBodies<FloatW>(velocities, wc->indexA);
+		b2BodyWide<FloatW> B = b2GatherBodies<FloatW>(velocities, wc->indexB);
+
+		FloatW mA = b2LoadW<FloatW>(wc->invMassA);
+		FloatW iA = b2LoadW<FloatW>(wc->invIA);
+		FloatW mB = b2LoadW<FloatW>(wc->invMassB);
+		FloatW iB = b2LoadW<FloatW>(wc->invIB);
+
+		FloatW nx = b2LoadW<FloatW>(wc->normalX);
+		FloatW ny = b2LoadW<FloatW>(wc->normalY);
+
+		// tangent = b2Cross(normal, 1.0f)
+		FloatW tx = ny;
+		FloatW ty = b2NegW(nx);
+
+		for (int32 j = 0; j < wc->pointCount; ++j)
+		{
+			const b2ContactPointWide* wcp = wc->points + j;
+			FloatW rAx = b2LoadW<FloatW>(wcp->rAx);
+			FloatW rAy = b2LoadW<FloatW>(wcp->rAy);
+			FloatW rBx = b2LoadW<FloatW>(wcp->rBx);
+			FloatW rBy = b2LoadW<FloatW>(wcp->rBy);
+			FloatW normalImpulse = b2LoadW<FloatW>(wcp->normalImpulse);
+			FloatW tangentImpulse = b2LoadW<FloatW>(wcp->tangentImpulse);
+
+			FloatW Px = b2AddW(b2MulW(normalImpulse, nx), b2MulW(tangentImpulse, tx));
+			FloatW Py = b2AddW(b2MulW(normalImpulse, ny), b2MulW(tangentImpulse, ty));
+
+			A.w = b2SubW(A.w, b2MulW(iA, b2CrossW(rAx, rAy, Px, Py)));
+			A.vx = b2SubW(A.vx, b2MulW(mA, Px));
+			A.vy = b2SubW(A.vy, b2MulW(mA, Py));
+			B.w = b2AddW(B.w, b2MulW(iB, b2CrossW(rBx, rBy, Px, Py)));
+			B.vx = b2AddW(B.vx, b2MulW(mB, Px));
+			B.vy = b2AddW(B.vy, b2MulW(mB, Py));
+		}
+
+		b2ScatterBodies(velocities, wc->indexA, wc->constraintIndex, A);
+		b2ScatterBodies(velocities, wc->indexB, wc->constraintIndex, B);
+	}
+}
+
+template <typename FloatW>
+static void b2SolveVelocityConstraintsWide(b2ContactConstraintWide* constraints, int32 count, b2Velocity* velocities)
+{
+	FloatW zero = b2ZeroW<FloatW>();
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		b2ContactConstraintWide* wc = constraints + i;
+
+		b2BodyWide<FloatW> A = b2GatherBodies<FloatW>(velocities, wc->indexA);
+		b2BodyWide<FloatW> B = b2GatherBodies<FloatW>(velocities, wc->indexB);
+
+		FloatW mA = b2LoadW<FloatW>(wc->invMassA);
+		FloatW iA = b2LoadW<FloatW>(wc->invIA);
+		FloatW mB = b2LoadW<FloatW>(wc->invMassB);
+		FloatW iB = b2LoadW<FloatW>(wc->invIB);
+
+		FloatW nx = b2LoadW<FloatW>(wc->normalX);
+		FloatW ny = b2LoadW<FloatW>(wc->normalY);
+		FloatW tx = ny;
+		FloatW ty = b2NegW(nx);
+		FloatW friction = b2LoadW<FloatW>(wc->friction);
+		FloatW tangentSpeed = b2LoadW<FloatW>(wc->tangentSpeed);
+
+		int32 pointCount = wc->pointCount;
+
+		// Solve tangent constraints first because non-penetration is more important
+		// than friction.
+		for (int32 j = 0; j < pointCount; ++j)
+		{
+			b2ContactPointWide* wcp = wc->points + j;
+			FloatW rAx = b2LoadW<FloatW>(wcp->rAx);
+			FloatW rAy = b2LoadW<FloatW>(wcp->rAy);
+			FloatW rBx = b2LoadW<FloatW>(wcp->rBx);
+			FloatW rBy = b2LoadW<FloatW>(wcp->rBy);
+
+			FloatW dvx, dvy;
+			b2RelativeVelocityW(&dvx, &dvy, A, B, rAx, rAy, rBx, rBy);
+
+			// Compute tangent force
+			FloatW vt = b2SubW(b2AddW(b2MulW(dvx, tx), b2MulW(dvy, ty)), tangentSpeed);
+			FloatW lambda = b2MulW(b2LoadW<FloatW>(wcp->tangentMass), b2NegW(vt));
+
+			// b2Clamp the accumulated force
+			FloatW tangentImpulse = b2LoadW<FloatW>(wcp->tangentImpulse);
+			FloatW maxFriction = b2MulW(friction, b2LoadW<FloatW>(wcp->normalImpulse));
+			FloatW newImpulse = b2MaxW(b2NegW(maxFriction), b2MinW(b2AddW(tangentImpulse, lambda), maxFriction));
+			lambda = b2SubW(newImpulse, tangentImpulse);
+			b2StoreW(wcp->tangentImpulse, newImpulse);
+
+			// Apply contact impulse
+			FloatW Px = b2MulW(lambda, tx);
+			FloatW Py = b2MulW(lambda, ty);
+
+			A.vx = b2SubW(A.vx, b2MulW(mA, Px));
+			A.vy = b2SubW(A.vy, b2MulW(mA, Py));
+			A.w = b2SubW(A.w, b2MulW(iA, b2CrossW(rAx, rAy, Px, Py)));
+
+			B.vx = b2AddW(B.vx, b2MulW(mB, Px));
+			B.vy = b2AddW(B.vy, b2MulW(mB, Py));
+			B.w = b2AddW(B.w, b2MulW(iB, b2CrossW(rBx, rBy, Px, Py)));
+		}
+
+		// Solve normal constraints
+		if (wc->blockSolve == false)
+		{
+			for (int32 j = 0; j < pointCount; ++j)
+			{
+				b2ContactPointWide* wcp = wc->points + j;
+				FloatW rAx = b2LoadW<FloatW>(wcp->rAx);
+				FloatW rAy = b2LoadW<FloatW>(wcp->rAy);
+				FloatW rBx = b2LoadW<FloatW>(wcp->rBx);
+				FloatW rBy = b2LoadW<FloatW>(wcp->rBy);
+
+				FloatW dvx, dvy;
+				b2RelativeVelocityW(&dvx, &dvy, A, B, rAx, rAy, rBx, rBy);
+
+				// Compute normal impulse
+				FloatW vn = b2AddW(b2MulW(dvx, nx), b2MulW(dvy, ny));
+				FloatW velocityBias = b2LoadW<FloatW>(wcp->velocityBias);
+				FloatW lambda = b2MulW(b2NegW(b2LoadW<FloatW>(wcp->normalMass)), b2SubW(vn, velocityBias));
+
+				// b2Clamp the accumulated impulse
+				FloatW normalImpulse = b2LoadW<FloatW>(wcp->normalImpulse);
+				FloatW newImpulse = b2MaxW(b2AddW(normalImpulse, lambda), zero);
+				lambda = b2SubW(newImpulse, normalImpulse);
+				b2StoreW(wcp->normalImpulse, newImpulse);
+
+				// Apply contact impulse
+				FloatW Px = b2MulW(lambda, nx);
+				FloatW Py = b2MulW(lambda, ny);
+
+				A.vx = b2SubW(A.vx, b2MulW(mA, Px));
+				A.vy = b2SubW(A.vy, b2MulW(mA, Py));
+				A.w = b2SubW(A.w, b2MulW(iA, b2CrossW(rAx, rAy, Px, Py)));
+
+				B.vx = b2AddW(B.vx, b2MulW(mB, Px));
+				B.vy = b2AddW(B.vy, b2MulW(mB, Py));
+				B.w = b2AddW(B.w, b2MulW(iB, b2CrossW(rBx, rBy, Px, Py)));
+			}
+		}
+		else
+		{
+			// The block solver of SolveVelocityConstraints. All four cases are computed
+			// and the first valid case is selected per lane.
+			b2ContactPointWide* cp1 = wc->points + 0;
+			b2ContactPointWide* cp2 = wc->points + 1;
+
+			FloatW r1Ax = b2LoadW<FloatW>(cp1->rAx);
+			FloatW r1Ay = b2LoadW<FloatW>(cp1->rAy);
+			FloatW r1Bx = b2LoadW<FloatW>(cp1->rBx);
+			FloatW r1By = b2LoadW<FloatW>(cp1->rBy);
+			FloatW r2Ax = b2LoadW<FloatW>(cp2->rAx);
+			FloatW r2Ay = b2LoadW<FloatW>(cp2->rAy);
+			FloatW r2Bx = b2LoadW<FloatW>(cp2->rBx);
+			FloatW r2By = b2LoadW<FloatW>(cp2->rBy);
+
+			FloatW ax = b2LoadW<FloatW>(cp1->normalImpulse);
+			FloatW ay = b2LoadW<FloatW>(cp2->normalImpulse);
+
+			// Relative velocity at contact
+			FloatW dv1x, dv1y, dv2x, dv2y;
+			b2RelativeVelocityW(&dv1x, &dv1y, A, B, r1Ax, r1Ay, r1Bx, r1By);
+			b2RelativeVelocityW(&dv2x, &dv2y, A, B, r2Ax, r2Ay, r2Bx, r2By);
+
+			// Compute normal velocity
+			FloatW vn1 = b2AddW(b2MulW(dv1x, nx), b2MulW(dv1y, ny));
+			FloatW vn2 = b2AddW(b2MulW(dv2x, nx), b2MulW(dv2y, ny));
+
+			FloatW k11 = b2LoadW<FloatW>(wc->k11);
+			FloatW k12 = b2LoadW<FloatW>(wc->k12);
+			FloatW k22 = b2LoadW<FloatW>(wc->k22);
+
+			// Compute b'
+			FloatW bx = b2SubW(vn1, b2LoadW<FloatW>(cp1->velocityBias));
+			FloatW by = b2SubW(vn2, b2LoadW<FloatW>(cp2->velocityBias));
+			bx = b2SubW(bx, b2AddW(b2MulW(k11, ax), b2MulW(k12, ay)));
+			by = b2SubW(by, b2AddW(b2MulW(k12, ax), b2MulW(k22, ay)));
+
+			// Case 4: x1 = 0 and x2 = 0
+			FloatW valid4 = b2AndW(b2GreaterEqualW(bx, zero), b2GreaterEqualW(by, zero));
+
+			// Case 3: vn2 = 0 and x1 = 0
+			FloatW x3y = b2MulW(b2NegW(b2LoadW<FloatW>(cp2->normalMass)), by);
+			FloatW vn1Case3 = b2AddW(b2MulW(k12, x3y), bx);
+			FloatW valid3 = b2AndW(b2GreaterEqualW(x3y, zero), b2GreaterEqualW(vn1Case3, zero));
+
+			// Case 2: vn1 = 0 and x2 = 0
+			FloatW x2x = b2MulW(b2NegW(b2LoadW<FloatW>(cp1->normalMass)), bx);
+			FloatW vn2Case2 = b2AddW(b2MulW(k12, x2x), by);
+			FloatW valid2 = b2AndW(b2GreaterEqualW(x2x, zero), b2GreaterEqualW(vn2Case2, zero));
+
+			// Case 1: vn = 0
+			FloatW x1x = b2NegW(b2AddW(b2MulW(b2LoadW<FloatW>(wc->normalMass11), bx), b2MulW(b2LoadW<FloatW>(wc->normalMass12), by)));
+			FloatW x1y = b2NegW(b2AddW(b2MulW(b2LoadW<FloatW>(wc->normalMass21), bx), b2MulW(b2LoadW<FloatW>(wc->normalMass22), by)));
+			FloatW valid1 = b2AndW(b2GreaterEqualW(x1x, zero), b2GreaterEqualW(x1y, zero));
+
+			// No solution keeps the old impulse.
+			FloatW xx = ax;
+			FloatW xy = ay;
+			xx = b2BlendW(xx, zero, valid4);
+			xy = b2BlendW(xy, zero, valid4);
+			xx = b2BlendW(xx, zero, valid3);
+			xy = b2BlendW(xy, x3y, valid3);
+			xx = b2BlendW(xx, x2x, valid2);
+			xy = b2BlendW(xy, zero, valid2);
+			xx = b2BlendW(xx, x1x, valid1);
+			xy = b2BlendW(xy, x1y, valid1);
+
+			// Get the incremental impulse
+			FloatW dx = b2SubW(xx, ax);
+			FloatW dy = b2SubW(xy, ay);
+
+			// Apply incremental impulse
+			FloatW P1x = b2MulW(dx, nx);
+			FloatW P1y = b2MulW(dx, ny);
+			FloatW P2x = b2MulW(dy, nx);
+			FloatW P2y = b2MulW(dy, ny);
+
+			A.vx = b2SubW(A.vx, b2MulW(mA, b2AddW(P1x, P2x)));
+			A.vy = b2SubW(A.vy, b2MulW(mA, b2AddW(P1y, P2y)));
+			A.w = b2SubW(A.w, b2MulW(iA, b2AddW(b2CrossW(r1Ax, r1Ay, P1x, P1y), b2CrossW(r2Ax, r2Ay, P2x, P2y))));
+
+			B.vx = b2AddW(B.vx, b2MulW(mB, b2AddW(P1x, P2x)));
+			B.vy = b2AddW(B.vy, b2MulW(mB, b2AddW(P1y, P2y)));
+			B.w = b2AddW(B.w, b2MulW(iB, b2AddW(b2CrossW(r1Bx, r1By, P1x, P1y), b2CrossW(r2Bx, r2By, P2x, P2y))));
+
+			// Accumulate
+			b2StoreW(cp1->normalImpulse, xx);
+			b2StoreW(cp2->normalImpulse, xy);
+		}
+
+		b2ScatterBodies(velocities, wc->indexA, wc->constraintIndex, A);
+		b2ScatterBodies(velocities, wc->indexB, wc->constraintIndex, B);
+	}
+}
+
+void b2ContactSolver::WarmStartWide()
+{
+	if (g_wideSolverScalar)
+	{
+		b2WarmStartWide<b2ScalarW>(m_wideConstraints, m_wideCount, m_velocities);
+	}
+	else
+	{
+		b2WarmStartWide<b2FloatW>(m_wideConstraints, m_wideCount, m_velocities);
+	}
+}
+
+void b2ContactSolver::SolveVelocityConstraintsWide()
+{
+	if (g_wideSolverScalar)
+	{
+		b2SolveVelocityConstraintsWide<b2ScalarW>(m_wideConstraints, m_wideCount, m_velocities);
+	}
+	else
+	{
+		b2SolveVelocityConstraintsWide<b2FloatW>(m_wideConstraints, m_wideCount, m_velocities);
+	}
+}
+
+void b2ContactSolver::StoreImpulsesWide()
+{
+	for (int32 i = 0; i < m_wideCount; ++i)
+	{
+		const b2ContactConstraintWide* wc = m_wideConstraints + i;
+		for (int32 lane = 0; lane < b2_simdWidth; ++lane)
+		{
+			int32 index = wc->constraintIndex[lane];
+			if (index < 0)
+			{
+				continue;
+			}
+
+			b2ContactVelocityConstraint* vc = m_velocityConstraints + index;
+			for (int32 j = 0; j < vc->pointCount; ++j)
+			{
+				vc->points[j].normalImpulse = wc->points[j].normalImpulse[lane];
+				vc->points[j].tangentImpulse = wc->points[j].tangentImpulse[lane];
+			}
+		}
+	}
+}
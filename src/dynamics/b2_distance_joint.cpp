@@ -25,6 +25,8 @@
 #include "box2d/b2_distance_joint.h"
 #include "box2d/b2_time_step.h"
 
+#include "common/b2_snapshot.h"
+
 // 1-D constrained system
 // m (v2 - v1) = lambda
 // v2 + (beta/h) * x1 + gamma * lambda = 0, gamma has units of inverse mass.
@@ -75,10 +77,10 @@ b2DistanceJoint::b2DistanceJoint(const b2DistanceJointDef* def)
 
 void b2DistanceJoint::InitVelocityConstraints(const b2SolverData& data)
 {
-	m_indexA = m_bodyA->m_islandIndex;
-	m_indexB = m_bodyB->m_islandIndex;
-	m_localCenterA = m_bodyA->m_sweep.localCenter;
-	m_localCenterB = m_bodyB->m_sweep.localCenter;
+	m_indexA = data.GetIndex(m_bodyA);
+	m_indexB = data.GetIndex(m_bodyB);
+	m_localCenterA = m_bodyA->m_localCenter;
+	m_localCenterB = m_bodyB->m_localCenter;
 	m_invMassA = m_bodyA->m_invMass;
 	m_invMassB = m_bodyB->m_invMass;
 	m_invIA = m_bodyA->m_invI;
@@ -419,3 +421,31 @@ void b2DistanceJoint::Draw(b2Draw* draw) const
 		}
 	}
 }
+
+void b2DistanceJoint::WriteState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_stiffness);
+	writer->Write(m_damping);
+	writer->Write(m_length);
+	writer->Write(m_minLength);
+	writer->Write(m_maxLength);
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_impulse);
+	writer->Write(m_lowerImpulse);
+	writer->Write(m_upperImpulse);
+}
+
+void b2DistanceJoint::ReadState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_stiffness);
+	reader->Read(&m_damping);
+	reader->Read(&m_length);
+	reader->Read(&m_minLength);
+	reader->Read(&m_maxLength);
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_impulse);
+	reader->Read(&m_lowerImpulse);
+	reader->Read(&m_upperImpulse);
+}
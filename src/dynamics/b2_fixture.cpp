@@ -50,6 +50,7 @@ void b2Fixture::Create(b2BlockAllocator* allocator, b2Body* body, const b2Fixtur
 
 	m_body = body;
 	m_next = nullptr;
+	m_id = body->GetWorld()->m_nextId++;
 
 	m_filter = def->filter;
 
@@ -129,12 +130,13 @@ void b2Fixture::CreateProxies(b2BroadPhase* broadPhase, const b2Transform& xf)
 
 	// Create proxies in the broad-phase.
 	m_proxyCount = m_shape->GetChildCount();
+	bool isStatic = m_body->GetType() == b2_staticBody;
 
 	for (int32 i = 0; i < m_proxyCount; ++i)
 	{
 		b2FixtureProxy* proxy = m_proxies + i;
 		m_shape->ComputeAABB(&proxy->aabb, xf, i);
-		proxy->proxyId = broadPhase->CreateProxy(proxy->aabb, proxy);
+		proxy->proxyId = broadPhase->CreateProxy(proxy->aabb, proxy, isStatic);
 		proxy->fixture = this;
 		proxy->childIndex = i;
 	}
@@ -153,7 +155,7 @@ void b2Fixture::DestroyProxies(b2BroadPhase* broadPhase)
 	m_proxyCount = 0;
 }
 
-void b2Fixture::Synchronize(b2BroadPhase* broadPhase, const b2Transform& transform1, const b2Transform& transform2)
+void b2Fixture::Synchronize(b2BroadPhase* broadPhase, const b2Transform& transform1, const b2Transform& transform2, const b2Vec2& lookAhead)
 {
 	if (m_proxyCount == 0)
 	{	
@@ -171,6 +173,10 @@ void b2Fixture::Synchronize(b2BroadPhase* broadPhase, const b2Transform& transfo
 	
 		proxy->aabb.Combine(aabb1, aabb2);
 
+		// Speculative contacts need to exist before the shapes reach each other.
+		proxy->aabb.lowerBound += b2Min(lookAhead, b2Vec2_zero);
+		proxy->aabb.upperBound += b2Max(lookAhead, b2Vec2_zero);
+
 		b2Vec2 displacement = aabb2.GetCenter() - aabb1.GetCenter();
 
 		broadPhase->MoveProxy(proxy->proxyId, proxy->aabb, displacement);
@@ -227,6 +233,18 @@ void b2Fixture::SetSensor(bool sensor)
 	{
 		m_body->SetAwake(true);
 		m_isSensor = sensor;
+
+		// Touching contacts switch between sensor and solid. Wake the other bodies as well
+		// so these contacts are updated and join the islands in the next step, even if
+		// this body cannot be woken.
+		for (b2ContactEdge* edge = m_body->GetContactList(); edge; edge = edge->next)
+		{
+			b2Contact* contact = edge->contact;
+			if (contact->IsTouching() && (contact->GetFixtureA() == this || contact->GetFixtureB() == this))
+			{
+				edge->other->SetAwake(true);
+			}
+		}
 	}
 }
 
@@ -24,6 +24,8 @@
 #include "box2d/b2_body.h"
 #include "box2d/b2_time_step.h"
 
+#include "common/b2_snapshot.h"
+
 // Point-to-point constraint
 // Cdot = v2 - v1
 //      = v2 + cross(w2, r2) - v1 - cross(w1, r1)
@@ -59,10 +61,10 @@ b2FrictionJoint::b2FrictionJoint(const b2FrictionJointDef* def)
 
 void b2FrictionJoint::InitVelocityConstraints(const b2SolverData& data)
 {
-	m_indexA = m_bodyA->m_islandIndex;
-	m_indexB = m_bodyB->m_islandIndex;
-	m_localCenterA = m_bodyA->m_sweep.localCenter;
-	m_localCenterB = m_bodyB->m_sweep.localCenter;
+	m_indexA = data.GetIndex(m_bodyA);
+	m_indexB = data.GetIndex(m_bodyB);
+	m_localCenterA = m_bodyA->m_localCenter;
+	m_localCenterB = m_bodyB->m_localCenter;
 	m_invMassA = m_bodyA->m_invMass;
 	m_invMassB = m_bodyB->m_invMass;
 	m_invIA = m_bodyA->m_invI;
@@ -253,3 +255,23 @@ void b2FrictionJoint::Dump()
 	b2Dump("  jd.maxTorque = %.9g;\n", m_maxTorque);
 	b2Dump("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2FrictionJoint::WriteState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_linearImpulse);
+	writer->Write(m_angularImpulse);
+	writer->Write(m_maxForce);
+	writer->Write(m_maxTorque);
+}
+
+void b2FrictionJoint::ReadState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_linearImpulse);
+	reader->Read(&m_angularImpulse);
+	reader->Read(&m_maxForce);
+	reader->Read(&m_maxTorque);
+}
@@ -26,6 +26,8 @@
 #include "box2d/b2_body.h"
 #include "box2d/b2_time_step.h"
 
+#include "common/b2_snapshot.h"
+
 // Gear Joint:
 // C0 = (coordinate1 + ratio * coordinate2)_initial
 // C = (coordinate1 + ratio * coordinate2) - C0 = 0
@@ -69,9 +71,9 @@ b2GearJoint::b2GearJoint(const b2GearJointDef* def)
 
 	// Get geometry of joint1
 	b2Transform xfA = m_bodyA->m_xf;
-	float aA = m_bodyA->m_sweep.a;
+	float aA = m_bodyA->GetAngle();
 	b2Transform xfC = m_bodyC->m_xf;
-	float aC = m_bodyC->m_sweep.a;
+	float aC = m_bodyC->GetAngle();
 
 	if (m_typeA == e_revoluteJoint)
 	{
@@ -110,9 +112,9 @@ b2GearJoint::b2GearJoint(const b2GearJointDef* def)
 
 	// Get geometry of joint2
 	b2Transform xfB = m_bodyB->m_xf;
-	float aB = m_bodyB->m_sweep.a;
+	float aB = m_bodyB->GetAngle();
 	b2Transform xfD = m_bodyD->m_xf;
-	float aD = m_bodyD->m_sweep.a;
+	float aD = m_bodyD->GetAngle();
 
 	if (m_typeB == e_revoluteJoint)
 	{
@@ -146,14 +148,14 @@ b2GearJoint::b2GearJoint(const b2GearJointDef* def)
 
 void b2GearJoint::InitVelocityConstraints(const b2SolverData& data)
 {
-	m_indexA = m_bodyA->m_islandIndex;
-	m_indexB = m_bodyB->m_islandIndex;
-	m_indexC = m_bodyC->m_islandIndex;
-	m_indexD = m_bodyD->m_islandIndex;
-	m_lcA = m_bodyA->m_sweep.localCenter;
-	m_lcB = m_bodyB->m_sweep.localCenter;
-	m_lcC = m_bodyC->m_sweep.localCenter;
-	m_lcD = m_bodyD->m_sweep.localCenter;
+	m_indexA = data.GetIndex(m_bodyA);
+	m_indexB = data.GetIndex(m_bodyB);
+	m_indexC = data.GetIndex(m_bodyC);
+	m_indexD = data.GetIndex(m_bodyD);
+	m_lcA = m_bodyA->m_localCenter;
+	m_lcB = m_bodyB->m_localCenter;
+	m_lcC = m_bodyC->m_localCenter;
+	m_lcD = m_bodyD->m_localCenter;
 	m_mA = m_bodyA->m_invMass;
 	m_mB = m_bodyB->m_invMass;
 	m_mC = m_bodyC->m_invMass;
@@ -435,3 +437,18 @@ void b2GearJoint::Dump()
 	b2Dump("  jd.ratio = %.9g;\n", m_ratio);
 	b2Dump("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2GearJoint::WriteState(b2SnapshotWriter* writer) const
+{
+	// The bodies, anchors and axes come from the two joints.
+	writer->Write(m_constant);
+	writer->Write(m_ratio);
+	writer->Write(m_impulse);
+}
+
+void b2GearJoint::ReadState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_constant);
+	reader->Read(&m_ratio);
+	reader->Read(&m_impulse);
+}
@@ -25,6 +25,7 @@
 #include "box2d/b2_distance.h"
 #include "box2d/b2_fixture.h"
 #include "box2d/b2_joint.h"
+#include "box2d/b2_profiler.h"
 #include "box2d/b2_stack_allocator.h"
 #include "box2d/b2_timer.h"
 #include "box2d/b2_world.h"
@@ -150,12 +151,28 @@ This might be faster than computing sin+cos.
 However, we can compute sin+cos of the same angle fast.
 */
 
+int32 b2SolverData::GetIndex(b2Body* body) const
+{
+	int32 index = body->m_stateIndex;
+	if (staticSlot == nullptr || body->m_type != b2_staticBody)
+	{
+		return index;
+	}
+
+	int32 slot = (*staticSlot)++;
+	b2Assert(slot < staticSlotEnd);
+	positions[slot] = positions[index];
+	velocities[slot] = velocities[index];
+	return slot;
+}
+
 b2Island::b2Island(
 	int32 bodyCapacity,
 	int32 contactCapacity,
 	int32 jointCapacity,
 	b2StackAllocator* allocator,
-	b2ContactListener* listener)
+	b2ContactListener* listener,
+	b2BodyStates* states)
 {
 	m_bodyCapacity = bodyCapacity;
 	m_contactCapacity = contactCapacity;
@@ -166,20 +183,25 @@ b2Island::b2Island(
 
 	m_allocator = allocator;
 	m_listener = listener;
+	m_impulses = nullptr;
+
+	m_states = states;
+	m_staticSlotStart = states->count;
+	m_staticSlotCount = 0;
+	m_bodyColors = nullptr;
+	m_profiler = nullptr;
+
+	m_minSleepTime = 0.0f;
+	m_maxSleepTime = 0.0f;
 
 	m_bodies = (b2Body**)m_allocator->Allocate(bodyCapacity * sizeof(b2Body*));
 	m_contacts = (b2Contact**)m_allocator->Allocate(contactCapacity	 * sizeof(b2Contact*));
 	m_joints = (b2Joint**)m_allocator->Allocate(jointCapacity * sizeof(b2Joint*));
-
-	m_velocities = (b2Velocity*)m_allocator->Allocate(m_bodyCapacity * sizeof(b2Velocity));
-	m_positions = (b2Position*)m_allocator->Allocate(m_bodyCapacity * sizeof(b2Position));
 }
 
 b2Island::~b2Island()
 {
 	// Warning: the order should reverse the constructor order.
-	m_allocator->Free(m_positions);
-	m_allocator->Free(m_velocities);
 	m_allocator->Free(m_joints);
 	m_allocator->Free(m_contacts);
 	m_allocator->Free(m_bodies);
@@ -191,19 +213,22 @@ void b2Island::Solve(b2Profile* profile, const b2TimeStep& step, const b2Vec2& g
 
 	float h = step.dt;
 
-	// Integrate velocities and apply damping. Initialize the body state.
+	b2Position* positions = m_states->positions;
+	b2Velocity* velocities = m_states->velocities;
+
+	// Integrate velocities and apply damping.
+	b2ProfileBegin(m_profiler, "integrate velocities");
 	for (int32 i = 0; i < m_bodyCount; ++i)
 	{
 		b2Body* b = m_bodies[i];
+		int32 index = b->m_stateIndex;
 
-		b2Vec2 c = b->m_sweep.c;
-		float a = b->m_sweep.a;
-		b2Vec2 v = b->m_linearVelocity;
-		float w = b->m_angularVelocity;
+		b2Vec2 v = velocities[index].v;
+		float w = velocities[index].w;
 
 		// Store positions for continuous collision.
-		b->m_sweep.c0 = b->m_sweep.c;
-		b->m_sweep.a0 = b->m_sweep.a;
+		b->m_c0 = positions[index].c;
+		b->m_a0 = positions[index].a;
 
 		if (b->m_type == b2_dynamicBody)
 		{
@@ -222,27 +247,29 @@ void b2Island::Solve(b2Profile* profile, const b2TimeStep& step, const b2Vec2& g
 			w *= 1.0f / (1.0f + h * b->m_angularDamping);
 		}
 
-		m_positions[i].c = c;
-		m_positions[i].a = a;
-		m_velocities[i].v = v;
-		m_velocities[i].w = w;
+		velocities[index].v = v;
+		velocities[index].w = w;
 	}
+	b2ProfileEnd(m_profiler);
 
 	timer.Reset();
+	b2ProfileBegin(m_profiler, "init constraints");
 
 	// Solver data
+	int32 staticSlot = m_staticSlotStart;
 	b2SolverData solverData;
 	solverData.step = step;
-	solverData.positions = m_positions;
-	solverData.velocities = m_velocities;
+	solverData.positions = positions;
+	solverData.velocities = velocities;
+	solverData.staticSlot = &staticSlot;
+	solverData.staticSlotEnd = m_staticSlotStart + m_staticSlotCount;
 
 	// Initialize velocity constraints.
 	b2ContactSolverDef contactSolverDef;
-	contactSolverDef.step = step;
 	contactSolverDef.contacts = m_contacts;
 	contactSolverDef.count = m_contactCount;
-	contactSolverDef.positions = m_positions;
-	contactSolverDef.velocities = m_velocities;
+	contactSolverDef.data = &solverData;
+	contactSolverDef.bodyColors = m_bodyColors;
 	contactSolverDef.allocator = m_allocator;
 
 	b2ContactSolver contactSolver(&contactSolverDef);
@@ -250,6 +277,7 @@ void b2Island::Solve(b2Profile* profile, const b2TimeStep& step, const b2Vec2& g
 
 	if (step.warmStarting)
 	{
+		b2ProfileScope(m_profiler, "warm start");
 		contactSolver.WarmStart();
 	}
 	
@@ -258,10 +286,12 @@ void b2Island::Solve(b2Profile* profile, const b2TimeStep& step, const b2Vec2& g
 		m_joints[i]->InitVelocityConstraints(solverData);
 	}
 
+	b2ProfileEnd(m_profiler);
 	profile->solveInit = timer.GetMilliseconds();
 
 	// Solve velocity constraints
 	timer.Reset();
+	b2ProfileBegin(m_profiler, "solve velocity");
 	for (int32 i = 0; i < step.velocityIterations; ++i)
 	{
 		for (int32 j = 0; j < m_jointCount; ++j)
@@ -274,15 +304,18 @@ void b2Island::Solve(b2Profile* profile, const b2TimeStep& step, const b2Vec2& g
 
 	// Store impulses for warm starting
 	contactSolver.StoreImpulses();
+	b2ProfileEnd(m_profiler);
 	profile->solveVelocity = timer.GetMilliseconds();
 
 	// Integrate positions
+	b2ProfileBegin(m_profiler, "integrate positions");
 	for (int32 i = 0; i < m_bodyCount; ++i)
 	{
-		b2Vec2 c = m_positions[i].c;
-		float a = m_positions[i].a;
-		b2Vec2 v = m_velocities[i].v;
-		float w = m_velocities[i].w;
+		int32 index = m_bodies[i]->m_stateIndex;
+		b2Vec2 c = positions[index].c;
+		float a = positions[index].a;
+		b2Vec2 v = velocities[index].v;
+		float w = velocities[index].w;
 
 		// Check for large velocities
 		b2Vec2 translation = h * v;
@@ -303,14 +336,18 @@ void b2Island::Solve(b2Profile* profile, const b2TimeStep& step, const b2Vec2& g
 		c += h * v;
 		a += h * w;
 
-		m_positions[i].c = c;
-		m_positions[i].a = a;
-		m_velocities[i].v = v;
-		m_velocities[i].w = w;
+		positions[index].c = c;
+		positions[index].a = a;
+		velocities[index].v = v;
+		velocities[index].w = w;
 	}
 
+	contactSolver.ApplySpeculativeRestitution();
+	b2ProfileEnd(m_profiler);
+
 	// Solve position constraints
 	timer.Reset();
+	b2ProfileBegin(m_profiler, "solve position");
 	bool positionSolved = false;
 	for (int32 i = 0; i < step.positionIterations; ++i)
 	{
@@ -331,24 +368,23 @@ void b2Island::Solve(b2Profile* profile, const b2TimeStep& step, const b2Vec2& g
 		}
 	}
 
-	// Copy state buffers back to the bodies
+	// The state arrays hold the result. Update the body transforms.
 	for (int32 i = 0; i < m_bodyCount; ++i)
 	{
-		b2Body* body = m_bodies[i];
-		body->m_sweep.c = m_positions[i].c;
-		body->m_sweep.a = m_positions[i].a;
-		body->m_linearVelocity = m_velocities[i].v;
-		body->m_angularVelocity = m_velocities[i].w;
-		body->SynchronizeTransform();
+		m_bodies[i]->SynchronizeTransform();
 	}
 
+	b2ProfileEnd(m_profiler);
 	profile->solvePosition = timer.GetMilliseconds();
 
 	Report(contactSolver.m_velocityConstraints);
 
 	if (allowSleep)
 	{
+		b2ProfileScope(m_profiler, "sleep");
+
 		float minSleepTime = b2_maxFloat;
+		float maxSleepTime = 0.0f;
 
 		const float linTolSqr = b2_linearSleepTolerance * b2_linearSleepTolerance;
 		const float angTolSqr = b2_angularSleepTolerance * b2_angularSleepTolerance;
@@ -361,9 +397,10 @@ void b2Island::Solve(b2Profile* profile, const b2TimeStep& step, const b2Vec2& g
 				continue;
 			}
 
+			const b2Velocity& velocity = velocities[b->m_stateIndex];
 			if ((b->m_flags & b2Body::e_autoSleepFlag) == 0 ||
-				b->m_angularVelocity * b->m_angularVelocity > angTolSqr ||
-				b2Dot(b->m_linearVelocity, b->m_linearVelocity) > linTolSqr)
+				velocity.w * velocity.w > angTolSqr ||
+				b2Dot(velocity.v, velocity.v) > linTolSqr)
 			{
 				b->m_sleepTime = 0.0f;
 				minSleepTime = 0.0f;
@@ -372,42 +409,40 @@ void b2Island::Solve(b2Profile* profile, const b2TimeStep& step, const b2Vec2& g
 			{
 				b->m_sleepTime += h;
 				minSleepTime = b2Min(minSleepTime, b->m_sleepTime);
+				maxSleepTime = b2Max(maxSleepTime, b->m_sleepTime);
 			}
 		}
 
-		if (minSleepTime >= b2_timeToSleep && positionSolved)
+		if (positionSolved)
 		{
-			for (int32 i = 0; i < m_bodyCount; ++i)
-			{
-				b2Body* b = m_bodies[i];
-				b->SetAwake(false);
-			}
+			m_minSleepTime = minSleepTime;
 		}
+		m_maxSleepTime = maxSleepTime;
 	}
 }
 
 void b2Island::SolveTOI(const b2TimeStep& subStep, int32 toiIndexA, int32 toiIndexB)
 {
-	b2Assert(toiIndexA < m_bodyCount);
-	b2Assert(toiIndexB < m_bodyCount);
+	b2Assert(0 <= toiIndexA && toiIndexA < m_states->count);
+	b2Assert(0 <= toiIndexB && toiIndexB < m_states->count);
 
-	// Initialize the body state.
-	for (int32 i = 0; i < m_bodyCount; ++i)
-	{
-		b2Body* b = m_bodies[i];
-		m_positions[i].c = b->m_sweep.c;
-		m_positions[i].a = b->m_sweep.a;
-		m_velocities[i].v = b->m_linearVelocity;
-		m_velocities[i].w = b->m_angularVelocity;
-	}
+	b2Position* positions = m_states->positions;
+	b2Velocity* velocities = m_states->velocities;
+
+	// The TOI island is solved alone, so static bodies use their own slots.
+	b2SolverData solverData;
+	solverData.step = subStep;
+	solverData.positions = positions;
+	solverData.velocities = velocities;
+	solverData.staticSlot = nullptr;
+	solverData.staticSlotEnd = 0;
 
 	b2ContactSolverDef contactSolverDef;
 	contactSolverDef.contacts = m_contacts;
 	contactSolverDef.count = m_contactCount;
+	contactSolverDef.data = &solverData;
+	contactSolverDef.bodyColors = nullptr;
 	contactSolverDef.allocator = m_allocator;
-	contactSolverDef.step = subStep;
-	contactSolverDef.positions = m_positions;
-	contactSolverDef.velocities = m_velocities;
 	b2ContactSolver contactSolver(&contactSolverDef);
 
 	// Solve position constraints.
@@ -454,10 +489,12 @@ void b2Island::SolveTOI(const b2TimeStep& subStep, int32 toiIndexA, int32 toiInd
 #endif
 
 	// Leap of faith to new safe state.
-	m_bodies[toiIndexA]->m_sweep.c0 = m_positions[toiIndexA].c;
-	m_bodies[toiIndexA]->m_sweep.a0 = m_positions[toiIndexA].a;
-	m_bodies[toiIndexB]->m_sweep.c0 = m_positions[toiIndexB].c;
-	m_bodies[toiIndexB]->m_sweep.a0 = m_positions[toiIndexB].a;
+	b2Body* toiBodyA = m_states->bodies[toiIndexA];
+	b2Body* toiBodyB = m_states->bodies[toiIndexB];
+	toiBodyA->m_c0 = positions[toiIndexA].c;
+	toiBodyA->m_a0 = positions[toiIndexA].a;
+	toiBodyB->m_c0 = positions[toiIndexB].c;
+	toiBodyB->m_a0 = positions[toiIndexB].a;
 
 	// No warm starting is needed for TOI events because warm
 	// starting impulses were applied in the discrete solver.
@@ -477,10 +514,12 @@ void b2Island::SolveTOI(const b2TimeStep& subStep, int32 toiIndexA, int32 toiInd
 	// Integrate positions
 	for (int32 i = 0; i < m_bodyCount; ++i)
 	{
-		b2Vec2 c = m_positions[i].c;
-		float a = m_positions[i].a;
-		b2Vec2 v = m_velocities[i].v;
-		float w = m_velocities[i].w;
+		b2Body* body = m_bodies[i];
+		int32 index = body->m_stateIndex;
+		b2Vec2 c = positions[index].c;
+		float a = positions[index].a;
+		b2Vec2 v = velocities[index].v;
+		float w = velocities[index].w;
 
 		// Check for large velocities
 		b2Vec2 translation = h * v;
@@ -501,17 +540,12 @@ void b2Island::SolveTOI(const b2TimeStep& subStep, int32 toiIndexA, int32 toiInd
 		c += h * v;
 		a += h * w;
 
-		m_positions[i].c = c;
-		m_positions[i].a = a;
-		m_velocities[i].v = v;
-		m_velocities[i].w = w;
+		positions[index].c = c;
+		positions[index].a = a;
+		velocities[index].v = v;
+		velocities[index].w = w;
 
 		// Sync bodies
-		b2Body* body = m_bodies[i];
-		body->m_sweep.c = c;
-		body->m_sweep.a = a;
-		body->m_linearVelocity = v;
-		body->m_angularVelocity = w;
 		body->SynchronizeTransform();
 	}
 
@@ -525,6 +559,24 @@ void b2Island::Report(const b2ContactVelocityConstraint* constraints)
 		return;
 	}
 
+	if (m_impulses != nullptr)
+	{
+		// The caller reports these later.
+		for (int32 i = 0; i < m_contactCount; ++i)
+		{
+			const b2ContactVelocityConstraint* vc = constraints + i;
+
+			b2ContactImpulse* impulse = m_impulses + i;
+			impulse->count = vc->pointCount;
+			for (int32 j = 0; j < vc->pointCount; ++j)
+			{
+				impulse->normalImpulses[j] = vc->points[j].normalImpulse;
+				impulse->tangentImpulses[j] = vc->points[j].tangentImpulse;
+			}
+		}
+		return;
+	}
+
 	for (int32 i = 0; i < m_contactCount; ++i)
 	{
 		b2Contact* c = m_contacts[i];
@@ -542,3 +594,51 @@ void b2Island::Report(const b2ContactVelocityConstraint* constraints)
 		m_listener->PostSolve(c, &impulse);
 	}
 }
+
+void b2SolveIslandTask(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext)
+{
+	b2IslandSolverContext* context = (b2IslandSolverContext*)taskContext;
+	b2StackAllocator* allocator = context->allocators + workerIndex;
+
+	for (int32 i = startIndex; i < endIndex; ++i)
+	{
+		b2IslandRange* range = context->islands + i;
+		b2ProfileScope(context->profiler, "solve island");
+
+		b2Island island(range->bodyCount,
+						range->contactCount,
+						range->jointCount,
+						allocator,
+						context->listener,
+						context->states);
+
+		island.m_staticSlotStart = context->states->count + range->staticStart;
+		island.m_staticSlotCount = range->staticCount;
+		island.m_bodyColors = context->bodyColors;
+		island.m_profiler = context->profiler;
+
+		if (context->impulses != nullptr)
+		{
+			island.m_impulses = context->impulses + range->contactStart;
+		}
+
+		for (int32 j = 0; j < range->bodyCount; ++j)
+		{
+			island.Add(context->bodies[range->bodyStart + j]);
+		}
+
+		for (int32 j = 0; j < range->contactCount; ++j)
+		{
+			island.Add(context->contacts[range->contactStart + j]);
+		}
+
+		for (int32 j = 0; j < range->jointCount; ++j)
+		{
+			island.Add(context->joints[range->jointStart + j]);
+		}
+
+		island.Solve(&range->profile, context->step, context->gravity, context->allowSleep);
+		range->minSleepTime = island.m_minSleepTime;
+		range->maxSleepTime = island.m_maxSleepTime;
+	}
+}
@@ -29,17 +29,49 @@
 
 class b2Contact;
 class b2Joint;
+class b2Profiler;
 class b2StackAllocator;
 class b2ContactListener;
+struct b2ContactImpulse;
 struct b2ContactVelocityConstraint;
 struct b2Profile;
 
+/// A set of bodies connected by touching contacts and joints. Islands persist across
+/// time steps: they are merged when a constraint links two islands and split lazily,
+/// when an island with removed constraints wants to sleep. Static bodies do not belong
+/// to islands, so constraints to static bodies are kept by the island of the other body.
+/// All bodies of an island are awake or asleep together.
+struct b2PersistentIsland
+{
+	b2Body* bodyList;
+	b2Body* bodyTail;
+	b2Contact* contactList;
+	b2Contact* contactTail;
+	b2Joint* jointList;
+	b2Joint* jointTail;
+
+	int32 bodyCount;
+	int32 contactCount;
+	int32 jointCount;
+
+	// Number of constraints between island bodies removed since the island was formed.
+	// The island may be disconnected if this is not zero.
+	int32 constraintRemoveCount;
+
+	// Index in the awake island array of the world or -1 if the island is asleep.
+	int32 awakeIndex;
+};
+
 /// This is an internal class.
+/// The island is solved in place on the world body state arrays. Islands that share a
+/// static body may be solved concurrently, so Solve gives each constraint to a static
+/// body a private copy of the static body state in the scratch slots
+/// [m_staticSlotStart, m_staticSlotStart + m_staticSlotCount).
 class b2Island
 {
 public:
 	b2Island(int32 bodyCapacity, int32 contactCapacity, int32 jointCapacity,
-			b2StackAllocator* allocator, b2ContactListener* listener);
+			b2StackAllocator* allocator, b2ContactListener* listener, b2BodyStates* states);
 	~b2Island();
 
 	void Clear()
@@ -56,7 +88,6 @@ public:
 	void Add(b2Body* body)
 	{
 		b2Assert(m_bodyCount < m_bodyCapacity);
-		body->m_islandIndex = m_bodyCount;
 		m_bodies[m_bodyCount] = body;
 		++m_bodyCount;
 	}
@@ -75,15 +106,29 @@ public:
 
 	void Report(const b2ContactVelocityConstraint* constraints);
 
+	// Sleep timer results of Solve. The minimum is zero if the island may not sleep.
+	float m_minSleepTime;
+	float m_maxSleepTime;
+
 	b2StackAllocator* m_allocator;
 	b2ContactListener* m_listener;
 
+	// If not null, Report stores the impulses here instead of calling the listener.
+	b2ContactImpulse* m_impulses;
+
 	b2Body** m_bodies;
 	b2Contact** m_contacts;
 	b2Joint** m_joints;
 
-	b2Position* m_positions;
-	b2Velocity* m_velocities;
+	b2BodyStates* m_states;
+	int32 m_staticSlotStart;
+	int32 m_staticSlotCount;
+
+	// Graph colors of the bodies, indexed like the state arrays. Used by the wide solver.
+	uint32* m_bodyColors;
+
+	// Records the solver phases. May be null.
+	b2Profiler* m_profiler;
 
 	int32 m_bodyCount;
 	int32 m_jointCount;
@@ -94,4 +139,50 @@ public:
 	int32 m_jointCapacity;
 };
 
+/// An island gathered by b2World::Solve. The ranges index the arrays of b2IslandSolverContext.
+struct b2IslandRange
+{
+	int32 bodyStart;
+	int32 bodyCount;
+	int32 contactStart;
+	int32 contactCount;
+	int32 jointStart;
+	int32 jointCount;
+	int32 staticStart;
+	int32 staticCount;
+	b2PersistentIsland* island;
+	b2Profile profile;
+	float minSleepTime;
+	float maxSleepTime;
+};
+
+/// Shared input for b2SolveIslandTask.
+struct b2IslandSolverContext
+{
+	b2TimeStep step;
+	b2Vec2 gravity;
+	bool allowSleep;
+	b2ContactListener* listener;
+
+	// One allocator per worker.
+	b2StackAllocator* allocators;
+
+	b2IslandRange* islands;
+	b2Body** bodies;
+	b2Contact** contacts;
+	b2Joint** joints;
+
+	// The static body copies of the islands follow the bodies in the state arrays.
+	b2BodyStates* states;
+	uint32* bodyColors;
+
+	// Receives the post-solve impulses, parallel to contacts. May be null.
+	b2ContactImpulse* impulses;
+
+	b2Profiler* profiler;
+};
+
+/// Task callback that solves the islands [startIndex, endIndex) of a b2IslandSolverContext.
+void b2SolveIslandTask(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext);
+
 #endif
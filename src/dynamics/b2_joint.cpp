@@ -171,6 +171,88 @@ b2Joint* b2Joint::Create(const b2JointDef* def, b2BlockAllocator* allocator)
 	return joint;
 }
 
+b2Joint* b2Joint::CreateDefault(const b2JointDef* base, b2Joint* joint1, b2Joint* joint2, b2BlockAllocator* allocator)
+{
+	switch (base->type)
+	{
+	case e_distanceJoint:
+		{
+			b2DistanceJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			return Create(&def, allocator);
+		}
+
+	case e_mouseJoint:
+		{
+			b2MouseJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			return Create(&def, allocator);
+		}
+
+	case e_prismaticJoint:
+		{
+			b2PrismaticJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			return Create(&def, allocator);
+		}
+
+	case e_revoluteJoint:
+		{
+			b2RevoluteJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			return Create(&def, allocator);
+		}
+
+	case e_pulleyJoint:
+		{
+			b2PulleyJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			return Create(&def, allocator);
+		}
+
+	case e_gearJoint:
+		{
+			b2GearJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			def.joint1 = joint1;
+			def.joint2 = joint2;
+			return Create(&def, allocator);
+		}
+
+	case e_wheelJoint:
+		{
+			b2WheelJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			return Create(&def, allocator);
+		}
+
+	case e_weldJoint:
+		{
+			b2WeldJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			return Create(&def, allocator);
+		}
+
+	case e_frictionJoint:
+		{
+			b2FrictionJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			return Create(&def, allocator);
+		}
+
+	case e_motorJoint:
+		{
+			b2MotorJointDef def;
+			static_cast<b2JointDef&>(def) = *base;
+			return Create(&def, allocator);
+		}
+
+	default:
+		b2Assert(false);
+		return nullptr;
+	}
+}
+
 void b2Joint::Destroy(b2Joint* joint, b2BlockAllocator* allocator)
 {
 	joint->~b2Joint();
@@ -233,7 +315,9 @@ b2Joint::b2Joint(const b2JointDef* def)
 	m_bodyB = def->bodyB;
 	m_index = 0;
 	m_collideConnected = def->collideConnected;
-	m_islandFlag = false;
+	m_islandPrev = nullptr;
+	m_islandNext = nullptr;
+	m_islandLinked = false;
 	m_userData = def->userData;
 
 	m_edgeA.joint = nullptr;
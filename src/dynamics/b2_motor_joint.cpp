@@ -24,6 +24,8 @@
 #include "box2d/b2_motor_joint.h"
 #include "box2d/b2_time_step.h"
 
+#include "common/b2_snapshot.h"
+
 // Point-to-point constraint
 // Cdot = v2 - v1
 //      = v2 + cross(w2, r2) - v1 - cross(w1, r1)
@@ -67,10 +69,10 @@ b2MotorJoint::b2MotorJoint(const b2MotorJointDef* def)
 
 void b2MotorJoint::InitVelocityConstraints(const b2SolverData& data)
 {
-	m_indexA = m_bodyA->m_islandIndex;
-	m_indexB = m_bodyB->m_islandIndex;
-	m_localCenterA = m_bodyA->m_sweep.localCenter;
-	m_localCenterB = m_bodyB->m_sweep.localCenter;
+	m_indexA = data.GetIndex(m_bodyA);
+	m_indexB = data.GetIndex(m_bodyB);
+	m_localCenterA = m_bodyA->m_localCenter;
+	m_localCenterB = m_bodyB->m_localCenter;
 	m_invMassA = m_bodyA->m_invMass;
 	m_invMassB = m_bodyB->m_invMass;
 	m_invIA = m_bodyA->m_invI;
@@ -309,3 +311,25 @@ void b2MotorJoint::Dump()
 	b2Dump("  jd.correctionFactor = %.9g;\n", m_correctionFactor);
 	b2Dump("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2MotorJoint::WriteState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_linearOffset);
+	writer->Write(m_angularOffset);
+	writer->Write(m_linearImpulse);
+	writer->Write(m_angularImpulse);
+	writer->Write(m_maxForce);
+	writer->Write(m_maxTorque);
+	writer->Write(m_correctionFactor);
+}
+
+void b2MotorJoint::ReadState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_linearOffset);
+	reader->Read(&m_angularOffset);
+	reader->Read(&m_linearImpulse);
+	reader->Read(&m_angularImpulse);
+	reader->Read(&m_maxForce);
+	reader->Read(&m_maxTorque);
+	reader->Read(&m_correctionFactor);
+}
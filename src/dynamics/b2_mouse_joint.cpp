@@ -24,6 +24,8 @@
 #include "box2d/b2_mouse_joint.h"
 #include "box2d/b2_time_step.h"
 
+#include "common/b2_snapshot.h"
+
 // p = attached point, m = mouse point
 // C = p - m
 // Cdot = v
@@ -72,8 +74,8 @@ float b2MouseJoint::GetMaxForce() const
 
 void b2MouseJoint::InitVelocityConstraints(const b2SolverData& data)
 {
-	m_indexB = m_bodyB->m_islandIndex;
-	m_localCenterB = m_bodyB->m_sweep.localCenter;
+	m_indexB = data.GetIndex(m_bodyB);
+	m_localCenterB = m_bodyB->m_localCenter;
 	m_invMassB = m_bodyB->m_invMass;
 	m_invIB = m_bodyB->m_invI;
 
@@ -188,3 +190,23 @@ void b2MouseJoint::ShiftOrigin(const b2Vec2& newOrigin)
 {
 	m_targetA -= newOrigin;
 }
+
+void b2MouseJoint::WriteState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_localAnchorB);
+	writer->Write(m_targetA);
+	writer->Write(m_stiffness);
+	writer->Write(m_damping);
+	writer->Write(m_impulse);
+	writer->Write(m_maxForce);
+}
+
+void b2MouseJoint::ReadState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_targetA);
+	reader->Read(&m_stiffness);
+	reader->Read(&m_damping);
+	reader->Read(&m_impulse);
+	reader->Read(&m_maxForce);
+}
@@ -25,6 +25,8 @@
 #include "box2d/b2_prismatic_joint.h"
 #include "box2d/b2_time_step.h"
 
+#include "common/b2_snapshot.h"
+
 // Linear constraint (point-to-line)
 // d = p2 - p1 = x2 + r2 - x1 - r1
 // C = dot(perp, d)
@@ -113,10 +115,10 @@ b2PrismaticJoint::b2PrismaticJoint(const b2PrismaticJointDef* def)
 
 void b2PrismaticJoint::InitVelocityConstraints(const b2SolverData& data)
 {
-	m_indexA = m_bodyA->m_islandIndex;
-	m_indexB = m_bodyB->m_islandIndex;
-	m_localCenterA = m_bodyA->m_sweep.localCenter;
-	m_localCenterB = m_bodyB->m_sweep.localCenter;
+	m_indexA = data.GetIndex(m_bodyA);
+	m_indexB = data.GetIndex(m_bodyB);
+	m_localCenterA = m_bodyA->m_localCenter;
+	m_localCenterB = m_bodyB->m_localCenter;
 	m_invMassA = m_bodyA->m_invMass;
 	m_invMassB = m_bodyB->m_invMass;
 	m_invIA = m_bodyA->m_invI;
@@ -486,17 +488,17 @@ float b2PrismaticJoint::GetJointSpeed() const
 	b2Body* bA = m_bodyA;
 	b2Body* bB = m_bodyB;
 
-	b2Vec2 rA = b2Mul(bA->m_xf.q, m_localAnchorA - bA->m_sweep.localCenter);
-	b2Vec2 rB = b2Mul(bB->m_xf.q, m_localAnchorB - bB->m_sweep.localCenter);
-	b2Vec2 p1 = bA->m_sweep.c + rA;
-	b2Vec2 p2 = bB->m_sweep.c + rB;
+	b2Vec2 rA = b2Mul(bA->m_xf.q, m_localAnchorA - bA->m_localCenter);
+	b2Vec2 rB = b2Mul(bB->m_xf.q, m_localAnchorB - bB->m_localCenter);
+	b2Vec2 p1 = bA->GetWorldCenter() + rA;
+	b2Vec2 p2 = bB->GetWorldCenter() + rB;
 	b2Vec2 d = p2 - p1;
 	b2Vec2 axis = b2Mul(bA->m_xf.q, m_localXAxisA);
 
-	b2Vec2 vA = bA->m_linearVelocity;
-	b2Vec2 vB = bB->m_linearVelocity;
-	float wA = bA->m_angularVelocity;
-	float wB = bB->m_angularVelocity;
+	b2Vec2 vA = bA->GetLinearVelocity();
+	b2Vec2 vB = bB->GetLinearVelocity();
+	float wA = bA->GetAngularVelocity();
+	float wB = bB->GetAngularVelocity();
 
 	float speed = b2Dot(d, b2Cross(wA, axis)) + b2Dot(axis, vB + b2Cross(wB, rB) - vA - b2Cross(wA, rA));
 	return speed;
@@ -641,3 +643,43 @@ void b2PrismaticJoint::Draw(b2Draw* draw) const
 	draw->DrawPoint(pA, 5.0f, c1);
 	draw->DrawPoint(pB, 5.0f, c4);
 }
+
+void b2PrismaticJoint::WriteState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_localXAxisA);
+	writer->Write(m_localYAxisA);
+	writer->Write(m_referenceAngle);
+	writer->Write(m_impulse);
+	writer->Write(m_motorImpulse);
+	writer->Write(m_lowerImpulse);
+	writer->Write(m_upperImpulse);
+	writer->Write(m_lowerTranslation);
+	writer->Write(m_upperTranslation);
+	writer->Write(m_maxMotorForce);
+	writer->Write(m_motorSpeed);
+	writer->Write(m_translation);
+	writer->Write(uint8(m_enableLimit));
+	writer->Write(uint8(m_enableMotor));
+}
+
+void b2PrismaticJoint::ReadState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_localXAxisA);
+	reader->Read(&m_localYAxisA);
+	reader->Read(&m_referenceAngle);
+	reader->Read(&m_impulse);
+	reader->Read(&m_motorImpulse);
+	reader->Read(&m_lowerImpulse);
+	reader->Read(&m_upperImpulse);
+	reader->Read(&m_lowerTranslation);
+	reader->Read(&m_upperTranslation);
+	reader->Read(&m_maxMotorForce);
+	reader->Read(&m_motorSpeed);
+	reader->Read(&m_translation);
+	m_enableLimit = reader->Read<uint8>() != 0;
+	m_enableMotor = reader->Read<uint8>() != 0;
+}
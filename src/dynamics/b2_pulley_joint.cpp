@@ -24,6 +24,8 @@
 #include "box2d/b2_pulley_joint.h"
 #include "box2d/b2_time_step.h"
 
+#include "common/b2_snapshot.h"
+
 // Pulley:
 // length1 = norm(p1 - s1)
 // length2 = norm(p2 - s2)
@@ -76,10 +78,10 @@ b2PulleyJoint::b2PulleyJoint(const b2PulleyJointDef* def)
 
 void b2PulleyJoint::InitVelocityConstraints(const b2SolverData& data)
 {
-	m_indexA = m_bodyA->m_islandIndex;
-	m_indexB = m_bodyB->m_islandIndex;
-	m_localCenterA = m_bodyA->m_sweep.localCenter;
-	m_localCenterB = m_bodyB->m_sweep.localCenter;
+	m_indexA = data.GetIndex(m_bodyA);
+	m_indexB = data.GetIndex(m_bodyB);
+	m_localCenterA = m_bodyA->m_localCenter;
+	m_localCenterB = m_bodyB->m_localCenter;
 	m_invMassA = m_bodyA->m_invMass;
 	m_invMassB = m_bodyB->m_invMass;
 	m_invIA = m_bodyA->m_invI;
@@ -350,3 +352,29 @@ void b2PulleyJoint::ShiftOrigin(const b2Vec2& newOrigin)
 	m_groundAnchorA -= newOrigin;
 	m_groundAnchorB -= newOrigin;
 }
+
+void b2PulleyJoint::WriteState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_groundAnchorA);
+	writer->Write(m_groundAnchorB);
+	writer->Write(m_lengthA);
+	writer->Write(m_lengthB);
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_constant);
+	writer->Write(m_ratio);
+	writer->Write(m_impulse);
+}
+
+void b2PulleyJoint::ReadState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_groundAnchorA);
+	reader->Read(&m_groundAnchorB);
+	reader->Read(&m_lengthA);
+	reader->Read(&m_lengthB);
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_constant);
+	reader->Read(&m_ratio);
+	reader->Read(&m_impulse);
+}
@@ -25,6 +25,8 @@
 #include "box2d/b2_revolute_joint.h"
 #include "box2d/b2_time_step.h"
 
+#include "common/b2_snapshot.h"
+
 // Point-to-point constraint
 // C = p2 - p1
 // Cdot = v2 - v1
@@ -72,10 +74,10 @@ b2RevoluteJoint::b2RevoluteJoint(const b2RevoluteJointDef* def)
 
 void b2RevoluteJoint::InitVelocityConstraints(const b2SolverData& data)
 {
-	m_indexA = m_bodyA->m_islandIndex;
-	m_indexB = m_bodyB->m_islandIndex;
-	m_localCenterA = m_bodyA->m_sweep.localCenter;
-	m_localCenterB = m_bodyB->m_sweep.localCenter;
+	m_indexA = data.GetIndex(m_bodyA);
+	m_indexB = data.GetIndex(m_bodyB);
+	m_localCenterA = m_bodyA->m_localCenter;
+	m_localCenterB = m_bodyB->m_localCenter;
 	m_invMassA = m_bodyA->m_invMass;
 	m_invMassB = m_bodyB->m_invMass;
 	m_invIA = m_bodyA->m_invI;
@@ -345,14 +347,14 @@ float b2RevoluteJoint::GetJointAngle() const
 {
 	b2Body* bA = m_bodyA;
 	b2Body* bB = m_bodyB;
-	return bB->m_sweep.a - bA->m_sweep.a - m_referenceAngle;
+	return bB->GetAngle() - bA->GetAngle() - m_referenceAngle;
 }
 
 float b2RevoluteJoint::GetJointSpeed() const
 {
 	b2Body* bA = m_bodyA;
 	b2Body* bB = m_bodyB;
-	return bB->m_angularVelocity - bA->m_angularVelocity;
+	return bB->GetAngularVelocity() - bA->GetAngularVelocity();
 }
 
 bool b2RevoluteJoint::IsMotorEnabled() const
@@ -499,3 +501,37 @@ void b2RevoluteJoint::Draw(b2Draw* draw) const
 	draw->DrawSegment(pA, pB, color);
 	draw->DrawSegment(xfB.p, pB, color);
 }
+
+void b2RevoluteJoint::WriteState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_impulse);
+	writer->Write(m_motorImpulse);
+	writer->Write(m_lowerImpulse);
+	writer->Write(m_upperImpulse);
+	writer->Write(m_maxMotorTorque);
+	writer->Write(m_motorSpeed);
+	writer->Write(m_referenceAngle);
+	writer->Write(m_lowerAngle);
+	writer->Write(m_upperAngle);
+	writer->Write(uint8(m_enableMotor));
+	writer->Write(uint8(m_enableLimit));
+}
+
+void b2RevoluteJoint::ReadState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_impulse);
+	reader->Read(&m_motorImpulse);
+	reader->Read(&m_lowerImpulse);
+	reader->Read(&m_upperImpulse);
+	reader->Read(&m_maxMotorTorque);
+	reader->Read(&m_motorSpeed);
+	reader->Read(&m_referenceAngle);
+	reader->Read(&m_lowerAngle);
+	reader->Read(&m_upperAngle);
+	m_enableMotor = reader->Read<uint8>() != 0;
+	m_enableLimit = reader->Read<uint8>() != 0;
+}
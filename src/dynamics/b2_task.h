@@ -0,0 +1,75 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef B2_TASK_H
+#define B2_TASK_H
+
+#include "common/b2_counters.h"
+
+#include "box2d/b2_world_callbacks.h"
+
+/// A task and its context, wrapped so that task system threads leave the
+/// global collision counters alone.
+struct b2CountedTask
+{
+	b2TaskCallback* task;
+	void* context;
+};
+
+inline void b2CountedTaskCallback(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext)
+{
+	b2CountedTask* countedTask = (b2CountedTask*)taskContext;
+
+	// The worker may be the calling thread, so restore its setting afterwards.
+	bool enabled = b2_collisionCountersEnabled;
+	b2_collisionCountersEnabled = false;
+	countedTask->task(startIndex, endIndex, workerIndex, countedTask->context);
+	b2_collisionCountersEnabled = enabled;
+}
+
+/// Run a task on the task system and wait for it. Without a task system the
+/// task runs on the calling thread as worker zero.
+inline void b2RunTask(b2TaskSystem* taskSystem, b2TaskCallback* task, int32 itemCount, int32 minRange, void* taskContext)
+{
+	if (itemCount == 0)
+	{
+		return;
+	}
+
+	if (taskSystem == nullptr)
+	{
+		task(0, itemCount, 0, taskContext);
+		return;
+	}
+
+	b2CountedTask countedTask;
+	countedTask.task = task;
+	countedTask.context = taskContext;
+
+	void* userTask = taskSystem->EnqueueTask(b2CountedTaskCallback, itemCount, minRange, &countedTask);
+	if (userTask != nullptr)
+	{
+		taskSystem->FinishTask(userTask);
+	}
+}
+
+#endif
@@ -24,6 +24,8 @@
 #include "box2d/b2_time_step.h"
 #include "box2d/b2_weld_joint.h"
 
+#include "common/b2_snapshot.h"
+
 // Point-to-point constraint
 // C = p2 - p1
 // Cdot = v2 - v1
@@ -61,10 +63,10 @@ b2WeldJoint::b2WeldJoint(const b2WeldJointDef* def)
 
 void b2WeldJoint::InitVelocityConstraints(const b2SolverData& data)
 {
-	m_indexA = m_bodyA->m_islandIndex;
-	m_indexB = m_bodyB->m_islandIndex;
-	m_localCenterA = m_bodyA->m_sweep.localCenter;
-	m_localCenterB = m_bodyB->m_sweep.localCenter;
+	m_indexA = data.GetIndex(m_bodyA);
+	m_indexB = data.GetIndex(m_bodyB);
+	m_localCenterA = m_bodyA->m_localCenter;
+	m_localCenterB = m_bodyB->m_localCenter;
 	m_invMassA = m_bodyA->m_invMass;
 	m_invMassB = m_bodyB->m_invMass;
 	m_invIA = m_bodyA->m_invI;
@@ -342,3 +344,23 @@ void b2WeldJoint::Dump()
 	b2Dump("  jd.damping = %.9g;\n", m_damping);
 	b2Dump("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2WeldJoint::WriteState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_stiffness);
+	writer->Write(m_damping);
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_referenceAngle);
+	writer->Write(m_impulse);
+}
+
+void b2WeldJoint::ReadState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_stiffness);
+	reader->Read(&m_damping);
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_referenceAngle);
+	reader->Read(&m_impulse);
+}
@@ -22,6 +22,8 @@
 
 #include "b2_contact_solver.h"
 #include "b2_island.h"
+#include "b2_task.h"
+#include "common/b2_snapshot.h"
 
 #include "box2d/b2_body.h"
 #include "box2d/b2_broad_phase.h"
@@ -29,28 +31,82 @@
 #include "box2d/b2_circle_shape.h"
 #include "box2d/b2_collision.h"
 #include "box2d/b2_contact.h"
+#include "box2d/b2_distance.h"
 #include "box2d/b2_draw.h"
 #include "box2d/b2_edge_shape.h"
 #include "box2d/b2_fixture.h"
+#include "box2d/b2_gear_joint.h"
 #include "box2d/b2_polygon_shape.h"
+#include "box2d/b2_profiler.h"
 #include "box2d/b2_pulley_joint.h"
 #include "box2d/b2_time_of_impact.h"
 #include "box2d/b2_timer.h"
 #include "box2d/b2_world.h"
 
+#include <algorithm>
 #include <new>
 
+// Set the gravity of a temporary definition for constructor delegation.
+static const b2WorldDef* b2WithGravity(b2WorldDef&& def, const b2Vec2& gravity)
+{
+	def.gravity = gravity;
+	return &def;
+}
+
+// Overlaps found by one worker. The queries handled by a worker store their
+// overlaps contiguously.
+struct b2QueryBatchBuffer
+{
+	b2Allocator* allocator;
+	b2QueryResult* results;
+	int32 count;
+	int32 capacity;
+};
+
+// The overlaps of one query within the buffer of the worker that ran it.
+struct b2QueryBatchRange
+{
+	int32 workerIndex;
+	int32 start;
+	int32 count;
+};
+
 b2World::b2World(const b2Vec2& gravity)
+	: b2World(b2WithGravity(b2WorldDef(), gravity))
+{
+}
+
+b2World::b2World(const b2WorldDef* def)
+	: m_allocator(def->allocator)
+	, m_blockAllocator(&m_allocator)
+	, m_stackAllocator(def->stackCapacity, &m_allocator)
+	, m_contactManager(&m_allocator)
 {
+	m_allocator.SetBudget(def->memoryBudget);
+	m_allocator.SetListener(def->memoryListener);
+
 	m_destructionListener = nullptr;
 	m_debugDraw = nullptr;
 
 	m_bodyList = nullptr;
 	m_jointList = nullptr;
 
+	m_queryBuffers = nullptr;
+	m_queryBufferCount = 0;
+	m_queryRanges = nullptr;
+	m_queryRangeCapacity = 0;
+
+	m_awakeIslands = nullptr;
+	m_awakeIslandCount = 0;
+	m_awakeIslandCapacity = 0;
+
+	memset(&m_bodyStates, 0, sizeof(b2BodyStates));
+
 	m_bodyCount = 0;
 	m_jointCount = 0;
 
+	m_wideSolver = false;
+	m_wideQueries = false;
 	m_warmStarting = true;
 	m_continuousPhysics = true;
 	m_subStepping = false;
@@ -58,17 +114,27 @@ b2World::b2World(const b2Vec2& gravity)
 	m_stepComplete = true;
 
 	m_allowSleep = true;
-	m_gravity = gravity;
+	m_gravity = def->gravity;
 
 	m_newContacts = false;
 	m_locked = false;
 	m_clearForces = true;
 
 	m_inv_dt0 = 0.0f;
+	m_nextId = 0;
 
 	m_contactManager.m_allocator = &m_blockAllocator;
+	m_contactManager.m_stackAllocator = &m_stackAllocator;
+
+	m_taskSystem = nullptr;
+	m_workerAllocators = nullptr;
+	m_workerCount = 0;
+
+	m_stackCapacity = m_stackAllocator.GetCapacity();
+	m_growStack = def->growStack;
 
 	memset(&m_profile, 0, sizeof(b2Profile));
+	memset(&m_stepStats, 0, sizeof(b2StepStats));
 }
 
 b2World::~b2World()
@@ -90,6 +156,23 @@ b2World::~b2World()
 
 		b = bNext;
 	}
+
+	for (int32 i = 0; i < m_queryBufferCount; ++i)
+	{
+		b2Free(&m_allocator, m_queryBuffers[i].results, m_queryBuffers[i].capacity * sizeof(b2QueryResult));
+	}
+	b2Free(&m_allocator, m_queryBuffers, m_queryBufferCount * sizeof(b2QueryBatchBuffer));
+	b2Free(&m_allocator, m_queryRanges, m_queryRangeCapacity * sizeof(b2QueryBatchRange));
+
+	// Islands live in the block allocator.
+	b2Free(&m_allocator, m_awakeIslands, m_awakeIslandCapacity * sizeof(b2PersistentIsland*));
+
+	int32 stateCapacity = m_bodyStates.capacity;
+	b2Free(&m_allocator, m_bodyStates.positions, stateCapacity * sizeof(b2Position));
+	b2Free(&m_allocator, m_bodyStates.velocities, stateCapacity * sizeof(b2Velocity));
+	b2Free(&m_allocator, m_bodyStates.bodies, stateCapacity * sizeof(b2Body*));
+
+	SetTaskSystem(nullptr);
 }
 
 void b2World::SetDestructionListener(b2DestructionListener* listener)
@@ -112,6 +195,136 @@ void b2World::SetDebugDraw(b2Draw* debugDraw)
 	m_debugDraw = debugDraw;
 }
 
+void b2World::SetTaskSystem(b2TaskSystem* taskSystem)
+{
+	b2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	for (int32 i = 0; i < m_workerCount; ++i)
+	{
+		m_workerAllocators[i].~b2StackAllocator();
+	}
+	b2Free(&m_allocator, m_workerAllocators, m_workerCount * sizeof(b2StackAllocator));
+	m_workerAllocators = nullptr;
+	m_workerCount = 0;
+
+	m_taskSystem = taskSystem;
+	m_contactManager.m_taskSystem = taskSystem;
+
+	if (m_taskSystem)
+	{
+		m_workerCount = m_taskSystem->GetWorkerCount();
+		b2Assert(m_workerCount > 0);
+		m_workerAllocators = (b2StackAllocator*)b2Alloc(&m_allocator, m_workerCount * sizeof(b2StackAllocator));
+		for (int32 i = 0; i < m_workerCount; ++i)
+		{
+			new (m_workerAllocators + i) b2StackAllocator(m_stackCapacity, &m_allocator);
+		}
+	}
+}
+
+void b2World::SetStackCapacity(int32 capacity)
+{
+	b2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	m_stackAllocator.SetCapacity(capacity);
+	m_stackCapacity = m_stackAllocator.GetCapacity();
+
+	for (int32 i = 0; i < m_workerCount; ++i)
+	{
+		m_workerAllocators[i].SetCapacity(m_stackCapacity);
+	}
+}
+
+int32 b2World::GetStackHeapFallbackCount() const
+{
+	int32 count = m_stackAllocator.GetHeapFallbackCount();
+	for (int32 i = 0; i < m_workerCount; ++i)
+	{
+		count += m_workerAllocators[i].GetHeapFallbackCount();
+	}
+	return count;
+}
+
+b2MemoryStats b2World::GetMemoryStats() const
+{
+	b2MemoryStats stats;
+	stats.bodies = m_bodyCount * sizeof(b2Body);
+	stats.bodies += m_bodyStates.capacity * (sizeof(b2Position) + sizeof(b2Velocity) + sizeof(b2Body*));
+
+	stats.fixtures = 0;
+	stats.proxies = 0;
+	for (const b2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		for (const b2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			stats.fixtures += sizeof(b2Fixture);
+
+			const b2Shape* shape = f->m_shape;
+			switch (shape->m_type)
+			{
+			case b2Shape::e_circle:
+				stats.fixtures += sizeof(b2CircleShape);
+				break;
+
+			case b2Shape::e_edge:
+				stats.fixtures += sizeof(b2EdgeShape);
+				break;
+
+			case b2Shape::e_polygon:
+				stats.fixtures += sizeof(b2PolygonShape);
+				break;
+
+			case b2Shape::e_chain:
+				stats.fixtures += sizeof(b2ChainShape) + ((const b2ChainShape*)shape)->m_count * sizeof(b2Vec2);
+				break;
+
+			default:
+				b2Assert(false);
+				break;
+			}
+
+			stats.proxies += shape->GetChildCount() * sizeof(b2FixtureProxy);
+		}
+	}
+
+	const b2ContactManager& cm = m_contactManager;
+	stats.contacts = cm.m_contactCount * sizeof(b2Contact);
+	stats.contacts += cm.m_contactCapacity * sizeof(b2Contact*) + cm.m_pairCapacity * sizeof(b2ContactPair);
+
+	stats.proxies += cm.m_broadPhase.GetBufferByteCount();
+	stats.treeNodes = cm.m_broadPhase.GetTreeByteCount();
+
+	stats.stack = m_stackAllocator.GetCapacity();
+	for (int32 i = 0; i < m_workerCount; ++i)
+	{
+		stats.stack += m_workerAllocators[i].GetCapacity();
+	}
+
+	stats.totalBytes = m_allocator.GetByteCount();
+	stats.peakBytes = m_allocator.GetPeakByteCount();
+	stats.budget = m_allocator.GetBudget();
+	return stats;
+}
+
+b2StackAllocator* b2World::GetWorkerAllocators()
+{
+	if (m_taskSystem == nullptr)
+	{
+		// Inline tasks run on top of the world stack as worker zero.
+		return &m_stackAllocator;
+	}
+
+	return m_workerAllocators;
+}
+
 b2Body* b2World::CreateBody(const b2BodyDef* def)
 {
 	b2Assert(IsLocked() == false);
@@ -133,88 +346,268 @@ b2Body* b2World::CreateBody(const b2BodyDef* def)
 	m_bodyList = b;
 	++m_bodyCount;
 
+	LinkBody(b);
+
 	return b;
 }
 
-void b2World::DestroyBody(b2Body* b)
+void b2World::CreateBodies(const b2BodyDef* bodyDefs, const b2FixtureDef* fixtureDefs, int32 count, b2Body** bodies)
 {
-	b2Assert(m_bodyCount > 0);
 	b2Assert(IsLocked() == false);
 	if (IsLocked())
 	{
+		for (int32 i = 0; i < count; ++i)
+		{
+			bodies[i] = nullptr;
+		}
 		return;
 	}
 
-	// Delete the attached joints.
-	b2JointEdge* je = b->m_jointList;
-	while (je)
+	ReserveBodyStates(m_bodyStates.count + count);
+
+	int32 proxyCount = 0;
+	for (int32 i = 0; i < count; ++i)
 	{
-		b2JointEdge* je0 = je;
-		je = je->next;
+		void* mem = m_blockAllocator.Allocate(sizeof(b2Body));
+		b2Body* b = new (mem) b2Body(bodyDefs + i, this);
 
-		if (m_destructionListener)
+		// Add to world doubly linked list.
+		b->m_prev = nullptr;
+		b->m_next = m_bodyList;
+		if (m_bodyList)
 		{
-			m_destructionListener->SayGoodbye(je0->joint);
+			m_bodyList->m_prev = b;
 		}
+		m_bodyList = b;
+		++m_bodyCount;
+
+		LinkBody(b);
+
+		if (fixtureDefs != nullptr)
+		{
+			void* memory = m_blockAllocator.Allocate(sizeof(b2Fixture));
+			b2Fixture* fixture = new (memory) b2Fixture;
+			fixture->Create(&m_blockAllocator, b, fixtureDefs + i);
+			fixture->m_body = b;
+
+			b->m_fixtureList = fixture;
+			b->m_fixtureCount = 1;
 
-		DestroyJoint(je0->joint);
+			if (b->IsEnabled())
+			{
+				proxyCount += fixture->m_shape->GetChildCount();
+			}
+
+			if (fixture->m_density > 0.0f)
+			{
+				b->ResetMassData();
+			}
+		}
 
-		b->m_jointList = je;
+		bodies[i] = b;
 	}
-	b->m_jointList = nullptr;
 
-	// Delete the attached contacts.
-	b2ContactEdge* ce = b->m_contactList;
-	while (ce)
+	if (proxyCount == 0)
 	{
-		b2ContactEdge* ce0 = ce;
-		ce = ce->next;
-		m_contactManager.Destroy(ce0->contact);
+		return;
 	}
-	b->m_contactList = nullptr;
 
-	// Delete the attached fixtures. This destroys broad-phase proxies.
-	b2Fixture* f = b->m_fixtureList;
-	while (f)
+	// Build the proxies of all fixtures at once. Static proxies come first
+	// because they go to a separate tree.
+	b2AABB* aabbs = (b2AABB*)m_stackAllocator.Allocate(proxyCount * sizeof(b2AABB));
+	void** userData = (void**)m_stackAllocator.Allocate(proxyCount * sizeof(void*));
+	int32* proxyIds = (int32*)m_stackAllocator.Allocate(proxyCount * sizeof(int32));
+
+	int32 proxyIndex = 0;
+	int32 staticProxyCount = 0;
+	for (int32 pass = 0; pass < 2; ++pass)
 	{
-		b2Fixture* f0 = f;
-		f = f->m_next;
+		bool isStatic = pass == 0;
+		for (int32 i = 0; i < count; ++i)
+		{
+			b2Body* b = bodies[i];
+			if (b->IsEnabled() == false || (b->m_type == b2_staticBody) != isStatic)
+			{
+				continue;
+			}
+
+			b2Fixture* fixture = b->m_fixtureList;
+			fixture->m_proxyCount = fixture->m_shape->GetChildCount();
+			for (int32 j = 0; j < fixture->m_proxyCount; ++j)
+			{
+				b2FixtureProxy* proxy = fixture->m_proxies + j;
+				fixture->m_shape->ComputeAABB(&proxy->aabb, b->m_xf, j);
+				proxy->fixture = fixture;
+				proxy->childIndex = j;
+				aabbs[proxyIndex] = proxy->aabb;
+				userData[proxyIndex] = proxy;
+				++proxyIndex;
+			}
+		}
 
-		if (m_destructionListener)
+		if (isStatic)
 		{
-			m_destructionListener->SayGoodbye(f0);
+			staticProxyCount = proxyIndex;
 		}
+	}
+
+	b2Assert(proxyIndex == proxyCount);
+	b2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	broadPhase->CreateProxies(aabbs, userData, staticProxyCount, true, proxyIds);
+	broadPhase->CreateProxies(aabbs + staticProxyCount, userData + staticProxyCount,
+		proxyCount - staticProxyCount, false, proxyIds + staticProxyCount);
 
-		f0->DestroyProxies(&m_contactManager.m_broadPhase);
-		f0->Destroy(&m_blockAllocator);
-		f0->~b2Fixture();
-		m_blockAllocator.Free(f0, sizeof(b2Fixture));
+	proxyIndex = 0;
+	for (int32 pass = 0; pass < 2; ++pass)
+	{
+		bool isStatic = pass == 0;
+		for (int32 i = 0; i < count; ++i)
+		{
+			b2Body* b = bodies[i];
+			if (b->IsEnabled() == false || (b->m_type == b2_staticBody) != isStatic)
+			{
+				continue;
+			}
 
-		b->m_fixtureList = f;
-		b->m_fixtureCount -= 1;
+			b2Fixture* fixture = b->m_fixtureList;
+			for (int32 j = 0; j < fixture->m_proxyCount; ++j)
+			{
+				fixture->m_proxies[j].proxyId = proxyIds[proxyIndex++];
+			}
+		}
 	}
-	b->m_fixtureList = nullptr;
-	b->m_fixtureCount = 0;
 
-	// Remove world body list.
-	if (b->m_prev)
+	m_stackAllocator.Free(proxyIds);
+	m_stackAllocator.Free(userData);
+	m_stackAllocator.Free(aabbs);
+
+	// New contacts are created at the beginning of the next time step.
+	m_newContacts = true;
+}
+
+void b2World::DestroyBody(b2Body* b)
+{
+	DestroyBodies(&b, 1);
+}
+
+void b2World::DestroyBodies(b2Body* const* bodies, int32 count)
+{
+	b2Assert(m_bodyCount >= count);
+	b2Assert(IsLocked() == false);
+	if (IsLocked())
 	{
-		b->m_prev->m_next = b->m_next;
+		return;
 	}
 
-	if (b->m_next)
+	int32 proxyCount = 0;
+	for (int32 i = 0; i < count; ++i)
 	{
-		b->m_next->m_prev = b->m_prev;
+		b2Body* b = bodies[i];
+
+		// Delete the attached joints.
+		b2JointEdge* je = b->m_jointList;
+		while (je)
+		{
+			b2JointEdge* je0 = je;
+			je = je->next;
+
+			if (m_destructionListener)
+			{
+				m_destructionListener->SayGoodbye(je0->joint);
+			}
+
+			DestroyJoint(je0->joint);
+
+			b->m_jointList = je;
+		}
+		b->m_jointList = nullptr;
+
+		// Delete the attached contacts.
+		b2ContactEdge* ce = b->m_contactList;
+		while (ce)
+		{
+			b2ContactEdge* ce0 = ce;
+			ce = ce->next;
+			m_contactManager.Destroy(ce0->contact);
+		}
+		b->m_contactList = nullptr;
+
+		for (b2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			if (m_destructionListener)
+			{
+				m_destructionListener->SayGoodbye(f);
+			}
+
+			proxyCount += f->m_proxyCount;
+		}
 	}
 
-	if (b == m_bodyList)
+	// Destroy the broad-phase proxies of all fixtures at once.
+	int32* proxyIds = (int32*)m_stackAllocator.Allocate(proxyCount * sizeof(int32));
+	int32 proxyIndex = 0;
+	for (int32 i = 0; i < count; ++i)
 	{
-		m_bodyList = b->m_next;
+		for (b2Fixture* f = bodies[i]->m_fixtureList; f; f = f->m_next)
+		{
+			for (int32 j = 0; j < f->m_proxyCount; ++j)
+			{
+				proxyIds[proxyIndex++] = f->m_proxies[j].proxyId;
+				f->m_proxies[j].proxyId = b2BroadPhase::e_nullProxy;
+			}
+			f->m_proxyCount = 0;
+		}
 	}
 
-	--m_bodyCount;
-	b->~b2Body();
-	m_blockAllocator.Free(b, sizeof(b2Body));
+	b2Assert(proxyIndex == proxyCount);
+	m_contactManager.m_broadPhase.DestroyProxies(proxyIds, proxyCount);
+	m_stackAllocator.Free(proxyIds);
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		b2Body* b = bodies[i];
+
+		// Delete the attached fixtures.
+		b2Fixture* f = b->m_fixtureList;
+		while (f)
+		{
+			b2Fixture* f0 = f;
+			f = f->m_next;
+
+			f0->Destroy(&m_blockAllocator);
+			f0->~b2Fixture();
+			m_blockAllocator.Free(f0, sizeof(b2Fixture));
+
+			b->m_fixtureList = f;
+			b->m_fixtureCount -= 1;
+		}
+		b->m_fixtureList = nullptr;
+		b->m_fixtureCount = 0;
+
+		UnlinkBody(b);
+
+		// Remove world body list.
+		if (b->m_prev)
+		{
+			b->m_prev->m_next = b->m_next;
+		}
+
+		if (b->m_next)
+		{
+			b->m_next->m_prev = b->m_prev;
+		}
+
+		if (b == m_bodyList)
+		{
+			m_bodyList = b->m_next;
+		}
+
+		DestroyBodyState(b);
+
+		--m_bodyCount;
+		b->~b2Body();
+		m_blockAllocator.Free(b, sizeof(b2Body));
+	}
 }
 
 b2Joint* b2World::CreateJoint(const b2JointDef* def)
@@ -226,6 +619,7 @@ b2Joint* b2World::CreateJoint(const b2JointDef* def)
 	}
 
 	b2Joint* j = b2Joint::Create(def, &m_blockAllocator);
+	j->m_id = m_nextId++;
 
 	// Connect to the world list.
 	j->m_prev = nullptr;
@@ -272,7 +666,9 @@ b2Joint* b2World::CreateJoint(const b2JointDef* def)
 		}
 	}
 
-	// Note: creating a joint doesn't wake the bodies.
+	// Note: creating a joint doesn't wake the bodies. It may merge a sleeping island
+	// into an awake island.
+	LinkJoint(j);
 
 	return j;
 }
@@ -311,6 +707,11 @@ void b2World::DestroyJoint(b2Joint* j)
 	bodyA->SetAwake(true);
 	bodyB->SetAwake(true);
 
+	if (j->m_islandLinked)
+	{
+		UnlinkJoint(j);
+	}
+
 	// Remove from body 1.
 	if (j->m_edgeA.prev)
 	{
@@ -372,951 +773,3672 @@ void b2World::DestroyJoint(b2Joint* j)
 	}
 }
 
-//
-void b2World::SetAllowSleeping(bool flag)
+void b2World::LinkBody(b2Body* body)
 {
-	if (flag == m_allowSleep)
-	{
-		return;
-	}
+	b2Assert(body->m_island == nullptr);
 
-	m_allowSleep = flag;
-	if (m_allowSleep == false)
+	if (body->m_type != b2_staticBody && body->IsEnabled())
 	{
-		for (b2Body* b = m_bodyList; b; b = b->m_next)
+		b2PersistentIsland* island = CreateIsland();
+		island->bodyList = body;
+		island->bodyTail = body;
+		island->bodyCount = 1;
+
+		body->m_island = island;
+		body->m_islandPrev = nullptr;
+		body->m_islandNext = nullptr;
+
+		if (body->IsAwake())
 		{
-			b->SetAwake(true);
+			WakeIsland(island);
 		}
 	}
+
+	for (b2JointEdge* je = body->m_jointList; je; je = je->next)
+	{
+		LinkJoint(je->joint);
+	}
 }
 
-// Find islands, integrate and solve constraints, solve position constraints
-void b2World::Solve(const b2TimeStep& step)
+void b2World::UnlinkBody(b2Body* body)
 {
-	m_profile.solveInit = 0.0f;
-	m_profile.solveVelocity = 0.0f;
-	m_profile.solvePosition = 0.0f;
+	for (b2JointEdge* je = body->m_jointList; je; je = je->next)
+	{
+		if (je->joint->m_islandLinked)
+		{
+			UnlinkJoint(je->joint);
+		}
+	}
 
-	// Size the island for the worst case.
-	b2Island island(m_bodyCount,
-					m_contactManager.m_contactCount,
-					m_jointCount,
-					&m_stackAllocator,
-					m_contactManager.m_contactListener);
+	for (b2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+	{
+		if (ce->contact->m_flags & b2Contact::e_islandLinkFlag)
+		{
+			UnlinkContact(ce->contact);
+		}
+	}
 
-	// Clear all the island flags.
-	for (b2Body* b = m_bodyList; b; b = b->m_next)
+	b2PersistentIsland* island = body->m_island;
+	if (island == nullptr)
 	{
-		b->m_flags &= ~b2Body::e_islandFlag;
+		return;
 	}
-	for (b2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+
+	if (body->m_islandPrev)
 	{
-		c->m_flags &= ~b2Contact::e_islandFlag;
+		body->m_islandPrev->m_islandNext = body->m_islandNext;
 	}
-	for (b2Joint* j = m_jointList; j; j = j->m_next)
+	else
 	{
-		j->m_islandFlag = false;
+		island->bodyList = body->m_islandNext;
 	}
 
-	// Build and simulate all awake islands.
-	int32 stackSize = m_bodyCount;
-	b2Body** stack = (b2Body**)m_stackAllocator.Allocate(stackSize * sizeof(b2Body*));
-	for (b2Body* seed = m_bodyList; seed; seed = seed->m_next)
+	if (body->m_islandNext)
 	{
-		if (seed->m_flags & b2Body::e_islandFlag)
-		{
-			continue;
-		}
+		body->m_islandNext->m_islandPrev = body->m_islandPrev;
+	}
+	else
+	{
+		island->bodyTail = body->m_islandPrev;
+	}
 
-		if (seed->IsAwake() == false || seed->IsEnabled() == false)
-		{
-			continue;
-		}
+	body->m_island = nullptr;
+	body->m_islandPrev = nullptr;
+	body->m_islandNext = nullptr;
 
-		// The seed can be dynamic or kinematic.
-		if (seed->GetType() == b2_staticBody)
-		{
-			continue;
-		}
+	--island->bodyCount;
+	if (island->bodyCount == 0)
+	{
+		b2Assert(island->contactCount == 0 && island->jointCount == 0);
+		DestroyIsland(island);
+	}
+}
 
-		// Reset island and stack.
-		island.Clear();
-		int32 stackCount = 0;
-		stack[stackCount++] = seed;
-		seed->m_flags |= b2Body::e_islandFlag;
+void b2World::LinkContact(b2Contact* contact)
+{
+	b2Assert((contact->m_flags & b2Contact::e_islandLinkFlag) == 0);
 
-		// Perform a depth first search (DFS) on the constraint graph.
-		while (stackCount > 0)
-		{
-			// Grab the next body off the stack and add it to the island.
-			b2Body* b = stack[--stackCount];
-			b2Assert(b->IsEnabled() == true);
-			island.Add(b);
+	b2PersistentIsland* islandA = contact->m_fixtureA->m_body->m_island;
+	b2PersistentIsland* islandB = contact->m_fixtureB->m_body->m_island;
+	b2Assert(islandA != nullptr || islandB != nullptr);
 
-			// To keep islands as small as possible, we don't
-			// propagate islands across static bodies.
-			if (b->GetType() == b2_staticBody)
-			{
-				continue;
-			}
+	b2PersistentIsland* island = islandA != nullptr ? islandA : islandB;
+	if (islandA != nullptr && islandB != nullptr && islandA != islandB)
+	{
+		island = MergeIslands(islandA, islandB);
+	}
 
-			// Make sure the body is awake (without resetting sleep timer).
-			b->m_flags |= b2Body::e_awakeFlag;
+	contact->m_islandPrev = island->contactTail;
+	contact->m_islandNext = nullptr;
+	if (island->contactTail)
+	{
+		island->contactTail->m_islandNext = contact;
+	}
+	else
+	{
+		island->contactList = contact;
+	}
+	island->contactTail = contact;
+	++island->contactCount;
 
-			// Search all contacts connected to this body.
-			for (b2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
-			{
-				b2Contact* contact = ce->contact;
+	contact->m_flags |= b2Contact::e_islandLinkFlag;
+}
 
-				// Has this contact already been added to an island?
-				if (contact->m_flags & b2Contact::e_islandFlag)
-				{
-					continue;
-				}
+void b2World::UnlinkContact(b2Contact* contact)
+{
+	b2Assert(contact->m_flags & b2Contact::e_islandLinkFlag);
 
-				// Is this contact solid and touching?
-				if (contact->IsEnabled() == false ||
-					contact->IsTouching() == false)
-				{
-					continue;
-				}
+	b2PersistentIsland* islandA = contact->m_fixtureA->m_body->m_island;
+	b2PersistentIsland* islandB = contact->m_fixtureB->m_body->m_island;
+	b2Assert(islandA == nullptr || islandB == nullptr || islandA == islandB);
 
-				// Skip sensors.
-				bool sensorA = contact->m_fixtureA->m_isSensor;
-				bool sensorB = contact->m_fixtureB->m_isSensor;
-				if (sensorA || sensorB)
-				{
-					continue;
-				}
+	b2PersistentIsland* island = islandA != nullptr ? islandA : islandB;
+	b2Assert(island != nullptr);
 
-				island.Add(contact);
-				contact->m_flags |= b2Contact::e_islandFlag;
+	if (contact->m_islandPrev)
+	{
+		contact->m_islandPrev->m_islandNext = contact->m_islandNext;
+	}
+	else
+	{
+		island->contactList = contact->m_islandNext;
+	}
 
-				b2Body* other = ce->other;
+	if (contact->m_islandNext)
+	{
+		contact->m_islandNext->m_islandPrev = contact->m_islandPrev;
+	}
+	else
+	{
+		island->contactTail = contact->m_islandPrev;
+	}
 
-				// Was the other body already added to this island?
-				if (other->m_flags & b2Body::e_islandFlag)
-				{
-					continue;
-				}
+	contact->m_islandPrev = nullptr;
+	contact->m_islandNext = nullptr;
+	contact->m_flags &= ~b2Contact::e_islandLinkFlag;
 
-				b2Assert(stackCount < stackSize);
-				stack[stackCount++] = other;
-				other->m_flags |= b2Body::e_islandFlag;
-			}
+	--island->contactCount;
 
-			// Search all joints connect to this body.
-			for (b2JointEdge* je = b->m_jointList; je; je = je->next)
-			{
-				if (je->joint->m_islandFlag == true)
-				{
-					continue;
-				}
+	// Only constraints between two island bodies can disconnect the island.
+	if (islandA != nullptr && islandB != nullptr)
+	{
+		++island->constraintRemoveCount;
+	}
+}
 
-				b2Body* other = je->other;
+void b2World::LinkJoint(b2Joint* joint)
+{
+	if (joint->m_islandLinked)
+	{
+		return;
+	}
 
-				// Don't simulate joints connected to disabled bodies.
-				if (other->IsEnabled() == false)
-				{
-					continue;
-				}
+	// Joints connected to disabled bodies are not simulated.
+	b2Body* bodyA = joint->m_bodyA;
+	b2Body* bodyB = joint->m_bodyB;
+	if (bodyA->IsEnabled() == false || bodyB->IsEnabled() == false)
+	{
+		return;
+	}
 
-				island.Add(je->joint);
-				je->joint->m_islandFlag = true;
+	b2PersistentIsland* islandA = bodyA->m_island;
+	b2PersistentIsland* islandB = bodyB->m_island;
+	if (islandA == nullptr && islandB == nullptr)
+	{
+		return;
+	}
 
-				if (other->m_flags & b2Body::e_islandFlag)
-				{
-					continue;
-				}
+	b2PersistentIsland* island = islandA != nullptr ? islandA : islandB;
+	if (islandA != nullptr && islandB != nullptr && islandA != islandB)
+	{
+		island = MergeIslands(islandA, islandB);
+	}
 
-				b2Assert(stackCount < stackSize);
-				stack[stackCount++] = other;
-				other->m_flags |= b2Body::e_islandFlag;
-			}
-		}
+	joint->m_islandPrev = island->jointTail;
+	joint->m_islandNext = nullptr;
+	if (island->jointTail)
+	{
+		island->jointTail->m_islandNext = joint;
+	}
+	else
+	{
+		island->jointList = joint;
+	}
+	island->jointTail = joint;
+	++island->jointCount;
 
-		b2Profile profile;
-		island.Solve(&profile, step, m_gravity, m_allowSleep);
-		m_profile.solveInit += profile.solveInit;
-		m_profile.solveVelocity += profile.solveVelocity;
-		m_profile.solvePosition += profile.solvePosition;
+	joint->m_islandLinked = true;
+}
 
-		// Post solve cleanup.
-		for (int32 i = 0; i < island.m_bodyCount; ++i)
-		{
-			// Allow static bodies to participate in other islands.
-			b2Body* b = island.m_bodies[i];
-			if (b->GetType() == b2_staticBody)
-			{
-				b->m_flags &= ~b2Body::e_islandFlag;
-			}
-		}
-	}
+void b2World::UnlinkJoint(b2Joint* joint)
+{
+	b2Assert(joint->m_islandLinked);
 
-	m_stackAllocator.Free(stack);
+	b2PersistentIsland* islandA = joint->m_bodyA->m_island;
+	b2PersistentIsland* islandB = joint->m_bodyB->m_island;
+	b2Assert(islandA == nullptr || islandB == nullptr || islandA == islandB);
+
+	b2PersistentIsland* island = islandA != nullptr ? islandA : islandB;
+	b2Assert(island != nullptr);
 
+	if (joint->m_islandPrev)
 	{
-		b2Timer timer;
-		// Synchronize fixtures, check for out of range bodies.
-		for (b2Body* b = m_bodyList; b; b = b->GetNext())
-		{
-			// If a body was not in an island then it did not move.
-			if ((b->m_flags & b2Body::e_islandFlag) == 0)
-			{
-				continue;
-			}
+		joint->m_islandPrev->m_islandNext = joint->m_islandNext;
+	}
+	else
+	{
+		island->jointList = joint->m_islandNext;
+	}
 
-			if (b->GetType() == b2_staticBody)
-			{
-				continue;
-			}
+	if (joint->m_islandNext)
+	{
+		joint->m_islandNext->m_islandPrev = joint->m_islandPrev;
+	}
+	else
+	{
+		island->jointTail = joint->m_islandPrev;
+	}
 
-			// Update fixtures (for broad-phase).
-			b->SynchronizeFixtures();
-		}
+	joint->m_islandPrev = nullptr;
+	joint->m_islandNext = nullptr;
+	joint->m_islandLinked = false;
 
-		// Look for new contacts.
-		m_contactManager.FindNewContacts();
-		m_profile.broadphase = timer.GetMilliseconds();
+	--island->jointCount;
+
+	if (islandA != nullptr && islandB != nullptr)
+	{
+		++island->constraintRemoveCount;
 	}
 }
 
-// Find TOI contacts and solve them.
-void b2World::SolveTOI(const b2TimeStep& step)
+b2PersistentIsland* b2World::CreateIsland()
+{
+	void* mem = m_blockAllocator.Allocate(sizeof(b2PersistentIsland));
+	b2PersistentIsland* island = (b2PersistentIsland*)mem;
+	memset(island, 0, sizeof(b2PersistentIsland));
+	island->awakeIndex = -1;
+	return island;
+}
+
+void b2World::DestroyIsland(b2PersistentIsland* island)
 {
-	b2Island island(2 * b2_maxTOIContacts, b2_maxTOIContacts, 0, &m_stackAllocator, m_contactManager.m_contactListener);
+	if (island->awakeIndex != -1)
+	{
+		RemoveAwakeIsland(island);
+	}
 
-	if (m_stepComplete)
+	m_blockAllocator.Free(island, sizeof(b2PersistentIsland));
+}
+
+b2PersistentIsland* b2World::MergeIslands(b2PersistentIsland* island1, b2PersistentIsland* island2)
+{
+	// Move the smaller island into the larger one.
+	b2PersistentIsland* larger = island1;
+	b2PersistentIsland* smaller = island2;
+	if (island1->bodyCount < island2->bodyCount)
 	{
-		for (b2Body* b = m_bodyList; b; b = b->m_next)
+		larger = island2;
+		smaller = island1;
+	}
+
+	// A sleeping island is woken by an awake island, as if the island was searched again.
+	if (smaller->awakeIndex != -1 && larger->awakeIndex == -1)
+	{
+		WakeIsland(larger);
+	}
+
+	for (b2Body* b = smaller->bodyList; b; b = b->m_islandNext)
+	{
+		b->m_island = larger;
+	}
+
+	if (smaller->bodyList)
+	{
+		larger->bodyTail->m_islandNext = smaller->bodyList;
+		smaller->bodyList->m_islandPrev = larger->bodyTail;
+		larger->bodyTail = smaller->bodyTail;
+	}
+
+	if (smaller->contactList)
+	{
+		if (larger->contactTail)
 		{
-			b->m_flags &= ~b2Body::e_islandFlag;
-			b->m_sweep.alpha0 = 0.0f;
+			larger->contactTail->m_islandNext = smaller->contactList;
+			smaller->contactList->m_islandPrev = larger->contactTail;
+		}
+		else
+		{
+			larger->contactList = smaller->contactList;
 		}
+		larger->contactTail = smaller->contactTail;
+	}
 
-		for (b2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+	if (smaller->jointList)
+	{
+		if (larger->jointTail)
 		{
-			// Invalidate TOI
-			c->m_flags &= ~(b2Contact::e_toiFlag | b2Contact::e_islandFlag);
-			c->m_toiCount = 0;
-			c->m_toi = 1.0f;
+			larger->jointTail->m_islandNext = smaller->jointList;
+			smaller->jointList->m_islandPrev = larger->jointTail;
+		}
+		else
+		{
+			larger->jointList = smaller->jointList;
 		}
+		larger->jointTail = smaller->jointTail;
 	}
 
-	// Find TOI events and solve them.
-	for (;;)
+	larger->bodyCount += smaller->bodyCount;
+	larger->contactCount += smaller->contactCount;
+	larger->jointCount += smaller->jointCount;
+	larger->constraintRemoveCount += smaller->constraintRemoveCount;
+
+	DestroyIsland(smaller);
+
+	return larger;
+}
+
+// Rebuild the islands of the bodies in this island with a depth first search.
+// The first island found reuses the storage of the original island. All islands
+// keep the awake state of the original island.
+void b2World::SplitIsland(b2PersistentIsland* island)
+{
+	int32 bodyCount = island->bodyCount;
+	bool awake = island->awakeIndex != -1;
+
+	b2Body** bodies = (b2Body**)m_stackAllocator.Allocate(bodyCount * sizeof(b2Body*));
+	b2Body** stack = (b2Body**)m_stackAllocator.Allocate(bodyCount * sizeof(b2Body*));
+
+	int32 index = 0;
+	for (b2Body* b = island->bodyList; b; b = b->m_islandNext)
 	{
-		// Find the first TOI.
-		b2Contact* minContact = nullptr;
-		float minAlpha = 1.0f;
+		bodies[index++] = b;
+		b->m_island = nullptr;
+	}
+	b2Assert(index == bodyCount);
+
+	b2PersistentIsland* target = island;
+	target->bodyList = nullptr;
+	target->bodyTail = nullptr;
+	target->contactList = nullptr;
+	target->contactTail = nullptr;
+	target->jointList = nullptr;
+	target->jointTail = nullptr;
+	target->bodyCount = 0;
+	target->contactCount = 0;
+	target->jointCount = 0;
+	target->constraintRemoveCount = 0;
+
+	for (int32 i = 0; i < bodyCount; ++i)
+	{
+		b2Body* seed = bodies[i];
+		if (seed->m_island != nullptr)
+		{
+			continue;
+		}
 
-		for (b2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+		if (target == nullptr)
 		{
-			// Is this contact disabled?
-			if (c->IsEnabled() == false)
+			target = CreateIsland();
+			if (awake)
 			{
-				continue;
+				WakeIsland(target);
 			}
+		}
 
-			// Prevent excessive sub-stepping.
-			if (c->m_toiCount > b2_maxSubSteps)
-			{
-				continue;
-			}
+		int32 stackCount = 0;
+		stack[stackCount++] = seed;
+		seed->m_island = target;
 
-			float alpha = 1.0f;
-			if (c->m_flags & b2Contact::e_toiFlag)
+		while (stackCount > 0)
+		{
+			b2Body* b = stack[--stackCount];
+
+			b->m_islandPrev = target->bodyTail;
+			b->m_islandNext = nullptr;
+			if (target->bodyTail)
 			{
-				// This contact has a valid cached TOI.
-				alpha = c->m_toi;
+				target->bodyTail->m_islandNext = b;
 			}
 			else
 			{
-				b2Fixture* fA = c->GetFixtureA();
-				b2Fixture* fB = c->GetFixtureB();
+				target->bodyList = b;
+			}
+			target->bodyTail = b;
+			++target->bodyCount;
 
-				// Is there a sensor?
-				if (fA->IsSensor() || fB->IsSensor())
+			for (b2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
+			{
+				b2Contact* contact = ce->contact;
+				if ((contact->m_flags & b2Contact::e_islandLinkFlag) == 0)
 				{
 					continue;
 				}
 
-				b2Body* bA = fA->GetBody();
-				b2Body* bB = fB->GetBody();
-
-				b2BodyType typeA = bA->m_type;
-				b2BodyType typeB = bB->m_type;
-				b2Assert(typeA == b2_dynamicBody || typeB == b2_dynamicBody);
-
-				bool activeA = bA->IsAwake() && typeA != b2_staticBody;
-				bool activeB = bB->IsAwake() && typeB != b2_staticBody;
+				// A contact is added by its first island body.
+				b2Body* bodyA = contact->m_fixtureA->m_body;
+				b2Body* owner = bodyA->m_type != b2_staticBody ? bodyA : contact->m_fixtureB->m_body;
+				if (owner == b)
+				{
+					contact->m_islandPrev = target->contactTail;
+					contact->m_islandNext = nullptr;
+					if (target->contactTail)
+					{
+						target->contactTail->m_islandNext = contact;
+					}
+					else
+					{
+						target->contactList = contact;
+					}
+					target->contactTail = contact;
+					++target->contactCount;
+				}
 
-				// Is at least one body active (awake and dynamic or kinematic)?
-				if (activeA == false && activeB == false)
+				b2Body* other = ce->other;
+				if (other->m_type == b2_staticBody || other->m_island != nullptr)
 				{
 					continue;
 				}
 
-				bool collideA = bA->IsBullet() || typeA != b2_dynamicBody;
-				bool collideB = bB->IsBullet() || typeB != b2_dynamicBody;
+				b2Assert(stackCount < bodyCount);
+				stack[stackCount++] = other;
+				other->m_island = target;
+			}
 
-				// Are these two non-bullet dynamic bodies?
-				if (collideA == false && collideB == false)
+			for (b2JointEdge* je = b->m_jointList; je; je = je->next)
+			{
+				b2Joint* joint = je->joint;
+				if (joint->m_islandLinked == false)
 				{
 					continue;
 				}
 
-				// Compute the TOI for this contact.
-				// Put the sweeps onto the same time interval.
-				float alpha0 = bA->m_sweep.alpha0;
-
-				if (bA->m_sweep.alpha0 < bB->m_sweep.alpha0)
+				b2Body* owner = joint->m_bodyA->m_type != b2_staticBody ? joint->m_bodyA : joint->m_bodyB;
+				if (owner == b)
 				{
-					alpha0 = bB->m_sweep.alpha0;
-					bA->m_sweep.Advance(alpha0);
+					joint->m_islandPrev = target->jointTail;
+					joint->m_islandNext = nullptr;
+					if (target->jointTail)
+					{
+						target->jointTail->m_islandNext = joint;
+					}
+					else
+					{
+						target->jointList = joint;
+					}
+					target->jointTail = joint;
+					++target->jointCount;
 				}
-				else if (bB->m_sweep.alpha0 < bA->m_sweep.alpha0)
+
+				b2Body* other = je->other;
+				if (other->m_type == b2_staticBody || other->m_island != nullptr)
 				{
-					alpha0 = bA->m_sweep.alpha0;
-					bB->m_sweep.Advance(alpha0);
+					continue;
 				}
 
-				b2Assert(alpha0 < 1.0f);
+				b2Assert(stackCount < bodyCount);
+				stack[stackCount++] = other;
+				other->m_island = target;
+			}
+		}
 
-				int32 indexA = c->GetChildIndexA();
-				int32 indexB = c->GetChildIndexB();
+		target = nullptr;
+	}
 
-				// Compute the time of impact in interval [0, minTOI]
-				b2TOIInput input;
-				input.proxyA.Set(fA->GetShape(), indexA);
-				input.proxyB.Set(fB->GetShape(), indexB);
-				input.sweepA = bA->m_sweep;
-				input.sweepB = bB->m_sweep;
-				input.tMax = 1.0f;
+	m_stackAllocator.Free(stack);
+	m_stackAllocator.Free(bodies);
+}
 
-				b2TOIOutput output;
-				b2TimeOfImpact(&output, &input);
+void b2World::WakeIsland(b2PersistentIsland* island)
+{
+	b2Assert(island->awakeIndex == -1);
 
-				// Beta is the fraction of the remaining portion of the .
-				float beta = output.t;
-				if (output.state == b2TOIOutput::e_touching)
-				{
-					alpha = b2Min(alpha0 + (1.0f - alpha0) * beta, 1.0f);
-				}
-				else
-				{
-					alpha = 1.0f;
-				}
+	if (m_awakeIslandCount == m_awakeIslandCapacity)
+	{
+		b2PersistentIsland** oldIslands = m_awakeIslands;
+		m_awakeIslandCapacity = b2Max(2 * m_awakeIslandCapacity, 16);
+		m_awakeIslands = (b2PersistentIsland**)b2Alloc(&m_allocator, m_awakeIslandCapacity * sizeof(b2PersistentIsland*));
+		if (oldIslands)
+		{
+			memcpy(m_awakeIslands, oldIslands, m_awakeIslandCount * sizeof(b2PersistentIsland*));
+		}
+		b2Free(&m_allocator, oldIslands, m_awakeIslandCount * sizeof(b2PersistentIsland*));
+	}
 
-				c->m_toi = alpha;
-				c->m_flags |= b2Contact::e_toiFlag;
-			}
+	island->awakeIndex = m_awakeIslandCount;
+	m_awakeIslands[m_awakeIslandCount++] = island;
+}
 
-			if (alpha < minAlpha)
-			{
-				// This is the minimum TOI found so far.
-				minContact = c;
-				minAlpha = alpha;
-			}
-		}
+void b2World::CreateBodyState(b2Body* body)
+{
+	if (m_bodyStates.count == m_bodyStates.capacity)
+	{
+		ReserveBodyStates(b2Max(2 * m_bodyStates.capacity, 64));
+	}
 
-		if (minContact == nullptr || 1.0f - 10.0f * b2_epsilon < minAlpha)
-		{
-			// No more TOI events. Done!
-			m_stepComplete = true;
-			break;
-		}
+	int32 index = m_bodyStates.count++;
+	m_bodyStates.bodies[index] = body;
+	body->m_states = &m_bodyStates;
+	body->m_stateIndex = index;
+}
 
-		// Advance the bodies to the TOI.
-		b2Fixture* fA = minContact->GetFixtureA();
-		b2Fixture* fB = minContact->GetFixtureB();
-		b2Body* bA = fA->GetBody();
-		b2Body* bB = fB->GetBody();
+void b2World::DestroyBodyState(b2Body* body)
+{
+	int32 index = body->m_stateIndex;
+	b2Assert(0 <= index && index < m_bodyStates.count);
+	b2Assert(m_bodyStates.bodies[index] == body);
+
+	// Move the last body into the hole.
+	int32 last = m_bodyStates.count - 1;
+	b2Body* lastBody = m_bodyStates.bodies[last];
+	m_bodyStates.positions[index] = m_bodyStates.positions[last];
+	m_bodyStates.velocities[index] = m_bodyStates.velocities[last];
+	m_bodyStates.bodies[index] = lastBody;
+	lastBody->m_stateIndex = index;
+	--m_bodyStates.count;
+
+	body->m_stateIndex = -1;
+}
 
-		b2Sweep backup1 = bA->m_sweep;
-		b2Sweep backup2 = bB->m_sweep;
+void b2World::ReserveBodyStates(int32 capacity)
+{
+	if (capacity <= m_bodyStates.capacity)
+	{
+		return;
+	}
 
-		bA->Advance(minAlpha);
-		bB->Advance(minAlpha);
+	b2Position* oldPositions = m_bodyStates.positions;
+	b2Velocity* oldVelocities = m_bodyStates.velocities;
+	b2Body** oldBodies = m_bodyStates.bodies;
+	int32 oldCapacity = m_bodyStates.capacity;
 
-		// The TOI contact likely has some new contact points.
-		minContact->Update(m_contactManager.m_contactListener);
-		minContact->m_flags &= ~b2Contact::e_toiFlag;
-		++minContact->m_toiCount;
+	m_bodyStates.capacity = capacity;
+	m_bodyStates.positions = (b2Position*)b2Alloc(&m_allocator, capacity * sizeof(b2Position));
+	m_bodyStates.velocities = (b2Velocity*)b2Alloc(&m_allocator, capacity * sizeof(b2Velocity));
+	m_bodyStates.bodies = (b2Body**)b2Alloc(&m_allocator, capacity * sizeof(b2Body*));
 
-		// Is the contact solid?
-		if (minContact->IsEnabled() == false || minContact->IsTouching() == false)
-		{
-			// Restore the sweeps.
-			minContact->SetEnabled(false);
-			bA->m_sweep = backup1;
-			bB->m_sweep = backup2;
-			bA->SynchronizeTransform();
-			bB->SynchronizeTransform();
-			continue;
-		}
+	int32 count = m_bodyStates.count;
+	if (oldPositions)
+	{
+		memcpy(m_bodyStates.positions, oldPositions, count * sizeof(b2Position));
+		memcpy(m_bodyStates.velocities, oldVelocities, count * sizeof(b2Velocity));
+		memcpy(m_bodyStates.bodies, oldBodies, count * sizeof(b2Body*));
+	}
 
-		bA->SetAwake(true);
-		bB->SetAwake(true);
+	b2Free(&m_allocator, oldPositions, oldCapacity * sizeof(b2Position));
+	b2Free(&m_allocator, oldVelocities, oldCapacity * sizeof(b2Velocity));
+	b2Free(&m_allocator, oldBodies, oldCapacity * sizeof(b2Body*));
+}
 
-		// Build the island
-		island.Clear();
-		island.Add(bA);
-		island.Add(bB);
-		island.Add(minContact);
+void b2World::RemoveAwakeIsland(b2PersistentIsland* island)
+{
+	int32 index = island->awakeIndex;
+	b2Assert(0 <= index && index < m_awakeIslandCount);
+	b2Assert(m_awakeIslands[index] == island);
 
-		bA->m_flags |= b2Body::e_islandFlag;
-		bB->m_flags |= b2Body::e_islandFlag;
-		minContact->m_flags |= b2Contact::e_islandFlag;
+	// Move the last island into the hole.
+	b2PersistentIsland* last = m_awakeIslands[m_awakeIslandCount - 1];
+	m_awakeIslands[index] = last;
+	last->awakeIndex = index;
+	--m_awakeIslandCount;
 
-		// Get contacts on bodyA and bodyB.
-		b2Body* bodies[2] = {bA, bB};
-		for (int32 i = 0; i < 2; ++i)
-		{
+	island->awakeIndex = -1;
+}
+
+// Canonical orders for determinism mode. Ids are unique, so these are strict total
+// orders and the sorted result does not depend on the input order.
+static bool b2BodyLess(const b2Body* a, const b2Body* b)
+{
+	return a->GetId() < b->GetId();
+}
+
+static bool b2JointLess(const b2Joint* a, const b2Joint* b)
+{
+	return a->GetId() < b->GetId();
+}
+
+static bool b2ContactLess(const b2Contact* a, const b2Contact* b)
+{
+	uint32 idA = a->GetFixtureA()->GetId();
+	uint32 idB = b->GetFixtureA()->GetId();
+	if (idA != idB)
+	{
+		return idA < idB;
+	}
+
+	if (a->GetChildIndexA() != b->GetChildIndexA())
+	{
+		return a->GetChildIndexA() < b->GetChildIndexA();
+	}
+
+	idA = a->GetFixtureB()->GetId();
+	idB = b->GetFixtureB()->GetId();
+	if (idA != idB)
+	{
+		return idA < idB;
+	}
+
+	return a->GetChildIndexB() < b->GetChildIndexB();
+}
+
+static bool b2ContactEdgeLess(const b2ContactEdge* a, const b2ContactEdge* b)
+{
+	return b2ContactLess(a->contact, b->contact);
+}
+
+void b2World::SortContacts(int32 startIndex)
+{
+	b2Contact** contacts = m_contactManager.m_contacts;
+	int32 count = m_contactManager.m_contactCount;
+	if (std::is_sorted(contacts + startIndex, contacts + count, b2ContactLess))
+	{
+		return;
+	}
+
+	std::sort(contacts + startIndex, contacts + count, b2ContactLess);
+	for (int32 i = startIndex; i < count; ++i)
+	{
+		contacts[i]->m_managerIndex = i;
+	}
+}
+
+struct b2IslandKey
+{
+	b2PersistentIsland* island;
+	uint32 key;
+};
+
+static bool b2IslandKeyLess(const b2IslandKey& a, const b2IslandKey& b)
+{
+	return a.key < b.key;
+}
+
+// Orders the awake islands by their lowest body id. The order of the awake island
+// array otherwise depends on the history of merges, splits and wake ups.
+// Islands that Solve will put back to sleep go last, so that removing them keeps the
+// order of the others.
+void b2World::SortAwakeIslands()
+{
+	b2IslandKey* keys = (b2IslandKey*)m_stackAllocator.Allocate(m_awakeIslandCount * sizeof(b2IslandKey));
+	for (int32 i = 0; i < m_awakeIslandCount; ++i)
+	{
+		b2PersistentIsland* island = m_awakeIslands[i];
+		uint32 key = island->bodyList->m_id;
+		bool awake = false;
+		for (b2Body* b = island->bodyList; b; b = b->m_islandNext)
+		{
+			key = b2Min(key, b->m_id);
+			awake = awake || b->IsAwake();
+		}
+
+		keys[i].island = island;
+		keys[i].key = awake ? key : 0xffffffff;
+	}
+
+	std::sort(keys, keys + m_awakeIslandCount, b2IslandKeyLess);
+	for (int32 i = 0; i < m_awakeIslandCount; ++i)
+	{
+		m_awakeIslands[i] = keys[i].island;
+		m_awakeIslands[i]->awakeIndex = i;
+	}
+
+	m_stackAllocator.Free(keys);
+}
+
+// Orders the contact list of a body. The list is otherwise in the order the contacts
+// were created, which depends on the broad-phase.
+void b2World::SortContactList(b2Body* body)
+{
+	int32 count = 0;
+	for (b2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+	{
+		++count;
+	}
+
+	if (count < 2)
+	{
+		return;
+	}
+
+	b2ContactEdge** edges = (b2ContactEdge**)m_stackAllocator.Allocate(count * sizeof(b2ContactEdge*));
+	int32 index = 0;
+	for (b2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+	{
+		edges[index++] = ce;
+	}
+
+	std::sort(edges, edges + count, b2ContactEdgeLess);
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		edges[i]->prev = i > 0 ? edges[i - 1] : nullptr;
+		edges[i]->next = i < count - 1 ? edges[i + 1] : nullptr;
+	}
+	body->m_contactList = edges[0];
+
+	m_stackAllocator.Free(edges);
+}
+
+//
+void b2World::SetAllowSleeping(bool flag)
+{
+	if (flag == m_allowSleep)
+	{
+		return;
+	}
+
+	m_allowSleep = flag;
+	if (m_allowSleep == false)
+	{
+		for (b2Body* b = m_bodyList; b; b = b->m_next)
+		{
+			b->SetAwake(true);
+		}
+	}
+}
+
+// Find islands, integrate and solve constraints, solve position constraints
+void b2World::Solve(const b2TimeStep& step)
+{
+	m_profile.solveInit = 0.0f;
+	m_profile.solveVelocity = 0.0f;
+	m_profile.solvePosition = 0.0f;
+
+	int32 contactCount = m_contactManager.m_contactCount;
+
+	// Islands are gathered first and then solved as a task. A static body may appear
+	// in several islands, so each constraint to a static body gets a copy of the static
+	// body state. The copies are stored past the bodies in the state arrays.
+	b2IslandRange* islands = (b2IslandRange*)m_stackAllocator.Allocate(m_awakeIslandCount * sizeof(b2IslandRange));
+	b2Body** bodies = (b2Body**)m_stackAllocator.Allocate(m_bodyCount * sizeof(b2Body*));
+	b2Contact** contacts = (b2Contact**)m_stackAllocator.Allocate(contactCount * sizeof(b2Contact*));
+	b2Joint** joints = (b2Joint**)m_stackAllocator.Allocate(m_jointCount * sizeof(b2Joint*));
+
+	int32 islandCount = 0;
+	int32 bodyCount = 0;
+	int32 islandContactCount = 0;
+	int32 jointCount = 0;
+	int32 staticCount = 0;
+
+	b2ProfileBegin(m_contactManager.m_profiler, "build islands");
+
+	bool deterministic = m_contactManager.m_deterministic;
+	if (deterministic)
+	{
+		SortAwakeIslands();
+	}
+
+	// Gather the awake islands. Sleeping islands are not visited.
+	for (int32 i = 0; i < m_awakeIslandCount;)
+	{
+		b2PersistentIsland* persistent = m_awakeIslands[i];
+
+		// The island stays asleep if all of its bodies were put to sleep by the user.
+		bool awake = false;
+		for (b2Body* b = persistent->bodyList; b; b = b->m_islandNext)
+		{
+			if (b->IsAwake())
+			{
+				awake = true;
+				break;
+			}
+		}
+
+		if (awake == false)
+		{
+			// This moves the last awake island to index i.
+			RemoveAwakeIsland(persistent);
+			continue;
+		}
+
+		++i;
+
+		b2IslandRange* island = islands + islandCount++;
+		island->island = persistent;
+		island->bodyStart = bodyCount;
+		island->contactStart = islandContactCount;
+		island->jointStart = jointCount;
+		island->staticStart = staticCount;
+
+		for (b2Body* b = persistent->bodyList; b; b = b->m_islandNext)
+		{
+			b2Assert(b->IsEnabled() == true);
+
+			// Make sure the body is awake (without resetting sleep timer).
+			b->m_flags |= b2Body::e_awakeFlag;
+			bodies[bodyCount++] = b;
+		}
+
+		for (b2Contact* c = persistent->contactList; c; c = c->m_islandNext)
+		{
+			// The contact may have been disabled by the user. It still connects the island.
+			if (c->IsEnabled() == false)
+			{
+				continue;
+			}
+
+			contacts[islandContactCount++] = c;
+
+			if (c->m_fixtureA->m_body->m_type == b2_staticBody || c->m_fixtureB->m_body->m_type == b2_staticBody)
+			{
+				++staticCount;
+			}
+		}
+
+		for (b2Joint* j = persistent->jointList; j; j = j->m_islandNext)
+		{
+			joints[jointCount++] = j;
+
+			if (j->m_bodyA->m_type == b2_staticBody)
+			{
+				++staticCount;
+			}
+
+			if (j->m_bodyB->m_type == b2_staticBody)
+			{
+				++staticCount;
+			}
+
+			// Gear joints may also use the static bodies of their two joints.
+			if (j->m_type == e_gearJoint)
+			{
+				staticCount += 2;
+			}
+		}
+
+		island->bodyCount = bodyCount - island->bodyStart;
+		island->contactCount = islandContactCount - island->contactStart;
+		island->jointCount = jointCount - island->jointStart;
+		island->staticCount = staticCount - island->staticStart;
+
+		b2StepStats& stats = m_contactManager.m_stats;
+		int32 sizeClass = 0;
+		while (sizeClass < b2_islandSizeClassCount - 1 && (2 << sizeClass) <= island->bodyCount)
+		{
+			++sizeClass;
+		}
+		stats.islandSizes[sizeClass] += 1;
+		stats.largestIsland = b2Max(stats.largestIsland, island->bodyCount);
+		stats.islands += 1;
+
+		// The island lists are in the order of links and merges.
+		if (deterministic)
+		{
+			std::sort(bodies + island->bodyStart, bodies + bodyCount, b2BodyLess);
+			std::sort(contacts + island->contactStart, contacts + islandContactCount, b2ContactLess);
+			std::sort(joints + island->jointStart, joints + jointCount, b2JointLess);
+		}
+	}
+
+	b2ProfileEnd(m_contactManager.m_profiler);
+
+	b2ContactListener* listener = m_contactManager.m_contactListener;
+
+	// Post-solve events are reported in island order after all islands are solved.
+	b2ContactImpulse* impulses = nullptr;
+	if (listener != nullptr)
+	{
+		impulses = (b2ContactImpulse*)m_stackAllocator.Allocate(islandContactCount * sizeof(b2ContactImpulse));
+	}
+
+	b2IslandSolverContext context;
+	context.step = step;
+	context.gravity = m_gravity;
+	context.allowSleep = m_allowSleep;
+	context.listener = listener;
+	context.allocators = GetWorkerAllocators();
+	context.islands = islands;
+	context.bodies = bodies;
+	context.contacts = contacts;
+	context.joints = joints;
+	context.impulses = impulses;
+	context.profiler = m_contactManager.m_profiler;
+
+	// Make room for the static body copies.
+	ReserveBodyStates(m_bodyStates.count + staticCount);
+	context.states = &m_bodyStates;
+
+	// The wide solver colors the bodies of all islands in one array.
+	uint32* bodyColors = nullptr;
+	if (step.wideSolver)
+	{
+		bodyColors = (uint32*)m_stackAllocator.Allocate(m_bodyStates.count * sizeof(uint32));
+		memset(bodyColors, 0, m_bodyStates.count * sizeof(uint32));
+	}
+	context.bodyColors = bodyColors;
+
+	b2ProfileBegin(m_contactManager.m_profiler, "solve islands");
+	b2RunTask(m_taskSystem, b2SolveIslandTask, islandCount, 1, &context);
+	b2ProfileEnd(m_contactManager.m_profiler);
+
+	if (bodyColors != nullptr)
+	{
+		m_stackAllocator.Free(bodyColors);
+	}
+
+	for (int32 i = 0; i < islandCount; ++i)
+	{
+		const b2IslandRange* island = islands + i;
+		m_profile.solveInit += island->profile.solveInit;
+		m_profile.solveVelocity += island->profile.solveVelocity;
+		m_profile.solvePosition += island->profile.solvePosition;
+	}
+
+	// Put islands to sleep. An island with removed constraints may have fallen apart,
+	// so it is split first. Splitting a sleeping island yields sleeping islands.
+	// Otherwise the island that is closest to sleeping is split, so that a resting part
+	// is not kept awake by a moving part that is no longer connected.
+	b2ProfileBegin(m_contactManager.m_profiler, "sleep islands");
+	b2PersistentIsland* splitIsland = nullptr;
+	float splitSleepTime = 0.0f;
+	for (int32 i = 0; i < islandCount; ++i)
+	{
+		const b2IslandRange* island = islands + i;
+		b2PersistentIsland* persistent = island->island;
+
+		if (island->minSleepTime >= b2_timeToSleep)
+		{
+			for (int32 j = 0; j < island->bodyCount; ++j)
+			{
+				bodies[island->bodyStart + j]->SetAwake(false);
+			}
+
+			RemoveAwakeIsland(persistent);
+
+			if (persistent->constraintRemoveCount > 0)
+			{
+				SplitIsland(persistent);
+			}
+		}
+		else if (persistent->constraintRemoveCount > 0 && island->maxSleepTime >= b2_timeToSleep &&
+				 island->maxSleepTime > splitSleepTime)
+		{
+			splitIsland = persistent;
+			splitSleepTime = island->maxSleepTime;
+		}
+	}
+
+	if (splitIsland != nullptr)
+	{
+		SplitIsland(splitIsland);
+	}
+	b2ProfileEnd(m_contactManager.m_profiler);
+
+	if (impulses != nullptr)
+	{
+		b2ProfileScope(m_contactManager.m_profiler, "post solve");
+		for (int32 i = 0; i < islandContactCount; ++i)
+		{
+			listener->PostSolve(contacts[i], impulses + i);
+		}
+	}
+
+	{
+		b2ProfileScope(m_contactManager.m_profiler, "broad-phase");
+		b2Timer timer;
+
+		// Synchronize fixtures, check for out of range bodies. Bodies that were not
+		// in an island did not move.
+		b2ProfileBegin(m_contactManager.m_profiler, "move proxies");
+		for (int32 i = 0; i < bodyCount; ++i)
+		{
+			// Update fixtures (for broad-phase).
+			bodies[i]->SynchronizeFixtures();
+		}
+		b2ProfileEnd(m_contactManager.m_profiler);
+
+		if (impulses != nullptr)
+		{
+			m_stackAllocator.Free(impulses);
+		}
+
+		m_stackAllocator.Free(joints);
+		m_stackAllocator.Free(contacts);
+		m_stackAllocator.Free(bodies);
+		m_stackAllocator.Free(islands);
+
+		// Look for new contacts.
+		b2Timer pairTimer;
+		m_contactManager.FindPairs();
+		m_profile.findPairs = pairTimer.GetMilliseconds();
+
+		pairTimer.Reset();
+		m_contactManager.UpdatePairs();
+		m_profile.updatePairs = pairTimer.GetMilliseconds();
+		m_profile.broadphase = timer.GetMilliseconds();
+	}
+}
+
+// A time of impact event. Events are ordered by time and then by contact index so they
+// are processed in the order of a linear scan over the contact array.
+struct b2TOIEvent
+{
+	float alpha;
+	int32 contactIndex;
+};
+
+static inline bool b2TOIEventLess(const b2TOIEvent& a, const b2TOIEvent& b)
+{
+	return a.alpha < b.alpha || (a.alpha == b.alpha && a.contactIndex < b.contactIndex);
+}
+
+// Binary min-heap of time of impact events. Events become stale when the contact
+// TOI is invalidated, so they are checked against the contact when popped.
+struct b2TOIQueue
+{
+	explicit b2TOIQueue(b2Allocator* allocator)
+	{
+		this->allocator = allocator;
+		events = nullptr;
+		count = 0;
+		capacity = 0;
+	}
+
+	~b2TOIQueue()
+	{
+		b2Free(allocator, events, capacity * sizeof(b2TOIEvent));
+	}
+
+	void Push(float alpha, int32 contactIndex)
+	{
+		if (count == capacity)
+		{
+			b2TOIEvent* oldEvents = events;
+			capacity = b2Max(2 * capacity, 64);
+			events = (b2TOIEvent*)b2Alloc(allocator, capacity * sizeof(b2TOIEvent));
+			if (oldEvents != nullptr)
+			{
+				memcpy(events, oldEvents, count * sizeof(b2TOIEvent));
+				b2Free(allocator, oldEvents, count * sizeof(b2TOIEvent));
+			}
+		}
+
+		b2TOIEvent event;
+		event.alpha = alpha;
+		event.contactIndex = contactIndex;
+
+		int32 index = count++;
+		while (index > 0)
+		{
+			int32 parent = (index - 1) >> 1;
+			if (b2TOIEventLess(event, events[parent]) == false)
+			{
+				break;
+			}
+
+			events[index] = events[parent];
+			index = parent;
+		}
+
+		events[index] = event;
+	}
+
+	b2TOIEvent Pop()
+	{
+		b2Assert(count > 0);
+		b2TOIEvent top = events[0];
+		b2TOIEvent last = events[--count];
+
+		int32 index = 0;
+		for (;;)
+		{
+			int32 child = 2 * index + 1;
+			if (child >= count)
+			{
+				break;
+			}
+
+			if (child + 1 < count && b2TOIEventLess(events[child + 1], events[child]))
+			{
+				++child;
+			}
+
+			if (b2TOIEventLess(events[child], last) == false)
+			{
+				break;
+			}
+
+			events[index] = events[child];
+			index = child;
+		}
+
+		if (count > 0)
+		{
+			events[index] = last;
+		}
+
+		return top;
+	}
+
+	b2Allocator* allocator;
+	b2TOIEvent* events;
+	int32 count;
+	int32 capacity;
+};
+
+static void b2SiftDown(int32* values, int32 index, int32 count)
+{
+	int32 value = values[index];
+	for (;;)
+	{
+		int32 child = 2 * index + 1;
+		if (child >= count)
+		{
+			break;
+		}
+
+		if (child + 1 < count && values[child] < values[child + 1])
+		{
+			++child;
+		}
+
+		if (values[child] <= value)
+		{
+			break;
+		}
+
+		values[index] = values[child];
+		index = child;
+	}
+
+	values[index] = value;
+}
+
+// Heap sort in ascending order.
+static void b2Sort(int32* values, int32 count)
+{
+	for (int32 i = count / 2 - 1; i >= 0; --i)
+	{
+		b2SiftDown(values, i, count);
+	}
+
+	for (int32 i = count - 1; i > 0; --i)
+	{
+		int32 value = values[0];
+		values[0] = values[i];
+		values[i] = value;
+		b2SiftDown(values, 0, i);
+	}
+}
+
+// The input of one TOI computation. Sweeps are copied when the candidate is gathered
+// so the computation does not depend on body state.
+struct b2TOICandidate
+{
+	b2Contact* contact;
+	b2TOIInput input;
+	float alpha0;
+	float alpha;
+	int32 iterations;
+	int32 distanceIterations;
+};
+
+static void b2TimeOfImpactTask(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext)
+{
+	B2_NOT_USED(workerIndex);
+
+	// b2RunTask keeps task threads from touching the global TOI and GJK counters.
+	// b2StepStats counts the iterations from the outputs instead.
+	b2TOICandidate* candidates = (b2TOICandidate*)taskContext;
+	for (int32 i = startIndex; i < endIndex; ++i)
+	{
+		b2TOICandidate* candidate = candidates + i;
+
+		b2TOIOutput output;
+		b2TimeOfImpact(&output, &candidate->input);
+		candidate->iterations = output.iterations;
+		candidate->distanceIterations = output.distanceIterations;
+
+		// Beta is the fraction of the remaining portion of the step.
+		float beta = output.t;
+		if (output.state == b2TOIOutput::e_touching)
+		{
+			candidate->alpha = b2Min(candidate->alpha0 + (1.0f - candidate->alpha0) * beta, 1.0f);
+		}
+		else
+		{
+			candidate->alpha = 1.0f;
+		}
+	}
+}
+
+// Queue the TOI of the given contacts, which must be in contact array order. Contacts
+// without a valid TOI are prepared serially, because putting the sweeps onto the same
+// time interval moves the bodies, and then computed in parallel.
+void b2World::ComputeTOIs(b2Contact** contacts, int32 count, b2TOIQueue* queue)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	b2ProfileScope(m_contactManager.m_profiler, "compute toi");
+	b2TOICandidate* candidates = (b2TOICandidate*)m_stackAllocator.Allocate(count * sizeof(b2TOICandidate));
+	int32 candidateCount = 0;
+
+	for (int32 i = 0; i < count; ++i)
+	{
+		b2Contact* c = contacts[i];
+
+		// Is this contact disabled?
+		if (c->IsEnabled() == false)
+		{
+			continue;
+		}
+
+		// Prevent excessive sub-stepping.
+		if (c->m_toiCount > b2_maxSubSteps)
+		{
+			continue;
+		}
+
+		if (c->m_flags & b2Contact::e_toiFlag)
+		{
+			// This contact has a valid cached TOI.
+			if (c->m_toi < 1.0f)
+			{
+				queue->Push(c->m_toi, c->m_managerIndex);
+			}
+			continue;
+		}
+
+		b2Fixture* fA = c->GetFixtureA();
+		b2Fixture* fB = c->GetFixtureB();
+
+		// Is there a sensor?
+		if (fA->IsSensor() || fB->IsSensor())
+		{
+			continue;
+		}
+
+		b2Body* bA = fA->GetBody();
+		b2Body* bB = fB->GetBody();
+
+		b2BodyType typeA = bA->m_type;
+		b2BodyType typeB = bB->m_type;
+		b2Assert(typeA == b2_dynamicBody || typeB == b2_dynamicBody);
+
+		bool activeA = bA->IsAwake() && typeA != b2_staticBody;
+		bool activeB = bB->IsAwake() && typeB != b2_staticBody;
+
+		// Is at least one body active (awake and dynamic or kinematic)?
+		if (activeA == false && activeB == false)
+		{
+			continue;
+		}
+
+		bool collideA = bA->IsBullet() || typeA != b2_dynamicBody;
+		bool collideB = bB->IsBullet() || typeB != b2_dynamicBody;
+
+		// Are these two non-bullet dynamic bodies?
+		if (collideA == false && collideB == false)
+		{
+			continue;
+		}
+
+		// Speculative contacts already keep these bodies from tunneling.
+		if (bA->IsSpeculative() || bB->IsSpeculative())
+		{
+			continue;
+		}
+
+		// Put the sweeps onto the same time interval.
+		b2Sweep sweepA = bA->GetSweep();
+		b2Sweep sweepB = bB->GetSweep();
+		float alpha0 = sweepA.alpha0;
+
+		if (sweepA.alpha0 < sweepB.alpha0)
+		{
+			alpha0 = sweepB.alpha0;
+			sweepA.Advance(alpha0);
+			bA->SetSweep(sweepA);
+		}
+		else if (sweepB.alpha0 < sweepA.alpha0)
+		{
+			alpha0 = sweepA.alpha0;
+			sweepB.Advance(alpha0);
+			bB->SetSweep(sweepB);
+		}
+
+		b2Assert(alpha0 < 1.0f);
+
+		// Compute the time of impact in interval [0, minTOI]
+		b2TOICandidate* candidate = candidates + candidateCount++;
+		candidate->contact = c;
+		candidate->input.proxyA.Set(fA->GetShape(), c->GetChildIndexA());
+		candidate->input.proxyB.Set(fB->GetShape(), c->GetChildIndexB());
+		candidate->input.sweepA = sweepA;
+		candidate->input.sweepB = sweepB;
+		candidate->input.tMax = 1.0f;
+		candidate->alpha0 = alpha0;
+		candidate->alpha = 1.0f;
+	}
+
+	b2RunTask(m_taskSystem, b2TimeOfImpactTask, candidateCount, 8, candidates);
+
+	b2StepStats& stats = m_contactManager.m_stats;
+	stats.toiCalls += candidateCount;
+
+	for (int32 i = 0; i < candidateCount; ++i)
+	{
+		b2TOICandidate* candidate = candidates + i;
+		b2Contact* c = candidate->contact;
+		c->m_toi = candidate->alpha;
+		c->m_flags |= b2Contact::e_toiFlag;
+		stats.toiIterations += candidate->iterations;
+		stats.gjkIterations += candidate->distanceIterations;
+
+		if (candidate->alpha < 1.0f)
+		{
+			queue->Push(candidate->alpha, c->m_managerIndex);
+		}
+	}
+
+	m_stackAllocator.Free(candidates);
+}
+
+// Find TOI contacts and solve them.
+void b2World::SolveTOI(const b2TimeStep& step)
+{
+	b2Island island(2 * b2_maxTOIContacts, b2_maxTOIContacts, 0, &m_stackAllocator, m_contactManager.m_contactListener, &m_bodyStates);
+
+	if (m_stepComplete)
+	{
+		for (b2Body* b = m_bodyList; b; b = b->m_next)
+		{
+			b->m_flags &= ~b2Body::e_islandFlag;
+			b->m_alpha0 = 0.0f;
+		}
+
+		b2Contact** contacts = m_contactManager.m_contacts;
+		for (int32 i = 0; i < m_contactManager.m_contactCount; ++i)
+		{
+			b2Contact* c = contacts[i];
+
+			// Invalidate TOI
+			c->m_flags &= ~(b2Contact::e_toiFlag | b2Contact::e_islandFlag);
+			c->m_toiCount = 0;
+			c->m_toi = 1.0f;
+		}
+	}
+
+	// Compute the TOI of all candidate contacts up front. After each event only the
+	// contacts of the moved bodies and new contacts need a new TOI.
+	b2TOIQueue queue(&m_allocator);
+	ComputeTOIs(m_contactManager.m_contacts, m_contactManager.m_contactCount, &queue);
+
+	// Indices of the contacts of the bodies moved by the last event.
+	int32* invalidIndices = nullptr;
+	int32 invalidCapacity = 0;
+
+	// Find TOI events and solve them.
+	for (;;)
+	{
+		// Find the first TOI that is still valid.
+		b2Contact* minContact = nullptr;
+		float minAlpha = 1.0f;
+
+		while (queue.count > 0)
+		{
+			b2TOIEvent event = queue.Pop();
+			b2Contact* c = m_contactManager.m_contacts[event.contactIndex];
+
+			if ((c->m_flags & b2Contact::e_toiFlag) == 0 || c->m_toi != event.alpha)
+			{
+				continue;
+			}
+
+			if (c->IsEnabled() == false || c->m_toiCount > b2_maxSubSteps)
+			{
+				continue;
+			}
+
+			minContact = c;
+			minAlpha = event.alpha;
+			break;
+		}
+
+		if (minContact == nullptr || 1.0f - 10.0f * b2_epsilon < minAlpha)
+		{
+			// No more TOI events. Done!
+			m_stepComplete = true;
+			break;
+		}
+
+		b2ProfileScope(m_contactManager.m_profiler, "toi event");
+
+		// Advance the bodies to the TOI.
+		b2Fixture* fA = minContact->GetFixtureA();
+		b2Fixture* fB = minContact->GetFixtureB();
+		b2Body* bA = fA->GetBody();
+		b2Body* bB = fB->GetBody();
+
+		b2Sweep backup1 = bA->GetSweep();
+		b2Sweep backup2 = bB->GetSweep();
+
+		bA->Advance(minAlpha);
+		bB->Advance(minAlpha);
+
+		// The TOI contact likely has some new contact points.
+		minContact->Update(m_contactManager.m_contactListener);
+		minContact->m_flags &= ~b2Contact::e_toiFlag;
+		++minContact->m_toiCount;
+
+		b2StepStats& stats = m_contactManager.m_stats;
+		stats.toiMaxSubSteps = b2Max(stats.toiMaxSubSteps, minContact->m_toiCount);
+
+		// Is the contact solid?
+		if (minContact->IsEnabled() == false || minContact->IsTouching() == false)
+		{
+			// Restore the sweeps.
+			minContact->SetEnabled(false);
+			bA->SetSweep(backup1);
+			bB->SetSweep(backup2);
+			bA->SynchronizeTransform();
+			bB->SynchronizeTransform();
+			continue;
+		}
+
+		stats.toiEvents += 1;
+
+		bA->SetAwake(true);
+		bB->SetAwake(true);
+
+		// The contact lists are searched in order and the island has a capacity.
+		if (m_contactManager.m_deterministic)
+		{
+			SortContactList(bA);
+			SortContactList(bB);
+		}
+
+		// Build the island
+		island.Clear();
+		island.Add(bA);
+		island.Add(bB);
+		island.Add(minContact);
+
+		bA->m_flags |= b2Body::e_islandFlag;
+		bB->m_flags |= b2Body::e_islandFlag;
+		minContact->m_flags |= b2Contact::e_islandFlag;
+
+		// Get contacts on bodyA and bodyB.
+		b2Body* bodies[2] = {bA, bB};
+		for (int32 i = 0; i < 2; ++i)
+		{
 			b2Body* body = bodies[i];
 			if (body->m_type == b2_dynamicBody)
 			{
-				for (b2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+				for (b2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+				{
+					if (island.m_bodyCount == island.m_bodyCapacity)
+					{
+						break;
+					}
+
+					if (island.m_contactCount == island.m_contactCapacity)
+					{
+						break;
+					}
+
+					b2Contact* contact = ce->contact;
+
+					// Has this contact already been added to the island?
+					if (contact->m_flags & b2Contact::e_islandFlag)
+					{
+						continue;
+					}
+
+					// Only add static, kinematic, or bullet bodies.
+					b2Body* other = ce->other;
+					if (other->m_type == b2_dynamicBody &&
+						body->IsBullet() == false && other->IsBullet() == false)
+					{
+						continue;
+					}
+
+					// Skip sensors.
+					bool sensorA = contact->m_fixtureA->m_isSensor;
+					bool sensorB = contact->m_fixtureB->m_isSensor;
+					if (sensorA || sensorB)
+					{
+						continue;
+					}
+
+					// Tentatively advance the body to the TOI.
+					b2Sweep backup = other->GetSweep();
+					if ((other->m_flags & b2Body::e_islandFlag) == 0)
+					{
+						other->Advance(minAlpha);
+					}
+
+					// Update the contact points
+					contact->Update(m_contactManager.m_contactListener);
+
+					// Was the contact disabled by the user?
+					if (contact->IsEnabled() == false)
+					{
+						other->SetSweep(backup);
+						other->SynchronizeTransform();
+						continue;
+					}
+
+					// Are there contact points?
+					if (contact->IsTouching() == false)
+					{
+						other->SetSweep(backup);
+						other->SynchronizeTransform();
+						continue;
+					}
+
+					// Add the contact to the island
+					contact->m_flags |= b2Contact::e_islandFlag;
+					island.Add(contact);
+
+					// Has the other body already been added to the island?
+					if (other->m_flags & b2Body::e_islandFlag)
+					{
+						continue;
+					}
+					
+					// Add the other body to the island.
+					other->m_flags |= b2Body::e_islandFlag;
+
+					if (other->m_type != b2_staticBody)
+					{
+						other->SetAwake(true);
+					}
+
+					island.Add(other);
+				}
+			}
+		}
+
+		b2TimeStep subStep;
+		subStep.dt = (1.0f - minAlpha) * step.dt;
+		subStep.inv_dt = 1.0f / subStep.dt;
+		subStep.dtRatio = 1.0f;
+		subStep.positionIterations = 20;
+		subStep.velocityIterations = step.velocityIterations;
+		subStep.warmStarting = false;
+		subStep.wideSolver = false;
+		island.SolveTOI(subStep, bA->m_stateIndex, bB->m_stateIndex);
+
+		// Reset island flags and synchronize broad-phase proxies.
+		int32 invalidCount = 0;
+		for (int32 i = 0; i < island.m_bodyCount; ++i)
+		{
+			b2Body* body = island.m_bodies[i];
+			body->m_flags &= ~b2Body::e_islandFlag;
+
+			if (body->m_type != b2_dynamicBody)
+			{
+				continue;
+			}
+
+			body->SynchronizeFixtures();
+
+			// Invalidate all contact TOIs on this displaced body.
+			for (b2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+			{
+				ce->contact->m_flags &= ~(b2Contact::e_toiFlag | b2Contact::e_islandFlag);
+
+				if (invalidCount == invalidCapacity)
+				{
+					int32* oldIndices = invalidIndices;
+					invalidCapacity = b2Max(2 * invalidCapacity, 64);
+					invalidIndices = (int32*)b2Alloc(&m_allocator, invalidCapacity * sizeof(int32));
+					if (oldIndices != nullptr)
+					{
+						memcpy(invalidIndices, oldIndices, invalidCount * sizeof(int32));
+						b2Free(&m_allocator, oldIndices, invalidCount * sizeof(int32));
+					}
+				}
+
+				invalidIndices[invalidCount++] = ce->contact->m_managerIndex;
+			}
+		}
+
+		// Commit fixture proxy movements to the broad-phase so that new contacts are created.
+		// Contacts are only destroyed during collision, so existing contacts keep their index.
+		int32 oldContactCount = m_contactManager.m_contactCount;
+		m_contactManager.FindNewContacts();
+
+		// New contacts come in broad-phase order. Existing contacts keep their index.
+		if (m_contactManager.m_deterministic)
+		{
+			SortContacts(oldContactCount);
+		}
+
+		// Recompute the invalidated contacts in contact array order, once each.
+		b2Sort(invalidIndices, invalidCount);
+
+		b2Contact** invalidContacts = (b2Contact**)m_stackAllocator.Allocate(invalidCount * sizeof(b2Contact*));
+		int32 uniqueCount = 0;
+		for (int32 i = 0; i < invalidCount; ++i)
+		{
+			if (i == 0 || invalidIndices[i - 1] != invalidIndices[i])
+			{
+				invalidContacts[uniqueCount++] = m_contactManager.m_contacts[invalidIndices[i]];
+			}
+		}
+
+		ComputeTOIs(invalidContacts, uniqueCount, &queue);
+		m_stackAllocator.Free(invalidContacts);
+
+		// New contacts follow all existing contacts in the array.
+		ComputeTOIs(m_contactManager.m_contacts + oldContactCount, m_contactManager.m_contactCount - oldContactCount, &queue);
+
+		if (m_subStepping)
+		{
+			m_stepComplete = false;
+			break;
+		}
+	}
+
+	b2Free(&m_allocator, invalidIndices, invalidCapacity * sizeof(int32));
+}
+
+void b2World::Step(float dt, int32 velocityIterations, int32 positionIterations)
+{
+	b2ProfileFrame(m_contactManager.m_profiler);
+	b2ProfileScope(m_contactManager.m_profiler, "step");
+	b2Timer stepTimer;
+
+	// The stacks are empty between steps, so this is where they can grow.
+	if (m_growStack)
+	{
+		m_stackAllocator.Grow();
+		for (int32 i = 0; i < m_workerCount; ++i)
+		{
+			m_workerAllocators[i].Grow();
+		}
+	}
+
+	int32 heapFallbackCount = GetStackHeapFallbackCount();
+
+	// If new fixtures were added, we need to find the new contacts.
+	if (m_newContacts)
+	{
+		b2ProfileScope(m_contactManager.m_profiler, "new contacts");
+		m_contactManager.FindNewContacts();
+		m_newContacts = false;
+	}
+
+	m_locked = true;
+
+	b2TimeStep step;
+	step.dt = dt;
+	step.velocityIterations	= velocityIterations;
+	step.positionIterations = positionIterations;
+	if (dt > 0.0f)
+	{
+		step.inv_dt = 1.0f / dt;
+	}
+	else
+	{
+		step.inv_dt = 0.0f;
+	}
+
+	step.dtRatio = m_inv_dt0 * dt;
+
+	step.warmStarting = m_warmStarting;
+	step.wideSolver = m_wideSolver;
+
+	m_contactManager.m_speculativeTime = dt;
+	
+	// Update contacts. This is where some contacts are destroyed.
+	{
+		b2ProfileScope(m_contactManager.m_profiler, "collide");
+		b2Timer timer;
+		if (m_contactManager.m_deterministic)
+		{
+			SortContacts(0);
+		}
+		m_contactManager.Collide();
+		m_profile.collide = timer.GetMilliseconds();
+	}
+
+	// Integrate velocities, solve velocity constraints, and integrate positions.
+	if (m_stepComplete && step.dt > 0.0f)
+	{
+		b2ProfileScope(m_contactManager.m_profiler, "solve");
+		b2Timer timer;
+		Solve(step);
+		m_profile.solve = timer.GetMilliseconds();
+	}
+
+	// Handle TOI events. Speculative contacts replace them for all bodies.
+	if (m_continuousPhysics && m_contactManager.m_speculativeContacts == false && step.dt > 0.0f)
+	{
+		b2ProfileScope(m_contactManager.m_profiler, "solve toi");
+		b2Timer timer;
+		if (m_contactManager.m_deterministic)
+		{
+			SortContacts(0);
+		}
+		SolveTOI(step);
+		m_profile.solveTOI = timer.GetMilliseconds();
+	}
+
+	// Queries between steps use the wide trees.
+	if (m_wideQueries)
+	{
+		b2ProfileScope(m_contactManager.m_profiler, "build wide trees");
+		b2Timer timer;
+		m_contactManager.m_broadPhase.BuildWideTrees();
+		m_profile.broadphase += timer.GetMilliseconds();
+	}
+
+	if (step.dt > 0.0f)
+	{
+		m_inv_dt0 = step.inv_dt;
+	}
+
+	if (m_clearForces)
+	{
+		ClearForces();
+	}
+
+	m_locked = false;
+
+	PublishStepStats();
+
+	m_profile.stackHeapFallbacks = GetStackHeapFallbackCount() - heapFallbackCount;
+	m_profile.step = stepTimer.GetMilliseconds();
+}
+
+void b2World::PublishStepStats()
+{
+	b2StepStats& stats = m_contactManager.m_stats;
+
+	b2Contact** contacts = m_contactManager.m_contacts;
+	for (int32 i = 0; i < m_contactManager.m_contactCount; ++i)
+	{
+		if (contacts[i]->IsTouching())
+		{
+			stats.touchingContacts += 1;
+		}
+	}
+
+	for (b2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		if (b->m_type == b2_staticBody || b->IsEnabled() == false)
+		{
+			continue;
+		}
+
+		if (b->IsAwake())
+		{
+			stats.awakeBodies += 1;
+		}
+		else
+		{
+			stats.sleepingBodies += 1;
+		}
+	}
+
+	m_stepStats = stats;
+	memset(&stats, 0, sizeof(b2StepStats));
+}
+
+void b2World::ClearForces()
+{
+	for (b2Body* body = m_bodyList; body; body = body->GetNext())
+	{
+		body->m_force.SetZero();
+		body->m_torque = 0.0f;
+	}
+}
+
+struct b2WorldQueryWrapper
+{
+	bool QueryCallback(int32 proxyId)
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)broadPhase->GetUserData(proxyId);
+		return callback->ReportFixture(proxy->fixture);
+	}
+
+	const b2BroadPhase* broadPhase;
+	b2QueryCallback* callback;
+};
+
+void b2World::QueryAABB(b2QueryCallback* callback, const b2AABB& aabb) const
+{
+	b2WorldQueryWrapper wrapper;
+	wrapper.broadPhase = &m_contactManager.m_broadPhase;
+	wrapper.callback = callback;
+	m_contactManager.m_broadPhase.Query(&wrapper, aabb);
+}
+
+struct b2WorldRayCastWrapper
+{
+	float RayCastCallback(const b2RayCastInput& input, int32 proxyId)
+	{
+		void* userData = broadPhase->GetUserData(proxyId);
+		b2FixtureProxy* proxy = (b2FixtureProxy*)userData;
+		b2Fixture* fixture = proxy->fixture;
+		int32 index = proxy->childIndex;
+		b2RayCastOutput output;
+		bool hit = fixture->RayCast(&output, input, index);
+
+		if (hit)
+		{
+			float fraction = output.fraction;
+			b2Vec2 point = (1.0f - fraction) * input.p1 + fraction * input.p2;
+			return callback->ReportFixture(fixture, point, output.normal, fraction);
+		}
+
+		return input.maxFraction;
+	}
+
+	const b2BroadPhase* broadPhase;
+	b2RayCastCallback* callback;
+};
+
+void b2World::RayCast(b2RayCastCallback* callback, const b2Vec2& point1, const b2Vec2& point2) const
+{
+	b2WorldRayCastWrapper wrapper;
+	wrapper.broadPhase = &m_contactManager.m_broadPhase;
+	wrapper.callback = callback;
+	b2RayCastInput input;
+	input.maxFraction = 1.0f;
+	input.p1 = point1;
+	input.p2 = point2;
+	m_contactManager.m_broadPhase.RayCast(&wrapper, input);
+}
+
+struct b2WorldRayCastPacketWrapper
+{
+	float RayCastCallback(const b2RayCastInput& input, int32 proxyId, int32 rayIndex)
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)broadPhase->GetUserData(proxyId);
+		b2Fixture* fixture = proxy->fixture;
+		if (fixture->IsSensor() || (fixture->GetFilterData().categoryBits & rays[rayIndex].maskBits) == 0)
+		{
+			return -1.0f;
+		}
+
+		b2RayCastOutput output;
+		bool hit = fixture->RayCast(&output, input, proxy->childIndex);
+		if (hit == false)
+		{
+			return -1.0f;
+		}
+
+		b2RayResult* result = results + rayIndex;
+		float fraction = output.fraction;
+		result->fixture = fixture;
+		result->point = (1.0f - fraction) * input.p1 + fraction * input.p2;
+		result->normal = output.normal;
+		result->fraction = fraction;
+		return fraction;
+	}
+
+	const b2BroadPhase* broadPhase;
+	const b2RayInput* rays;
+	b2RayResult* results;
+};
+
+struct b2RayCastBatchContext
+{
+	const b2BroadPhase* broadPhase;
+	const b2RayInput* inputs;
+	b2RayResult* results;
+	int32 count;
+};
+
+// Casts the packets [startIndex, endIndex).
+static void b2RayCastBatchTask(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext)
+{
+	B2_NOT_USED(workerIndex);
+
+	b2RayCastBatchContext* context = (b2RayCastBatchContext*)taskContext;
+
+	for (int32 i = startIndex; i < endIndex; ++i)
+	{
+		int32 rayStart = i * b2_rayPacketSize;
+		int32 rayCount = b2Min(b2_rayPacketSize, context->count - rayStart);
+
+		b2WorldRayCastPacketWrapper wrapper;
+		wrapper.broadPhase = context->broadPhase;
+		wrapper.rays = context->inputs + rayStart;
+		wrapper.results = context->results + rayStart;
+
+		b2RayCastInput inputs[b2_rayPacketSize];
+		for (int32 j = 0; j < rayCount; ++j)
+		{
+			inputs[j].p1 = wrapper.rays[j].p1;
+			inputs[j].p2 = wrapper.rays[j].p2;
+			inputs[j].maxFraction = 1.0f;
+
+			b2RayResult* result = wrapper.results + j;
+			result->fixture = nullptr;
+			result->point = wrapper.rays[j].p2;
+			result->normal.SetZero();
+			result->fraction = 1.0f;
+		}
+
+		context->broadPhase->RayCastPacket(&wrapper, inputs, rayCount);
+	}
+}
+
+void b2World::RayCastBatch(const b2RayInput* inputs, int32 count, b2RayResult* results) const
+{
+	b2RayCastBatchContext context;
+	context.broadPhase = &m_contactManager.m_broadPhase;
+	context.inputs = inputs;
+	context.results = results;
+	context.count = count;
+
+	int32 packetCount = (count + b2_rayPacketSize - 1) / b2_rayPacketSize;
+	b2RunTask(m_taskSystem, b2RayCastBatchTask, packetCount, 16, &context);
+}
+
+struct b2WorldQueryBatchWrapper
+{
+	bool QueryCallback(int32 proxyId)
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)broadPhase->GetUserData(proxyId);
+		b2Fixture* fixture = proxy->fixture;
+
+		if (box != nullptr)
+		{
+			// The fat AABB overlaps, so reject with the tight AABB and accept shapes
+			// inside the box before running GJK.
+			const b2AABB& fixtureAABB = fixture->GetAABB(proxy->childIndex);
+			if (b2TestOverlap(aabb, fixtureAABB) == false)
+			{
+				return true;
+			}
+
+			if (aabb.Contains(fixtureAABB) == false)
+			{
+				const b2Transform& xf = fixture->GetBody()->GetTransform();
+				if (b2TestOverlap(box, 0, fixture->GetShape(), proxy->childIndex, boxTransform, xf) == false)
+				{
+					return true;
+				}
+			}
+		}
+
+		if (buffer->count == buffer->capacity)
+		{
+			b2QueryResult* oldResults = buffer->results;
+			buffer->capacity *= 2;
+			buffer->results = (b2QueryResult*)b2Alloc(buffer->allocator, buffer->capacity * sizeof(b2QueryResult));
+			memcpy(buffer->results, oldResults, buffer->count * sizeof(b2QueryResult));
+			b2Free(buffer->allocator, oldResults, buffer->count * sizeof(b2QueryResult));
+		}
+
+		b2QueryResult* result = buffer->results + buffer->count;
+		result->queryIndex = queryIndex;
+		result->fixture = fixture;
+		result->childIndex = proxy->childIndex;
+		++buffer->count;
+
+		return true;
+	}
+
+	const b2BroadPhase* broadPhase;
+	const b2PolygonShape* box;
+	b2Transform boxTransform;
+	b2QueryBatchBuffer* buffer;
+	b2AABB aabb;
+	int32 queryIndex;
+};
+
+struct b2QueryBatchContext
+{
+	const b2BroadPhase* broadPhase;
+	const b2AABB* aabbs;
+	b2QueryBatchBuffer* buffers;
+	b2QueryBatchRange* ranges;
+	bool testOverlap;
+};
+
+// Runs the queries [startIndex, endIndex).
+static void b2QueryBatchTask(int32 startIndex, int32 endIndex, int32 workerIndex, void* taskContext)
+{
+	b2QueryBatchContext* context = (b2QueryBatchContext*)taskContext;
+
+	b2PolygonShape box;
+	b2WorldQueryBatchWrapper wrapper;
+	wrapper.broadPhase = context->broadPhase;
+	wrapper.box = context->testOverlap ? &box : nullptr;
+	wrapper.boxTransform.SetIdentity();
+	wrapper.buffer = context->buffers + workerIndex;
+
+	for (int32 i = startIndex; i < endIndex; ++i)
+	{
+		const b2AABB& aabb = context->aabbs[i];
+		if (context->testOverlap)
+		{
+			b2Vec2 extents = aabb.GetExtents();
+			box.SetAsBox(extents.x, extents.y, aabb.GetCenter(), 0.0f);
+			box.m_radius = 0.0f;
+		}
+
+		b2QueryBatchRange* range = context->ranges + i;
+		range->workerIndex = workerIndex;
+		range->start = wrapper.buffer->count;
+
+		wrapper.aabb = aabb;
+		wrapper.queryIndex = i;
+		context->broadPhase->Query(&wrapper, aabb);
+
+		range->count = wrapper.buffer->count - range->start;
+	}
+}
+
+int32 b2World::QueryAABBBatch(const b2AABB* aabbs, int32 count, b2QueryResult* results, int32 capacity, bool testOverlap) const
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// The scratch only grows, so a batch that fits in an earlier batch does not allocate.
+	int32 workerCount = m_taskSystem != nullptr ? m_workerCount : 1;
+	if (workerCount > m_queryBufferCount)
+	{
+		b2QueryBatchBuffer* oldBuffers = m_queryBuffers;
+		m_queryBuffers = (b2QueryBatchBuffer*)b2Alloc(&m_allocator, workerCount * sizeof(b2QueryBatchBuffer));
+		if (oldBuffers != nullptr)
+		{
+			memcpy(m_queryBuffers, oldBuffers, m_queryBufferCount * sizeof(b2QueryBatchBuffer));
+			b2Free(&m_allocator, oldBuffers, m_queryBufferCount * sizeof(b2QueryBatchBuffer));
+		}
+
+		for (int32 i = m_queryBufferCount; i < workerCount; ++i)
+		{
+			m_queryBuffers[i].allocator = &m_allocator;
+			m_queryBuffers[i].capacity = 64;
+			m_queryBuffers[i].results = (b2QueryResult*)b2Alloc(&m_allocator, m_queryBuffers[i].capacity * sizeof(b2QueryResult));
+		}
+
+		m_queryBufferCount = workerCount;
+	}
+
+	if (count > m_queryRangeCapacity)
+	{
+		b2Free(&m_allocator, m_queryRanges, m_queryRangeCapacity * sizeof(b2QueryBatchRange));
+		m_queryRangeCapacity = b2Max(count, 2 * m_queryRangeCapacity);
+		m_queryRanges = (b2QueryBatchRange*)b2Alloc(&m_allocator, m_queryRangeCapacity * sizeof(b2QueryBatchRange));
+	}
+
+	b2QueryBatchBuffer* buffers = m_queryBuffers;
+	b2QueryBatchRange* ranges = m_queryRanges;
+	for (int32 i = 0; i < workerCount; ++i)
+	{
+		buffers[i].count = 0;
+	}
+
+	b2QueryBatchContext context;
+	context.broadPhase = &m_contactManager.m_broadPhase;
+	context.aabbs = aabbs;
+	context.buffers = buffers;
+	context.ranges = ranges;
+	context.testOverlap = testOverlap;
+
+	b2RunTask(m_taskSystem, b2QueryBatchTask, count, 16, &context);
+
+	// Gather the overlaps in query order so the output does not depend on scheduling.
+	int32 resultCount = 0;
+	for (int32 i = 0; i < count; ++i)
+	{
+		const b2QueryBatchRange& range = ranges[i];
+		int32 copyCount = b2Min(range.count, capacity - resultCount);
+		if (copyCount > 0)
+		{
+			memcpy(results + resultCount, buffers[range.workerIndex].results + range.start, copyCount * sizeof(b2QueryResult));
+		}
+		resultCount += range.count;
+	}
+
+	return resultCount;
+}
+
+struct b2WorldShapeCastWrapper
+{
+	float ShapeCastCallback(const b2AABBCastInput& input, int32 proxyId)
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)broadPhase->GetUserData(proxyId);
+		b2Fixture* fixture = proxy->fixture;
+		if (fixture->IsSensor() || (fixture->GetFilterData().categoryBits & maskBits) == 0)
+		{
+			return -1.0f;
+		}
+
+		castInput.proxyA.Set(fixture->GetShape(), proxy->childIndex);
+		castInput.transformA = fixture->GetBody()->GetTransform();
+
+		b2ShapeCastOutput output;
+		bool hit = b2ShapeCast(&output, &castInput);
+		if (hit == false || output.lambda > input.maxFraction)
+		{
+			return -1.0f;
+		}
+
+		result->fixture = fixture;
+		result->point = output.point;
+		result->normal = output.normal;
+		result->fraction = output.lambda;
+		return output.lambda;
+	}
+
+	const b2BroadPhase* broadPhase;
+	b2ShapeCastInput castInput;
+	b2ShapeCastResult* result;
+	uint16 maskBits;
+};
+
+bool b2World::ShapeCast(const b2Shape* shape, const b2Transform& transform, const b2Vec2& translation,
+						b2ShapeCastResult* result, uint16 maskBits) const
+{
+	b2Assert(shape->GetChildCount() == 1);
+
+	result->fixture = nullptr;
+	result->point.SetZero();
+	result->normal.SetZero();
+	result->fraction = 1.0f;
+
+	b2WorldShapeCastWrapper wrapper;
+	wrapper.broadPhase = &m_contactManager.m_broadPhase;
+	wrapper.castInput.proxyB.Set(shape, 0);
+	wrapper.castInput.transformB = transform;
+	wrapper.castInput.translationB = translation;
+	wrapper.result = result;
+	wrapper.maskBits = maskBits;
+
+	b2AABBCastInput input;
+	shape->ComputeAABB(&input.aabb, transform, 0);
+	input.translation = translation;
+	input.maxFraction = 1.0f;
+	m_contactManager.m_broadPhase.ShapeCast(&wrapper, input);
+
+	return result->fixture != nullptr;
+}
+
+struct b2WorldOverlapWrapper
+{
+	bool QueryCallback(int32 proxyId)
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)broadPhase->GetUserData(proxyId);
+		b2Fixture* fixture = proxy->fixture;
+		if ((fixture->GetFilterData().categoryBits & maskBits) == 0)
+		{
+			return true;
+		}
+
+		if (b2TestOverlap(aabb, fixture->GetAABB(proxy->childIndex)) == false)
+		{
+			return true;
+		}
+
+		const b2Transform& xf = fixture->GetBody()->GetTransform();
+		if (b2TestOverlap(shape, 0, fixture->GetShape(), proxy->childIndex, transform, xf) == false)
+		{
+			return true;
+		}
+
+		if (count < capacity)
+		{
+			b2QueryResult* result = results + count;
+			result->queryIndex = 0;
+			result->fixture = fixture;
+			result->childIndex = proxy->childIndex;
+		}
+		++count;
+
+		return true;
+	}
+
+	const b2BroadPhase* broadPhase;
+	const b2Shape* shape;
+	b2Transform transform;
+	b2AABB aabb;
+	b2QueryResult* results;
+	int32 capacity;
+	int32 count;
+	uint16 maskBits;
+};
+
+int32 b2World::OverlapShape(const b2Shape* shape, const b2Transform& transform, b2QueryResult* results,
+							int32 capacity, uint16 maskBits) const
+{
+	b2Assert(shape->GetChildCount() == 1);
+
+	b2WorldOverlapWrapper wrapper;
+	wrapper.broadPhase = &m_contactManager.m_broadPhase;
+	wrapper.shape = shape;
+	wrapper.transform = transform;
+	shape->ComputeAABB(&wrapper.aabb, transform, 0);
+	wrapper.results = results;
+	wrapper.capacity = capacity;
+	wrapper.count = 0;
+	wrapper.maskBits = maskBits;
+
+	m_contactManager.m_broadPhase.Query(&wrapper, wrapper.aabb);
+
+	return wrapper.count;
+}
+
+void b2World::DrawShape(b2Fixture* fixture, const b2Transform& xf, const b2Color& color)
+{
+	switch (fixture->GetType())
+	{
+	case b2Shape::e_circle:
+		{
+			b2CircleShape* circle = (b2CircleShape*)fixture->GetShape();
+
+			b2Vec2 center = b2Mul(xf, circle->m_p);
+			float radius = circle->m_radius;
+			b2Vec2 axis = b2Mul(xf.q, b2Vec2(1.0f, 0.0f));
+
+			m_debugDraw->DrawSolidCircle(center, radius, axis, color);
+		}
+		break;
+
+	case b2Shape::e_edge:
+		{
+			b2EdgeShape* edge = (b2EdgeShape*)fixture->GetShape();
+			b2Vec2 v1 = b2Mul(xf, edge->m_vertex1);
+			b2Vec2 v2 = b2Mul(xf, edge->m_vertex2);
+			m_debugDraw->DrawSegment(v1, v2, color);
+
+			if (edge->m_oneSided == false)
+			{
+				m_debugDraw->DrawPoint(v1, 4.0f, color);
+				m_debugDraw->DrawPoint(v2, 4.0f, color);
+			}
+		}
+		break;
+
+	case b2Shape::e_chain:
+		{
+			b2ChainShape* chain = (b2ChainShape*)fixture->GetShape();
+			int32 count = chain->m_count;
+			const b2Vec2* vertices = chain->m_vertices;
+
+			b2Vec2 v1 = b2Mul(xf, vertices[0]);
+			for (int32 i = 1; i < count; ++i)
+			{
+				b2Vec2 v2 = b2Mul(xf, vertices[i]);
+				m_debugDraw->DrawSegment(v1, v2, color);
+				v1 = v2;
+			}
+		}
+		break;
+
+	case b2Shape::e_polygon:
+		{
+			b2PolygonShape* poly = (b2PolygonShape*)fixture->GetShape();
+			int32 vertexCount = poly->m_count;
+			b2Assert(vertexCount <= b2_maxPolygonVertices);
+			b2Vec2 vertices[b2_maxPolygonVertices];
+
+			for (int32 i = 0; i < vertexCount; ++i)
+			{
+				vertices[i] = b2Mul(xf, poly->m_vertices[i]);
+			}
+
+			m_debugDraw->DrawSolidPolygon(vertices, vertexCount, color);
+		}
+		break;
+
+	default:
+	break;
+	}
+}
+
+void b2World::DebugDraw()
+{
+	if (m_debugDraw == nullptr)
+	{
+		return;
+	}
+
+	uint32 flags = m_debugDraw->GetFlags();
+
+	if (flags & b2Draw::e_shapeBit)
+	{
+		for (b2Body* b = m_bodyList; b; b = b->GetNext())
+		{
+			const b2Transform& xf = b->GetTransform();
+			for (b2Fixture* f = b->GetFixtureList(); f; f = f->GetNext())
+			{
+				if (b->GetType() == b2_dynamicBody && b->m_mass == 0.0f)
+				{
+					// Bad body
+					DrawShape(f, xf, b2Color(1.0f, 0.0f, 0.0f));
+				}
+				else if (b->IsEnabled() == false)
+				{
+					DrawShape(f, xf, b2Color(0.5f, 0.5f, 0.3f));
+				}
+				else if (b->GetType() == b2_staticBody)
+				{
+					DrawShape(f, xf, b2Color(0.5f, 0.9f, 0.5f));
+				}
+				else if (b->GetType() == b2_kinematicBody)
+				{
+					DrawShape(f, xf, b2Color(0.5f, 0.5f, 0.9f));
+				}
+				else if (b->IsAwake() == false)
+				{
+					DrawShape(f, xf, b2Color(0.6f, 0.6f, 0.6f));
+				}
+				else
+				{
+					DrawShape(f, xf, b2Color(0.9f, 0.7f, 0.7f));
+				}
+			}
+		}
+	}
+
+	if (flags & b2Draw::e_jointBit)
+	{
+		for (b2Joint* j = m_jointList; j; j = j->GetNext())
+		{
+			j->Draw(m_debugDraw);
+		}
+	}
+
+	if (flags & b2Draw::e_pairBit)
+	{
+		b2Color color(0.3f, 0.9f, 0.9f);
+		for (int32 i = 0; i < m_contactManager.m_contactCount; ++i)
+		{
+			b2Contact* c = m_contactManager.m_contacts[i];
+			b2Fixture* fixtureA = c->GetFixtureA();
+			b2Fixture* fixtureB = c->GetFixtureB();
+			int32 indexA = c->GetChildIndexA();
+			int32 indexB = c->GetChildIndexB();
+			b2Vec2 cA = fixtureA->GetAABB(indexA).GetCenter();
+			b2Vec2 cB = fixtureB->GetAABB(indexB).GetCenter();
+
+			m_debugDraw->DrawSegment(cA, cB, color);
+		}
+	}
+
+	if (flags & b2Draw::e_aabbBit)
+	{
+		b2Color color(0.9f, 0.3f, 0.9f);
+		b2BroadPhase* bp = &m_contactManager.m_broadPhase;
+
+		for (b2Body* b = m_bodyList; b; b = b->GetNext())
+		{
+			if (b->IsEnabled() == false)
+			{
+				continue;
+			}
+
+			for (b2Fixture* f = b->GetFixtureList(); f; f = f->GetNext())
+			{
+				for (int32 i = 0; i < f->m_proxyCount; ++i)
+				{
+					b2FixtureProxy* proxy = f->m_proxies + i;
+					b2AABB aabb = bp->GetFatAABB(proxy->proxyId);
+					b2Vec2 vs[4];
+					vs[0].Set(aabb.lowerBound.x, aabb.lowerBound.y);
+					vs[1].Set(aabb.upperBound.x, aabb.lowerBound.y);
+					vs[2].Set(aabb.upperBound.x, aabb.upperBound.y);
+					vs[3].Set(aabb.lowerBound.x, aabb.upperBound.y);
+
+					m_debugDraw->DrawPolygon(vs, 4, color);
+				}
+			}
+		}
+	}
+
+	if (flags & b2Draw::e_centerOfMassBit)
+	{
+		for (b2Body* b = m_bodyList; b; b = b->GetNext())
+		{
+			b2Transform xf = b->GetTransform();
+			xf.p = b->GetWorldCenter();
+			m_debugDraw->DrawTransform(xf);
+		}
+	}
+}
+
+void b2World::SetWideQueries(bool flag)
+{
+	if (flag == m_wideQueries)
+	{
+		return;
+	}
+
+	m_wideQueries = flag;
+	if (flag)
+	{
+		m_contactManager.m_broadPhase.BuildWideTrees();
+	}
+	else
+	{
+		m_contactManager.m_broadPhase.ClearWideTrees();
+	}
+}
+
+int32 b2World::GetProxyCount() const
+{
+	return m_contactManager.m_broadPhase.GetProxyCount();
+}
+
+int32 b2World::GetTreeHeight() const
+{
+	return m_contactManager.m_broadPhase.GetTreeHeight();
+}
+
+int32 b2World::GetTreeBalance() const
+{
+	return m_contactManager.m_broadPhase.GetTreeBalance();
+}
+
+float b2World::GetTreeQuality() const
+{
+	return m_contactManager.m_broadPhase.GetTreeQuality();
+}
+
+void b2World::ShiftOrigin(const b2Vec2& newOrigin)
+{
+	b2Assert(m_locked == false);
+	if (m_locked)
+	{
+		return;
+	}
+
+	for (b2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		b->m_xf.p -= newOrigin;
+		b->m_c0 -= newOrigin;
+		b->GetPositionState().c -= newOrigin;
+	}
+
+	for (b2Joint* j = m_jointList; j; j = j->m_next)
+	{
+		j->ShiftOrigin(newOrigin);
+	}
+
+	m_contactManager.m_broadPhase.ShiftOrigin(newOrigin);
+}
+
+void b2World::Dump()
+{
+	if (m_locked)
+	{
+		return;
+	}
+
+	b2OpenDump("box2d_dump.inl");
+
+	b2Dump("b2Vec2 g(%.9g, %.9g);\n", m_gravity.x, m_gravity.y);
+	b2Dump("m_world->SetGravity(g);\n");
+
+	b2Dump("b2Body** bodies = (b2Body**)b2Alloc(%d * sizeof(b2Body*));\n", m_bodyCount);
+	b2Dump("b2Joint** joints = (b2Joint**)b2Alloc(%d * sizeof(b2Joint*));\n", m_jointCount);
+
+	int32 i = 0;
+	for (b2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		b->m_islandIndex = i;
+		b->Dump();
+		++i;
+	}
+
+	i = 0;
+	for (b2Joint* j = m_jointList; j; j = j->m_next)
+	{
+		j->m_index = i;
+		++i;
+	}
+
+	// First pass on joints, skip gear joints.
+	for (b2Joint* j = m_jointList; j; j = j->m_next)
+	{
+		if (j->m_type == e_gearJoint)
+		{
+			continue;
+		}
+
+		b2Dump("{\n");
+		j->Dump();
+		b2Dump("}\n");
+	}
+
+	// Second pass on joints, only gear joints.
+	for (b2Joint* j = m_jointList; j; j = j->m_next)
+	{
+		if (j->m_type != e_gearJoint)
+		{
+			continue;
+		}
+
+		b2Dump("{\n");
+		j->Dump();
+		b2Dump("}\n");
+	}
+
+	b2Dump("b2Free(joints);\n");
+	b2Dump("b2Free(bodies);\n");
+	b2Dump("joints = nullptr;\n");
+	b2Dump("bodies = nullptr;\n");
+
+	b2CloseDump();
+}
+
+// Snapshot header. Snapshots are raw memory images of the state, so they are only
+// valid for builds with the same settings and layout.
+#define b2_snapshotMagic 0x32423253
+#define b2_snapshotVersion 2
+
+static void b2WriteSnapshotHeader(b2SnapshotWriter* writer, int32 size)
+{
+	writer->Write(int32(b2_snapshotMagic));
+	writer->Write(int32(b2_snapshotVersion));
+	writer->Write(size);
+	writer->Write(int32(b2_maxPolygonVertices));
+	writer->Write(int32(b2_maxManifoldPoints));
+	writer->Write(int32(sizeof(b2BodyUserData)));
+	writer->Write(int32(sizeof(b2FixtureUserData)));
+	writer->Write(int32(sizeof(b2JointUserData)));
+}
+
+static bool b2ReadSnapshotHeader(b2SnapshotReader* reader, int32 size)
+{
+	bool valid = reader->Read<int32>() == b2_snapshotMagic;
+	valid = valid && reader->Read<int32>() == b2_snapshotVersion;
+	valid = valid && reader->Read<int32>() == size;
+	valid = valid && reader->Read<int32>() == b2_maxPolygonVertices;
+	valid = valid && reader->Read<int32>() == b2_maxManifoldPoints;
+	valid = valid && reader->Read<int32>() == int32(sizeof(b2BodyUserData));
+	valid = valid && reader->Read<int32>() == int32(sizeof(b2FixtureUserData));
+	valid = valid && reader->Read<int32>() == int32(sizeof(b2JointUserData));
+	return valid && reader->IsValid();
+}
+
+static void b2WriteShape(b2SnapshotWriter* writer, const b2Shape* shape)
+{
+	writer->Write(int32(shape->m_type));
+	writer->Write(shape->m_radius);
+
+	switch (shape->m_type)
+	{
+	case b2Shape::e_circle:
+		{
+			const b2CircleShape* circle = (const b2CircleShape*)shape;
+			writer->Write(circle->m_p);
+		}
+		break;
+
+	case b2Shape::e_edge:
+		{
+			const b2EdgeShape* edge = (const b2EdgeShape*)shape;
+			writer->Write(edge->m_vertex0);
+			writer->Write(edge->m_vertex1);
+			writer->Write(edge->m_vertex2);
+			writer->Write(edge->m_vertex3);
+			writer->Write(uint8(edge->m_oneSided));
+		}
+		break;
+
+	case b2Shape::e_polygon:
+		{
+			const b2PolygonShape* polygon = (const b2PolygonShape*)shape;
+			writer->Write(polygon->m_centroid);
+			writer->Write(polygon->m_count);
+			writer->Write(polygon->m_vertices, polygon->m_count * sizeof(b2Vec2));
+			writer->Write(polygon->m_normals, polygon->m_count * sizeof(b2Vec2));
+		}
+		break;
+
+	case b2Shape::e_chain:
+		{
+			const b2ChainShape* chain = (const b2ChainShape*)shape;
+			writer->Write(chain->m_count);
+			writer->Write(chain->m_prevVertex);
+			writer->Write(chain->m_nextVertex);
+
+			// Aligned so that a level can use the vertices in place.
+			writer->Align(alignof(b2Vec2));
+			writer->Write(chain->m_vertices, chain->m_count * sizeof(b2Vec2));
+		}
+		break;
+
+	default:
+		b2Assert(false);
+		break;
+	}
+}
+
+void b2World::WriteFixture(b2SnapshotWriter* writer, const b2Fixture* fixture) const
+{
+	b2WriteShape(writer, fixture->m_shape);
+	writer->Write(fixture->m_density);
+	writer->Write(fixture->m_friction);
+	writer->Write(fixture->m_restitution);
+	writer->Write(fixture->m_restitutionThreshold);
+	writer->Write(fixture->m_filter);
+	writer->Write(uint8(fixture->m_isSensor));
+	writer->Write(fixture->m_userData);
+	writer->Write(fixture->m_id);
+
+	writer->Write(fixture->m_proxyCount);
+	for (int32 i = 0; i < fixture->m_proxyCount; ++i)
+	{
+		const b2FixtureProxy* proxy = fixture->m_proxies + i;
+		writer->Write(proxy->aabb);
+		writer->Write(proxy->childIndex);
+		writer->Write(proxy->proxyId);
+	}
+}
+
+b2Fixture* b2World::ReadFixture(b2SnapshotReader* reader, b2Body* body, bool level)
+{
+	b2CircleShape circle;
+	b2EdgeShape edge;
+	b2PolygonShape polygon;
+	b2ChainShape chain;
+
+	b2FixtureDef def;
+	b2Shape::Type type = b2Shape::Type(reader->Read<int32>());
+	float radius = reader->Read<float>();
+	switch (type)
+	{
+	case b2Shape::e_circle:
+		circle.m_radius = radius;
+		reader->Read(&circle.m_p);
+		def.shape = &circle;
+		break;
+
+	case b2Shape::e_edge:
+		edge.m_radius = radius;
+		reader->Read(&edge.m_vertex0);
+		reader->Read(&edge.m_vertex1);
+		reader->Read(&edge.m_vertex2);
+		reader->Read(&edge.m_vertex3);
+		edge.m_oneSided = reader->Read<uint8>() != 0;
+		def.shape = &edge;
+		break;
+
+	case b2Shape::e_polygon:
+		polygon.m_radius = radius;
+		reader->Read(&polygon.m_centroid);
+		reader->Read(&polygon.m_count);
+		if (polygon.m_count < 3 || polygon.m_count > b2_maxPolygonVertices)
+		{
+			reader->Invalidate();
+			return nullptr;
+		}
+		reader->Read(polygon.m_vertices, polygon.m_count * sizeof(b2Vec2));
+		reader->Read(polygon.m_normals, polygon.m_count * sizeof(b2Vec2));
+		def.shape = &polygon;
+		break;
+
+	case b2Shape::e_chain:
+		{
+			int32 count = reader->ReadCount(sizeof(b2Vec2));
+			if (count < 2)
+			{
+				reader->Invalidate();
+				return nullptr;
+			}
+			b2Vec2 prevVertex = reader->Read<b2Vec2>();
+			b2Vec2 nextVertex = reader->Read<b2Vec2>();
+			reader->Align(alignof(b2Vec2));
+			if (level)
+			{
+				const b2Vec2* vertices = (const b2Vec2*)reader->Reference(count * sizeof(b2Vec2));
+				if (vertices == nullptr)
 				{
-					if (island.m_bodyCount == island.m_bodyCapacity)
-					{
-						break;
-					}
+					return nullptr;
+				}
+				chain.CreateChainReference(vertices, count, prevVertex, nextVertex);
+			}
+			else
+			{
+				chain.m_count = count;
+				chain.m_vertices = (b2Vec2*)b2Alloc(count * sizeof(b2Vec2));
+				reader->Read(chain.m_vertices, count * sizeof(b2Vec2));
+				chain.m_prevVertex = prevVertex;
+				chain.m_nextVertex = nextVertex;
+			}
+			chain.m_radius = radius;
+			def.shape = &chain;
+		}
+		break;
 
-					if (island.m_contactCount == island.m_contactCapacity)
-					{
-						break;
-					}
+	default:
+		reader->Invalidate();
+		return nullptr;
+	}
 
-					b2Contact* contact = ce->contact;
+	def.density = reader->Read<float>();
+	def.friction = reader->Read<float>();
+	def.restitution = reader->Read<float>();
+	def.restitutionThreshold = reader->Read<float>();
+	reader->Read(&def.filter);
+	def.isSensor = reader->Read<uint8>() != 0;
+	reader->Read(&def.userData);
+	uint32 id = reader->Read<uint32>();
+
+	// The shape is only complete if the reader is still valid.
+	if (reader->IsValid() == false)
+	{
+		return nullptr;
+	}
 
-					// Has this contact already been added to the island?
-					if (contact->m_flags & b2Contact::e_islandFlag)
-					{
-						continue;
-					}
+	void* memory = m_blockAllocator.Allocate(sizeof(b2Fixture));
+	b2Fixture* fixture = new (memory) b2Fixture;
+	fixture->Create(&m_blockAllocator, body, &def);
 
-					// Only add static, kinematic, or bullet bodies.
-					b2Body* other = ce->other;
-					if (other->m_type == b2_dynamicBody &&
-						body->IsBullet() == false && other->IsBullet() == false)
-					{
-						continue;
-					}
+	// A level is added to a world, so its fixtures get new ids.
+	if (level == false)
+	{
+		fixture->m_id = id;
+	}
 
-					// Skip sensors.
-					bool sensorA = contact->m_fixtureA->m_isSensor;
-					bool sensorB = contact->m_fixtureB->m_isSensor;
-					if (sensorA || sensorB)
-					{
-						continue;
-					}
+	// The proxies already exist in the broad-phase. Only the user data is set.
+	b2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	int32 proxyCount = reader->Read<int32>();
+	if (proxyCount < 0 || proxyCount > fixture->m_shape->GetChildCount())
+	{
+		reader->Invalidate();
+	}
 
-					// Tentatively advance the body to the TOI.
-					b2Sweep backup = other->m_sweep;
-					if ((other->m_flags & b2Body::e_islandFlag) == 0)
-					{
-						other->Advance(minAlpha);
-					}
+	for (int32 i = 0; i < proxyCount && reader->IsValid(); ++i)
+	{
+		b2FixtureProxy* proxy = fixture->m_proxies + i;
+		reader->Read(&proxy->aabb);
+		reader->Read(&proxy->childIndex);
+		reader->Read(&proxy->proxyId);
+		proxy->fixture = fixture;
+		if (broadPhase->IsProxy(proxy->proxyId) == false)
+		{
+			reader->Invalidate();
+		}
+	}
+
+	if (reader->IsValid() == false)
+	{
+		fixture->Destroy(&m_blockAllocator);
+		fixture->~b2Fixture();
+		m_blockAllocator.Free(fixture, sizeof(b2Fixture));
+		return nullptr;
+	}
+
+	fixture->m_proxyCount = proxyCount;
+	for (int32 i = 0; i < proxyCount; ++i)
+	{
+		b2FixtureProxy* proxy = fixture->m_proxies + i;
+		broadPhase->SetUserData(proxy->proxyId, proxy);
+	}
+
+	return fixture;
+}
+
+int32 b2World::SaveSnapshot(void* data, int32 capacity)
+{
+	b2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return 0;
+	}
+
+	b2Assert(m_bodyStates.count == m_bodyCount);
+
+	b2SnapshotWriter writer(data, capacity);
+	b2WriteSnapshotHeader(&writer, 0);
+
+	writer.Write(m_bodyCount);
+	writer.Write(m_jointCount);
+	writer.Write(m_contactManager.m_contactCount);
+
+	writer.Write(m_gravity);
+	writer.Write(m_inv_dt0);
+	writer.Write(m_contactManager.m_speculativeTime);
+	writer.Write(uint8(m_allowSleep));
+	writer.Write(uint8(m_warmStarting));
+	writer.Write(uint8(m_continuousPhysics));
+	writer.Write(uint8(m_subStepping));
+	writer.Write(uint8(m_clearForces));
+	writer.Write(uint8(m_contactManager.m_speculativeContacts));
+	writer.Write(uint8(m_contactManager.m_deterministic));
+	writer.Write(uint8(m_stepComplete));
+	writer.Write(uint8(m_newContacts));
+	writer.Write(m_nextId);
+
+	m_contactManager.m_broadPhase.WriteSnapshot(&writer);
+
+	// Bodies go in state order so that the state index is the body index.
+	for (int32 i = 0; i < m_bodyCount; ++i)
+	{
+		const b2Body* b = m_bodyStates.bodies[i];
+		writer.Write(int32(b->m_type));
+		writer.Write(b->m_flags);
+		writer.Write(b->m_xf);
+		writer.Write(b->m_localCenter);
+		writer.Write(b->m_c0);
+		writer.Write(b->m_a0);
+		writer.Write(b->m_alpha0);
+		writer.Write(b->m_force);
+		writer.Write(b->m_torque);
+		writer.Write(b->m_mass);
+		writer.Write(b->m_invMass);
+		writer.Write(b->m_I);
+		writer.Write(b->m_invI);
+		writer.Write(b->m_linearDamping);
+		writer.Write(b->m_angularDamping);
+		writer.Write(b->m_gravityScale);
+		writer.Write(b->m_sleepTime);
+		writer.Write(b->m_userData);
+		writer.Write(b->m_id);
+		writer.Write(m_bodyStates.positions[i]);
+		writer.Write(m_bodyStates.velocities[i]);
+
+		writer.Write(b->m_fixtureCount);
+		for (const b2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			WriteFixture(&writer, f);
+		}
+	}
+
+	for (const b2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		writer.Write(b->m_stateIndex);
+	}
+
+	// Joints go in creation order, which is the reverse of the list order. Gear joints
+	// then follow their joints.
+	b2Joint* lastJoint = m_jointList;
+	while (lastJoint != nullptr && lastJoint->m_next != nullptr)
+	{
+		lastJoint = lastJoint->m_next;
+	}
 
-					// Update the contact points
-					contact->Update(m_contactManager.m_contactListener);
+	int32 jointIndex = 0;
+	for (b2Joint* j = lastJoint; j; j = j->m_prev)
+	{
+		j->m_index = jointIndex++;
 
-					// Was the contact disabled by the user?
-					if (contact->IsEnabled() == false)
-					{
-						other->m_sweep = backup;
-						other->SynchronizeTransform();
-						continue;
-					}
+		writer.Write(int32(j->m_type));
+		writer.Write(j->m_bodyA->m_stateIndex);
+		writer.Write(j->m_bodyB->m_stateIndex);
+		writer.Write(uint8(j->m_collideConnected));
+		writer.Write(j->m_userData);
+		writer.Write(j->m_id);
 
-					// Are there contact points?
-					if (contact->IsTouching() == false)
-					{
-						other->m_sweep = backup;
-						other->SynchronizeTransform();
-						continue;
-					}
+		if (j->m_type == e_gearJoint)
+		{
+			b2GearJoint* gear = (b2GearJoint*)j;
+			b2Assert(gear->GetJoint1()->m_index < j->m_index && gear->GetJoint2()->m_index < j->m_index);
+			writer.Write(gear->GetJoint1()->m_index);
+			writer.Write(gear->GetJoint2()->m_index);
+		}
 
-					// Add the contact to the island
-					contact->m_flags |= b2Contact::e_islandFlag;
-					island.Add(contact);
+		j->WriteState(&writer);
+	}
 
-					// Has the other body already been added to the island?
-					if (other->m_flags & b2Body::e_islandFlag)
-					{
-						continue;
-					}
-					
-					// Add the other body to the island.
-					other->m_flags |= b2Body::e_islandFlag;
+	// Contacts go in contact array order. The proxies identify the fixtures.
+	for (int32 i = 0; i < m_contactManager.m_contactCount; ++i)
+	{
+		const b2Contact* c = m_contactManager.m_contacts[i];
+		writer.Write(c->m_fixtureA->m_proxies[c->m_indexA].proxyId);
+		writer.Write(c->m_fixtureB->m_proxies[c->m_indexB].proxyId);
+		writer.Write(c->m_flags);
+		writer.Write(c->m_manifold);
+		writer.Write(c->m_toiCount);
+		writer.Write(c->m_toi);
+		writer.Write(c->m_friction);
+		writer.Write(c->m_restitution);
+		writer.Write(c->m_restitutionThreshold);
+		writer.Write(c->m_tangentSpeed);
+		writer.Write(c->m_speculativeDistance);
+	}
 
-					if (other->m_type != b2_staticBody)
-					{
-						other->SetAwake(true);
-					}
+	// The order of the contact and joint lists of the bodies.
+	for (int32 i = 0; i < m_bodyCount; ++i)
+	{
+		const b2Body* b = m_bodyStates.bodies[i];
 
-					island.Add(other);
-				}
-			}
+		int32 count = 0;
+		for (const b2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
+		{
+			++count;
 		}
 
-		b2TimeStep subStep;
-		subStep.dt = (1.0f - minAlpha) * step.dt;
-		subStep.inv_dt = 1.0f / subStep.dt;
-		subStep.dtRatio = 1.0f;
-		subStep.positionIterations = 20;
-		subStep.velocityIterations = step.velocityIterations;
-		subStep.warmStarting = false;
-		island.SolveTOI(subStep, bA->m_islandIndex, bB->m_islandIndex);
+		writer.Write(count);
+		for (const b2ContactEdge* ce = b->m_contactList; ce; ce = ce->next)
+		{
+			writer.Write(ce->contact->m_managerIndex);
+		}
 
-		// Reset island flags and synchronize broad-phase proxies.
-		for (int32 i = 0; i < island.m_bodyCount; ++i)
+		count = 0;
+		for (const b2JointEdge* je = b->m_jointList; je; je = je->next)
 		{
-			b2Body* body = island.m_bodies[i];
-			body->m_flags &= ~b2Body::e_islandFlag;
+			++count;
+		}
 
-			if (body->m_type != b2_dynamicBody)
-			{
-				continue;
-			}
+		writer.Write(count);
+		for (const b2JointEdge* je = b->m_jointList; je; je = je->next)
+		{
+			writer.Write(je->joint->m_index);
+		}
+	}
 
-			body->SynchronizeFixtures();
+	// Persistent islands. The awake islands go first in awake order, then the sleeping
+	// islands in the order of their first body.
+	int32 islandCount = m_awakeIslandCount;
+	for (int32 i = 0; i < m_bodyCount; ++i)
+	{
+		const b2Body* b = m_bodyStates.bodies[i];
+		if (b->m_island != nullptr && b->m_island->bodyList == b && b->m_island->awakeIndex == -1)
+		{
+			++islandCount;
+		}
+	}
 
-			// Invalidate all contact TOIs on this displaced body.
-			for (b2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+	writer.Write(m_awakeIslandCount);
+	writer.Write(islandCount);
+
+	int32 bodyIndex = 0;
+	for (int32 i = 0; i < islandCount; ++i)
+	{
+		const b2PersistentIsland* island = nullptr;
+		if (i < m_awakeIslandCount)
+		{
+			island = m_awakeIslands[i];
+		}
+		else
+		{
+			for (;;)
 			{
-				ce->contact->m_flags &= ~(b2Contact::e_toiFlag | b2Contact::e_islandFlag);
+				const b2Body* b = m_bodyStates.bodies[bodyIndex++];
+				if (b->m_island != nullptr && b->m_island->bodyList == b && b->m_island->awakeIndex == -1)
+				{
+					island = b->m_island;
+					break;
+				}
 			}
 		}
 
-		// Commit fixture proxy movements to the broad-phase so that new contacts are created.
-		// Also, some contacts can be destroyed.
-		m_contactManager.FindNewContacts();
+		writer.Write(island->constraintRemoveCount);
 
-		if (m_subStepping)
+		writer.Write(island->bodyCount);
+		for (const b2Body* b = island->bodyList; b; b = b->m_islandNext)
 		{
-			m_stepComplete = false;
-			break;
+			writer.Write(b->m_stateIndex);
 		}
-	}
-}
 
-void b2World::Step(float dt, int32 velocityIterations, int32 positionIterations)
-{
-	b2Timer stepTimer;
+		writer.Write(island->contactCount);
+		for (const b2Contact* c = island->contactList; c; c = c->m_islandNext)
+		{
+			writer.Write(c->m_managerIndex);
+		}
 
-	// If new fixtures were added, we need to find the new contacts.
-	if (m_newContacts)
-	{
-		m_contactManager.FindNewContacts();
-		m_newContacts = false;
+		writer.Write(island->jointCount);
+		for (const b2Joint* j = island->jointList; j; j = j->m_islandNext)
+		{
+			writer.Write(j->m_index);
+		}
 	}
 
-	m_locked = true;
-
-	b2TimeStep step;
-	step.dt = dt;
-	step.velocityIterations	= velocityIterations;
-	step.positionIterations = positionIterations;
-	if (dt > 0.0f)
+	// Now that the size is known, write it into the header.
+	int32 size = writer.GetSize();
+	if (size <= capacity && data != nullptr)
 	{
-		step.inv_dt = 1.0f / dt;
-	}
-	else
-	{
-		step.inv_dt = 0.0f;
+		b2SnapshotWriter headerWriter(data, capacity);
+		b2WriteSnapshotHeader(&headerWriter, size);
 	}
 
-	step.dtRatio = m_inv_dt0 * dt;
+	return size;
+}
 
-	step.warmStarting = m_warmStarting;
-	
-	// Update contacts. This is where some contacts are destroyed.
+bool b2World::RestoreSnapshot(const void* data, int32 size)
+{
+	b2Assert(IsLocked() == false);
+	if (IsLocked())
 	{
-		b2Timer timer;
-		m_contactManager.Collide();
-		m_profile.collide = timer.GetMilliseconds();
+		return false;
 	}
 
-	// Integrate velocities, solve velocity constraints, and integrate positions.
-	if (m_stepComplete && step.dt > 0.0f)
+	b2SnapshotReader reader(data, size);
+	if (b2ReadSnapshotHeader(&reader, size) == false)
 	{
-		b2Timer timer;
-		Solve(step);
-		m_profile.solve = timer.GetMilliseconds();
+		return false;
 	}
 
-	// Handle TOI events.
-	if (m_continuousPhysics && step.dt > 0.0f)
-	{
-		b2Timer timer;
-		SolveTOI(step);
-		m_profile.solveTOI = timer.GetMilliseconds();
-	}
+	// Remove everything without telling the listeners.
+	b2DestructionListener* destructionListener = m_destructionListener;
+	b2ContactListener* contactListener = m_contactManager.m_contactListener;
+	b2ContactListener silentListener;
+	m_destructionListener = nullptr;
+	m_contactManager.m_contactListener = &silentListener;
 
-	if (step.dt > 0.0f)
+	b2Body** oldBodies = (b2Body**)m_stackAllocator.Allocate(m_bodyCount * sizeof(b2Body*));
+	int32 oldBodyCount = 0;
+	for (b2Body* b = m_bodyList; b; b = b->m_next)
 	{
-		m_inv_dt0 = step.inv_dt;
+		oldBodies[oldBodyCount++] = b;
 	}
-
-	if (m_clearForces)
+	DestroyBodies(oldBodies, oldBodyCount);
+	m_stackAllocator.Free(oldBodies);
+
+	m_destructionListener = destructionListener;
+	m_contactManager.m_contactListener = contactListener;
+
+	b2Assert(m_bodyCount == 0 && m_jointCount == 0 && m_contactManager.m_contactCount == 0);
+	b2Assert(m_awakeIslandCount == 0 && m_bodyStates.count == 0);
+
+	int32 bodyCount = reader.ReadCount(1);
+	int32 jointCount = reader.ReadCount(1);
+	int32 contactCount = reader.ReadCount(1);
+
+	// The settings are kept until the objects are read.
+	b2Vec2 gravity = reader.Read<b2Vec2>();
+	float inv_dt0 = reader.Read<float>();
+	float speculativeTime = reader.Read<float>();
+	uint8 flags[9];
+	reader.Read(flags, sizeof(flags));
+	uint32 nextId = reader.Read<uint32>();
+
+	b2Body** bodies = (b2Body**)m_stackAllocator.Allocate(bodyCount * sizeof(b2Body*));
+	b2Joint** joints = (b2Joint**)m_stackAllocator.Allocate(jointCount * sizeof(b2Joint*));
+	ReadSnapshotObjects(&reader, bodies, bodyCount, joints, jointCount, contactCount);
+	m_stackAllocator.Free(joints);
+	m_stackAllocator.Free(bodies);
+
+	if (reader.IsValid() == false)
 	{
-		ClearForces();
+		DestroySnapshotObjects();
+		return false;
 	}
 
-	m_locked = false;
-
-	m_profile.step = stepTimer.GetMilliseconds();
+	m_gravity = gravity;
+	m_inv_dt0 = inv_dt0;
+	m_contactManager.m_speculativeTime = speculativeTime;
+	m_allowSleep = flags[0] != 0;
+	m_warmStarting = flags[1] != 0;
+	m_continuousPhysics = flags[2] != 0;
+	m_subStepping = flags[3] != 0;
+	m_clearForces = flags[4] != 0;
+	m_contactManager.m_speculativeContacts = flags[5] != 0;
+	m_contactManager.m_deterministic = flags[6] != 0;
+	m_stepComplete = flags[7] != 0;
+	m_newContacts = flags[8] != 0;
+
+	// Bodies and fixtures took new ids when they were created.
+	m_nextId = nextId;
+
+	return true;
 }
 
-void b2World::ClearForces()
+void b2World::ReadSnapshotObjects(b2SnapshotReader* reader, b2Body** bodies, int32 bodyCount,
+	b2Joint** joints, int32 jointCount, int32 contactCount)
 {
-	for (b2Body* body = m_bodyList; body; body = body->GetNext())
+	b2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	broadPhase->ReadSnapshot(reader);
+	if (reader->IsValid() == false)
 	{
-		body->m_force.SetZero();
-		body->m_torque = 0.0f;
+		return;
 	}
-}
 
-struct b2WorldQueryWrapper
-{
-	bool QueryCallback(int32 proxyId)
+	// Bodies and fixtures.
+	ReserveBodyStates(bodyCount);
+
+	b2BodyDef bodyDef;
+	for (int32 i = 0; i < bodyCount; ++i)
 	{
-		b2FixtureProxy* proxy = (b2FixtureProxy*)broadPhase->GetUserData(proxyId);
-		return callback->ReportFixture(proxy->fixture);
+		void* mem = m_blockAllocator.Allocate(sizeof(b2Body));
+		b2Body* b = new (mem) b2Body(&bodyDef, this);
+		b2Assert(b->m_stateIndex == i);
+		bodies[i] = b;
+
+		int32 type = reader->Read<int32>();
+		if (type < b2_staticBody || b2_dynamicBody < type)
+		{
+			reader->Invalidate();
+			return;
+		}
+
+		b->m_type = b2BodyType(type);
+		reader->Read(&b->m_flags);
+		reader->Read(&b->m_xf);
+		reader->Read(&b->m_localCenter);
+		reader->Read(&b->m_c0);
+		reader->Read(&b->m_a0);
+		reader->Read(&b->m_alpha0);
+		reader->Read(&b->m_force);
+		reader->Read(&b->m_torque);
+		reader->Read(&b->m_mass);
+		reader->Read(&b->m_invMass);
+		reader->Read(&b->m_I);
+		reader->Read(&b->m_invI);
+		reader->Read(&b->m_linearDamping);
+		reader->Read(&b->m_angularDamping);
+		reader->Read(&b->m_gravityScale);
+		reader->Read(&b->m_sleepTime);
+		reader->Read(&b->m_userData);
+		reader->Read(&b->m_id);
+		reader->Read(m_bodyStates.positions + i);
+		reader->Read(m_bodyStates.velocities + i);
+
+		int32 fixtureCount = reader->ReadCount(1);
+		b2Fixture* fixtureTail = nullptr;
+		for (int32 j = 0; j < fixtureCount; ++j)
+		{
+			// Keep the list order.
+			b2Fixture* fixture = ReadFixture(reader, b, false);
+			if (fixture == nullptr)
+			{
+				return;
+			}
+
+			if (fixtureTail != nullptr)
+			{
+				fixtureTail->m_next = fixture;
+			}
+			else
+			{
+				b->m_fixtureList = fixture;
+			}
+			fixtureTail = fixture;
+			++b->m_fixtureCount;
+		}
 	}
 
-	const b2BroadPhase* broadPhase;
-	b2QueryCallback* callback;
-};
+	b2Body* bodyTail = nullptr;
+	for (int32 i = 0; i < bodyCount; ++i)
+	{
+		int32 index = reader->ReadIndex(bodyCount);
+		if (reader->IsValid() == false || bodies[index] == m_bodyList || bodies[index]->m_prev != nullptr)
+		{
+			reader->Invalidate();
+			return;
+		}
 
-void b2World::QueryAABB(b2QueryCallback* callback, const b2AABB& aabb) const
-{
-	b2WorldQueryWrapper wrapper;
-	wrapper.broadPhase = &m_contactManager.m_broadPhase;
-	wrapper.callback = callback;
-	m_contactManager.m_broadPhase.Query(&wrapper, aabb);
-}
+		b2Body* b = bodies[index];
 
-struct b2WorldRayCastWrapper
-{
-	float RayCastCallback(const b2RayCastInput& input, int32 proxyId)
+		b->m_prev = bodyTail;
+		if (bodyTail != nullptr)
+		{
+			bodyTail->m_next = b;
+		}
+		else
+		{
+			m_bodyList = b;
+		}
+		bodyTail = b;
+	}
+	m_bodyCount = bodyCount;
+
+	// Joints in creation order. Prepending them restores the list order.
+	for (int32 i = 0; i < jointCount; ++i)
 	{
-		void* userData = broadPhase->GetUserData(proxyId);
-		b2FixtureProxy* proxy = (b2FixtureProxy*)userData;
-		b2Fixture* fixture = proxy->fixture;
-		int32 index = proxy->childIndex;
-		b2RayCastOutput output;
-		bool hit = fixture->RayCast(&output, input, index);
+		b2JointDef def;
+		int32 type = reader->Read<int32>();
+		int32 indexA = reader->ReadIndex(bodyCount);
+		int32 indexB = reader->ReadIndex(bodyCount);
+		def.collideConnected = reader->Read<uint8>() != 0;
+		reader->Read(&def.userData);
+		uint32 id = reader->Read<uint32>();
+
+		// A gear joint refers to two earlier revolute or prismatic joints.
+		b2Joint* joint1 = nullptr;
+		b2Joint* joint2 = nullptr;
+		if (type == e_gearJoint)
+		{
+			int32 index1 = reader->ReadIndex(i);
+			int32 index2 = reader->ReadIndex(i);
+			if (reader->IsValid())
+			{
+				joint1 = joints[index1];
+				joint2 = joints[index2];
+				if ((joint1->m_type != e_revoluteJoint && joint1->m_type != e_prismaticJoint) ||
+					(joint2->m_type != e_revoluteJoint && joint2->m_type != e_prismaticJoint))
+				{
+					reader->Invalidate();
+				}
+			}
+		}
 
-		if (hit)
+		if (reader->IsValid() == false || type <= e_unknownJoint || e_motorJoint < type)
 		{
-			float fraction = output.fraction;
-			b2Vec2 point = (1.0f - fraction) * input.p1 + fraction * input.p2;
-			return callback->ReportFixture(fixture, point, output.normal, fraction);
+			reader->Invalidate();
+			return;
 		}
 
-		return input.maxFraction;
+		def.type = b2JointType(type);
+		def.bodyA = bodies[indexA];
+		def.bodyB = bodies[indexB];
+		b2Joint* j = b2Joint::CreateDefault(&def, joint1, joint2, &m_blockAllocator);
+		j->ReadState(reader);
+		j->m_index = i;
+		j->m_id = id;
+		joints[i] = j;
+
+		j->m_prev = nullptr;
+		j->m_next = m_jointList;
+		if (m_jointList)
+		{
+			m_jointList->m_prev = j;
+		}
+		m_jointList = j;
+		++m_jointCount;
+
+		j->m_edgeA.joint = j;
+		j->m_edgeA.other = j->m_bodyB;
+		j->m_edgeB.joint = j;
+		j->m_edgeB.other = j->m_bodyA;
 	}
 
-	const b2BroadPhase* broadPhase;
-	b2RayCastCallback* callback;
-};
+	// Contacts in contact array order.
+	for (int32 i = 0; i < contactCount; ++i)
+	{
+		int32 proxyIdA = reader->Read<int32>();
+		int32 proxyIdB = reader->Read<int32>();
+		if (reader->IsValid() == false || broadPhase->IsProxy(proxyIdA) == false || broadPhase->IsProxy(proxyIdB) == false ||
+			m_contactManager.FindContact(proxyIdA, proxyIdB) != nullptr)
+		{
+			reader->Invalidate();
+			return;
+		}
 
-void b2World::RayCast(b2RayCastCallback* callback, const b2Vec2& point1, const b2Vec2& point2) const
-{
-	b2WorldRayCastWrapper wrapper;
-	wrapper.broadPhase = &m_contactManager.m_broadPhase;
-	wrapper.callback = callback;
-	b2RayCastInput input;
-	input.maxFraction = 1.0f;
-	input.p1 = point1;
-	input.p2 = point2;
-	m_contactManager.m_broadPhase.RayCast(&wrapper, input);
-}
+		b2FixtureProxy* proxyA = (b2FixtureProxy*)broadPhase->GetUserData(proxyIdA);
+		b2FixtureProxy* proxyB = (b2FixtureProxy*)broadPhase->GetUserData(proxyIdB);
+		if (proxyA == nullptr || proxyB == nullptr)
+		{
+			reader->Invalidate();
+			return;
+		}
 
-void b2World::DrawShape(b2Fixture* fixture, const b2Transform& xf, const b2Color& color)
-{
-	switch (fixture->GetType())
+		b2Contact* c = b2Contact::Create(proxyA->fixture, proxyA->childIndex, proxyB->fixture, proxyB->childIndex, &m_blockAllocator);
+		if (c == nullptr || c->m_fixtureA != proxyA->fixture)
+		{
+			if (c != nullptr)
+			{
+				b2Contact::Destroy(c, &m_blockAllocator);
+			}
+			reader->Invalidate();
+			return;
+		}
+
+		reader->Read(&c->m_flags);
+		reader->Read(&c->m_manifold);
+		reader->Read(&c->m_toiCount);
+		reader->Read(&c->m_toi);
+		reader->Read(&c->m_friction);
+		reader->Read(&c->m_restitution);
+		reader->Read(&c->m_restitutionThreshold);
+		reader->Read(&c->m_tangentSpeed);
+		reader->Read(&c->m_speculativeDistance);
+
+		c->m_nodeA.contact = c;
+		c->m_nodeA.other = c->m_fixtureB->m_body;
+		c->m_nodeB.contact = c;
+		c->m_nodeB.other = c->m_fixtureA->m_body;
+
+		m_contactManager.AddToContactArray(c);
+		m_contactManager.AddToPairTable(c);
+
+		if (c->m_manifold.pointCount < 0 || c->m_manifold.pointCount > b2_maxManifoldPoints)
+		{
+			reader->Invalidate();
+			return;
+		}
+	}
+
+	b2Contact** contacts = m_contactManager.m_contacts;
+
+	// The contact and joint lists of the bodies.
+	for (int32 i = 0; i < bodyCount; ++i)
 	{
-	case b2Shape::e_circle:
+		b2Body* b = bodies[i];
+
+		int32 count = reader->ReadCount(sizeof(int32));
+		b2ContactEdge* contactTail = nullptr;
+		for (int32 j = 0; j < count; ++j)
+		{
+			int32 index = reader->ReadIndex(contactCount);
+			if (reader->IsValid() == false || (contacts[index]->m_fixtureA->m_body != b && contacts[index]->m_fixtureB->m_body != b))
+			{
+				reader->Invalidate();
+				return;
+			}
+
+			b2Contact* c = contacts[index];
+			b2ContactEdge* ce = c->m_fixtureA->m_body == b ? &c->m_nodeA : &c->m_nodeB;
+			ce->prev = contactTail;
+			ce->next = nullptr;
+			if (contactTail != nullptr)
+			{
+				contactTail->next = ce;
+			}
+			else
+			{
+				b->m_contactList = ce;
+			}
+			contactTail = ce;
+		}
+
+		count = reader->ReadCount(sizeof(int32));
+		b2JointEdge* jointTail = nullptr;
+		for (int32 j = 0; j < count; ++j)
 		{
-			b2CircleShape* circle = (b2CircleShape*)fixture->GetShape();
+			int32 index = reader->ReadIndex(jointCount);
+			if (reader->IsValid() == false || (joints[index]->m_bodyA != b && joints[index]->m_bodyB != b))
+			{
+				reader->Invalidate();
+				return;
+			}
 
-			b2Vec2 center = b2Mul(xf, circle->m_p);
-			float radius = circle->m_radius;
-			b2Vec2 axis = b2Mul(xf.q, b2Vec2(1.0f, 0.0f));
+			b2Joint* joint = joints[index];
+			b2JointEdge* je = joint->m_bodyA == b ? &joint->m_edgeA : &joint->m_edgeB;
+			je->prev = jointTail;
+			je->next = nullptr;
+			if (jointTail != nullptr)
+			{
+				jointTail->next = je;
+			}
+			else
+			{
+				b->m_jointList = je;
+			}
+			jointTail = je;
+		}
+	}
 
-			m_debugDraw->DrawSolidCircle(center, radius, axis, color);
+	// Persistent islands.
+	int32 awakeIslandCount = reader->Read<int32>();
+	int32 islandCount = reader->ReadCount(sizeof(int32));
+	for (int32 i = 0; i < islandCount; ++i)
+	{
+		b2PersistentIsland* island = CreateIsland();
+		reader->Read(&island->constraintRemoveCount);
+
+		// Islands are never empty. A body, and so its island, is in one island only.
+		island->bodyCount = reader->ReadCount(sizeof(int32));
+		if (island->bodyCount == 0)
+		{
+			reader->Invalidate();
 		}
-		break;
 
-	case b2Shape::e_edge:
+		for (int32 j = 0; j < island->bodyCount && reader->IsValid(); ++j)
 		{
-			b2EdgeShape* edge = (b2EdgeShape*)fixture->GetShape();
-			b2Vec2 v1 = b2Mul(xf, edge->m_vertex1);
-			b2Vec2 v2 = b2Mul(xf, edge->m_vertex2);
-			m_debugDraw->DrawSegment(v1, v2, color);
+			int32 index = reader->ReadIndex(bodyCount);
+			if (reader->IsValid() == false || bodies[index]->m_island != nullptr)
+			{
+				reader->Invalidate();
+				break;
+			}
 
-			if (edge->m_oneSided == false)
+			b2Body* b = bodies[index];
+
+			b->m_island = island;
+			b->m_islandPrev = island->bodyTail;
+			if (island->bodyTail != nullptr)
 			{
-				m_debugDraw->DrawPoint(v1, 4.0f, color);
-				m_debugDraw->DrawPoint(v2, 4.0f, color);
+				island->bodyTail->m_islandNext = b;
+			}
+			else
+			{
+				island->bodyList = b;
 			}
+			island->bodyTail = b;
 		}
-		break;
 
-	case b2Shape::e_chain:
+		island->contactCount = reader->ReadCount(sizeof(int32));
+		for (int32 j = 0; j < island->contactCount && reader->IsValid(); ++j)
 		{
-			b2ChainShape* chain = (b2ChainShape*)fixture->GetShape();
-			int32 count = chain->m_count;
-			const b2Vec2* vertices = chain->m_vertices;
+			int32 index = reader->ReadIndex(contactCount);
+			if (reader->IsValid() == false)
+			{
+				break;
+			}
 
-			b2Vec2 v1 = b2Mul(xf, vertices[0]);
-			for (int32 i = 1; i < count; ++i)
+			b2Contact* c = contacts[index];
+
+			c->m_islandPrev = island->contactTail;
+			if (island->contactTail != nullptr)
 			{
-				b2Vec2 v2 = b2Mul(xf, vertices[i]);
-				m_debugDraw->DrawSegment(v1, v2, color);
-				v1 = v2;
+				island->contactTail->m_islandNext = c;
+			}
+			else
+			{
+				island->contactList = c;
 			}
+			island->contactTail = c;
 		}
-		break;
 
-	case b2Shape::e_polygon:
+		island->jointCount = reader->ReadCount(sizeof(int32));
+		for (int32 j = 0; j < island->jointCount && reader->IsValid(); ++j)
 		{
-			b2PolygonShape* poly = (b2PolygonShape*)fixture->GetShape();
-			int32 vertexCount = poly->m_count;
-			b2Assert(vertexCount <= b2_maxPolygonVertices);
-			b2Vec2 vertices[b2_maxPolygonVertices];
+			int32 index = reader->ReadIndex(jointCount);
+			if (reader->IsValid() == false || joints[index]->m_islandLinked)
+			{
+				reader->Invalidate();
+				break;
+			}
 
-			for (int32 i = 0; i < vertexCount; ++i)
+			b2Joint* joint = joints[index];
+
+			joint->m_islandLinked = true;
+			joint->m_islandPrev = island->jointTail;
+			if (island->jointTail != nullptr)
 			{
-				vertices[i] = b2Mul(xf, poly->m_vertices[i]);
+				island->jointTail->m_islandNext = joint;
+			}
+			else
+			{
+				island->jointList = joint;
 			}
+			island->jointTail = joint;
+		}
 
-			m_debugDraw->DrawSolidPolygon(vertices, vertexCount, color);
+		if (reader->IsValid() == false)
+		{
+			// Only the bodies of an island lead to it.
+			if (island->bodyList == nullptr)
+			{
+				DestroyIsland(island);
+			}
+			return;
 		}
-		break;
 
-	default:
-	break;
+		// The awake islands come first in awake order.
+		if (i < awakeIslandCount)
+		{
+			WakeIsland(island);
+		}
 	}
 }
 
-void b2World::DebugDraw()
+void b2World::DestroySnapshotObjects()
 {
-	if (m_debugDraw == nullptr)
+	// The objects may be partly linked, so they are found through the contact array,
+	// the joint list and the body states rather than through the body lists.
+	b2ContactManager* contactManager = &m_contactManager;
+	for (int32 i = 0; i < contactManager->m_contactCount; ++i)
 	{
-		return;
+		// Do not wake the bodies.
+		b2Contact* c = contactManager->m_contacts[i];
+		c->m_manifold.pointCount = 0;
+		b2Contact::Destroy(c, &m_blockAllocator);
 	}
-
-	uint32 flags = m_debugDraw->GetFlags();
-
-	if (flags & b2Draw::e_shapeBit)
+	contactManager->m_contactCount = 0;
+	if (contactManager->m_pairCapacity > 0)
 	{
-		for (b2Body* b = m_bodyList; b; b = b->GetNext())
-		{
-			const b2Transform& xf = b->GetTransform();
-			for (b2Fixture* f = b->GetFixtureList(); f; f = f->GetNext())
-			{
-				if (b->GetType() == b2_dynamicBody && b->m_mass == 0.0f)
-				{
-					// Bad body
-					DrawShape(f, xf, b2Color(1.0f, 0.0f, 0.0f));
-				}
-				else if (b->IsEnabled() == false)
-				{
-					DrawShape(f, xf, b2Color(0.5f, 0.5f, 0.3f));
-				}
-				else if (b->GetType() == b2_staticBody)
-				{
-					DrawShape(f, xf, b2Color(0.5f, 0.9f, 0.5f));
-				}
-				else if (b->GetType() == b2_kinematicBody)
-				{
-					DrawShape(f, xf, b2Color(0.5f, 0.5f, 0.9f));
-				}
-				else if (b->IsAwake() == false)
-				{
-					DrawShape(f, xf, b2Color(0.6f, 0.6f, 0.6f));
-				}
-				else
-				{
-					DrawShape(f, xf, b2Color(0.9f, 0.7f, 0.7f));
-				}
-			}
-		}
+		memset(contactManager->m_pairTable, 0, contactManager->m_pairCapacity * sizeof(b2ContactPair));
 	}
 
-	if (flags & b2Draw::e_jointBit)
+	while (m_jointList)
 	{
-		for (b2Joint* j = m_jointList; j; j = j->GetNext())
-		{
-			j->Draw(m_debugDraw);
-		}
+		b2Joint* j = m_jointList;
+		m_jointList = j->m_next;
+		b2Joint::Destroy(j, &m_blockAllocator);
 	}
+	m_jointCount = 0;
 
-	if (flags & b2Draw::e_pairBit)
+	for (int32 i = 0; i < m_bodyStates.count; ++i)
 	{
-		b2Color color(0.3f, 0.9f, 0.9f);
-		for (b2Contact* c = m_contactManager.m_contactList; c; c = c->GetNext())
+		b2PersistentIsland* island = m_bodyStates.bodies[i]->m_island;
+		if (island == nullptr)
 		{
-			b2Fixture* fixtureA = c->GetFixtureA();
-			b2Fixture* fixtureB = c->GetFixtureB();
-			int32 indexA = c->GetChildIndexA();
-			int32 indexB = c->GetChildIndexB();
-			b2Vec2 cA = fixtureA->GetAABB(indexA).GetCenter();
-			b2Vec2 cB = fixtureB->GetAABB(indexB).GetCenter();
-
-			m_debugDraw->DrawSegment(cA, cB, color);
+			continue;
 		}
-	}
-
-	if (flags & b2Draw::e_aabbBit)
-	{
-		b2Color color(0.9f, 0.3f, 0.9f);
-		b2BroadPhase* bp = &m_contactManager.m_broadPhase;
 
-		for (b2Body* b = m_bodyList; b; b = b->GetNext())
+		for (b2Body* b = island->bodyList; b; b = b->m_islandNext)
 		{
-			if (b->IsEnabled() == false)
-			{
-				continue;
-			}
-
-			for (b2Fixture* f = b->GetFixtureList(); f; f = f->GetNext())
-			{
-				for (int32 i = 0; i < f->m_proxyCount; ++i)
-				{
-					b2FixtureProxy* proxy = f->m_proxies + i;
-					b2AABB aabb = bp->GetFatAABB(proxy->proxyId);
-					b2Vec2 vs[4];
-					vs[0].Set(aabb.lowerBound.x, aabb.lowerBound.y);
-					vs[1].Set(aabb.upperBound.x, aabb.lowerBound.y);
-					vs[2].Set(aabb.upperBound.x, aabb.upperBound.y);
-					vs[3].Set(aabb.lowerBound.x, aabb.upperBound.y);
-
-					m_debugDraw->DrawPolygon(vs, 4, color);
-				}
-			}
+			b->m_island = nullptr;
 		}
+		DestroyIsland(island);
 	}
+	b2Assert(m_awakeIslandCount == 0);
 
-	if (flags & b2Draw::e_centerOfMassBit)
+	for (int32 i = 0; i < m_bodyStates.count; ++i)
 	{
-		for (b2Body* b = m_bodyList; b; b = b->GetNext())
+		b2Body* b = m_bodyStates.bodies[i];
+		b2Fixture* f = b->m_fixtureList;
+		while (f)
 		{
-			b2Transform xf = b->GetTransform();
-			xf.p = b->GetWorldCenter();
-			m_debugDraw->DrawTransform(xf);
+			b2Fixture* f0 = f;
+			f = f->m_next;
+
+			// The proxies go with the broad-phase below.
+			f0->m_proxyCount = 0;
+			f0->Destroy(&m_blockAllocator);
+			f0->~b2Fixture();
+			m_blockAllocator.Free(f0, sizeof(b2Fixture));
 		}
+
+		b->~b2Body();
+		m_blockAllocator.Free(b, sizeof(b2Body));
 	}
-}
+	m_bodyStates.count = 0;
+	m_bodyList = nullptr;
+	m_bodyCount = 0;
 
-int32 b2World::GetProxyCount() const
-{
-	return m_contactManager.m_broadPhase.GetProxyCount();
+	contactManager->m_broadPhase.Reset();
 }
 
-int32 b2World::GetTreeHeight() const
-{
-	return m_contactManager.m_broadPhase.GetTreeHeight();
-}
+#define b2_levelMagic 0x564c3242
+#define b2_levelVersion 1
 
-int32 b2World::GetTreeBalance() const
+static void b2WriteLevelHeader(b2SnapshotWriter* writer, int32 size)
 {
-	return m_contactManager.m_broadPhase.GetTreeBalance();
+	writer->Write(int32(b2_levelMagic));
+	writer->Write(int32(b2_levelVersion));
+	writer->Write(size);
+	writer->Write(int32(sizeof(void*)));
+	writer->Write(int32(sizeof(b2TreeNode)));
+	writer->Write(int32(b2_maxPolygonVertices));
+	writer->Write(int32(sizeof(b2BodyUserData)));
+	writer->Write(int32(sizeof(b2FixtureUserData)));
 }
 
-float b2World::GetTreeQuality() const
+static bool b2ReadLevelHeader(b2SnapshotReader* reader, int32 size)
 {
-	return m_contactManager.m_broadPhase.GetTreeQuality();
+	bool valid = reader->Read<int32>() == b2_levelMagic;
+	valid = valid && reader->Read<int32>() == b2_levelVersion;
+	valid = valid && reader->Read<int32>() == size;
+	valid = valid && reader->Read<int32>() == int32(sizeof(void*));
+	valid = valid && reader->Read<int32>() == int32(sizeof(b2TreeNode));
+	valid = valid && reader->Read<int32>() == b2_maxPolygonVertices;
+	valid = valid && reader->Read<int32>() == int32(sizeof(b2BodyUserData));
+	valid = valid && reader->Read<int32>() == int32(sizeof(b2FixtureUserData));
+	return valid && reader->IsValid();
 }
 
-void b2World::ShiftOrigin(const b2Vec2& newOrigin)
+int32 b2World::SaveLevel(void* data, int32 capacity) const
 {
-	b2Assert(m_locked == false);
-	if (m_locked)
+	b2Assert(IsLocked() == false);
+
+	b2SnapshotWriter writer(data, capacity);
+	b2WriteLevelHeader(&writer, 0);
+
+	int32 bodyCount = 0;
+	for (const b2Body* b = m_bodyList; b; b = b->m_next)
 	{
-		return;
+		if (b->m_type == b2_staticBody)
+		{
+			++bodyCount;
+		}
 	}
 
-	for (b2Body* b = m_bodyList; b; b = b->m_next)
+	writer.Write(bodyCount);
+	m_contactManager.m_broadPhase.WriteStaticTree(&writer);
+
+	for (const b2Body* b = m_bodyList; b; b = b->m_next)
 	{
-		b->m_xf.p -= newOrigin;
-		b->m_sweep.c0 -= newOrigin;
-		b->m_sweep.c -= newOrigin;
+		if (b->m_type != b2_staticBody)
+		{
+			continue;
+		}
+
+		writer.Write(b->m_xf.p);
+		writer.Write(b->GetAngle());
+		writer.Write(uint8(b->IsEnabled()));
+		writer.Write(b->m_userData);
+
+		writer.Write(b->m_fixtureCount);
+		for (const b2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			WriteFixture(&writer, f);
+		}
 	}
 
-	for (b2Joint* j = m_jointList; j; j = j->m_next)
+	int32 size = writer.GetSize();
+	if (size <= capacity && data != nullptr)
 	{
-		j->ShiftOrigin(newOrigin);
+		b2SnapshotWriter headerWriter(data, capacity);
+		b2WriteLevelHeader(&headerWriter, size);
 	}
 
-	m_contactManager.m_broadPhase.ShiftOrigin(newOrigin);
+	return size;
 }
 
-void b2World::Dump()
+bool b2World::LoadLevel(void* data, int32 size)
 {
-	if (m_locked)
+	b2Assert(IsLocked() == false);
+	if (IsLocked())
 	{
-		return;
+		return false;
 	}
 
-	b2OpenDump("box2d_dump.inl");
-
-	b2Dump("b2Vec2 g(%.9g, %.9g);\n", m_gravity.x, m_gravity.y);
-	b2Dump("m_world->SetGravity(g);\n");
-
-	b2Dump("b2Body** bodies = (b2Body**)b2Alloc(%d * sizeof(b2Body*));\n", m_bodyCount);
-	b2Dump("b2Joint** joints = (b2Joint**)b2Alloc(%d * sizeof(b2Joint*));\n", m_jointCount);
+	// The tree nodes are used in place.
+	b2Assert(((uintptr_t)data & 15) == 0);
+	if (((uintptr_t)data & 15) != 0)
+	{
+		return false;
+	}
 
-	int32 i = 0;
-	for (b2Body* b = m_bodyList; b; b = b->m_next)
+	b2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	if (broadPhase->GetTree(b2BroadPhase::e_staticTree).GetNodeCount() != 0)
 	{
-		b->m_islandIndex = i;
-		b->Dump();
-		++i;
+		return false;
 	}
 
-	i = 0;
-	for (b2Joint* j = m_jointList; j; j = j->m_next)
+	b2SnapshotReader reader(data, size);
+	if (b2ReadLevelHeader(&reader, size) == false)
 	{
-		j->m_index = i;
-		++i;
+		return false;
 	}
 
-	// First pass on joints, skip gear joints.
-	for (b2Joint* j = m_jointList; j; j = j->m_next)
+	int32 bodyCount = reader.Read<int32>();
+	broadPhase->ReferenceStaticTree(&reader);
+
+	for (int32 i = 0; i < bodyCount; ++i)
 	{
-		if (j->m_type == e_gearJoint)
+		b2BodyDef def;
+		def.type = b2_staticBody;
+		reader.Read(&def.position);
+		reader.Read(&def.angle);
+		def.enabled = reader.Read<uint8>() != 0;
+		reader.Read(&def.userData);
+		b2Body* b = CreateBody(&def);
+
+		// The proxies of the fixtures are already in the static tree.
+		int32 fixtureCount = reader.Read<int32>();
+		b2Fixture* fixtureTail = nullptr;
+		for (int32 j = 0; j < fixtureCount; ++j)
 		{
-			continue;
-		}
+			b2Fixture* fixture = ReadFixture(&reader, b, true);
+			if (fixture == nullptr)
+			{
+				break;
+			}
 
-		b2Dump("{\n");
-		j->Dump();
-		b2Dump("}\n");
+			if (fixtureTail != nullptr)
+			{
+				fixtureTail->m_next = fixture;
+			}
+			else
+			{
+				b->m_fixtureList = fixture;
+			}
+			fixtureTail = fixture;
+			++b->m_fixtureCount;
+		}
 	}
 
-	// Second pass on joints, only gear joints.
-	for (b2Joint* j = m_jointList; j; j = j->m_next)
+	// The level proxies are not in the move buffer, so look for pairs from the other side.
+	for (b2Body* b = m_bodyList; b; b = b->m_next)
 	{
-		if (j->m_type != e_gearJoint)
+		if (b->m_type == b2_staticBody)
 		{
 			continue;
 		}
 
-		b2Dump("{\n");
-		j->Dump();
-		b2Dump("}\n");
+		for (b2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			for (int32 i = 0; i < f->m_proxyCount; ++i)
+			{
+				broadPhase->TouchProxy(f->m_proxies[i].proxyId);
+			}
+		}
 	}
 
-	b2Dump("b2Free(joints);\n");
-	b2Dump("b2Free(bodies);\n");
-	b2Dump("joints = nullptr;\n");
-	b2Dump("bodies = nullptr;\n");
+	m_newContacts = true;
 
-	b2CloseDump();
+	b2Assert(reader.IsValid());
+	return true;
 }
@@ -45,6 +45,10 @@ static Test* s_test = nullptr;
 static Settings s_settings;
 static bool s_rightMouseDown = false;
 static b2Vec2 s_clickPointWS = b2Vec2_zero;
+#ifdef B2_PROFILER
+// Keeps the slowest steps for a Chrome trace.
+static b2Profiler s_profiler;
+#endif
 // Display scaling factor of the current monitor AKA DPI. A value of 1.0f means
 // 100% (default)
 static float displayScalingFactor = 1.0f;
@@ -76,6 +80,24 @@ static void RestartTest()
 	s_test = g_testEntries[s_settings.m_testIndex].createFcn();
 }
 
+#ifdef B2_PROFILER
+static void SaveTrace()
+{
+	int32 size = s_profiler.ExportChromeTrace(nullptr, 0);
+	char* text = (char*)b2Alloc(size + 1);
+	s_profiler.ExportChromeTrace(text, size + 1);
+
+	FILE* file = fopen("box2d_trace.json", "w");
+	if (file != nullptr)
+	{
+		fwrite(text, 1, size, file);
+		fclose(file);
+	}
+
+	b2Free(text);
+}
+#endif
+
 static void CreateUI(GLFWwindow* window, const char* glslVersion = NULL)
 {
 	IMGUI_CHECKVERSION();
@@ -374,7 +396,10 @@ static void UpdateUI()
 				ImGui::Checkbox("Sleep", &s_settings.m_enableSleep);
 				ImGui::Checkbox("Warm Starting", &s_settings.m_enableWarmStarting);
 				ImGui::Checkbox("Time of Impact", &s_settings.m_enableContinuous);
+				ImGui::Checkbox("Speculative", &s_settings.m_enableSpeculative);
 				ImGui::Checkbox("Sub-Stepping", &s_settings.m_enableSubStepping);
+				ImGui::Checkbox("Wide Solver", &s_settings.m_enableWideSolver);
+				ImGui::Checkbox("Wide Queries", &s_settings.m_enableWideQueries);
 
 				ImGui::Separator();
 
@@ -390,6 +415,23 @@ static void UpdateUI()
 				ImGui::Checkbox("Profile", &s_settings.m_drawProfile);
 
 				ImVec2 button_sz = ImVec2(-1, 0);
+
+#ifdef B2_PROFILER
+				bool trace = s_profiler.IsEnabled();
+				if (ImGui::Checkbox("Trace Worst Steps", &trace))
+				{
+					s_profiler.Clear();
+					s_profiler.SetWorstFrameCount(10);
+					s_profiler.SetEnabled(trace);
+					s_settings.m_profiler = &s_profiler;
+				}
+
+				if (ImGui::Button("Save Trace", button_sz))
+				{
+					SaveTrace();
+				}
+#endif
+
 				if (ImGui::Button("Pause (P)", button_sz))
 				{
 					s_settings.m_pause = !s_settings.m_pause;
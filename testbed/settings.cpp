@@ -75,7 +75,10 @@ void Settings::Save()
 	fprintf(file, "  \"drawProfile\": %s,\n", m_drawProfile ? "true" : "false");
 	fprintf(file, "  \"enableWarmStarting\": %s,\n", m_enableWarmStarting ? "true" : "false");
 	fprintf(file, "  \"enableContinuous\": %s,\n", m_enableContinuous ? "true" : "false");
+	fprintf(file, "  \"enableSpeculative\": %s,\n", m_enableSpeculative ? "true" : "false");
 	fprintf(file, "  \"enableSubStepping\": %s,\n", m_enableSubStepping ? "true" : "false");
+	fprintf(file, "  \"enableWideSolver\": %s,\n", m_enableWideSolver ? "true" : "false");
+	fprintf(file, "  \"enableWideQueries\": %s,\n", m_enableWideQueries ? "true" : "false");
 	fprintf(file, "  \"enableSleep\": %s\n", m_enableSleep ? "true" : "false");
 	fprintf(file, "}\n");
 	fclose(file);
@@ -22,6 +22,8 @@
 
 #pragma once
 
+class b2Profiler;
+
 struct Settings
 {
 	Settings()
@@ -49,10 +51,14 @@ struct Settings
 		m_drawProfile = false;
 		m_enableWarmStarting = true;
 		m_enableContinuous = true;
+		m_enableSpeculative = false;
 		m_enableSubStepping = false;
+		m_enableWideSolver = false;
+		m_enableWideQueries = false;
 		m_enableSleep = true;
 		m_pause = false;
 		m_singleStep = false;
+		m_profiler = nullptr;
 	}
 
 	void Save();
@@ -76,8 +82,14 @@ struct Settings
 	bool m_drawProfile;
 	bool m_enableWarmStarting;
 	bool m_enableContinuous;
+	bool m_enableSpeculative;
 	bool m_enableSubStepping;
+	bool m_enableWideSolver;
+	bool m_enableWideQueries;
 	bool m_enableSleep;
 	bool m_pause;
 	bool m_singleStep;
+
+	// Attached to the world of the test. This is not saved.
+	b2Profiler* m_profiler;
 };
@@ -304,7 +304,11 @@ void Test::Step(Settings& settings)
 	m_world->SetAllowSleeping(settings.m_enableSleep);
 	m_world->SetWarmStarting(settings.m_enableWarmStarting);
 	m_world->SetContinuousPhysics(settings.m_enableContinuous);
+	m_world->SetSpeculativeContacts(settings.m_enableSpeculative);
 	m_world->SetSubStepping(settings.m_enableSubStepping);
+	m_world->SetWideSolver(settings.m_enableWideSolver);
+	m_world->SetWideQueries(settings.m_enableWideQueries);
+	m_world->SetProfiler(settings.m_profiler);
 
 	m_pointCount = 0;
 
@@ -332,6 +336,27 @@ void Test::Step(Settings& settings)
 		float quality = m_world->GetTreeQuality();
 		g_debugDraw.DrawString(5, m_textLine, "proxies/height/balance/quality = %d/%d/%d/%g", proxyCount, height, balance, quality);
 		m_textLine += m_textIncrement;
+
+		const b2StepStats& stats = m_world->GetStepStats();
+		g_debugDraw.DrawString(5, m_textLine, "contacts created/destroyed/touching = %d/%d/%d",
+			stats.contactsCreated, stats.contactsDestroyed, stats.touchingContacts);
+		m_textLine += m_textIncrement;
+
+		g_debugDraw.DrawString(5, m_textLine, "pairs tested/accepted = %d/%d, proxies moved = %d",
+			stats.pairsTested, stats.contactsCreated, stats.proxiesMoved);
+		m_textLine += m_textIncrement;
+
+		g_debugDraw.DrawString(5, m_textLine, "islands/largest = %d/%d, by size [1 2 4 8 16 32 64 128+] = [%d %d %d %d %d %d %d %d]",
+			stats.islands, stats.largestIsland, stats.islandSizes[0], stats.islandSizes[1], stats.islandSizes[2], stats.islandSizes[3],
+			stats.islandSizes[4], stats.islandSizes[5], stats.islandSizes[6], stats.islandSizes[7]);
+		m_textLine += m_textIncrement;
+
+		g_debugDraw.DrawString(5, m_textLine, "toi calls/events/max sub-steps = %d/%d/%d, toi/gjk iters = %d/%d",
+			stats.toiCalls, stats.toiEvents, stats.toiMaxSubSteps, stats.toiIterations, stats.gjkIterations);
+		m_textLine += m_textIncrement;
+
+		g_debugDraw.DrawString(5, m_textLine, "bodies awake/sleeping = %d/%d", stats.awakeBodies, stats.sleepingBodies);
+		m_textLine += m_textIncrement;
 	}
 
 	// Track maximum profile times
@@ -345,6 +370,7 @@ void Test::Step(Settings& settings)
 		m_maxProfile.solvePosition = b2Max(m_maxProfile.solvePosition, p.solvePosition);
 		m_maxProfile.solveTOI = b2Max(m_maxProfile.solveTOI, p.solveTOI);
 		m_maxProfile.broadphase = b2Max(m_maxProfile.broadphase, p.broadphase);
+		m_maxProfile.stackHeapFallbacks = b2Max(m_maxProfile.stackHeapFallbacks, p.stackHeapFallbacks);
 
 		m_totalProfile.step += p.step;
 		m_totalProfile.collide += p.collide;
@@ -391,6 +417,8 @@ void Test::Step(Settings& settings)
 		m_textLine += m_textIncrement;
 		g_debugDraw.DrawString(5, m_textLine, "broad-phase [ave] (max) = %5.2f [%6.2f] (%6.2f)", p.broadphase, aveProfile.broadphase, m_maxProfile.broadphase);
 		m_textLine += m_textIncrement;
+		g_debugDraw.DrawString(5, m_textLine, "stack heap fallbacks (max) = %d (%d)", p.stackHeapFallbacks, m_maxProfile.stackHeapFallbacks);
+		m_textLine += m_textIncrement;
 	}
 
 	if (m_bombSpawning)
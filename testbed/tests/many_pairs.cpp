@@ -0,0 +1,156 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "settings.h"
+#include "test.h"
+
+extern B2_API bool g_contactPairTable;
+
+/// This stresses contact pair lookup. All asteroids overlap the trigger zone of the
+/// boundary body, so that body has thousands of contacts. The broad-phase reports a
+/// pair with the larger proxy id second and the old lookup walked the contact list of
+/// that body. Static proxies live in the small static tree and get small ids, so the
+/// boundary is a kinematic body created last, which gives it the largest ids in the
+/// dynamic tree. Press T to switch between the pair table and the old walk.
+class ManyPairs : public Test
+{
+public:
+	enum
+	{
+		e_count = 2000
+	};
+
+	ManyPairs()
+	{
+		m_world->SetGravity(b2Vec2(0.0f, 0.0f));
+
+		{
+			b2CircleShape shape;
+			shape.m_radius = 0.25f;
+
+			for (int32 i = 0; i < e_count; ++i)
+			{
+				b2BodyDef bd;
+				bd.type = b2_dynamicBody;
+				bd.position.Set(RandomFloat(-24.0f, 24.0f), RandomFloat(1.0f, 49.0f));
+				bd.linearVelocity.Set(RandomFloat(-4.0f, 4.0f), RandomFloat(-4.0f, 4.0f));
+				b2Body* body = m_world->CreateBody(&bd);
+				body->CreateFixture(&shape, 1.0f);
+			}
+		}
+
+		{
+			b2BodyDef bd;
+			bd.type = b2_kinematicBody;
+			m_boundary = m_world->CreateBody(&bd);
+
+			b2Vec2 vs[4];
+			vs[0].Set(-25.0f, 0.0f);
+			vs[1].Set(25.0f, 0.0f);
+			vs[2].Set(25.0f, 50.0f);
+			vs[3].Set(-25.0f, 50.0f);
+			b2ChainShape loop;
+			loop.CreateLoop(vs, 4);
+			m_boundary->CreateFixture(&loop, 0.0f);
+
+			b2PolygonShape zone;
+			zone.SetAsBox(25.0f, 25.0f, b2Vec2(0.0f, 25.0f), 0.0f);
+
+			b2FixtureDef fd;
+			fd.shape = &zone;
+			fd.isSensor = true;
+			m_boundary->CreateFixture(&fd);
+		}
+
+		ResetTimes();
+	}
+
+	void ResetTimes()
+	{
+		m_broadphaseTime = 0.0f;
+		m_findPairsTime = 0.0f;
+		m_updatePairsTime = 0.0f;
+		m_pairCount = 0;
+		m_sampleCount = 0;
+	}
+
+	void Keyboard(int key) override
+	{
+		switch (key)
+		{
+		case GLFW_KEY_T:
+			g_contactPairTable = !g_contactPairTable;
+			ResetTimes();
+			break;
+		}
+	}
+
+	void Step(Settings& settings) override
+	{
+		bool advance = settings.m_pause == false || settings.m_singleStep;
+
+		Test::Step(settings);
+
+		if (advance)
+		{
+			const b2Profile& profile = m_world->GetProfile();
+			m_broadphaseTime += profile.broadphase;
+			m_findPairsTime += profile.findPairs;
+			m_updatePairsTime += profile.updatePairs;
+			m_pairCount += m_world->GetStepStats().pairsTested;
+			++m_sampleCount;
+		}
+
+		int32 boundaryContactCount = 0;
+		for (b2ContactEdge* ce = m_boundary->GetContactList(); ce; ce = ce->next)
+		{
+			++boundaryContactCount;
+		}
+
+		// Each new pair is looked up once. The lookups are timed with the contact
+		// creation, but separately from the tree queries.
+		float scale = m_sampleCount > 0 ? 1.0f / m_sampleCount : 0.0f;
+		g_debugDraw.DrawString(5, m_textLine, "lookup = %s (T to toggle)",
+			g_contactPairTable ? "pair table" : "contact list walk");
+		m_textLine += m_textIncrement;
+		g_debugDraw.DrawString(5, m_textLine, "boundary contacts = %d, pair lookups per step = %.0f",
+			boundaryContactCount, scale * m_pairCount);
+		m_textLine += m_textIncrement;
+		g_debugDraw.DrawString(5, m_textLine, "average: tree queries = %6.2f ms, pair lookups = %6.2f ms, broad-phase = %6.2f ms",
+			scale * m_findPairsTime, scale * m_updatePairsTime, scale * m_broadphaseTime);
+		m_textLine += m_textIncrement;
+	}
+
+	static Test* Create()
+	{
+		return new ManyPairs;
+	}
+
+	b2Body* m_boundary;
+	float m_broadphaseTime;
+	float m_findPairsTime;
+	float m_updatePairsTime;
+	int32 m_pairCount;
+	int32 m_sampleCount;
+};
+
+static int testIndex = RegisterTest("Benchmark", "Many Pairs", ManyPairs::Create);
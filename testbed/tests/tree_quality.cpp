@@ -0,0 +1,164 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "settings.h"
+#include "test.h"
+
+/// This measures the quality of the dynamic tree after incremental insertion and after
+/// a rebuild. Press F for a full rebuild, P for a partial rebuild, M to move some
+/// proxies and R to recreate the tree by incremental insertion.
+class TreeQuality : public Test
+{
+public:
+	enum
+	{
+		e_proxyCount = 10000,
+		e_queryCount = 1000
+	};
+
+	TreeQuality()
+	{
+		m_worldExtent = 200.0f;
+		m_rebuildTime = 0.0f;
+		Reset();
+	}
+
+	~TreeQuality()
+	{
+		DestroyProxies();
+	}
+
+	void DestroyProxies()
+	{
+		for (int32 i = 0; i < e_proxyCount; ++i)
+		{
+			m_tree.DestroyProxy(m_proxyIds[i]);
+		}
+	}
+
+	void GetRandomAABB(b2AABB* aabb)
+	{
+		b2Vec2 w(RandomFloat(0.2f, 2.0f), RandomFloat(0.2f, 2.0f));
+		aabb->lowerBound.x = RandomFloat(-m_worldExtent, m_worldExtent);
+		aabb->lowerBound.y = RandomFloat(0.0f, 2.0f * m_worldExtent);
+		aabb->upperBound = aabb->lowerBound + w;
+	}
+
+	void Reset()
+	{
+		srand(888);
+
+		b2Timer timer;
+		for (int32 i = 0; i < e_proxyCount; ++i)
+		{
+			GetRandomAABB(m_aabbs + i);
+			m_proxyIds[i] = m_tree.CreateProxy(m_aabbs[i], nullptr);
+		}
+		m_buildTime = timer.GetMilliseconds();
+	}
+
+	void Move()
+	{
+		for (int32 i = 0; i < e_proxyCount / 10; ++i)
+		{
+			int32 index = rand() % e_proxyCount;
+			GetRandomAABB(m_aabbs + index);
+			m_tree.MoveProxy(m_proxyIds[index], m_aabbs[index], b2Vec2_zero);
+		}
+	}
+
+	void Keyboard(int key) override
+	{
+		switch (key)
+		{
+		case GLFW_KEY_F:
+		case GLFW_KEY_P:
+			{
+				b2Timer timer;
+				m_tree.Rebuild(key == GLFW_KEY_F);
+				m_rebuildTime = timer.GetMilliseconds();
+			}
+			break;
+
+		case GLFW_KEY_M:
+			Move();
+			break;
+
+		case GLFW_KEY_R:
+			DestroyProxies();
+			Reset();
+			break;
+		}
+	}
+
+	bool QueryCallback(int32 proxyId)
+	{
+		B2_NOT_USED(proxyId);
+		++m_hitCount;
+		return true;
+	}
+
+	void Step(Settings& settings) override
+	{
+		B2_NOT_USED(settings);
+
+		// Query cost is dominated by the number of visited nodes, so it follows the area ratio.
+		m_hitCount = 0;
+		b2Timer timer;
+		for (int32 i = 0; i < e_queryCount; ++i)
+		{
+			b2AABB aabb;
+			aabb.lowerBound.Set(RandomFloat(-m_worldExtent, m_worldExtent), RandomFloat(0.0f, 2.0f * m_worldExtent));
+			aabb.upperBound = aabb.lowerBound + b2Vec2(4.0f, 4.0f);
+			m_tree.Query(this, aabb);
+		}
+		float queryTime = timer.GetMilliseconds();
+
+		g_debugDraw.DrawString(5, m_textLine, "Keys: (f) full rebuild, (p) partial rebuild, (m) move, (r) reset");
+		m_textLine += m_textIncrement;
+
+		g_debugDraw.DrawString(5, m_textLine, "proxies = %d, height = %d, max balance = %d, area ratio = %.1f",
+			int32(e_proxyCount), m_tree.GetHeight(), m_tree.GetMaxBalance(), m_tree.GetAreaRatio());
+		m_textLine += m_textIncrement;
+
+		g_debugDraw.DrawString(5, m_textLine, "%d queries = %.3f ms, hits = %d", int32(e_queryCount), queryTime, m_hitCount);
+		m_textLine += m_textIncrement;
+
+		g_debugDraw.DrawString(5, m_textLine, "incremental build = %.2f ms, last rebuild = %.2f ms", m_buildTime, m_rebuildTime);
+		m_textLine += m_textIncrement;
+	}
+
+	static Test* Create()
+	{
+		return new TreeQuality;
+	}
+
+	float m_worldExtent;
+	b2DynamicTree m_tree;
+	b2AABB m_aabbs[e_proxyCount];
+	int32 m_proxyIds[e_proxyCount];
+	int32 m_hitCount;
+	float m_buildTime;
+	float m_rebuildTime;
+};
+
+static int testIndex = RegisterTest("Benchmark", "Tree Quality", TreeQuality::Create);
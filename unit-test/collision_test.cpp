@@ -23,6 +23,7 @@
 #include "box2d/box2d.h"
 #include "doctest.h"
 #include <stdio.h>
+#include <stdlib.h>
 
 // Unit tests for collision algorithms
 DOCTEST_TEST_CASE("collision test")
@@ -79,3 +80,72 @@ DOCTEST_TEST_CASE("collision test")
 		CHECK(b2Abs(massData2.I - inertia) < 40.0f * (absTol + relTol * inertia));
 	}
 }
+
+struct TreeCallback
+{
+	bool QueryCallback(int32 proxyId)
+	{
+		B2_NOT_USED(proxyId);
+		++count;
+		return true;
+	}
+
+	float RayCastCallback(const b2RayCastInput& input, int32 proxyId)
+	{
+		b2RayCastOutput output;
+		if (tree->GetFatAABB(proxyId).RayCast(&output, input))
+		{
+			closest = output.fraction;
+			return output.fraction;
+		}
+		return input.maxFraction;
+	}
+
+	const b2DynamicTree* tree;
+	int32 count;
+	float closest;
+};
+
+// The wide tree must find the same proxies as the binary tree.
+DOCTEST_TEST_CASE("wide tree")
+{
+	b2DynamicTree tree;
+	srand(42);
+	for (int32 i = 0; i < 1000; ++i)
+	{
+		b2AABB aabb;
+		aabb.lowerBound.Set(-100.0f + 200.0f * rand() / RAND_MAX, -100.0f + 200.0f * rand() / RAND_MAX);
+		aabb.upperBound = aabb.lowerBound + b2Vec2(0.5f + 2.0f * rand() / RAND_MAX, 0.5f + 2.0f * rand() / RAND_MAX);
+		tree.CreateProxy(aabb, nullptr);
+	}
+
+	for (int32 i = 0; i < 100; ++i)
+	{
+		b2AABB aabb;
+		aabb.lowerBound.Set(-100.0f + 200.0f * rand() / RAND_MAX, -100.0f + 200.0f * rand() / RAND_MAX);
+		aabb.upperBound = aabb.lowerBound + b2Vec2(10.0f, 10.0f);
+
+		b2RayCastInput input;
+		input.p1.Set(-110.0f, -100.0f + 200.0f * rand() / RAND_MAX);
+		input.p2.Set(110.0f, -100.0f + 200.0f * rand() / RAND_MAX);
+		input.maxFraction = 1.0f;
+
+		TreeCallback binary = { &tree, 0, 1.0f };
+		tree.Query(&binary, aabb);
+		tree.RayCast(&binary, input);
+
+		tree.BuildWideTree();
+		CHECK(tree.IsWideTreeValid());
+
+		TreeCallback wide = { &tree, 0, 1.0f };
+		tree.Query(&wide, aabb);
+		tree.RayCast(&wide, input);
+
+		CHECK(wide.count == binary.count);
+		CHECK(wide.closest == binary.closest);
+
+		// Any change to the binary tree invalidates the wide tree.
+		tree.CreateProxy(aabb, nullptr);
+		CHECK(tree.IsWideTreeValid() == false);
+	}
+}
@@ -0,0 +1,266 @@
+// MIT License
+
+// Copyright (c) 2023 Erin Catto
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "box2d/box2d.h"
+#include "doctest.h"
+#include <stdint.h>
+
+extern B2_API bool g_wideSolverScalar;
+
+// Hashes world state over many steps and compares the hashes across configurations
+// that must give bit identical results in determinism mode.
+
+// FNV-1a
+static uint64_t HashBytes(uint64_t hash, const void* data, int32 size)
+{
+	const uint8* bytes = (const uint8*)data;
+	for (int32 i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static uint64_t HashWorld(const b2World* world)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const b2Body* body = world->GetBodyList(); body; body = body->GetNext())
+	{
+		b2Transform xf = body->GetTransform();
+		b2Vec2 v = body->GetLinearVelocity();
+		float w = body->GetAngularVelocity();
+		uint8 awake = body->IsAwake() ? 1 : 0;
+		hash = HashBytes(hash, &xf, sizeof(xf));
+		hash = HashBytes(hash, &v, sizeof(v));
+		hash = HashBytes(hash, &w, sizeof(w));
+		hash = HashBytes(hash, &awake, sizeof(awake));
+	}
+	return hash;
+}
+
+struct DeterminismConfig
+{
+	// Zero runs without a task system.
+	int32 workerCount;
+
+	// Churn the broad-phase and the body arrays before and while building the scene so
+	// that proxy ids, state indices and contact creation order differ.
+	bool history;
+
+	bool wideSolver;
+};
+
+static b2Body* CreateBox(b2World* world, b2BodyType type, const b2Vec2& position, float hx, float hy)
+{
+	b2BodyDef bd;
+	bd.type = type;
+	bd.position = position;
+	b2Body* body = world->CreateBody(&bd);
+
+	b2PolygonShape box;
+	box.SetAsBox(hx, hy);
+	body->CreateFixture(&box, 1.0f);
+	return body;
+}
+
+static void BuildDeterminismScene(b2World* world, bool history)
+{
+	b2Body* dummies[256];
+	int32 dummyCount = 0;
+
+	// Bodies that only exist to change the layout of the broad-phase and the arrays.
+	if (history)
+	{
+		for (int32 i = 0; i < 64; ++i)
+		{
+			dummies[dummyCount++] = CreateBox(world, b2_dynamicBody, b2Vec2(-200.0f + 3.0f * i, 100.0f), 0.5f, 0.5f);
+		}
+
+		world->Step(1.0f / 60.0f, 8, 3);
+
+		for (int32 i = 0; i < dummyCount; i += 2)
+		{
+			world->DestroyBody(dummies[i]);
+		}
+	}
+
+	b2BodyDef groundDef;
+	b2Body* ground = world->CreateBody(&groundDef);
+
+	b2EdgeShape edge;
+	edge.SetTwoSided(b2Vec2(-60.0f, 0.0f), b2Vec2(60.0f, 0.0f));
+	ground->CreateFixture(&edge, 0.0f);
+
+	b2Vec2 vertices[4] = { b2Vec2(60.0f, 20.0f), b2Vec2(40.0f, 0.5f), b2Vec2(-40.0f, 0.5f), b2Vec2(-60.0f, 20.0f) };
+	b2ChainShape chain;
+	chain.CreateChain(vertices, 4, b2Vec2(70.0f, 20.0f), b2Vec2(-70.0f, 20.0f));
+	ground->CreateFixture(&chain, 0.0f);
+
+	// Pyramid. With history every other box is followed by a body that is destroyed
+	// again, so the scene bodies keep their relative creation order.
+	for (int32 row = 0; row < 12; ++row)
+	{
+		for (int32 column = 0; column < 12 - row; ++column)
+		{
+			b2Vec2 position(-30.0f + 1.05f * column + 0.525f * row, 0.5f + 1.0f * row);
+			CreateBox(world, b2_dynamicBody, position, 0.5f, 0.5f);
+
+			if (history && (column & 1) == 0 && dummyCount < 256)
+			{
+				dummies[dummyCount++] = CreateBox(world, b2_dynamicBody, position + b2Vec2(0.0f, 50.0f), 0.25f, 0.25f);
+			}
+		}
+	}
+
+	// Bridge.
+	b2Body* prev = CreateBox(world, b2_staticBody, b2Vec2(0.0f, 8.0f), 0.25f, 0.25f);
+	for (int32 i = 0; i < 20; ++i)
+	{
+		b2Body* plank = CreateBox(world, b2_dynamicBody, b2Vec2(0.5f + i, 8.0f), 0.5f, 0.125f);
+
+		b2RevoluteJointDef jd;
+		jd.Initialize(prev, plank, b2Vec2(float(i), 8.0f));
+		world->CreateJoint(&jd);
+		prev = plank;
+	}
+
+	b2RevoluteJointDef jd;
+	jd.Initialize(prev, ground, b2Vec2(20.0f, 8.0f));
+	world->CreateJoint(&jd);
+
+	// Fast bullets that need time of impact events.
+	b2CircleShape circle;
+	circle.m_radius = 0.1f;
+	for (int32 i = 0; i < 8; ++i)
+	{
+		b2BodyDef bd;
+		bd.type = b2_dynamicBody;
+		bd.bullet = true;
+		bd.position.Set(-50.0f + 2.0f * i, 12.0f + i);
+		bd.linearVelocity.Set(120.0f, -20.0f);
+		b2Body* body = world->CreateBody(&bd);
+		body->CreateFixture(&circle, 5.0f);
+	}
+
+	if (history)
+	{
+		for (int32 i = 1; i < dummyCount; ++i)
+		{
+			if (i >= 64 || (i & 1) == 1)
+			{
+				world->DestroyBody(dummies[i]);
+			}
+		}
+	}
+}
+
+static void RunDeterminism(const DeterminismConfig& config, uint64_t* hashes, int32 hashCount, int32 stepsPerHash)
+{
+	b2ThreadPool threadPool(config.workerCount);
+
+	b2World world(b2Vec2(0.0f, -10.0f));
+	world.SetDeterministic(true);
+	world.SetWideSolver(config.wideSolver);
+	if (config.workerCount > 0)
+	{
+		world.SetTaskSystem(&threadPool);
+	}
+
+	BuildDeterminismScene(&world, config.history);
+
+	for (int32 i = 0; i < hashCount; ++i)
+	{
+		for (int32 j = 0; j < stepsPerHash; ++j)
+		{
+			world.Step(1.0f / 60.0f, 8, 3);
+		}
+
+		hashes[i] = HashWorld(&world);
+	}
+
+	world.SetTaskSystem(nullptr);
+}
+
+DOCTEST_TEST_CASE("determinism")
+{
+	const int32 hashCount = 20;
+	const int32 stepsPerHash = 100;
+
+	for (int32 wide = 0; wide < 2; ++wide)
+	{
+		DeterminismConfig reference = { 0, false, wide == 1 };
+		uint64_t expected[hashCount];
+		RunDeterminism(reference, expected, hashCount, stepsPerHash);
+
+		// The scene must not come to rest early, or the comparison says little.
+		CHECK(expected[0] != expected[1]);
+
+		DeterminismConfig configs[] =
+		{
+			{ 0, true, wide == 1 },
+			{ 1, false, wide == 1 },
+			{ 2, true, wide == 1 },
+			{ 4, false, wide == 1 },
+			{ 8, true, wide == 1 },
+		};
+
+		for (const DeterminismConfig& config : configs)
+		{
+			uint64_t actual[hashCount];
+			RunDeterminism(config, actual, hashCount, stepsPerHash);
+
+			for (int32 i = 0; i < hashCount; ++i)
+			{
+				INFO("workers ", config.workerCount, " history ", config.history, " wide ", wide, " hash ", i);
+				CHECK(actual[i] == expected[i]);
+				if (actual[i] != expected[i])
+				{
+					break;
+				}
+			}
+		}
+	}
+}
+
+DOCTEST_TEST_CASE("wide solver scalar fallback")
+{
+	const int32 hashCount = 20;
+	const int32 stepsPerHash = 100;
+
+	// The scalar implementation of the wide float operations is what B2_SIMD_NONE
+	// builds use. It must match the SIMD implementation bit for bit.
+	DeterminismConfig config = { 2, false, true };
+	uint64_t expected[hashCount];
+	RunDeterminism(config, expected, hashCount, stepsPerHash);
+
+	g_wideSolverScalar = true;
+	uint64_t actual[hashCount];
+	RunDeterminism(config, actual, hashCount, stepsPerHash);
+	g_wideSolverScalar = false;
+
+	CHECK(expected[0] != expected[1]);
+	for (int32 i = 0; i < hashCount; ++i)
+	{
+		INFO("hash ", i);
+		CHECK(actual[i] == expected[i]);
+	}
+}
@@ -22,7 +22,9 @@
 
 #include "box2d/box2d.h"
 #include "doctest.h"
+#include <atomic>
 #include <stdio.h>
+#include <string.h>
 
 static bool begin_contact = false;
 
@@ -71,3 +73,1238 @@ DOCTEST_TEST_CASE("begin contact")
 	CHECK(world.GetContactList() != nullptr);
 	CHECK(begin_contact == true);
 }
+
+class EventListener : public b2ContactListener
+{
+public:
+	EventListener() : beginCount(0), endCount(0), preSolveCount(0), count(0), impulse(0.0f) {}
+
+	void BeginContact(b2Contact* contact) override
+	{
+		B2_NOT_USED(contact);
+		beginCount += 1;
+	}
+
+	void EndContact(b2Contact* contact) override
+	{
+		B2_NOT_USED(contact);
+		endCount += 1;
+	}
+
+	void PreSolve(b2Contact* contact, const b2Manifold* oldManifold) override
+	{
+		B2_NOT_USED(contact);
+		B2_NOT_USED(oldManifold);
+		preSolveCount += 1;
+	}
+
+	void PostSolve(b2Contact* contact, const b2ContactImpulse* contactImpulse) override
+	{
+		B2_NOT_USED(contact);
+		count += 1;
+		for (int32 i = 0; i < contactImpulse->count; ++i)
+		{
+			// Order dependent so that the report order is checked too.
+			impulse = 0.5f * impulse + contactImpulse->normalImpulses[i];
+		}
+	}
+
+	int32 beginCount;
+	int32 endCount;
+	int32 preSolveCount;
+	int32 count;
+	float impulse;
+};
+
+// Stacks and chains on a shared ground give many islands that touch the same static body.
+static void BuildIslandScene(b2World* world)
+{
+	b2BodyDef groundDef;
+	b2Body* ground = world->CreateBody(&groundDef);
+
+	b2EdgeShape edge;
+	edge.SetTwoSided(b2Vec2(-100.0f, 0.0f), b2Vec2(100.0f, 0.0f));
+	ground->CreateFixture(&edge, 0.0f);
+
+	b2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+
+	for (int32 i = 0; i < 16; ++i)
+	{
+		float x = -80.0f + 10.0f * i;
+		for (int32 j = 0; j < 5; ++j)
+		{
+			b2BodyDef bd;
+			bd.type = b2_dynamicBody;
+			bd.position.Set(x + 0.05f * j, 0.5f + 1.05f * j);
+			b2Body* body = world->CreateBody(&bd);
+			body->CreateFixture(&box, 1.0f);
+		}
+
+		b2Body* prev = ground;
+		for (int32 j = 0; j < 4; ++j)
+		{
+			b2BodyDef bd;
+			bd.type = b2_dynamicBody;
+			bd.position.Set(x + 4.0f + j, 10.0f);
+			b2Body* body = world->CreateBody(&bd);
+			body->CreateFixture(&box, 1.0f);
+
+			b2RevoluteJointDef jd;
+			jd.Initialize(prev, body, b2Vec2(x + 3.5f + j, 10.0f));
+			world->CreateJoint(&jd);
+			prev = body;
+		}
+	}
+}
+
+DOCTEST_TEST_CASE("parallel islands")
+{
+	b2World serialWorld(b2Vec2(0.0f, -10.0f));
+	b2World parallelWorld(b2Vec2(0.0f, -10.0f));
+
+	EventListener serialListener;
+	EventListener parallelListener;
+	serialWorld.SetContactListener(&serialListener);
+	parallelWorld.SetContactListener(&parallelListener);
+
+	b2ThreadPool threadPool(4);
+	parallelWorld.SetTaskSystem(&threadPool);
+
+	BuildIslandScene(&serialWorld);
+	BuildIslandScene(&parallelWorld);
+
+	for (int32 i = 0; i < 240; ++i)
+	{
+		serialWorld.Step(1.0f / 60.0f, 8, 3);
+		parallelWorld.Step(1.0f / 60.0f, 8, 3);
+	}
+
+	CHECK(serialListener.beginCount == parallelListener.beginCount);
+	CHECK(serialListener.endCount == parallelListener.endCount);
+	CHECK(serialListener.preSolveCount == parallelListener.preSolveCount);
+	CHECK(serialListener.count > 0);
+	CHECK(serialListener.count == parallelListener.count);
+	CHECK(serialListener.impulse == parallelListener.impulse);
+
+	const b2Body* b1 = serialWorld.GetBodyList();
+	const b2Body* b2 = parallelWorld.GetBodyList();
+	while (b1 && b2)
+	{
+		CHECK(b1->GetPosition() == b2->GetPosition());
+		CHECK(b1->GetAngle() == b2->GetAngle());
+		CHECK(b1->IsAwake() == b2->IsAwake());
+		b1 = b1->GetNext();
+		b2 = b2->GetNext();
+	}
+
+	CHECK(b1 == nullptr);
+	CHECK(b2 == nullptr);
+
+	parallelWorld.SetTaskSystem(nullptr);
+}
+
+DOCTEST_TEST_CASE("wide solver")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+	world.SetWideSolver(true);
+	CHECK(world.GetWideSolver());
+
+	BuildIslandScene(&world);
+
+	for (int32 i = 0; i < 600; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+
+	// The stacks must come to rest without tipping over.
+	for (const b2Body* body = world.GetBodyList(); body; body = body->GetNext())
+	{
+		if (body->GetType() != b2_dynamicBody || body->GetJointList() != nullptr)
+		{
+			continue;
+		}
+
+		CHECK(body->IsAwake() == false);
+		CHECK(body->GetPosition().y < 5.0f);
+		CHECK(b2Abs(body->GetAngle()) < 0.1f);
+	}
+}
+
+DOCTEST_TEST_CASE("island split")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+
+	b2BodyDef groundDef;
+	b2Body* ground = world.CreateBody(&groundDef);
+
+	b2EdgeShape edge;
+	edge.SetTwoSided(b2Vec2(-20.0f, 0.0f), b2Vec2(20.0f, 0.0f));
+	ground->CreateFixture(&edge, 0.0f);
+
+	b2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+
+	// A box resting on the ground.
+	b2BodyDef bd;
+	bd.type = b2_dynamicBody;
+	bd.position.Set(0.0f, 0.5f);
+	b2Body* rest = world.CreateBody(&bd);
+	rest->CreateFixture(&box, 1.0f);
+
+	// A pendulum that keeps swinging.
+	bd.position.Set(10.0f, 10.0f);
+	b2Body* pendulum = world.CreateBody(&bd);
+	pendulum->CreateFixture(&box, 1.0f);
+
+	b2RevoluteJointDef pivotDef;
+	pivotDef.Initialize(ground, pendulum, b2Vec2(5.0f, 10.0f));
+	world.CreateJoint(&pivotDef);
+
+	// Tie the box to the pendulum so they share an island.
+	b2DistanceJointDef tieDef;
+	tieDef.Initialize(rest, pendulum, rest->GetPosition(), pendulum->GetPosition());
+	tieDef.minLength = 0.0f;
+	tieDef.maxLength = 100.0f;
+	b2Joint* tie = world.CreateJoint(&tieDef);
+
+	for (int32 i = 0; i < 10; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+
+	world.DestroyJoint(tie);
+
+	for (int32 i = 0; i < 120; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+
+	// The box must not be kept awake by the pendulum.
+	CHECK(rest->IsAwake() == false);
+	CHECK(pendulum->IsAwake() == true);
+}
+
+DOCTEST_TEST_CASE("batched bodies")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+
+	b2BodyDef groundDef;
+	b2Body* ground = world.CreateBody(&groundDef);
+
+	b2EdgeShape edge;
+	edge.SetTwoSided(b2Vec2(-40.0f, 0.0f), b2Vec2(40.0f, 0.0f));
+	ground->CreateFixture(&edge, 0.0f);
+
+	b2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+
+	const int32 count = 400;
+	b2BodyDef bodyDefs[count];
+	b2FixtureDef fixtureDefs[count];
+	b2Body* bodies[count];
+	for (int32 i = 0; i < count; ++i)
+	{
+		bodyDefs[i].type = b2_dynamicBody;
+		bodyDefs[i].position.Set(-30.0f + 1.5f * (i % 40), 0.5f + 1.2f * (i / 40));
+		fixtureDefs[i].shape = &box;
+		fixtureDefs[i].density = 1.0f;
+	}
+
+	world.CreateBodies(bodyDefs, fixtureDefs, count, bodies);
+	CHECK(world.GetBodyCount() == count + 1);
+	CHECK(world.GetProxyCount() == count + 1);
+	CHECK(bodies[0]->GetMass() > 0.0f);
+	CHECK(bodies[count - 1]->GetFixtureList()->GetBody() == bodies[count - 1]);
+
+	for (int32 i = 0; i < 60; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+
+	// The bottom row rests on the ground.
+	CHECK(world.GetContactCount() >= 40);
+	CHECK(bodies[0]->GetPosition().y > 0.0f);
+
+	// Destroy every other body.
+	b2Body* destroyed[count / 2];
+	for (int32 i = 0; i < count / 2; ++i)
+	{
+		destroyed[i] = bodies[2 * i];
+	}
+
+	world.DestroyBodies(destroyed, count / 2);
+	CHECK(world.GetBodyCount() == count / 2 + 1);
+	CHECK(world.GetProxyCount() == count / 2 + 1);
+
+	for (int32 i = 0; i < 60; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+
+	CHECK(bodies[1]->GetPosition().y > 0.0f);
+	CHECK(world.GetTreeHeight() < 20);
+}
+
+DOCTEST_TEST_CASE("static broad-phase tree")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+
+	b2BodyDef groundDef;
+	b2Body* ground = world.CreateBody(&groundDef);
+
+	b2EdgeShape edge;
+	edge.SetTwoSided(b2Vec2(-20.0f, 0.0f), b2Vec2(20.0f, 0.0f));
+	ground->CreateFixture(&edge, 0.0f);
+
+	b2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+
+	b2BodyDef bodyDef;
+	bodyDef.type = b2_dynamicBody;
+	bodyDef.position.Set(0.0f, 0.5f);
+	b2Body* body = world.CreateBody(&bodyDef);
+	body->CreateFixture(&box, 1.0f);
+
+	bodyDef.type = b2_staticBody;
+	bodyDef.position.Set(0.5f, 0.55f);
+	b2Body* block = world.CreateBody(&bodyDef);
+	block->CreateFixture(&box, 0.0f);
+
+	const b2BroadPhase& broadPhase = world.GetContactManager().m_broadPhase;
+	const b2DynamicTree& staticTree = broadPhase.GetTree(b2BroadPhase::e_staticTree);
+	const b2DynamicTree& dynamicTree = broadPhase.GetTree(b2BroadPhase::e_dynamicTree);
+	CHECK(staticTree.GetHeight() == 1);
+	CHECK(dynamicTree.GetHeight() == 0);
+
+	// The block overlaps the ground but static pairs are never reported.
+	world.Step(1.0f / 60.0f, 8, 3);
+	CHECK(world.GetContactCount() == 2);
+
+	// Changing the type moves the proxies between trees.
+	block->SetType(b2_dynamicBody);
+	CHECK(staticTree.GetHeight() == 0);
+	CHECK(dynamicTree.GetHeight() == 1);
+	CHECK(world.GetProxyCount() == 3);
+
+	world.Step(1.0f / 60.0f, 8, 3);
+	CHECK(world.GetContactCount() == 3);
+
+	block->SetType(b2_staticBody);
+	CHECK(staticTree.GetHeight() == 1);
+
+	world.Step(1.0f / 60.0f, 8, 3);
+	CHECK(world.GetContactCount() == 2);
+}
+
+class ClosestRayCallback : public b2RayCastCallback
+{
+public:
+	ClosestRayCallback()
+	{
+		fixture = nullptr;
+		fraction = 1.0f;
+	}
+
+	float ReportFixture(b2Fixture* fixtureIn, const b2Vec2& point, const b2Vec2& normal, float fractionIn) override
+	{
+		B2_NOT_USED(point);
+		B2_NOT_USED(normal);
+		fixture = fixtureIn;
+		fraction = fractionIn;
+		return fractionIn;
+	}
+
+	b2Fixture* fixture;
+	float fraction;
+};
+
+DOCTEST_TEST_CASE("ray cast batch")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+	BuildIslandScene(&world);
+
+	for (int32 i = 0; i < 30; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+
+	// Fans of rays like a lidar sensor.
+	const int32 count = 8 * 64;
+	b2RayInput inputs[count];
+	b2RayResult results[count];
+	for (int32 i = 0; i < count; ++i)
+	{
+		float angle = 2.0f * b2_pi * (i % 64) / 64.0f;
+		b2Vec2 origin(-75.0f + 20.0f * (i / 64), 3.0f);
+		inputs[i].p1 = origin;
+		inputs[i].p2 = origin + 15.0f * b2Vec2(cosf(angle), sinf(angle));
+	}
+
+	world.RayCastBatch(inputs, count, results);
+
+	int32 hitCount = 0;
+	for (int32 i = 0; i < count; ++i)
+	{
+		ClosestRayCallback callback;
+		world.RayCast(&callback, inputs[i].p1, inputs[i].p2);
+		CHECK(results[i].fixture == callback.fixture);
+		CHECK(results[i].fraction == callback.fraction);
+		hitCount += callback.fixture != nullptr ? 1 : 0;
+	}
+
+	CHECK(hitCount > 0);
+
+	// The mask filters fixtures by category.
+	inputs[0].maskBits = 0;
+	world.RayCastBatch(inputs, 1, results);
+	CHECK(results[0].fixture == nullptr);
+}
+
+class CollectQueryCallback : public b2QueryCallback
+{
+public:
+	CollectQueryCallback()
+	{
+		count = 0;
+	}
+
+	bool ReportFixture(b2Fixture* fixture) override
+	{
+		if (count < 64)
+		{
+			fixtures[count] = fixture;
+		}
+		++count;
+		return true;
+	}
+
+	b2Fixture* fixtures[64];
+	int32 count;
+};
+
+DOCTEST_TEST_CASE("query aabb batch")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+	BuildIslandScene(&world);
+
+	for (int32 i = 0; i < 30; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+
+	const int32 count = 32;
+	b2AABB aabbs[count];
+	for (int32 i = 0; i < count; ++i)
+	{
+		b2Vec2 center(-80.0f + 5.0f * i, 1.0f);
+		b2Vec2 extents(1.5f, 1.5f);
+		aabbs[i].lowerBound = center - extents;
+		aabbs[i].upperBound = center + extents;
+	}
+
+	const int32 capacity = 1024;
+	b2QueryResult results[capacity];
+	int32 resultCount = world.QueryAABBBatch(aabbs, count, results, capacity);
+	CHECK(resultCount > 0);
+	CHECK(resultCount <= capacity);
+
+	// The batch reports the same fixtures in the same order as single queries.
+	int32 index = 0;
+	for (int32 i = 0; i < count; ++i)
+	{
+		CollectQueryCallback callback;
+		world.QueryAABB(&callback, aabbs[i]);
+		REQUIRE(callback.count <= 64);
+		for (int32 j = 0; j < callback.count; ++j)
+		{
+			REQUIRE(index < resultCount);
+			CHECK(results[index].queryIndex == i);
+			CHECK(results[index].fixture == callback.fixtures[j]);
+			++index;
+		}
+	}
+	CHECK(index == resultCount);
+
+	// The exact test keeps a subset of the overlaps.
+	int32 exactCount = world.QueryAABBBatch(aabbs, count, results, capacity, true);
+	CHECK(exactCount > 0);
+	CHECK(exactCount <= resultCount);
+
+	// Truncated results still report the full count.
+	CHECK(world.QueryAABBBatch(aabbs, count, results, 4) == resultCount);
+
+	// The scratch memory is kept, so repeating the batch does not allocate.
+	int32 totalBytes = world.GetMemoryStats().totalBytes;
+	world.QueryAABBBatch(aabbs, count, results, capacity);
+	CHECK(world.GetMemoryStats().totalBytes == totalBytes);
+}
+
+DOCTEST_TEST_CASE("shape cast and overlap")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+
+	b2BodyDef groundDef;
+	b2Body* ground = world.CreateBody(&groundDef);
+	b2EdgeShape edge;
+	edge.SetTwoSided(b2Vec2(-20.0f, 0.0f), b2Vec2(20.0f, 0.0f));
+	ground->CreateFixture(&edge, 0.0f);
+
+	b2BodyDef boxDef;
+	boxDef.position.Set(5.0f, 1.0f);
+	b2Body* boxBody = world.CreateBody(&boxDef);
+	b2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+	b2Fixture* boxFixture = boxBody->CreateFixture(&box, 0.0f);
+
+	b2CircleShape circle;
+	circle.m_radius = 0.5f;
+
+	b2Transform transform;
+	transform.Set(b2Vec2(0.0f, 1.0f), 0.0f);
+
+	b2ShapeCastResult result;
+	bool hit = world.ShapeCast(&circle, transform, b2Vec2(10.0f, 0.0f), &result);
+	CHECK(hit);
+	CHECK(result.fixture == boxFixture);
+	CHECK(result.fraction == doctest::Approx(0.4f).epsilon(0.01f));
+	CHECK(result.normal.x == doctest::Approx(-1.0f));
+
+	// Filtered by the mask.
+	CHECK(world.ShapeCast(&circle, transform, b2Vec2(10.0f, 0.0f), &result, 0) == false);
+	CHECK(result.fixture == nullptr);
+
+	b2QueryResult overlaps[4];
+	transform.Set(b2Vec2(5.0f, 1.8f), 0.0f);
+	CHECK(world.OverlapShape(&circle, transform, overlaps, 4) == 1);
+	CHECK(overlaps[0].fixture == boxFixture);
+
+	transform.Set(b2Vec2(5.0f, 0.2f), 0.0f);
+	CHECK(world.OverlapShape(&circle, transform, overlaps, 4) == 2);
+	CHECK(world.OverlapShape(&circle, transform, overlaps, 4, 0) == 0);
+}
+
+DOCTEST_TEST_CASE("speculative contacts")
+{
+	b2World world(b2Vec2_zero);
+	world.SetContinuousPhysics(false);
+	world.SetSpeculativeContacts(true);
+	CHECK(world.GetSpeculativeContacts());
+
+	b2BodyDef wallDef;
+	wallDef.position.Set(10.0f, 0.0f);
+	b2Body* wall = world.CreateBody(&wallDef);
+	b2PolygonShape thin;
+	thin.SetAsBox(0.05f, 2.0f);
+	wall->CreateFixture(&thin, 0.0f);
+
+	b2BodyDef bulletDef;
+	bulletDef.type = b2_dynamicBody;
+	bulletDef.linearVelocity.Set(100.0f, 0.0f);
+	b2Body* bullet = world.CreateBody(&bulletDef);
+	b2CircleShape circle;
+	circle.m_radius = 0.1f;
+	bullet->CreateFixture(&circle, 1.0f);
+
+	int32 touchingSteps = 0;
+	for (int32 i = 0; i < 30; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+
+		for (b2Contact* c = world.GetContactList(); c; c = c->GetNext())
+		{
+			if (c->IsTouching())
+			{
+				++touchingSteps;
+			}
+		}
+	}
+
+	// Stopped at the wall instead of passing through it.
+	CHECK(bullet->GetPosition().x < 10.0f);
+	CHECK(bullet->GetPosition().x > 9.8f);
+	CHECK(bullet->GetLinearVelocity().x == doctest::Approx(0.0f));
+	CHECK(touchingSteps > 0);
+
+	// Without speculative contacts or continuous physics the bullet tunnels.
+	world.SetSpeculativeContacts(false);
+	bullet->SetTransform(b2Vec2_zero, 0.0f);
+	bullet->SetLinearVelocity(b2Vec2(100.0f, 0.0f));
+	for (int32 i = 0; i < 30; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+	CHECK(bullet->GetPosition().x > 10.0f);
+}
+
+DOCTEST_TEST_CASE("block allocator")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+
+	b2BlockAllocatorStats stats = world.GetBlockAllocatorStats();
+	int32 baseBytes = stats.liveBytes;
+
+	b2BodyDef bodyDef;
+	bodyDef.type = b2_dynamicBody;
+	b2Body* body = world.CreateBody(&bodyDef);
+	b2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+	body->CreateFixture(&box, 1.0f);
+
+	stats = world.GetBlockAllocatorStats();
+	CHECK(stats.liveBytes > baseBytes);
+	CHECK(stats.chunkCount > 0);
+	int32 peakBytes = stats.peakBytes;
+	CHECK(peakBytes >= stats.liveBytes);
+
+	int32 liveBlocks = 0;
+	for (int32 i = 0; i < b2_blockSizeCount; ++i)
+	{
+		liveBlocks += stats.liveBlocks[i];
+	}
+	CHECK(liveBlocks > 0);
+
+	world.DestroyBody(body);
+	stats = world.GetBlockAllocatorStats();
+	CHECK(stats.liveBytes == baseBytes);
+	CHECK(stats.peakBytes == peakBytes);
+
+	// A standalone allocator counts every size class.
+	b2BlockAllocator allocator;
+	void* blocks[256];
+	for (int32 i = 0; i < 256; ++i)
+	{
+		int32 size = 16 + 8 * (i % 64);
+		blocks[i] = allocator.Allocate(size);
+		memset(blocks[i], i, size);
+	}
+
+	stats = allocator.GetStats();
+	CHECK(stats.liveBlocks[0] == 4);
+	CHECK(stats.liveBlocks[b2_blockSizeCount - 1] == 4);
+
+	// No block was handed out twice.
+	int32 overwritten = 0;
+	for (int32 i = 0; i < 256; ++i)
+	{
+		const uint8* bytes = (const uint8*)blocks[i];
+		overwritten += bytes[0] != (uint8)i ? 1 : 0;
+	}
+	CHECK(overwritten == 0);
+
+	for (int32 i = 0; i < 256; ++i)
+	{
+		allocator.Free(blocks[i], 16 + 8 * (i % 64));
+	}
+
+	stats = allocator.GetStats();
+	CHECK(stats.liveBytes == 0);
+	CHECK(stats.liveBlocks[0] == 0);
+	CHECK(stats.liveBlocks[b2_blockSizeCount - 1] == 0);
+	CHECK(stats.peakBytes >= 256 * 16);
+}
+
+DOCTEST_TEST_CASE("stack growth")
+{
+	b2WorldDef def;
+	def.gravity.Set(0.0f, -10.0f);
+	def.stackCapacity = 1024;
+	b2World world(&def);
+	CHECK(world.GetStackCapacity() == 1024);
+	CHECK(world.GetStackGrowth());
+
+	BuildIslandScene(&world);
+
+	world.Step(1.0f / 60.0f, 8, 3);
+	CHECK(world.GetProfile().stackHeapFallbacks > 0);
+
+	// The stack grows before the next step.
+	world.Step(1.0f / 60.0f, 8, 3);
+	CHECK(world.GetProfile().stackHeapFallbacks == 0);
+
+	// Without growth a small stack keeps falling back to the heap.
+	world.SetStackGrowth(false);
+	world.SetStackCapacity(1024);
+	for (int32 i = 0; i < 4; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+		CHECK(world.GetProfile().stackHeapFallbacks > 0);
+	}
+	CHECK(world.GetStackCapacity() == 1024);
+}
+
+// Stores the size in front of each allocation to check the size given to Free. Task
+// workers allocate concurrently.
+class CountingAllocator : public b2Allocator
+{
+public:
+	void* Allocate(int32 size) override
+	{
+		byteCount += size;
+		int32* mem = (int32*)b2Alloc(size + 16);
+		mem[0] = size;
+		return (char*)mem + 16;
+	}
+
+	void Free(void* mem, int32 size) override
+	{
+		int32* header = (int32*)((char*)mem - 16);
+		CHECK(header[0] == size);
+		byteCount -= size;
+		b2Free(header);
+	}
+
+	std::atomic<int32> byteCount{ 0 };
+};
+
+class BudgetListener : public b2MemoryListener
+{
+public:
+	void OverBudget(int32 byteCount, int32 budget) override
+	{
+		CHECK(byteCount > budget);
+		++callCount;
+	}
+
+	std::atomic<int32> callCount{ 0 };
+};
+
+DOCTEST_TEST_CASE("memory budget")
+{
+	CountingAllocator allocator;
+	BudgetListener listener;
+	b2ThreadPool threadPool(4);
+
+	{
+		b2WorldDef def;
+		def.allocator = &allocator;
+		def.memoryBudget = 256 * 1024;
+		def.memoryListener = &listener;
+		b2World world(&def);
+		world.SetTaskSystem(&threadPool);
+
+		BuildIslandScene(&world);
+		for (int32 i = 0; i < 10; ++i)
+		{
+			world.Step(1.0f / 60.0f, 8, 3);
+		}
+
+		b2MemoryStats stats = world.GetMemoryStats();
+		CHECK(stats.bodies > 0);
+		CHECK(stats.fixtures > 0);
+		CHECK(stats.contacts > 0);
+		CHECK(stats.proxies > 0);
+		CHECK(stats.treeNodes > 0);
+		CHECK(stats.stack > 0);
+		CHECK(stats.budget == 256 * 1024);
+		CHECK(stats.peakBytes >= stats.totalBytes);
+
+		int32 categoryBytes = stats.bodies + stats.fixtures + stats.contacts + stats.proxies + stats.treeNodes + stats.stack;
+		CHECK(categoryBytes <= stats.totalBytes);
+
+		// Only the counters of the tracker itself are outside the total.
+		CHECK(stats.totalBytes < allocator.byteCount);
+		CHECK(allocator.byteCount - stats.totalBytes < 64);
+
+		CHECK(stats.totalBytes > def.memoryBudget);
+		CHECK(listener.callCount > 0);
+	}
+
+	CHECK(allocator.byteCount == 0);
+}
+
+static void StepAndRecord(b2World* world, int32 stepCount, b2Transform* transforms, int32 capacity)
+{
+	for (int32 i = 0; i < stepCount; ++i)
+	{
+		world->Step(1.0f / 60.0f, 8, 3);
+	}
+
+	int32 count = 0;
+	for (b2Body* body = world->GetBodyList(); body; body = body->GetNext())
+	{
+		REQUIRE(count < capacity);
+		transforms[count++] = body->GetTransform();
+	}
+}
+
+DOCTEST_TEST_CASE("snapshot")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+	BuildIslandScene(&world);
+
+	// Add a chain and a gear joint so that every kind of reference is covered.
+	b2BodyDef groundDef;
+	b2Body* ground = world.CreateBody(&groundDef);
+
+	b2Vec2 vertices[4] = { b2Vec2(-20.0f, 30.0f), b2Vec2(-10.0f, 20.0f), b2Vec2(10.0f, 20.0f), b2Vec2(20.0f, 30.0f) };
+	b2ChainShape chain;
+	chain.CreateChain(vertices, 4, b2Vec2(-30.0f, 30.0f), b2Vec2(30.0f, 30.0f));
+	ground->CreateFixture(&chain, 0.0f);
+
+	b2CircleShape circle;
+	circle.m_radius = 1.0f;
+
+	b2BodyDef bd;
+	bd.type = b2_dynamicBody;
+	bd.position.Set(-5.0f, 25.0f);
+	b2Body* wheel1 = world.CreateBody(&bd);
+	wheel1->CreateFixture(&circle, 1.0f);
+
+	bd.position.Set(5.0f, 25.0f);
+	b2Body* wheel2 = world.CreateBody(&bd);
+	wheel2->CreateFixture(&circle, 1.0f);
+
+	b2RevoluteJointDef rjd;
+	rjd.Initialize(ground, wheel1, wheel1->GetPosition());
+	b2Joint* revolute = world.CreateJoint(&rjd);
+
+	b2PrismaticJointDef pjd;
+	pjd.Initialize(ground, wheel2, wheel2->GetPosition(), b2Vec2(0.0f, 1.0f));
+	b2Joint* prismatic = world.CreateJoint(&pjd);
+
+	b2GearJointDef gjd;
+	gjd.bodyA = wheel1;
+	gjd.bodyB = wheel2;
+	gjd.joint1 = revolute;
+	gjd.joint2 = prismatic;
+	gjd.ratio = 2.0f;
+	world.CreateJoint(&gjd);
+
+	wheel1->ApplyAngularImpulse(5.0f, true);
+
+	for (int32 i = 0; i < 30; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+
+	int32 size = world.SaveSnapshot(nullptr, 0);
+	CHECK(size > 0);
+
+	uint8* snapshot = (uint8*)b2Alloc(size);
+	CHECK(world.SaveSnapshot(snapshot, size) == size);
+
+	const int32 capacity = 256;
+	b2Transform expected[capacity];
+	b2Transform actual[capacity];
+
+	int32 bodyCount = world.GetBodyCount();
+	int32 jointCount = world.GetJointCount();
+	int32 contactCount = world.GetContactCount();
+	StepAndRecord(&world, 60, expected, capacity);
+
+	// Restore in place.
+	CHECK(world.RestoreSnapshot(snapshot, size));
+	CHECK(world.GetBodyCount() == bodyCount);
+	CHECK(world.GetJointCount() == jointCount);
+	CHECK(world.GetContactCount() == contactCount);
+	StepAndRecord(&world, 60, actual, capacity);
+	CHECK(memcmp(expected, actual, bodyCount * sizeof(b2Transform)) == 0);
+
+	// Restore into a fresh world.
+	{
+		b2World copy(b2Vec2(0.0f, 0.0f));
+		CHECK(copy.RestoreSnapshot(snapshot, size));
+		StepAndRecord(&copy, 60, actual, capacity);
+		CHECK(memcmp(expected, actual, bodyCount * sizeof(b2Transform)) == 0);
+	}
+
+	// A damaged snapshot is rejected without changes.
+	snapshot[0] ^= 0xff;
+	CHECK(world.RestoreSnapshot(snapshot, size) == false);
+	CHECK(world.GetBodyCount() == bodyCount);
+	snapshot[0] ^= 0xff;
+
+	// A snapshot cut short past the header empties the world. The size in the header
+	// is patched so that only the missing data gives it away.
+	// Leaked objects would show as heap growth past the full world.
+	uint8* truncated = (uint8*)b2Alloc(size);
+	const int32 headerSize = 8 * sizeof(int32);
+	int32 fullBytes = world.GetMemoryStats().totalBytes;
+	for (int32 cut = headerSize; cut < size; cut += b2Max(1, (size - headerSize) / 97))
+	{
+		memcpy(truncated, snapshot, cut);
+		memcpy(truncated + 2 * sizeof(int32), &cut, sizeof(int32));
+
+		CHECK(world.RestoreSnapshot(truncated, cut) == false);
+		CHECK(world.GetBodyCount() == 0);
+		CHECK(world.GetJointCount() == 0);
+		CHECK(world.GetContactCount() == 0);
+		CHECK(world.GetGravity() == b2Vec2(0.0f, -10.0f));
+		CHECK(world.GetMemoryStats().totalBytes <= fullBytes);
+	}
+	b2Free(truncated);
+
+	// The emptied world still works.
+	world.Step(1.0f / 60.0f, 8, 3);
+	CHECK(world.RestoreSnapshot(snapshot, size));
+	StepAndRecord(&world, 60, actual, capacity);
+	CHECK(memcmp(expected, actual, bodyCount * sizeof(b2Transform)) == 0);
+
+	b2Free(snapshot);
+}
+
+static void BuildLevelDynamics(b2World* world)
+{
+	b2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+
+	for (int32 i = 0; i < 20; ++i)
+	{
+		b2BodyDef bd;
+		bd.type = b2_dynamicBody;
+		bd.position.Set(-9.5f + i, 5.0f + 0.5f * (i % 3));
+		b2Body* body = world->CreateBody(&bd);
+		body->CreateFixture(&box, 1.0f);
+	}
+}
+
+DOCTEST_TEST_CASE("level")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+
+	// Bumpy ground with many edges. The chain runs right to left so that it faces up.
+	const int32 vertexCount = 2001;
+	b2Vec2* vertices = (b2Vec2*)b2Alloc(vertexCount * sizeof(b2Vec2));
+	for (int32 i = 0; i < vertexCount; ++i)
+	{
+		float x = 100.0f - 0.1f * i;
+		vertices[i].Set(x, 0.2f * sinf(x));
+	}
+
+	b2BodyDef groundDef;
+	b2Body* ground = world.CreateBody(&groundDef);
+	b2ChainShape chain;
+	chain.CreateChain(vertices, vertexCount, b2Vec2(101.0f, 0.0f), b2Vec2(-101.0f, 0.0f));
+	ground->CreateFixture(&chain, 0.0f);
+	b2Free(vertices);
+
+	b2PolygonShape wall;
+	wall.SetAsBox(0.5f, 5.0f, b2Vec2(12.0f, 5.0f), 0.0f);
+	ground->CreateFixture(&wall, 0.0f);
+
+	// Let the static tree settle so that both worlds start from the same broad-phase.
+	world.Step(1.0f / 60.0f, 8, 3);
+
+	int32 size = world.SaveLevel(nullptr, 0);
+	void* level = b2Alloc(size);
+	CHECK(world.SaveLevel(level, size) == size);
+
+	// The level data must outlive the world.
+	{
+		b2World loaded(b2Vec2(0.0f, -10.0f));
+		CHECK(loaded.LoadLevel(level, size));
+		CHECK(loaded.GetBodyCount() == 1);
+		CHECK(loaded.GetProxyCount() == world.GetProxyCount());
+		CHECK(loaded.GetMemoryStats().treeNodes < world.GetMemoryStats().treeNodes);
+
+		// The chain vertices are used in place.
+		const b2Body* loadedGround = loaded.GetBodyList();
+		int32 chainCount = 0;
+		for (const b2Fixture* f = loadedGround->GetFixtureList(); f; f = f->GetNext())
+		{
+			if (f->GetType() == b2Shape::e_chain)
+			{
+				const b2ChainShape* loadedChain = (const b2ChainShape*)f->GetShape();
+				CHECK(loadedChain->m_count == vertexCount);
+				CHECK(loadedChain->m_ownsVertices == false);
+				CHECK((const char*)loadedChain->m_vertices > (const char*)level);
+				CHECK((const char*)loadedChain->m_vertices < (const char*)level + size);
+				++chainCount;
+			}
+		}
+		CHECK(chainCount == 1);
+
+		// A level only goes into a world without static proxies.
+		CHECK(loaded.LoadLevel(level, size) == false);
+
+		BuildLevelDynamics(&world);
+		BuildLevelDynamics(&loaded);
+
+		const int32 capacity = 32;
+		b2Transform expected[capacity];
+		b2Transform actual[capacity];
+		StepAndRecord(&world, 120, expected, capacity);
+		StepAndRecord(&loaded, 120, actual, capacity);
+		CHECK(world.GetContactCount() == loaded.GetContactCount());
+		CHECK(memcmp(expected, actual, world.GetBodyCount() * sizeof(b2Transform)) == 0);
+
+		// Boxes rest on the ground.
+		CHECK(expected[0].p.y > -1.0f);
+		CHECK(expected[0].p.y < 2.0f);
+	}
+
+	b2Free(level);
+}
+
+// Spin in a profiler frame for the given number of microseconds.
+static void ProfileFrame(b2Profiler* profiler, unsigned long long microseconds)
+{
+	profiler->BeginFrame();
+	unsigned long long start = b2Profiler::GetTicks();
+	b2ProfileZoneBegin(profiler, "outer");
+	b2ProfileZoneBegin(profiler, "inner");
+	b2ProfileZoneEnd(profiler);
+	profiler->Accumulate("sample", 10);
+	profiler->Accumulate("sample", 20);
+	while (b2Profiler::GetTicks() - start < 1000 * microseconds)
+	{
+	}
+	b2ProfileZoneEnd(profiler);
+	profiler->EndFrame();
+}
+
+DOCTEST_TEST_CASE("profiler")
+{
+	b2Profiler profiler(64);
+
+	// Nothing is recorded until the profiler is enabled.
+	ProfileFrame(&profiler, 0);
+	CHECK(profiler.GetFrameCount() == 0);
+
+	profiler.SetEnabled(true);
+	profiler.SetWorstFrameCount(2);
+	ProfileFrame(&profiler, 100);
+	ProfileFrame(&profiler, 3000);
+	ProfileFrame(&profiler, 2000);
+	ProfileFrame(&profiler, 50);
+
+	// The two slowest frames are kept in recording order. Each has an outer zone, an
+	// inner zone and one accumulated zone.
+	CHECK(profiler.GetFrameCount() == 2);
+	CHECK(profiler.GetEventCount() == 6);
+	CHECK(profiler.GetFrameTime(0) >= 3.0f);
+	CHECK(profiler.GetFrameTime(1) >= 2.0f);
+	CHECK(profiler.GetFrameTime(1) < profiler.GetFrameTime(0));
+
+	int32 size = profiler.ExportChromeTrace(nullptr, 0);
+	char* text = (char*)b2Alloc(size + 1);
+	CHECK(profiler.ExportChromeTrace(text, size + 1) == size);
+	CHECK(strlen(text) == size_t(size));
+	CHECK(strstr(text, "\"traceEvents\"") != nullptr);
+	CHECK(strstr(text, "\"name\":\"inner\"") != nullptr);
+	CHECK(strstr(text, "\"count\":2") != nullptr);
+	b2Free(text);
+
+	// Frames that do not fit are dropped.
+	profiler.Clear();
+	profiler.SetWorstFrameCount(0);
+	for (int32 i = 0; i < 30; ++i)
+	{
+		ProfileFrame(&profiler, 0);
+	}
+	CHECK(profiler.GetFrameCount() == 21);
+	CHECK(profiler.GetDroppedFrameCount() == 9);
+
+#ifdef B2_PROFILER
+	b2World world(b2Vec2(0.0f, -10.0f));
+	b2ThreadPool threadPool(4);
+	world.SetTaskSystem(&threadPool);
+	BuildIslandScene(&world);
+
+	b2Profiler stepProfiler;
+	stepProfiler.SetEnabled(true);
+	world.SetProfiler(&stepProfiler);
+	for (int32 i = 0; i < 10; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+	}
+	world.SetProfiler(nullptr);
+	world.SetTaskSystem(nullptr);
+
+	CHECK(stepProfiler.GetFrameCount() == 10);
+	size = stepProfiler.ExportChromeTrace(nullptr, 0);
+	text = (char*)b2Alloc(size + 1);
+	stepProfiler.ExportChromeTrace(text, size + 1);
+	CHECK(strstr(text, "\"name\":\"solve island\"") != nullptr);
+	CHECK(strstr(text, "\"name\":\"solve velocity\"") != nullptr);
+	CHECK(strstr(text, "\"name\":\"narrow-phase polygon-polygon\"") != nullptr);
+	b2Free(text);
+#endif
+}
+
+DOCTEST_TEST_CASE("step stats")
+{
+	b2World world(b2Vec2(0.0f, -10.0f));
+
+	b2BodyDef groundDef;
+	b2Body* ground = world.CreateBody(&groundDef);
+	b2EdgeShape edge;
+	edge.SetTwoSided(b2Vec2(-40.0f, 0.0f), b2Vec2(40.0f, 0.0f));
+	ground->CreateFixture(&edge, 0.0f);
+
+	// A column of boxes is one island.
+	const int32 boxCount = 5;
+	b2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+	for (int32 i = 0; i < boxCount; ++i)
+	{
+		b2BodyDef bd;
+		bd.type = b2_dynamicBody;
+		bd.position.Set(0.0f, 0.5f + 1.0f * i);
+		world.CreateBody(&bd)->CreateFixture(&box, 1.0f);
+	}
+
+	// A fast circle needs time of impact.
+	b2BodyDef bulletDef;
+	bulletDef.type = b2_dynamicBody;
+	bulletDef.position.Set(20.0f, 10.0f);
+	bulletDef.linearVelocity.Set(0.0f, -300.0f);
+	b2Body* bullet = world.CreateBody(&bulletDef);
+	b2CircleShape circle;
+	circle.m_radius = 0.1f;
+	bullet->CreateFixture(&circle, 1.0f);
+
+	world.Step(1.0f / 60.0f, 8, 3);
+	// The bullet leaves its fat AABB. Its enlarged AABB also reaches the ground.
+	b2StepStats stats = world.GetStepStats();
+	CHECK(stats.proxiesMoved == boxCount + 3);
+	CHECK(stats.contactsCreated == boxCount + 1);
+	CHECK(stats.pairsTested >= stats.contactsCreated);
+	CHECK(stats.touchingContacts == boxCount);
+	CHECK(stats.islands == 2);
+	CHECK(stats.largestIsland == boxCount);
+	CHECK(stats.islandSizes[0] == 1);
+	CHECK(stats.islandSizes[2] == 1);
+	CHECK(stats.awakeBodies == boxCount + 1);
+
+	int32 toiEvents = 0;
+	int32 gjkIterations = 0;
+	for (int32 i = 0; i < 10; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+		toiEvents += world.GetStepStats().toiEvents;
+		gjkIterations += world.GetStepStats().gjkIterations;
+		CHECK(world.GetStepStats().toiMaxSubSteps <= b2_maxSubSteps);
+	}
+	CHECK(toiEvents > 0);
+	CHECK(gjkIterations > 0);
+	CHECK(bullet->GetPosition().y > 0.0f);
+
+	// Contacts destroyed between steps are counted by the next step.
+	world.DestroyBody(bullet);
+	for (int32 i = 0; i < 600 && world.GetStepStats().sleepingBodies < boxCount; ++i)
+	{
+		world.Step(1.0f / 60.0f, 8, 3);
+		if (i == 0)
+		{
+			CHECK(world.GetStepStats().contactsDestroyed == 1);
+		}
+	}
+
+	// The island is solved on the step it falls asleep.
+	CHECK(world.GetStepStats().sleepingBodies == boxCount);
+	world.Step(1.0f / 60.0f, 8, 3);
+	stats = world.GetStepStats();
+	CHECK(stats.sleepingBodies == boxCount);
+	CHECK(stats.awakeBodies == 0);
+	CHECK(stats.islands == 0);
+	CHECK(stats.touchingContacts == boxCount);
+}
+
+static void BuildBulletScene(b2World* world)
+{
+	b2BodyDef groundDef;
+	b2Body* ground = world->CreateBody(&groundDef);
+
+	b2EdgeShape edge;
+	edge.SetTwoSided(b2Vec2(-40.0f, 0.0f), b2Vec2(40.0f, 0.0f));
+	ground->CreateFixture(&edge, 0.0f);
+
+	// Thin walls that the bullets would pass through without time of impact.
+	b2PolygonShape wall;
+	wall.SetAsBox(0.05f, 10.0f, b2Vec2(-30.0f, 10.0f), 0.0f);
+	ground->CreateFixture(&wall, 0.0f);
+	wall.SetAsBox(0.05f, 10.0f, b2Vec2(30.0f, 10.0f), 0.0f);
+	ground->CreateFixture(&wall, 0.0f);
+
+	b2PolygonShape box;
+	box.SetAsBox(0.5f, 0.5f);
+	for (int32 i = 0; i < 8; ++i)
+	{
+		for (int32 j = 0; j < 5; ++j)
+		{
+			b2BodyDef bd;
+			bd.type = b2_dynamicBody;
+			bd.position.Set(-4.0f + 1.05f * i, 0.5f + 1.0f * j);
+			world->CreateBody(&bd)->CreateFixture(&box, 1.0f);
+		}
+	}
+
+	b2CircleShape circle;
+	circle.m_radius = 0.1f;
+	b2PolygonShape square;
+	square.SetAsBox(0.1f, 0.1f);
+	for (int32 i = 0; i < 48; ++i)
+	{
+		float side = (i & 1) ? 1.0f : -1.0f;
+
+		b2BodyDef bd;
+		bd.type = b2_dynamicBody;
+		bd.bullet = true;
+		bd.position.Set(-25.0f * side, 1.0f + 0.4f * i);
+		bd.linearVelocity.Set(200.0f * side, -10.0f - float(i % 5));
+		bd.angularVelocity = 20.0f;
+		b2Body* body = world->CreateBody(&bd);
+
+		if (i % 3 == 0)
+		{
+			body->CreateFixture(&square, 2.0f);
+		}
+		else
+		{
+			body->CreateFixture(&circle, 2.0f);
+		}
+	}
+}
+
+DOCTEST_TEST_CASE("parallel time of impact")
+{
+	b2World serialWorld(b2Vec2(0.0f, -10.0f));
+	b2World parallelWorld(b2Vec2(0.0f, -10.0f));
+
+	b2ThreadPool threadPool(4);
+	parallelWorld.SetTaskSystem(&threadPool);
+
+	BuildBulletScene(&serialWorld);
+	BuildBulletScene(&parallelWorld);
+
+	int32 serialEvents = 0;
+	int32 parallelEvents = 0;
+	int32 serialIterations = 0;
+	int32 parallelIterations = 0;
+	for (int32 i = 0; i < 120; ++i)
+	{
+		serialWorld.Step(1.0f / 60.0f, 8, 3);
+		parallelWorld.Step(1.0f / 60.0f, 8, 3);
+
+		serialEvents += serialWorld.GetStepStats().toiEvents;
+		parallelEvents += parallelWorld.GetStepStats().toiEvents;
+		serialIterations += serialWorld.GetStepStats().toiIterations;
+		parallelIterations += parallelWorld.GetStepStats().toiIterations;
+	}
+
+	// Every bullet hits a wall at least once.
+	CHECK(serialEvents >= 48);
+	CHECK(serialEvents == parallelEvents);
+	CHECK(serialIterations == parallelIterations);
+
+	const b2Body* b1 = serialWorld.GetBodyList();
+	const b2Body* b2 = parallelWorld.GetBodyList();
+	while (b1 && b2)
+	{
+		CHECK(b1->GetPosition() == b2->GetPosition());
+		CHECK(b1->GetAngle() == b2->GetAngle());
+		CHECK(b1->GetLinearVelocity() == b2->GetLinearVelocity());
+
+		// No bullet got through a wall.
+		CHECK(b2Abs(b1->GetPosition().x) < 30.0f);
+		b1 = b1->GetNext();
+		b2 = b2->GetNext();
+	}
+
+	CHECK(b1 == nullptr);
+	CHECK(b2 == nullptr);
+
+	parallelWorld.SetTaskSystem(nullptr);
+}